@@ -204,8 +204,9 @@ local function init()
 		-- Wrap register_abm() to automatically instrument abms.
 		local orig_register_abm = core.register_abm
 		core.register_abm = function(spec)
-			spec.action = instrument {
-				func = spec.action,
+			local k = spec.bulk_action ~= nil and "bulk_action" or "action"
+			spec[k] = instrument {
+				func = spec[k],
 				class = "ABM",
 				label = spec.label,
 			}
@@ -0,0 +1,34 @@
+-- test ABMs with bulk_action
+
+local S = core.get_translator("testnodes")
+
+-- ABM bulk node
+core.register_node("testabms:bulk", {
+	description = S("Node for test ABM bulk"),
+	drawtype = "normal",
+	tiles = { "testabms_wait_node.png" },
+
+	groups = { dig_immediate = 3 },
+
+	on_construct = function (pos)
+		local meta = core.get_meta(pos)
+		meta:set_string("infotext", "Waiting for ABM testabms:bulk")
+	end,
+})
+
+core.register_abm({
+	label = "testabms:bulk",
+	nodenames = "testabms:bulk",
+	interval = 10,
+	chance = 1,
+	bulk_action = function (pos_list, node_list)
+		assert(#pos_list == #node_list)
+		for i, pos in ipairs(pos_list) do
+			assert(node_list[i].name == "testabms:bulk")
+			core.swap_node(pos, {name="testabms:after_abm"})
+			local meta = core.get_meta(pos)
+			meta:set_string("infotext",
+				"ABM testabms:bulk changed this node, " .. #pos_list .. " in batch.")
+		end
+	end
+})
@@ -1,6 +1,7 @@
 local path = core.get_modpath(core.get_current_modname())
 
 dofile(path.."/after_node.lua")
+dofile(path.."/bulk.lua")
 dofile(path.."/chances.lua")
 dofile(path.."/intervals.lua")
 dofile(path.."/min_max.lua")
@@ -0,0 +1,176 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "alloc_counter.h"
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static thread_local AllocCounter *t_counter = nullptr;
+
+AllocCounter::AllocCounter() :
+	m_outer(t_counter)
+{
+	t_counter = this;
+}
+
+AllocCounter::~AllocCounter()
+{
+	t_counter = m_outer;
+}
+
+#if ENABLE_ALLOC_COUNTER
+
+static void *aligned_malloc(std::size_t size, std::size_t align) noexcept
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	// The size must be a multiple of the alignment
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+}
+
+static void aligned_free(void *p) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+// Like the default operator new. align is 0 for the default alignment.
+static void *counted_alloc(std::size_t size, std::size_t align)
+{
+	if (AllocCounter *counter = t_counter) {
+		counter->count++;
+		counter->bytes += size;
+	}
+	if (size == 0)
+		size = 1;
+	for (;;) {
+		void *p = align ? aligned_malloc(size, align) : std::malloc(size);
+		if (p)
+			return p;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+static void *counted_alloc_nothrow(std::size_t size, std::size_t align) noexcept
+{
+	try {
+		return counted_alloc(size, align);
+	} catch (std::bad_alloc &) {
+		return nullptr;
+	}
+}
+
+void *operator new(std::size_t size)
+{
+	return counted_alloc(size, 0);
+}
+
+void *operator new[](std::size_t size)
+{
+	return counted_alloc(size, 0);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return counted_alloc_nothrow(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+	return counted_alloc(size, (std::size_t)align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+	return counted_alloc(size, (std::size_t)align);
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+	const std::nothrow_t &) noexcept
+{
+	return counted_alloc_nothrow(size, (std::size_t)align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+	const std::nothrow_t &) noexcept
+{
+	return counted_alloc_nothrow(size, (std::size_t)align);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	aligned_free(p);
+}
+
+#endif
@@ -0,0 +1,33 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <cstddef>
+#include "config.h"
+#include "util/basic_macros.h"
+
+/*
+	Counts the allocations of the calling thread with operator new while it
+	lives. Only the innermost counter of a thread counts.
+
+	Allocations are only counted in builds with ENABLE_ALLOC_COUNTER, which
+	replace the global operator new. The replacement allocates with malloc()
+	like the default one.
+*/
+class AllocCounter
+{
+public:
+	AllocCounter();
+	~AllocCounter();
+	DISABLE_CLASS_COPY(AllocCounter)
+
+	//! False if this build does not count allocations
+	static constexpr bool enabled = ENABLE_ALLOC_COUNTER;
+
+	size_t count = 0;
+	size_t bytes = 0;
+
+private:
+	AllocCounter *m_outer;
+};
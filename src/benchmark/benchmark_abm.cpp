@@ -0,0 +1,105 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "noise.h"
+#include "serverenvironment.h"
+#include "server/abmhandler.h"
+#include "threading/thread_pool.h"
+
+namespace {
+
+class TestABM : public ActiveBlockModifier {
+public:
+	TestABM(const std::string &trigger, const std::string &neighbor, u32 chance) :
+		m_trigger({trigger}), m_chance(chance)
+	{
+		if (!neighbor.empty())
+			m_neighbors.push_back(neighbor);
+	}
+
+	const std::vector<std::string> &getTriggerContents() const override
+		{ return m_trigger; }
+	const std::vector<std::string> &getRequiredNeighbors() const override
+		{ return m_neighbors; }
+	const std::vector<std::string> &getWithoutNeighbors() const override
+		{ return m_without; }
+	float getTriggerInterval() override { return 1.0f; }
+	u32 getTriggerChance() override { return m_chance; }
+	bool getSimpleCatchUp() override { return false; }
+	s16 getMinY() override { return S16_MIN; }
+	s16 getMaxY() override { return S16_MAX; }
+
+private:
+	std::vector<std::string> m_trigger, m_neighbors, m_without;
+	u32 m_chance;
+};
+
+}
+
+// Measures the C++ side of ABM processing (content, chance and neighbor
+// checks) for all blocks of a map with a varying number of threads.
+TEST_CASE("benchmark_abm")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	const char *names[] = {"stone", "dirt", "grass", "water", "lava"};
+	content_t ids[5];
+	for (int i = 0; i < 5; i++) {
+		ContentFeatures f;
+		f.name = names[i];
+		ids[i] = ndef->set(f.name, f);
+	}
+
+	const v3s16 bpmin(-4, -2, -4), bpmax(3, 1, 3);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	{
+		PcgRandom pr(42);
+		for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+		for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+		for (s16 x = bpmin.X; x <= bpmax.X; x++) {
+			MapBlock *block = map.getBlockNoCreateNoEx({x, y, z});
+			for (size_t i = 0; i < MapBlock::nodecount; i++)
+				block->getData()[i] = MapNode(ids[pr.range(0, 4)]);
+		}
+	}
+
+	// Typical water/lava/grass spreading ABMs
+	TestABM abm_grass("grass", "dirt", 1), abm_water("water", "lava", 1),
+		abm_lava("lava", "water", 1), abm_dirt("dirt", "", 50);
+	std::vector<ABMWithState> abms;
+	for (auto *abm : {&abm_grass, &abm_water, &abm_lava, &abm_dirt})
+		abms.emplace_back(abm);
+	ABMHandler handler(abms, 1.0f, ndef, false);
+
+	std::vector<ABMHandler::BlockScan> scans;
+	for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+	for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+	for (s16 x = bpmin.X; x <= bpmax.X; x++) {
+		scans.emplace_back();
+		REQUIRE(ABMHandler::prepareScan(&map, {x, y, z}, scans.size(), scans.back()));
+	}
+
+	auto bench = [&] (Catch::Benchmark::Chronometer &meter, unsigned int threads) {
+		// the calling thread helps out
+		ThreadPool pool("BenchABM", threads - 1);
+		meter.measure([&] {
+			pool.parallelFor(scans.size(), [&] (size_t i) {
+				scans[i].triggers.clear();
+				handler.scan(scans[i]);
+			});
+		});
+	};
+
+	BENCHMARK_ADVANCED("scan_256_blocks_1_thread")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 1); };
+	BENCHMARK_ADVANCED("scan_256_blocks_2_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 2); };
+	BENCHMARK_ADVANCED("scan_256_blocks_4_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 4); };
+	BENCHMARK_ADVANCED("scan_256_blocks_8_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 8); };
+}
@@ -0,0 +1,93 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "constants.h"
+#include "serverenvironment.h"
+#include "util/numeric.h"
+
+namespace {
+
+constexpr s16 ACTIVE_BLOCK_RANGE = 4;
+constexpr s16 ACTIVE_OBJECT_RANGE = 8;
+
+class MovingPlayers
+{
+public:
+	MovingPlayers(size_t n)
+	{
+		for (size_t i = 0; i < n; i++) {
+			v3f pos(myrand_range(-2000, 2000), myrand_range(-20, 60),
+				myrand_range(-2000, 2000));
+			m_pos.push_back(pos * BS);
+			m_yaw.push_back(myrand_range(0, 359));
+		}
+		views.resize(n);
+		step();
+	}
+
+	// Simulates one server step: everyone walks a bit and turns around
+	void step()
+	{
+		for (size_t i = 0; i < m_pos.size(); i++) {
+			m_yaw[i] += myrand_range(-10, 10);
+			v3f dir(0, 0, 1);
+			dir.rotateXZBy(m_yaw[i]);
+			m_pos[i] += dir * (0.5f * BS);
+
+			PlayerView &view = views[i];
+			view.id = i + 1;
+			view.blockpos = getNodeBlockPos(floatToInt(m_pos[i], BS));
+			view.wanted_range = 12;
+			view.camera_pos = m_pos[i] + v3f(0, 1.6f * BS, 0);
+			view.camera_dir = dir;
+			view.fov = 72.0f * core::DEGTORAD;
+		}
+	}
+
+	using PlayerView = ActiveBlockList::PlayerView;
+	std::vector<PlayerView> views;
+
+private:
+	std::vector<v3f> m_pos;
+	std::vector<f32> m_yaw;
+};
+
+void benchUpdate(Catch::Benchmark::Chronometer &meter, size_t n, bool rebuild)
+{
+	MovingPlayers players(n);
+	ActiveBlockList list;
+	std::vector<v3s16> removed, added, extra_added;
+	list.update(players.views, ACTIVE_BLOCK_RANGE, ACTIVE_OBJECT_RANGE,
+		removed, added, extra_added);
+
+	meter.measure([&] {
+		players.step();
+		removed.clear();
+		added.clear();
+		extra_added.clear();
+		// Starting from scratch is about what the old implementation did
+		if (rebuild)
+			list.clear();
+		list.update(players.views, ACTIVE_BLOCK_RANGE, ACTIVE_OBJECT_RANGE,
+			removed, added, extra_added);
+		return list.size();
+	});
+}
+
+}
+
+#define BENCH_UPDATE(_n) \
+	BENCHMARK_ADVANCED("update_" #_n "_players")(Catch::Benchmark::Chronometer meter) \
+	{ benchUpdate(meter, _n, false); }; \
+	BENCHMARK_ADVANCED("rebuild_" #_n "_players")(Catch::Benchmark::Chronometer meter) \
+	{ benchUpdate(meter, _n, true); };
+
+TEST_CASE("benchmark_activeblocklist")
+{
+	BENCH_UPDATE(10)
+	BENCH_UPDATE(50)
+	BENCH_UPDATE(200)
+}
+
+#undef BENCH_UPDATE
@@ -35,11 +35,14 @@ inline v3f randpos()
 		myrand_range(-POS_RANGE, POS_RANGE));
 }
 
-inline void fill(server::ActiveObjectMgr &mgr, size_t n)
+inline void fill(server::ActiveObjectMgr &mgr, size_t n,
+	std::vector<ServerActiveObject*> *all = nullptr)
 {
 	mgr.clear();
 	for (size_t i = 0; i < n; i++) {
 		auto obj = std::make_unique<TestObject>(randpos());
+		if (all)
+			all->push_back(obj.get());
 		bool ok = mgr.registerObject(std::move(obj));
 		REQUIRE(ok);
 	}
@@ -94,6 +97,46 @@ void benchGetObjectsInArea(Catch::Benchmark::Chronometer &meter)
 	mgr.clear(); // implementation expects this
 }
 
+// Same search without the spatial index, for comparison
+template <size_t N>
+void benchGetObjectsInsideRadiusLinear(Catch::Benchmark::Chronometer &meter)
+{
+	server::ActiveObjectMgr mgr;
+	std::vector<ServerActiveObject*> all;
+	size_t x;
+
+	fill(mgr, N, &all);
+	meter.measure([&] {
+		x = 0;
+		v3f pos = randpos();
+		for (auto *obj : all) {
+			if (obj->getBasePosition().getDistanceFromSQ(pos) <= 30.0f * 30.0f)
+				x += obj->m_static_exists ? 0 : 1;
+		}
+		return x;
+	});
+
+	mgr.clear(); // implementation expects this
+}
+
+template <size_t N>
+void benchUpdateObjectPos(Catch::Benchmark::Chronometer &meter)
+{
+	server::ActiveObjectMgr mgr;
+	std::vector<ServerActiveObject*> all;
+
+	fill(mgr, N, &all);
+	meter.measure([&] {
+		// the environment does this for every moving object
+		for (auto *obj : all) {
+			obj->setBasePosition(obj->getBasePosition() + v3f(2.5f, 0, 0));
+			mgr.updateObjectPos(obj);
+		}
+	});
+
+	mgr.clear(); // implementation expects this
+}
+
 #define BENCH_INSIDE_RADIUS(_count) \
 	BENCHMARK_ADVANCED("inside_radius_" #_count)(Catch::Benchmark::Chronometer meter) \
 	{ benchGetObjectsInsideRadius<_count>(meter); };
@@ -102,10 +145,32 @@ void benchGetObjectsInArea(Catch::Benchmark::Chronometer &meter)
 	BENCHMARK_ADVANCED("in_area_" #_count)(Catch::Benchmark::Chronometer meter) \
 	{ benchGetObjectsInArea<_count>(meter); };
 
+#define BENCH_INSIDE_RADIUS_LINEAR(_count) \
+	BENCHMARK_ADVANCED("inside_radius_linear_" #_count)(Catch::Benchmark::Chronometer meter) \
+	{ benchGetObjectsInsideRadiusLinear<_count>(meter); };
+
+#define BENCH_UPDATE_POS(_count) \
+	BENCHMARK_ADVANCED("update_pos_" #_count)(Catch::Benchmark::Chronometer meter) \
+	{ benchUpdateObjectPos<_count>(meter); };
+
 TEST_CASE("ActiveObjectMgr") {
 	BENCH_INSIDE_RADIUS(200)
 	BENCH_INSIDE_RADIUS(1450)
+	BENCH_INSIDE_RADIUS(1000)
+	BENCH_INSIDE_RADIUS(10000)
+	BENCH_INSIDE_RADIUS(50000)
+
+	BENCH_INSIDE_RADIUS_LINEAR(1000)
+	BENCH_INSIDE_RADIUS_LINEAR(10000)
+	BENCH_INSIDE_RADIUS_LINEAR(50000)
 
 	BENCH_IN_AREA(200)
 	BENCH_IN_AREA(1450)
+	BENCH_IN_AREA(1000)
+	BENCH_IN_AREA(10000)
+	BENCH_IN_AREA(50000)
+
+	BENCH_UPDATE_POS(1000)
+	BENCH_UPDATE_POS(10000)
+	BENCH_UPDATE_POS(50000)
 }
@@ -0,0 +1,165 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "mapgen/mapgen_v7.h"
+#include "mapgen/mg_biome.h"
+#include "mapgen/cavegen.h"
+#include "noise.h"
+#include "unittest/mock_server.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Size of one mapchunk with the default chunksize
+constexpr s16 CSIZE = 80;
+
+class TestBiomeManager : public BiomeManager {
+public:
+	TestBiomeManager(Server *server, const NodeDefManager *ndef) :
+		BiomeManager(server)
+	{
+		m_ndef = ndef;
+	}
+};
+
+// The same biome everywhere
+class SingleBiomeGen : public BiomeGen {
+public:
+	SingleBiomeGen(Biome *biome, v3s16 chunksize) : m_biome(biome)
+	{
+		m_csize = chunksize;
+		biomemap = new biome_t[m_csize.X * m_csize.Z];
+		std::fill_n(biomemap, m_csize.X * m_csize.Z, biome->index);
+	}
+	~SingleBiomeGen() { delete[] biomemap; }
+
+	BiomeGenType getType() const { return BIOMEGEN_ORIGINAL; }
+	BiomeGen *clone(BiomeManager *biomemgr) const { return nullptr; }
+	Biome *calcBiomeAtPoint(v3s16 pos) const { return m_biome; }
+	void calcBiomeNoise(v3s16 pmin) {}
+	biome_t *getBiomes(s16 *heightmap, v3s16 pmin) { return biomemap; }
+	Biome *getBiomeAtPoint(v3s16 pos) const { return m_biome; }
+	Biome *getBiomeAtIndex(size_t index, v3s16 pos) const { return m_biome; }
+	s16 getNextTransitionY(s16 y) const { return S16_MIN; }
+
+private:
+	Biome *m_biome;
+};
+
+}
+
+TEST_CASE("benchmark_cavegen")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	content_t c_stone, c_dirt, c_grass, c_water;
+	{
+		ContentFeatures f;
+		f.is_ground_content = true;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, f);
+		f.name = "dirt";
+		c_dirt = ndef->set(f.name, f);
+		f.name = "grass";
+		c_grass = ndef->set(f.name, f);
+		f.is_ground_content = false;
+		f.name = "water";
+		c_water = ndef->set(f.name, f);
+	}
+	ndef->setNodeRegistrationStatus(true);
+
+	MockServer server;
+	TestBiomeManager bmgr(&server, ndef);
+	Biome *biome = BiomeManager::create(BIOMETYPE_NORMAL);
+	biome->c_top = c_grass;
+	biome->depth_top = 1;
+	biome->c_filler = c_dirt;
+	biome->depth_filler = 3;
+	biome->c_stone = c_stone;
+	biome->c_water = c_water;
+	biome->c_water_top = c_water;
+	biome->c_river_water = c_water;
+	biome->c_riverbed = c_dirt;
+	biome->depth_riverbed = 2;
+	biome->c_cave_liquid = {CONTENT_IGNORE};
+	bmgr.add(biome);
+	SingleBiomeGen biomegen(biome, v3s16(CSIZE, CSIZE, CSIZE));
+
+	// Hilly terrain with a grass and dirt surface, water below y = 1
+	MapgenV7Params params;
+	Noise terrain(&params.np_terrain_base, 1, CSIZE, CSIZE);
+	terrain.perlinMap2D(0, 0);
+
+	auto make_chunk = [&] (const VoxelArea &area, s16 y, std::vector<MapNode> &out) {
+		out.assign(area.getVolume(), MapNode(CONTENT_AIR));
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			s16 height = terrain.result[rangelim(z, 0, CSIZE - 1) * CSIZE +
+				rangelim(x, 0, CSIZE - 1)] + y + CSIZE / 2;
+			for (s16 ny = area.MinEdge.Y; ny <= area.MaxEdge.Y; ny++) {
+				content_t c = CONTENT_AIR;
+				if (ny < height - 3)
+					c = c_stone;
+				else if (ny < height)
+					c = c_dirt;
+				else if (ny == height)
+					c = c_grass;
+				else if (ny < 1)
+					c = c_water;
+				out[area.index(x, ny, z)] = MapNode(c);
+			}
+		}
+	};
+
+	// A chunk at the surface and a chunk deep down, where caverns are
+	const v3s16 bpmin(-1, -1, -1), bpmax(5, 5, 5);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	MMVManip vm(&map);
+	vm.initialEmerge(bpmin, bpmax, false);
+	const v3s16 nmin(0, 0, 0), nmax(CSIZE - 1, CSIZE - 1, CSIZE - 1);
+	std::vector<MapNode> surface, deep;
+	make_chunk(vm.m_area, -CSIZE / 2, surface);
+	make_chunk(vm.m_area, 1000, deep);
+
+	auto reset = [&] (const std::vector<MapNode> &chunk) {
+		std::copy(chunk.begin(), chunk.end(), vm.m_data);
+		memset(vm.m_flags, 0, vm.m_area.getVolume());
+	};
+
+	// Included in all of the following
+	BENCHMARK("reset_vmanip") {
+		reset(surface);
+		return vm.m_data[0].getContent();
+	};
+
+	BENCHMARK("caves_noise_intersection") {
+		reset(surface);
+		CavesNoiseIntersection caves(ndef, &bmgr, &biomegen, v3s16(CSIZE, CSIZE, CSIZE),
+			&params.np_cave1, &params.np_cave2, 1, params.cave_width);
+		caves.generateCaves(&vm, nmin, nmax, biomegen.biomemap);
+		return vm.m_data[0].getContent();
+	};
+
+	// The chunk is moved down instead of the caverns up
+	BENCHMARK("caverns_noise") {
+		reset(deep);
+		CavernsNoise caverns(ndef, v3s16(CSIZE, CSIZE, CSIZE), &params.np_cavern,
+			1, params.cavern_limit + 1100, params.cavern_taper, params.cavern_threshold);
+		return caverns.generateCaverns(&vm, nmin, nmax);
+	};
+
+	BENCHMARK("caves_random_walk") {
+		reset(surface);
+		PseudoRandom ps(21343);
+		for (int i = 0; i < 30; i++) {
+			CavesRandomWalk cave(ndef, nullptr, 1, 1, c_water, CONTENT_IGNORE,
+				0.5f, &biomegen);
+			cave.makeCave(&vm, nmin, nmax, &ps, i % 10 == 9, nmax.Y, nullptr);
+		}
+		return vm.m_data[0].getContent();
+	};
+}
@@ -0,0 +1,140 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "network/peerhandler.h" // before connection.h
+#include "network/connection.h"
+#include "network/networkpacket.h"
+#include "network/networkprotocol.h"
+#include "porting.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct BenchHandler : public con::PeerHandler
+{
+	void peerAdded(con::IPeer *peer) override { last_id = peer->id; }
+	void deletingPeer(con::IPeer *peer, bool timeout) override {}
+
+	session_t last_id = 0;
+};
+
+struct Stats
+{
+	u64 packets = 0, lost = 0, time_us = 0;
+	std::vector<u64> latencies; // microseconds
+
+	void print(const char *name)
+	{
+		std::sort(latencies.begin(), latencies.end());
+		auto percentile = [&] (float p) -> u64 {
+			if (latencies.empty())
+				return 0;
+			return latencies[std::min<size_t>(latencies.size() * p, latencies.size() - 1)];
+		};
+		std::cout << name << ": " << (time_us ? packets * 1000000 / time_us : 0)
+			<< " packets/s, latency p50=" << percentile(0.5f)
+			<< "us p99=" << percentile(0.99f) << "us, lost " << lost
+			<< " of " << packets << std::endl;
+	}
+};
+
+class LoopbackPair
+{
+public:
+	LoopbackPair(u16 port)
+	{
+		server.reset(con::createMTP(30.0f, false, &hand_server));
+		client.reset(con::createMTP(30.0f, false, &hand_client));
+		server->Serve(Address(0, 0, 0, 0, port));
+		sleep_ms(50);
+		client->Connect(Address(127, 0, 0, 1, port));
+
+		// Pump both sides until the handshake is done
+		const u64 deadline = porting::getTimeMs() + 5000;
+		NetworkPacket pkt;
+		while (!(client->Connected() && hand_server.last_id != 0) &&
+				porting::getTimeMs() < deadline) {
+			server->ReceiveTimeoutMs(&pkt, 5);
+			client->ReceiveTimeoutMs(&pkt, 5);
+		}
+		REQUIRE(client->Connected());
+		client_id = hand_server.last_id;
+	}
+
+	/// Sends count packets from the server to the client and waits for them.
+	void run(u32 count, u32 size, bool reliable, Stats &stats)
+	{
+		const u64 start = porting::getTimeUs();
+		const std::string filler(size, 'x');
+		for (u32 i = 0; i < count; i++) {
+			NetworkPacket pkt(0x50, size + 8);
+			pkt << (u64)porting::getTimeUs();
+			pkt.putRawString(filler);
+			server->Send(client_id, reliable ? 1 : 0, &pkt, reliable);
+		}
+
+		u32 received = 0;
+		u64 end = start;
+		NetworkPacket ignored;
+		while (received < count) {
+			NetworkPacket pkt;
+			// Unreliable packets may get dropped
+			if (!client->ReceiveTimeoutMs(&pkt, reliable ? 5000 : 100))
+				break;
+			u64 sent;
+			pkt >> sent;
+			end = porting::getTimeUs();
+			stats.latencies.push_back(end - sent);
+			received++;
+			// Keep acknowledgements flowing back
+			if (received % 64 == 0)
+				server->TryReceive(&ignored);
+		}
+		while (server->TryReceive(&ignored));
+
+		stats.time_us += end - start;
+		stats.packets += count;
+		stats.lost += count - received;
+	}
+
+	BenchHandler hand_server, hand_client;
+	std::unique_ptr<con::IConnection> server, client;
+	session_t client_id = 0;
+};
+
+}
+
+// Pushes packets through the MTP connection layer over loopback.
+// Besides the Catch timings, packet rate and latency are printed.
+TEST_CASE("benchmark_connection")
+{
+	// Connected by the first benchmark that runs, so that skipped
+	// benchmarks don't bind the port
+	std::unique_ptr<LoopbackPair> pair;
+	auto get_pair = [&] () -> LoopbackPair & {
+		if (!pair)
+			pair = std::make_unique<LoopbackPair>(30019);
+		return *pair;
+	};
+
+#define BENCH_CON(_count, _size, _reliable, _label) \
+	{ \
+		Stats stats; \
+		BENCHMARK_ADVANCED(_label "_" #_count "x" #_size)(Catch::Benchmark::Chronometer meter) { \
+			LoopbackPair &p = get_pair(); \
+			meter.measure([&] { p.run(_count, _size, _reliable, stats); }); \
+		}; \
+		if (stats.packets > 0) \
+			stats.print(_label "_" #_count "x" #_size); \
+	}
+
+	BENCH_CON(1000, 64, true, "reliable")
+	BENCH_CON(1000, 64, false, "unreliable")
+	BENCH_CON(100, 2000, true, "reliable_split")
+
+#undef BENCH_CON
+}
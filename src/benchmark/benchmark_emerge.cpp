@@ -0,0 +1,203 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "emerge.h"
+#include "util/numeric.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+	A player flies through an empty world and turns every few seconds.
+	The client asks for the closest blocks in view, a single emerge thread
+	generates a fixed number of blocks per tick. Only the queue is real,
+	generating is simulated, so everything is measured in simulated time.
+*/
+
+namespace {
+
+constexpr f32 TICK = 0.1f; // seconds
+constexpr u32 TICKS = 600;
+constexpr u32 BLOCKS_PER_TICK = 6;
+constexpr u32 PEER_QUEUE_LIMIT = 128;
+constexpr s16 RANGE = 6; // blocks
+constexpr f32 FLY_SPEED = 1.5f; // blocks per second
+constexpr u32 TURN_EVERY = 30; // ticks
+constexpr u32 VIEWERS_EVERY = 5; // ticks, like the server does
+const f32 HALF_FOV = 36.0f * core::DEGTORAD;
+
+struct Results
+{
+	f32 first_visible = 0; // seconds from a turn to the first new block in view
+	f32 visible_latency = 0; // seconds from entering view to being generated
+	u32 generated = 0;
+	u32 generated_out_of_view = 0;
+	u32 cancelled = 0;
+};
+
+class FlyThrough
+{
+public:
+	FlyThrough(bool prioritize) : m_prioritize(prioritize) {}
+
+	Results run()
+	{
+		Results res;
+		f32 first_visible_sum = 0;
+		u32 turns = 0;
+		bool turned = false;
+		u32 turned_at = 0;
+		f64 latency_sum = 0;
+		u32 latency_count = 0;
+
+		for (u32 tick = 0; tick < TICKS; tick++) {
+			// Fly a zigzag: forward, left, forward, right, ...
+			if (tick % TURN_EVERY == 0) {
+				const u32 leg = tick / TURN_EVERY;
+				m_dir = leg % 2 == 0 ? v3f(1, 0, 0) :
+					v3f(0, 0, leg % 4 == 1 ? 1 : -1);
+				turned = tick > 0;
+				turned_at = tick;
+			}
+			m_pos += m_dir * (FLY_SPEED * TICK);
+
+			if (m_prioritize && tick % VIEWERS_EVERY == 0)
+				res.cancelled += updateViewers();
+
+			request(tick);
+
+			// The emerge thread
+			for (u32 i = 0; i < BLOCKS_PER_TICK; i++) {
+				EmergeQueue::Item item;
+				if (!m_queue.pop(item))
+					break;
+				m_requested.erase(item.pos);
+				m_generated.insert(item.pos);
+				res.generated++;
+
+				auto seen = m_seen_at.find(item.pos);
+				if (seen == m_seen_at.end() || !isVisible(item.pos)) {
+					res.generated_out_of_view++;
+					continue;
+				}
+				latency_sum += (tick - seen->second) * TICK;
+				latency_count++;
+				if (turned && seen->second >= turned_at) {
+					first_visible_sum += (tick - turned_at + 1) * TICK;
+					turns++;
+					turned = false;
+				}
+			}
+		}
+
+		res.first_visible = turns ? first_visible_sum / turns : 0;
+		res.visible_latency = latency_count ? latency_sum / latency_count : 0;
+		return res;
+	}
+
+private:
+	bool isVisible(v3s16 p) const
+	{
+		const v3f d = v3f(p.X, p.Y, p.Z) + v3f(0.5f) - m_pos;
+		const f32 dist = d.getLength();
+		if (dist > RANGE)
+			return false;
+		return dist < 1.0f || d.dotProduct(m_dir) / dist >= std::cos(HALF_FOV);
+	}
+
+	EmergeViewer viewer() const
+	{
+		return {m_pos, m_dir, m_dir * FLY_SPEED, (f32)RANGE + 1};
+	}
+
+	// What RemoteClient::GetNextBlocks() does, roughly
+	void request(u32 tick)
+	{
+		std::vector<std::pair<f32, v3s16>> wanted;
+		const v3s16 center(std::floor(m_pos.X), std::floor(m_pos.Y),
+			std::floor(m_pos.Z));
+		v3s16 p;
+		for (p.X = center.X - RANGE; p.X <= center.X + RANGE; p.X++)
+		for (p.Y = center.Y - RANGE; p.Y <= center.Y + RANGE; p.Y++)
+		for (p.Z = center.Z - RANGE; p.Z <= center.Z + RANGE; p.Z++) {
+			if (!isVisible(p) || m_generated.count(p))
+				continue;
+			m_seen_at.emplace(p, tick);
+			if (!m_requested.count(p))
+				wanted.emplace_back((p - center).getLengthSQ(), p);
+		}
+		std::sort(wanted.begin(), wanted.end(),
+			[] (const auto &a, const auto &b) { return a.first < b.first; });
+
+		const std::vector<EmergeViewer> viewers{viewer()};
+		for (const auto &it : wanted) {
+			if (m_requested.size() >= PEER_QUEUE_LIMIT)
+				break;
+			bool in_range;
+			f32 priority = getEmergePriority(viewers, it.second, &in_range);
+			m_queue.push({it.second, 0, m_prioritize, priority});
+			m_requested.insert(it.second);
+		}
+	}
+
+	// What EmergeManager::updateViewers() does
+	u32 updateViewers()
+	{
+		const std::vector<EmergeViewer> viewers{viewer()};
+		u32 cancelled = 0;
+		m_queue.removeIf([&] (EmergeQueue::Item &item) {
+			bool in_range;
+			item.priority = getEmergePriority(viewers, item.pos, &in_range);
+			if (in_range)
+				return false;
+			m_requested.erase(item.pos);
+			m_seen_at.erase(item.pos);
+			cancelled++;
+			return true;
+		});
+		return cancelled;
+	}
+
+	const bool m_prioritize;
+	v3f m_pos;
+	v3f m_dir;
+	EmergeQueue m_queue;
+	std::unordered_set<v3s16> m_requested;
+	std::unordered_set<v3s16> m_generated;
+	// When blocks first came into view
+	std::unordered_map<v3s16, u32> m_seen_at;
+};
+
+void print(const char *name, const Results &res)
+{
+	std::cout << name << ": time to first visible block after turning "
+		<< res.first_visible << "s, visible block latency "
+		<< res.visible_latency << "s, " << res.generated_out_of_view << " of "
+		<< res.generated << " generated out of view, "
+		<< res.cancelled << " cancelled" << std::endl;
+}
+
+}
+
+TEST_CASE("benchmark_emerge")
+{
+	// Cost of the queue itself. The simulation is deterministic, the
+	// results of the last run are printed.
+	Results fifo, prioritized;
+	BENCHMARK("fly_through_fifo") {
+		fifo = FlyThrough(false).run();
+		return fifo.generated;
+	};
+	BENCHMARK("fly_through_prioritized") {
+		prioritized = FlyThrough(true).run();
+		return prioritized.generated;
+	};
+	if (fifo.generated > 0)
+		print("fifo", fifo);
+	if (prioritized.generated > 0)
+		print("prioritized", prioritized);
+}
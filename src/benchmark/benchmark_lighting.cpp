@@ -6,6 +6,7 @@
 #include "voxelalgorithms.h"
 #include "dummygamedef.h"
 #include "dummymap.h"
+#include "nodedef.h"
 
 TEST_CASE("benchmark_lighting")
 {
@@ -68,4 +69,68 @@ TEST_CASE("benchmark_lighting")
 			voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
 		});
 	};
+
+	// Bulk edits on a bigger map: ground below y = 0, some lights in caves
+	const v3s16 bulk_bpmin(-4, -4, -4), bulk_bpmax(3, 3, 3);
+	DummyMap bulk_map(&gamedef, bulk_bpmin, bulk_bpmax);
+	{
+		std::map<v3s16, MapBlock*> modified_blocks;
+		MMVManip vm(&bulk_map);
+		vm.initialEmerge(bulk_bpmin, bulk_bpmax, false);
+		const VoxelArea &a = vm.m_area;
+		for (s16 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+		for (s16 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++)
+		for (s16 x = a.MinEdge.X; x <= a.MaxEdge.X; x++) {
+			content_t c = y < 0 ? content_wall : CONTENT_AIR;
+			if (y < -8 && (x + 64) % 16 < 6 && (z + 64) % 16 < 6 && y > -20)
+				c = (x + 64) % 16 == 2 && (z + 64) % 16 == 2 && y == -19 ?
+					content_light : CONTENT_AIR;
+			vm.m_data[a.index(x, y, z)] = MapNode(c);
+		}
+		voxalgo::blit_back_with_light(&bulk_map, &vm, &modified_blocks);
+	}
+
+	// Like an explosion: a ball is removed at the surface and put back
+	BENCHMARK_ADVANCED("voxalgo::update_lighting_nodes_bulk")(Catch::Benchmark::Chronometer meter) {
+		auto replace_ball = [&] (content_t from, content_t to,
+				std::map<v3s16, MapBlock*> &modified_blocks) {
+			std::vector<std::pair<v3s16, MapNode>> oldnodes;
+			v3s16 p;
+			for (p.Z = -8; p.Z <= 8; p.Z++)
+			for (p.Y = -8; p.Y <= 8; p.Y++)
+			for (p.X = -8; p.X <= 8; p.X++) {
+				MapNode n = bulk_map.getNode(p);
+				if (p.getLengthSQ() > 64 || n.getContent() != from)
+					continue;
+				oldnodes.emplace_back(p, n);
+				bulk_map.setNode(p, MapNode(to));
+			}
+			voxalgo::update_lighting_nodes(&bulk_map, oldnodes, modified_blocks);
+		};
+		std::map<v3s16, MapBlock*> modified_blocks;
+		meter.measure([&] {
+			replace_ball(content_wall, CONTENT_AIR, modified_blocks);
+			replace_ball(CONTENT_AIR, content_wall, modified_blocks);
+		});
+	};
+
+	// Like a WorldEdit fill: a big box in the air is filled and emptied
+	BENCHMARK_ADVANCED("voxalgo::blit_back_with_light_bulk")(Catch::Benchmark::Chronometer meter) {
+		const v3s16 box_bpmin(-2, 0, -2), box_bpmax(1, 1, 1);
+		MMVManip vm(&bulk_map);
+		vm.initialEmerge(box_bpmin, box_bpmax, false);
+		auto fill = [&] (content_t c) {
+			std::map<v3s16, MapBlock*> modified_blocks;
+			const VoxelArea &a = vm.m_area;
+			for (s16 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+			for (s16 y = 0; y < 16; y++)
+			for (s16 x = a.MinEdge.X; x <= a.MaxEdge.X; x++)
+				vm.m_data[a.index(x, y, z)] = MapNode(c);
+			voxalgo::blit_back_with_light(&bulk_map, &vm, &modified_blocks);
+		};
+		meter.measure([&] {
+			fill(content_wall);
+			fill(CONTENT_AIR);
+		});
+	};
 }
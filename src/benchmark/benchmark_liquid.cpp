@@ -0,0 +1,143 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "mapblock.h"
+#include "porting.h"
+#include "server/liquidtransformer.h"
+#include "threading/thread_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr int MAX_STEPS = 100;
+
+struct FloodResult {
+	u32 steps = 0;
+	u32 processed = 0;
+	u32 changed = 0;
+};
+
+}
+
+// Water runs down a terraced hill from a pool at its top, until it settles.
+TEST_CASE("benchmark_liquid")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	content_t c_stone, c_plant, c_water;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		c_stone = ndef->set(f.name, f);
+		f.name = "plant";
+		f.floodable = true;
+		f.walkable = false;
+		c_plant = ndef->set(f.name, f);
+
+		f = ContentFeatures();
+		f.light_propagates = true;
+		f.param_type = CPT_LIGHT;
+		f.liquid_alternative_source = "water_source";
+		f.liquid_alternative_flowing = "water_flowing";
+		f.name = f.liquid_alternative_source;
+		f.liquid_type = LIQUID_SOURCE;
+		c_water = ndef->set(f.name, f);
+		f.name = f.liquid_alternative_flowing;
+		f.liquid_type = LIQUID_FLOWING;
+		f.param_type_2 = CPT2_FLOWINGLIQUID;
+		ndef->set(f.name, f);
+	}
+	ndef->resolveCrossrefs();
+
+	const v3s16 bpmin(-3, -1, -3), bpmax(2, 1, 2);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	const v3s16 pmin = bpmin * MAP_BLOCKSIZE, pmax = (bpmax + 1) * MAP_BLOCKSIZE - 1;
+	std::vector<v3s16> sources;
+	v3s16 p;
+	for (p.Z = pmin.Z; p.Z <= pmax.Z; p.Z++)
+	for (p.Y = pmin.Y; p.Y <= pmax.Y; p.Y++)
+	for (p.X = pmin.X; p.X <= pmax.X; p.X++) {
+		// One node lower every 3 nodes away from the center
+		const s16 ground = 30 - (std::abs(p.X) + std::abs(p.Z)) / 3;
+		content_t c = CONTENT_AIR;
+		if (p.Y < ground)
+			c = c_stone;
+		else if (p.Y == ground && (p.X * 7 + p.Z * 13) % 17 == 0)
+			c = c_plant;
+		if (std::abs(p.X) < 4 && std::abs(p.Z) < 4 && p.Y >= ground && p.Y < 31) {
+			c = c_water;
+			sources.push_back(p);
+		}
+		map.setNode(p, MapNode(c));
+	}
+
+	std::vector<std::vector<MapNode>> initial;
+	for (p.Z = bpmin.Z; p.Z <= bpmax.Z; p.Z++)
+	for (p.Y = bpmin.Y; p.Y <= bpmax.Y; p.Y++)
+	for (p.X = bpmin.X; p.X <= bpmax.X; p.X++) {
+		MapNode *data = map.getBlockNoCreateNoEx(p)->getData();
+		initial.emplace_back(data, data + MapBlock::nodecount);
+	}
+
+	auto flood = [&] (LiquidTransformer &transformer) {
+		// Restore the map
+		size_t i = 0;
+		for (p.Z = bpmin.Z; p.Z <= bpmax.Z; p.Z++)
+		for (p.Y = bpmin.Y; p.Y <= bpmax.Y; p.Y++)
+		for (p.X = bpmin.X; p.X <= bpmax.X; p.X++, i++)
+			std::copy(initial[i].begin(), initial[i].end(),
+				map.getBlockNoCreateNoEx(p)->getData());
+
+		UniqueQueue<v3s16> queue;
+		for (const v3s16 &source : sources)
+			queue.push_back(source);
+		FloodResult res;
+		for (; res.steps < MAX_STEPS && queue.size() != 0; res.steps++) {
+			std::map<v3s16, MapBlock*> modified_blocks;
+			res.processed += queue.size();
+			res.changed += transformer.transform(queue, U32_MAX, modified_blocks, nullptr);
+		}
+		return res;
+	};
+
+	LiquidTransformer serial(&map, &gamedef);
+	// Totals over the runs of flood_serial, for printing updates per second
+	FloodResult serial_res;
+	u64 serial_runs = 0, serial_us = 0;
+
+	auto bench = [&] (Catch::Benchmark::Chronometer &meter, unsigned int threads) {
+		// the calling thread helps out
+		ThreadPool pool("BenchLiquid", threads - 1);
+		LiquidTransformer transformer(&map, &gamedef, &pool);
+		meter.measure([&] {
+			return flood(transformer).changed;
+		});
+	};
+
+	BENCHMARK_ADVANCED("flood_serial")(Catch::Benchmark::Chronometer meter)
+	{
+		meter.measure([&] {
+			const u64 t0 = porting::getTimeUs();
+			serial_res = flood(serial);
+			serial_us += porting::getTimeUs() - t0;
+			serial_runs++;
+			return serial_res.changed;
+		});
+	};
+	if (serial_runs > 0) {
+		std::cout << "serial: " << serial_res.processed << " liquid updates ("
+			<< serial_res.changed << " changed nodes) in " << serial_res.steps
+			<< " steps, " << serial_res.processed * serial_runs * 1000000ULL /
+				std::max<u64>(serial_us, 1) << " updates/s" << std::endl;
+	}
+	BENCHMARK_ADVANCED("flood_2_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 2); };
+	BENCHMARK_ADVANCED("flood_4_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 4); };
+}
@@ -0,0 +1,298 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "alloc_counter.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "light.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "porting.h"
+#include "serialization.h"
+#include "client/mapblock_mesh.h"
+#include "client/meshgen/collector.h"
+#include "unittest/mock_shadersource.h"
+#include "unittest/mock_texturesource.h"
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct Nodes {
+	content_t stone, dirt, grass, water_source, water_flowing, stair, plant, glass;
+};
+
+ContentFeatures makeNode(ITextureSource *tsrc, const std::string &name,
+	NodeDrawType drawtype, u8 material_type = TILE_MATERIAL_BASIC)
+{
+	ContentFeatures f;
+	f.name = name;
+	f.drawtype = drawtype;
+	if (drawtype != NDT_NORMAL) {
+		f.solidness = 0;
+		f.light_propagates = true;
+		f.param_type = CPT_LIGHT;
+	}
+	for (TileSpec &tile : f.tiles) {
+		tile.layers[0].texture_id = tsrc->getTextureId(name + ".png");
+		tile.layers[0].material_type = material_type;
+	}
+	return f;
+}
+
+Nodes registerNodes(NodeDefManager *ndef, ITextureSource *tsrc)
+{
+	Nodes c;
+	c.stone = ndef->set("stone", makeNode(tsrc, "stone", NDT_NORMAL));
+	c.dirt = ndef->set("dirt", makeNode(tsrc, "dirt", NDT_NORMAL));
+	c.grass = ndef->set("grass", makeNode(tsrc, "grass", NDT_NORMAL));
+
+	ContentFeatures f = makeNode(tsrc, "water_source", NDT_LIQUID,
+		TILE_MATERIAL_LIQUID_TRANSPARENT);
+	f.solidness = 1;
+	f.alpha = ALPHAMODE_BLEND;
+	f.liquid_type = LIQUID_SOURCE;
+	f.liquid_alternative_source = "water_source";
+	f.liquid_alternative_flowing = "water_flowing";
+	c.water_source = ndef->set(f.name, f);
+	f.name = "water_flowing";
+	f.drawtype = NDT_FLOWINGLIQUID;
+	f.solidness = 0;
+	f.liquid_type = LIQUID_FLOWING;
+	f.param_type_2 = CPT2_FLOWINGLIQUID;
+	for (TileSpec &tile : f.special_tiles)
+		tile = f.tiles[0];
+	c.water_flowing = ndef->set(f.name, f);
+
+	f = makeNode(tsrc, "stair", NDT_NODEBOX);
+	f.param_type_2 = CPT2_FACEDIR;
+	f.node_box.type = NODEBOX_FIXED;
+	f.node_box.fixed = {
+		aabb3f(-0.5f * BS, -0.5f * BS, -0.5f * BS, 0.5f * BS, 0, 0.5f * BS),
+		aabb3f(-0.5f * BS, 0, 0, 0.5f * BS, 0.5f * BS, 0.5f * BS),
+	};
+	c.stair = ndef->set(f.name, f);
+
+	f = makeNode(tsrc, "plant", NDT_PLANTLIKE);
+	f.walkable = false;
+	c.plant = ndef->set(f.name, f);
+
+	f = makeNode(tsrc, "glass", NDT_GLASSLIKE_FRAMED);
+	f.visual_solidness = 1;
+	c.glass = ndef->set(f.name, f);
+
+	ndef->setNodeRegistrationStatus(true);
+	ndef->resolveCrossrefs();
+	return c;
+}
+
+// Sunlight, getting darker below y = 8
+MapNode lit(content_t c, s16 y, u8 param2 = 0)
+{
+	u8 light = y >= 8 ? LIGHT_SUN : std::max(0, LIGHT_SUN - 2 * (8 - y));
+	return MapNode(c, light, param2);
+}
+
+// The block at the origin and the blocks around it, like the mesh update
+// queue has them: serialized to the disk format and read back
+template <typename F>
+std::vector<std::unique_ptr<MapBlock>> makeBlocks(DummyGameDef *gamedef, F node_at)
+{
+	DummyMap map(gamedef, v3s16(-1), v3s16(1));
+	v3s16 p;
+	for (p.Z = -MAP_BLOCKSIZE; p.Z < 2 * MAP_BLOCKSIZE; p.Z++)
+	for (p.Y = -MAP_BLOCKSIZE; p.Y < 2 * MAP_BLOCKSIZE; p.Y++)
+	for (p.X = -MAP_BLOCKSIZE; p.X < 2 * MAP_BLOCKSIZE; p.X++)
+		map.setNode(p, node_at(p.X, p.Y, p.Z));
+
+	std::vector<std::unique_ptr<MapBlock>> blocks;
+	v3s16 bp;
+	for (bp.Z = -1; bp.Z <= 1; bp.Z++)
+	for (bp.Y = -1; bp.Y <= 1; bp.Y++)
+	for (bp.X = -1; bp.X <= 1; bp.X++) {
+		std::ostringstream os(std::ios_base::binary);
+		map.getBlockNoCreateNoEx(bp)->serialize(os, SER_FMT_VER_HIGHEST_WRITE, true, -1);
+		std::istringstream is(os.str(), std::ios_base::binary);
+		auto block = std::make_unique<MapBlock>(bp, gamedef);
+		block->deSerialize(is, SER_FMT_VER_HIGHEST_WRITE, true);
+		blocks.push_back(std::move(block));
+	}
+	return blocks;
+}
+
+struct World {
+	const char *name;
+	std::vector<std::unique_ptr<MapBlock>> blocks;
+};
+
+struct MeshStats {
+	u32 vertices = 0;
+	u32 buffers = 0;
+};
+
+}
+
+TEST_CASE("benchmark_mapblock_mesh")
+{
+	set_light_table(1.0f);
+
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	MockTextureSource tsrc;
+	MockShaderSource shdrsrc;
+	const Nodes c = registerNodes(ndef, &tsrc);
+
+	std::vector<World> worlds;
+
+	worlds.push_back({"solid", makeBlocks(&gamedef, [&] (s16 x, s16 y, s16 z) {
+		s16 height = 6 + std::round(4 * std::sin(x / 5.0f) * std::cos(z / 7.0f));
+		if (y > height)
+			return lit(CONTENT_AIR, y);
+		return MapNode(y == height ? c.grass : y > height - 3 ? c.dirt : c.stone);
+	})});
+
+	// A lake flowing out at one side
+	worlds.push_back({"liquid", makeBlocks(&gamedef, [&] (s16 x, s16 y, s16 z) {
+		if (y < 2)
+			return MapNode(c.stone);
+		if (x < 8 && y <= 8)
+			return lit(c.water_source, y);
+		if (x < 16 && y == 2)
+			return lit(c.water_flowing, y, LIQUID_LEVEL_MAX - (x - 8));
+		return lit(CONTENT_AIR, y);
+	})});
+
+	// Stairs in all directions on a floor
+	worlds.push_back({"nodebox", makeBlocks(&gamedef, [&] (s16 x, s16 y, s16 z) {
+		if (y < 0)
+			return MapNode(c.stone);
+		if (y < 3 && (x + z + y) % 3 != 0)
+			return lit(c.stair, y, (x * 3 + z) % 4);
+		return lit(CONTENT_AIR, y);
+	})});
+
+	// A meadow
+	worlds.push_back({"plantlike", makeBlocks(&gamedef, [&] (s16 x, s16 y, s16 z) {
+		if (y < 0)
+			return MapNode(y == -1 ? c.grass : c.dirt);
+		if (y == 0 && (x * 7 + z * 13) % 3 != 0)
+			return lit(c.plant, y);
+		return lit(CONTENT_AIR, y);
+	})});
+
+	// Glass walls around 6 by 6 node rooms
+	worlds.push_back({"glasslike_framed", makeBlocks(&gamedef, [&] (s16 x, s16 y, s16 z) {
+		if (y < 0)
+			return MapNode(c.stone);
+		if (y < 5 && ((x + 16) % 7 == 0 || (z + 16) % 7 == 0))
+			return lit(c.glass, y);
+		return lit(CONTENT_AIR, y);
+	})});
+
+	// update_area: the nodes to mesh, all of them if empty
+	auto fill = [&] (MeshMakeData &data, const World &world, bool smooth_lighting,
+			const VoxelArea &update_area = VoxelArea()) {
+		if (update_area.hasEmptyExtent())
+			data.fillBlockDataBegin(v3s16(0, 0, 0));
+		else
+			data.fillBlockDataBegin(v3s16(0, 0, 0), update_area);
+		for (const auto &block : world.blocks)
+			data.fillBlockData(block->getPos(), block->getData());
+		data.m_smooth_lighting = smooth_lighting;
+	};
+
+	// collector: reused if given, like a mesh update thread does
+	// sizes: of the previous mesh of the block, replaced by the new ones
+	auto mesh = [&] (const World &world, bool smooth_lighting,
+			MeshCollector *collector = nullptr,
+			std::vector<PreMeshBufferSize> *sizes = nullptr) {
+		MeshMakeData data(ndef, MAP_BLOCKSIZE, MeshGrid{1});
+		fill(data, world, smooth_lighting);
+		if (sizes)
+			data.m_prebuffer_sizes = std::move(*sizes);
+		MapBlockMesh block_mesh(&tsrc, &shdrsrc, &data, collector);
+		if (sizes)
+			*sizes = block_mesh.getPreBufferSizes();
+
+		MeshStats stats;
+		for (int layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+			scene::IMesh *m = block_mesh.getMesh(layer);
+			for (u32 i = 0; i < m->getMeshBufferCount(); i++) {
+				stats.vertices += m->getMeshBuffer(i)->getVertexCount();
+				stats.buffers++;
+			}
+		}
+		return stats;
+	};
+
+	constexpr u32 RUNS = 50;
+	auto run = [] (const char *name, auto &&f) {
+		AllocCounter allocs;
+		const u64 t0 = porting::getTimeUs();
+		for (u32 i = 0; i < RUNS; i++)
+			f();
+		const u64 t = std::max<u64>(porting::getTimeUs() - t0, 1);
+		std::cout << "\t" << name << ": "
+			<< RUNS * 1000000ULL / t << " blocks/s";
+		if (AllocCounter::enabled) {
+			std::cout << ", " << allocs.bytes / RUNS << " bytes in "
+				<< allocs.count / RUNS << " allocations per block";
+		}
+		std::cout << std::endl;
+	};
+
+	// Only when benchmarks run, not for unit tests
+	if (!Catch::getCurrentContext().getConfig()->skipBenchmarks()) {
+		for (const World &world : worlds)
+		for (bool smooth_lighting : {false, true}) {
+			MeshStats stats = mesh(world, smooth_lighting);
+			std::cout << world.name << (smooth_lighting ? ", smooth lighting" : "")
+				<< ": " << stats.vertices << " vertices in " << stats.buffers
+				<< " buffers" << std::endl;
+
+			run("new collector", [&] {
+				mesh(world, smooth_lighting);
+			});
+
+			// The same block meshed again and again by one thread
+			MeshCollector collector(v3f(0.0f));
+			std::vector<PreMeshBufferSize> sizes;
+			mesh(world, smooth_lighting, &collector, &sizes);
+			run("reused collector", [&] {
+				mesh(world, smooth_lighting, &collector, &sizes);
+			});
+
+			// A node in the middle changed, its neighbors are updated in the
+			// current mesh. Copying the mesh happens on the main thread.
+			MeshMakeData current_data(ndef, MAP_BLOCKSIZE, MeshGrid{1});
+			fill(current_data, world, smooth_lighting);
+			MapBlockMesh current(&tsrc, &shdrsrc, &current_data);
+			const VoxelArea update_area(v3s16(7), v3s16(9));
+			u64 t_copy = 0;
+			run("node update", [&] {
+				MeshMakeData data(ndef, MAP_BLOCKSIZE, MeshGrid{1});
+				fill(data, world, smooth_lighting, update_area);
+				const u64 t0 = porting::getTimeUs();
+				data.m_previous_mesh = std::make_unique<MeshGeometry>();
+				current.getGeometry(*data.m_previous_mesh);
+				t_copy += porting::getTimeUs() - t0;
+				MapBlockMesh block_mesh(&tsrc, &shdrsrc, &data, &collector);
+			});
+			std::cout << "\t\tof which " << t_copy / RUNS
+				<< " us per block copying the current mesh" << std::endl;
+		}
+	}
+
+	for (const World &world : worlds) {
+		BENCHMARK(world.name) {
+			return mesh(world, false).vertices;
+		};
+		BENCHMARK(std::string(world.name) + "_smooth") {
+			return mesh(world, true).vertices;
+		};
+	}
+}
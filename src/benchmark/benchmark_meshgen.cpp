@@ -0,0 +1,156 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "light.h"
+#include "nodedef.h"
+#include "noise.h"
+#include "porting.h"
+#include "client/content_mapblock.h"
+#include "client/mapblock_mesh.h"
+#include "client/meshgen/collector.h"
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+constexpr s16 SIDE = MAP_BLOCKSIZE;
+
+content_t addSolidNode(NodeDefManager *ndef, const std::string &name, u32 texture)
+{
+	ContentFeatures f;
+	f.name = name;
+	f.drawtype = NDT_NORMAL;
+	f.solidness = 2;
+	f.alpha = ALPHAMODE_OPAQUE;
+	for (TileSpec &tile : f.tiles)
+		tile.layers[0].texture_id = texture;
+	return ndef->set(f.name, f);
+}
+
+// A block and the nodes around it, from a function which returns the node
+// at a position relative to the block
+template <typename F>
+std::unique_ptr<MeshMakeData> makeBlock(const NodeDefManager *ndef, F node_at)
+{
+	auto data = std::make_unique<MeshMakeData>(ndef, SIDE, MeshGrid{1});
+	data->m_blockpos = v3s16(0, 0, 0);
+	for (s16 z = -1; z <= SIDE; z++)
+	for (s16 y = -1; y <= SIDE; y++)
+	for (s16 x = -1; x <= SIDE; x++)
+		data->m_vmanip.setNode(v3s16(x, y, z), node_at(x, y, z));
+	return data;
+}
+
+// Returns the number of vertices
+size_t generateMesh(MeshMakeData &data)
+{
+	MeshCollector collector(v3f(0.5f * SIDE * BS));
+	MapblockMeshGenerator(&data, &collector).generate();
+	size_t vertex_count = 0;
+	for (auto &prebuffers : collector.prebuffers)
+	for (PreMeshBuffer &p : prebuffers)
+		vertex_count += p.vertices.size();
+	return vertex_count;
+}
+
+}
+
+TEST_CASE("benchmark_meshgen")
+{
+	set_light_table(1.0f);
+
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	const content_t c_stone = addSolidNode(ndef, "stone", 1);
+	const content_t c_dirt = addSolidNode(ndef, "dirt", 2);
+	const content_t c_grass = addSolidNode(ndef, "grass", 3);
+	const content_t c_ore = addSolidNode(ndef, "ore", 4);
+	ndef->setNodeRegistrationStatus(true);
+
+	// Air in sunlight, dark underground
+	const MapNode sunlit_air(CONTENT_AIR, LIGHT_SUN, 0);
+	const MapNode dark_air(CONTENT_AIR, 0, 0);
+
+	// Flat grass land
+	auto flat = makeBlock(ndef, [&] (s16 x, s16 y, s16 z) {
+		if (y > 8)
+			return sunlit_air;
+		return MapNode(y == 8 ? c_grass : y > 4 ? c_dirt : c_stone);
+	});
+
+	// Rolling hills
+	auto hills = makeBlock(ndef, [&] (s16 x, s16 y, s16 z) {
+		s16 height = 8 + std::round(3 * std::sin(x / 3.0f) * std::cos(z / 4.0f));
+		if (y > height)
+			return sunlit_air;
+		return MapNode(y == height ? c_grass : y > height - 3 ? c_dirt : c_stone);
+	});
+
+	// Stone with caves and some ore
+	NoiseParams np_caves(0, 1, v3f(8, 8, 8), 4242, 2, 0.5, 2.0);
+	Noise caves(&np_caves, 1, SIDE + 2, SIDE + 2, SIDE + 2);
+	caves.perlinMap3D(-1, -1, -1);
+	auto underground = makeBlock(ndef, [&] (s16 x, s16 y, s16 z) {
+		const float n = caves.result[((z + 1) * (SIDE + 2) + y + 1) * (SIDE + 2) + x + 1];
+		if (std::fabs(n) < 0.15f)
+			return dark_air;
+		return MapNode((x * 7 + y * 11 + z * 13) % 29 == 0 ? c_ore : c_stone);
+	});
+
+	const struct {
+		const char *name;
+		MeshMakeData *data;
+	} blocks[] = {
+		{"flat", flat.get()},
+		{"hills", hills.get()},
+		{"underground", underground.get()},
+	};
+
+	// Only when benchmarks run, not for unit tests
+	if (!Catch::getCurrentContext().getConfig()->skipBenchmarks()) {
+		for (bool smooth_lighting : {false, true})
+		for (bool greedy_meshing : {false, true})
+		for (const auto &block : blocks) {
+			block.data->m_smooth_lighting = smooth_lighting;
+			block.data->m_greedy_meshing = greedy_meshing;
+			constexpr int RUNS = 100;
+			size_t vertex_count = 0;
+			const u64 t0 = porting::getTimeUs();
+			for (int i = 0; i < RUNS; i++)
+				vertex_count = generateMesh(*block.data);
+			const u64 t = porting::getTimeUs() - t0;
+			std::cout << block.name << (smooth_lighting ? ", smooth lighting" : "")
+				<< (greedy_meshing ? ", greedy meshing" : "") << ": "
+				<< vertex_count << " vertices, " << t / RUNS << " us/block" << std::endl;
+		}
+	}
+
+	for (const auto &block : blocks) {
+		block.data->m_smooth_lighting = true;
+		block.data->m_greedy_meshing = false;
+	}
+	BENCHMARK("mesh_flat") {
+		return generateMesh(*flat);
+	};
+	BENCHMARK("mesh_hills") {
+		return generateMesh(*hills);
+	};
+	BENCHMARK("mesh_underground") {
+		return generateMesh(*underground);
+	};
+
+	for (const auto &block : blocks)
+		block.data->m_greedy_meshing = true;
+	BENCHMARK("mesh_flat_greedy") {
+		return generateMesh(*flat);
+	};
+	BENCHMARK("mesh_hills_greedy") {
+		return generateMesh(*hills);
+	};
+	BENCHMARK("mesh_underground_greedy") {
+		return generateMesh(*underground);
+	};
+}
@@ -0,0 +1,63 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "noise.h"
+#include "noise_simd.h"
+#include "mapgen/mapgen_carpathian.h"
+#include "mapgen/mapgen_v7.h"
+#include <string>
+
+namespace {
+
+// Size of one mapchunk with the default chunksize
+constexpr u32 CSIZE = 80;
+
+struct NoiseCase {
+	const char *name;
+	const NoiseParams *np;
+	bool is3d;
+};
+
+void benchNoise(Catch::Benchmark::Chronometer &meter, const NoiseCase &c)
+{
+	// 3D noises in mapgens are one node larger above and below
+	Noise noise(c.np, 1337, CSIZE, c.is3d ? CSIZE + 2 : CSIZE, c.is3d ? CSIZE : 1);
+	s16 chunk = 0;
+	meter.measure([&] {
+		// Walk along the chunks, as mapgen would
+		float x = (chunk++ % 64) * (float)CSIZE;
+		if (c.is3d)
+			return noise.perlinMap3D(x, -33, 1000)[0];
+		return noise.perlinMap2D(x, 1000)[0];
+	});
+}
+
+}
+
+TEST_CASE("benchmark_noise")
+{
+	MapgenV7Params v7;
+	MapgenCarpathianParams carpathian;
+	const NoiseCase cases[] = {
+		{"v7_terrain_base", &v7.np_terrain_base, false},
+		{"v7_mountain", &v7.np_mountain, true},
+		{"v7_cave1", &v7.np_cave1, true},
+		{"carpathian_height1", &carpathian.np_height1, false},
+		{"carpathian_mnt_var", &carpathian.np_mnt_var, true},
+	};
+
+	const noise_simd::Level orig_level = noise_simd::getLevel();
+	for (int l = noise_simd::LEVEL_SCALAR; l <= noise_simd::LEVEL_AVX2; l++) {
+		const auto level = (noise_simd::Level)l;
+		if (!noise_simd::setLevel(level))
+			continue;
+		for (const NoiseCase &c : cases) {
+			std::string name = std::string(c.name) + "_" + noise_simd::getLevelName(level);
+			BENCHMARK_ADVANCED(name.c_str())(Catch::Benchmark::Chronometer meter) {
+				benchNoise(meter, c);
+			};
+		}
+	}
+	noise_simd::setLevel(orig_level);
+}
@@ -0,0 +1,169 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "mapgen/mg_schematic.h"
+#include "noise.h"
+#include "util/numeric.h"
+#include <cmath>
+#include <vector>
+
+namespace {
+
+enum TreeNode { AIR, TRUNK, LEAVES, FRUIT };
+
+constexpr u8 PROB_ALWAYS = MTSCHEM_PROB_ALWAYS;
+constexpr u8 PROB_NEVER = MTSCHEM_PROB_NEVER;
+
+// A schematic built from a function which returns the node at a position
+// and its param1 (probability and force placement)
+template <typename F>
+void make_tree(Schematic &schem, const NodeDefManager *ndef, v3s16 size, F node_at)
+{
+	schem.size = size;
+	schem.schemdata = new MapNode[size.X * size.Y * size.Z];
+	schem.slice_probs = new u8[size.Y];
+	for (s16 y = 0; y < size.Y; y++)
+		schem.slice_probs[y] = PROB_ALWAYS;
+
+	u32 i = 0;
+	for (s16 z = 0; z < size.Z; z++)
+	for (s16 y = 0; y < size.Y; y++)
+	for (s16 x = 0; x < size.X; x++, i++) {
+		u8 param1;
+		TreeNode n = node_at(x, y, z, param1);
+		schem.schemdata[i] = MapNode(n, param1, 0);
+	}
+
+	schem.m_nodenames = {"air", "tree", "leaves", "apple"};
+	schem.m_nnlistsizes = {schem.m_nodenames.size()};
+	ndef->pendNodeResolve(&schem);
+}
+
+// Like the apple tree of Minetest Game: forced trunk, a leaf blob with
+// random holes, some apples
+void make_apple_tree(Schematic &schem, const NodeDefManager *ndef)
+{
+	make_tree(schem, ndef, v3s16(7, 8, 7), [] (s16 x, s16 y, s16 z, u8 &param1) {
+		s16 dx = x - 3, dz = z - 3;
+		if (dx == 0 && dz == 0 && y < 6) {
+			param1 = PROB_ALWAYS | MTSCHEM_FORCE_PLACE;
+			return TRUNK;
+		}
+		if (y >= 3 && std::abs(dx) + std::abs(dz) + std::abs(y - 5) < 5) {
+			bool edge = std::abs(dx) == 3 || std::abs(dz) == 3 || y == 7;
+			param1 = edge ? PROB_ALWAYS / 2 : PROB_ALWAYS;
+			return (x + y + z) % 9 == 0 ? FRUIT : LEAVES;
+		}
+		param1 = PROB_NEVER;
+		return AIR;
+	});
+}
+
+// Like the pine trees: a cone of leaves that are always placed
+void make_pine_tree(Schematic &schem, const NodeDefManager *ndef)
+{
+	make_tree(schem, ndef, v3s16(7, 14, 7), [] (s16 x, s16 y, s16 z, u8 &param1) {
+		s16 dx = x - 3, dz = z - 3;
+		if (dx == 0 && dz == 0 && y < 13) {
+			param1 = PROB_ALWAYS | MTSCHEM_FORCE_PLACE;
+			return TRUNK;
+		}
+		s16 radius = y < 3 ? -1 : (14 - y) / 3;
+		if (std::abs(dx) <= radius && std::abs(dz) <= radius) {
+			param1 = PROB_ALWAYS;
+			return LEAVES;
+		}
+		param1 = PROB_NEVER;
+		return AIR;
+	});
+}
+
+// Like the emergent jungle tree: a big forced trunk and crown
+void make_jungle_tree(Schematic &schem, const NodeDefManager *ndef)
+{
+	make_tree(schem, ndef, v3s16(11, 24, 11), [] (s16 x, s16 y, s16 z, u8 &param1) {
+		s16 dx = x - 5, dz = z - 5;
+		if (std::abs(dx) <= 1 && std::abs(dz) <= 1 && y < 20) {
+			param1 = PROB_ALWAYS | MTSCHEM_FORCE_PLACE;
+			return TRUNK;
+		}
+		if (y >= 17 && dx * dx + dz * dz + (y - 20) * (y - 20) * 4 < 30) {
+			param1 = PROB_ALWAYS | MTSCHEM_FORCE_PLACE;
+			return LEAVES;
+		}
+		param1 = PROB_NEVER;
+		return AIR;
+	});
+}
+
+}
+
+TEST_CASE("benchmark_schematic")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	for (const char *name : {"stone", "tree", "leaves", "apple"}) {
+		ContentFeatures f;
+		f.name = name;
+		ndef->set(f.name, f);
+	}
+	ndef->setNodeRegistrationStatus(true);
+
+	// A mapchunk with ground at y = 16
+	const v3s16 bpmin(0, 0, 0), bpmax(4, 4, 4);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	MMVManip vm(&map);
+	vm.initialEmerge(bpmin, bpmax, false);
+	const u32 volume = vm.m_area.getVolume();
+	std::vector<MapNode> initial(volume, MapNode(CONTENT_AIR));
+	const content_t c_ground = ndef->getId("stone");
+	for (s16 z = vm.m_area.MinEdge.Z; z <= vm.m_area.MaxEdge.Z; z++)
+	for (s16 y = vm.m_area.MinEdge.Y; y < 16; y++)
+	for (s16 x = vm.m_area.MinEdge.X; x <= vm.m_area.MaxEdge.X; x++)
+		initial[vm.m_area.index(x, y, z)] = MapNode(c_ground);
+
+	// Trees at random positions and rotations, like a dense forest
+	constexpr u32 NUM_TREES = 400;
+	struct Placement {
+		v3s16 p;
+		Rotation rot;
+	};
+	std::vector<Placement> placements;
+	PcgRandom pr(42);
+	for (u32 i = 0; i < NUM_TREES; i++) {
+		v3s16 p(pr.range(-5, 80), 16, pr.range(-5, 80));
+		placements.push_back({p, (Rotation)pr.range(ROTATE_0, ROTATE_270)});
+	}
+
+	auto bench = [&] (Schematic &schem, Catch::Benchmark::Chronometer &meter) {
+		meter.measure([&] {
+			std::copy(initial.begin(), initial.end(), vm.m_data);
+			for (const Placement &it : placements)
+				schem.blitToVManip(&vm, it.p, it.rot, false);
+			return vm.m_data[0].getContent();
+		});
+	};
+
+	Schematic apple, pine, jungle;
+	make_apple_tree(apple, ndef);
+	make_pine_tree(pine, ndef);
+	make_jungle_tree(jungle, ndef);
+
+	// Included in all of the following
+	BENCHMARK("reset_vmanip") {
+		std::copy(initial.begin(), initial.end(), vm.m_data);
+		return vm.m_data[0].getContent();
+	};
+	BENCHMARK_ADVANCED("place_apple_trees")(Catch::Benchmark::Chronometer meter) {
+		bench(apple, meter);
+	};
+	BENCHMARK_ADVANCED("place_pine_trees")(Catch::Benchmark::Chronometer meter) {
+		bench(pine, meter);
+	};
+	BENCHMARK_ADVANCED("place_jungle_trees")(Catch::Benchmark::Chronometer meter) {
+		bench(jungle, meter);
+	};
+}
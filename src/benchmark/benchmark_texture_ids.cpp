@@ -0,0 +1,98 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "catch.h"
+#include "threading/thread_pool.h"
+#include "util/container.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// How TextureSource used to map texture names to ids
+class LockedNameMap
+{
+public:
+	void insert(const std::string &name, u32 id)
+	{
+		MutexAutoLock lock(m_mutex);
+		m_ids[name] = id;
+	}
+
+	bool get(const std::string &name, u32 *id)
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_ids.find(name);
+		if (it == m_ids.end())
+			return false;
+		*id = it->second;
+		return true;
+	}
+
+private:
+	std::map<std::string, u32> m_ids;
+	std::mutex m_mutex;
+};
+
+constexpr u32 LOOKUPS_PER_THREAD = 100000;
+
+}
+
+// Texture name to id lookups like the mesh update threads do them, all of
+// them for textures which exist already
+TEST_CASE("benchmark_texture_ids")
+{
+	// Node textures, some of them with overlays and cracks
+	std::vector<std::string> names;
+	for (int i = 0; i < 500; i++) {
+		std::string name = "mymod_node" + std::to_string(i) + ".png";
+		names.push_back(name);
+		if (i % 5 == 0)
+			names.push_back(name + "^mymod_mineral.png");
+		if (i % 10 == 0) {
+			for (int crack = 0; crack < 5; crack++)
+				names.push_back(name + "^[crack:1:" + std::to_string(crack));
+		}
+	}
+
+	LockedNameMap locked_map;
+	InsertOnlyMap<std::string, u32> insert_only_map;
+	for (u32 i = 0; i < names.size(); i++) {
+		locked_map.insert(names[i], i);
+		insert_only_map.insert(names[i], i);
+	}
+
+	auto bench = [&] (Catch::Benchmark::Chronometer &meter, unsigned int threads,
+			auto &map) {
+		// the calling thread helps out
+		ThreadPool pool("BenchTexIds", threads - 1);
+		meter.measure([&] {
+			u32 found = 0;
+			std::mutex found_mutex;
+			pool.parallelFor(threads, [&] (size_t t) {
+				u32 n = 0, id;
+				for (u32 i = 0; i < LOOKUPS_PER_THREAD; i++)
+					n += map.get(names[(i * 7 + t * 131) % names.size()], &id);
+				MutexAutoLock lock(found_mutex);
+				found += n;
+			});
+			return found;
+		});
+	};
+
+	BENCHMARK_ADVANCED("locked_map_1_thread")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 1, locked_map); };
+	BENCHMARK_ADVANCED("locked_map_4_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 4, locked_map); };
+	BENCHMARK_ADVANCED("locked_map_8_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 8, locked_map); };
+
+	BENCHMARK_ADVANCED("insert_only_map_1_thread")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 1, insert_only_map); };
+	BENCHMARK_ADVANCED("insert_only_map_4_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 4, insert_only_map); };
+	BENCHMARK_ADVANCED("insert_only_map_8_threads")(Catch::Benchmark::Chronometer meter)
+	{ bench(meter, 8, insert_only_map); };
+}
@@ -579,7 +579,14 @@ void Client::step(float dtime)
 			if (!block && r.mesh)
 				block = sector->createBlankBlock(r.p.Y);
 
-			if (block) {
+			if (block && r.previous_mesh_id != 0 &&
+					(!block->mesh || block->mesh->getId() != r.previous_mesh_id)) {
+				// The nodes were updated in a mesh which was replaced meanwhile
+				delete r.mesh;
+				r.mesh = nullptr;
+				do_mapper_update = false;
+				addUpdateMeshTask(r.p, false, r.urgent);
+			} else if (block) {
 				// Delete the old mesh
 				if (block->mesh)
 					map.invalidateMapBlockMesh(block->mesh);
@@ -1459,15 +1466,14 @@ void Client::removeNode(v3s16 p)
 {
 	std::map<v3s16, MapBlock*> modified_blocks;
 
+	m_mesh_update_manager->rememberNodes(&m_env.getMap(), getNodeBlockPos(p));
 	try {
 		m_env.getMap().removeNodeAndUpdate(p, modified_blocks);
 	}
 	catch(InvalidPositionException &e) {
 	}
 
-	for (const auto &modified_block : modified_blocks) {
-		addUpdateMeshTaskWithEdge(modified_block.first, false, true);
-	}
+	m_mesh_update_manager->updateChangedNodes(&m_env.getMap(), modified_blocks, true);
 }
 
 /**
@@ -1520,6 +1526,7 @@ void Client::addNode(v3s16 p, MapNode n, bool remove_metadata)
 
 	std::map<v3s16, MapBlock*> modified_blocks;
 
+	m_mesh_update_manager->rememberNodes(&m_env.getMap(), getNodeBlockPos(p));
 	try {
 		//TimeTaker timer3("Client::addNode(): addNodeAndUpdate");
 		m_env.getMap().addNodeAndUpdate(p, n, modified_blocks, remove_metadata);
@@ -1527,9 +1534,7 @@ void Client::addNode(v3s16 p, MapNode n, bool remove_metadata)
 	catch(InvalidPositionException &e) {
 	}
 
-	for (const auto &modified_block : modified_blocks) {
-		addUpdateMeshTaskWithEdge(modified_block.first, false, true);
-	}
+	m_mesh_update_manager->updateChangedNodes(&m_env.getMap(), modified_blocks, true);
 }
 
 void Client::setPlayerControl(PlayerControl &control)
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: LGPL-2.1-or-later
 // Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
 
+#include <algorithm>
 #include <cmath>
 #include "content_mapblock.h"
 #include "util/basic_macros.h"
@@ -32,6 +33,10 @@
 // Corresponding offsets are listed in g_27dirs
 #define FRAMED_NEIGHBOR_COUNT 18
 
+// Distinct tiles whose faces are merged per mesh (for greedy meshing)
+// Faces of further tiles are drawn one by one
+#define GREEDY_MAX_TILES 256
+
 // Maps light index to corner direction
 static const v3s16 light_dirs[8] = {
 	v3s16(-1, -1, -1),
@@ -54,6 +59,9 @@ static const u8 light_indices[6][4] = {
 	{2, 6, 4, 0},
 };
 
+// Maps cuboid face index to the axis of its normal (0 = X, 1 = Y, 2 = Z)
+static const u8 greedy_face_axes[6] = {1, 1, 0, 0, 2, 2};
+
 // Standard index set to make a quad on 4 vertices
 static constexpr u16 quad_indices_02[] = {0, 1, 2, 2, 3, 0};
 static constexpr u16 quad_indices_13[] = {0, 1, 3, 3, 1, 2};
@@ -392,17 +400,19 @@ void MapblockMeshGenerator::drawAutoLightedCuboid(aabb3f box,
 	}
 }
 
+// Face directions of a cuboid, in the order of its tiles
+static const v3s16 tile_dirs[6] = {
+	v3s16(0, 1, 0),
+	v3s16(0, -1, 0),
+	v3s16(1, 0, 0),
+	v3s16(-1, 0, 0),
+	v3s16(0, 0, 1),
+	v3s16(0, 0, -1)
+};
+
 void MapblockMeshGenerator::drawSolidNode()
 {
 	u8 faces = 0; // k-th bit will be set if k-th face is to be drawn.
-	static const v3s16 tile_dirs[6] = {
-		v3s16(0, 1, 0),
-		v3s16(0, -1, 0),
-		v3s16(1, 0, 0),
-		v3s16(-1, 0, 0),
-		v3s16(0, 0, 1),
-		v3s16(0, 0, -1)
-	};
 	TileSpec tiles[6];
 	u16 lights[6];
 	content_t n1 = cur_node.n.getContent();
@@ -440,26 +450,50 @@ void MapblockMeshGenerator::drawSolidNode()
 	if (!faces)
 		return;
 	u8 mask = faces ^ 0b0011'1111; // k-th bit is set if k-th face is to be *omitted*, as expected by cuboid drawing functions.
-	cur_node.origin = intToFloat(cur_node.p, BS);
-	auto box = aabb3f(v3f(-0.5 * BS), v3f(0.5 * BS));
-	f32 texture_coord_buf[24];
-	box.MinEdge += cur_node.origin;
-	box.MaxEdge += cur_node.origin;
-	generateCuboidTextureCoords(box, texture_coord_buf);
+	LightPair smooth_lights[6][4];
 	if (data->m_smooth_lighting) {
-		LightPair lights[6][4];
 		for (int face = 0; face < 6; ++face) {
 			if (mask & (1 << face))
 				continue;
 			for (int k = 0; k < 4; k++) {
 				v3s16 corner = light_dirs[light_indices[face][k]];
-				lights[face][k] = LightPair(getSmoothLightSolid(
+				smooth_lights[face][k] = LightPair(getSmoothLightSolid(
 						blockpos_nodes + cur_node.p, tile_dirs[face], corner, data));
 			}
 		}
-
+	}
+	if (data->m_greedy_meshing && cur_node.f->drawtype == NDT_NORMAL) {
+		// Faces with the same light at all corners are merged later
+		for (int face = 0; face < 6; ++face) {
+			if (mask & (1 << face))
+				continue;
+			LightPair light;
+			if (data->m_smooth_lighting) {
+				const LightPair *corners = smooth_lights[face];
+				light = corners[0];
+				if (corners[1] != light || corners[2] != light || corners[3] != light)
+					continue;
+			} else {
+				light = LightPair(lights[face]);
+			}
+			video::SColor color = encode_light(light, cur_node.f->light_source);
+			if (!cur_node.f->light_source)
+				applyFacesShading(color, intToFloat(tile_dirs[face], 1.0f));
+			if (addGreedyFace(face, tiles[face], color))
+				mask |= 1 << face;
+		}
+		if (mask == 0b0011'1111)
+			return;
+	}
+	cur_node.origin = intToFloat(cur_node.p, BS);
+	auto box = aabb3f(v3f(-0.5 * BS), v3f(0.5 * BS));
+	f32 texture_coord_buf[24];
+	box.MinEdge += cur_node.origin;
+	box.MaxEdge += cur_node.origin;
+	generateCuboidTextureCoords(box, texture_coord_buf);
+	if (data->m_smooth_lighting) {
 		drawCuboid(box, tiles, 6, texture_coord_buf, mask, [&] (int face, video::S3DVertex vertices[4]) {
-			auto final_lights = lights[face];
+			auto final_lights = smooth_lights[face];
 			for (int j = 0; j < 4; j++) {
 				video::S3DVertex &vertex = vertices[j];
 				vertex.Color = encode_light(final_lights[j], cur_node.f->light_source);
@@ -484,6 +518,122 @@ void MapblockMeshGenerator::drawSolidNode()
 	}
 }
 
+// Two tiles are the same if their faces can be merged into one
+static bool isSameTile(const TileSpec &a, const TileSpec &b)
+{
+	if (a.world_aligned != b.world_aligned || a.rotation != b.rotation ||
+			a.emissive_light != b.emissive_light)
+		return false;
+	for (int layernum = 0; layernum < MAX_TILE_LAYERS; layernum++) {
+		if (a.layers[layernum] != b.layers[layernum])
+			return false;
+	}
+	return true;
+}
+
+bool MapblockMeshGenerator::addGreedyFace(int face, const TileSpec &tile, video::SColor color)
+{
+	for (const TileLayer &layer : tile.layers) {
+		if (layer.texture_id == 0)
+			continue;
+		// Waving and transparent materials need all of their vertices
+		if (layer.material_type != TILE_MATERIAL_BASIC &&
+				layer.material_type != TILE_MATERIAL_OPAQUE)
+			return false;
+	}
+
+	// Recently added tiles are the most likely to come again
+	size_t index = greedy_tiles.size();
+	while (index > 0 && !isSameTile(greedy_tiles[index - 1], tile))
+		index--;
+	if (index == 0) {
+		if (greedy_tiles.size() >= GREEDY_MAX_TILES)
+			return false;
+		greedy_tiles.push_back(tile);
+		index = greedy_tiles.size();
+	}
+
+	const u32 side = data->m_side_length;
+	const u8 n = greedy_face_axes[face];
+	const s16 pos[3] = {cur_node.p.X, cur_node.p.Y, cur_node.p.Z};
+	u32 key = face;
+	key = key * side + pos[n];
+	key = key * side + pos[(n + 2) % 3];
+	key = key * side + pos[(n + 1) % 3];
+	greedy_faces.push_back({key, (u16)index, color});
+	return true;
+}
+
+void MapblockMeshGenerator::drawGreedyFaces()
+{
+	if (greedy_faces.empty())
+		return;
+	std::sort(greedy_faces.begin(), greedy_faces.end(),
+		[] (const GreedyFace &a, const GreedyFace &b) { return a.key < b.key; });
+
+	const u32 side = data->m_side_length;
+	const u32 slice_size = side * side;
+	// The faces of one slice by position, a tile of 0 marks no face
+	std::vector<GreedyFace> slice(slice_size, GreedyFace{0, 0, video::SColor()});
+
+	for (size_t first = 0; first < greedy_faces.size(); ) {
+		const u32 slice_key = greedy_faces[first].key / slice_size;
+		size_t last = first;
+		for (; last < greedy_faces.size() && greedy_faces[last].key / slice_size == slice_key; last++)
+			slice[greedy_faces[last].key % slice_size] = greedy_faces[last];
+
+		const int face = slice_key / side;
+		const u8 n = greedy_face_axes[face], u = (n + 1) % 3, v = (n + 2) % 3;
+		for (size_t i = first; i < last; i++) {
+			const u32 start = greedy_faces[i].key % slice_size;
+			const GreedyFace f = slice[start];
+			if (f.tile == 0)
+				continue; // merged into an earlier face
+			auto same = [&] (u32 a, u32 b) {
+				const GreedyFace &f2 = slice[b * side + a];
+				return f2.tile == f.tile && f2.color == f.color;
+			};
+
+			// Grow along u as far as possible, then along v by whole rows
+			const u32 a0 = start % side, b0 = start / side;
+			u32 a1 = a0 + 1, b1 = b0 + 1;
+			while (a1 < side && same(a1, b0))
+				a1++;
+			for (; b1 < side; b1++) {
+				u32 a = a0;
+				while (a < a1 && same(a, b1))
+					a++;
+				if (a < a1)
+					break;
+			}
+			for (u32 b = b0; b < b1; b++)
+			for (u32 a = a0; a < a1; a++)
+				slice[b * side + a].tile = 0;
+
+			s16 pmin[3], pmax[3];
+			pmin[n] = pmax[n] = slice_key % side;
+			pmin[u] = a0;
+			pmax[u] = a1 - 1;
+			pmin[v] = b0;
+			pmax[v] = b1 - 1;
+			aabb3f box(v3f(-0.5 * BS), v3f(0.5 * BS));
+			box.MinEdge += intToFloat(v3s16(pmin[0], pmin[1], pmin[2]), BS);
+			box.MaxEdge += intToFloat(v3s16(pmax[0], pmax[1], pmax[2]), BS);
+
+			// The texture coordinates follow the position, so the texture
+			// repeats on the merged face just like on the separate ones
+			const TileSpec &tile = greedy_tiles[f.tile - 1];
+			f32 txc[24];
+			generateCuboidTextureCoords(box, txc);
+			auto vertices = setupCuboidVertices(box, txc, &tile, 1);
+			for (int j = 0; j < 4; j++)
+				vertices[4 * face + j].Color = f.color;
+			collector->append(tile, &vertices[4 * face], 4, quad_indices, 6);
+		}
+		first = last;
+	}
+}
+
 u8 MapblockMeshGenerator::getNodeBoxMask(aabb3f box, u8 solid_neighbors, u8 sametype_neighbors) const
 {
 	const f32 NODE_BOUNDARY = 0.5 * BS;
@@ -1592,7 +1742,8 @@ void MapblockMeshGenerator::drawNodeboxNode()
 		}
 	}
 
-	std::vector<aabb3f> boxes;
+	std::vector<aabb3f> &boxes = nodebox_boxes;
+	boxes.clear();
 	cur_node.n.getNodeBoxes(nodedef, &boxes, neighbors_set);
 
 	bool isTransparent = false;
@@ -1605,7 +1756,8 @@ void MapblockMeshGenerator::drawNodeboxNode()
 	}
 
 	if (isTransparent) {
-		std::vector<float> sections;
+		std::vector<float> &sections = nodebox_sections;
+		sections.clear();
 		// Preallocate 8 default splits + Min&Max for each nodebox
 		sections.reserve(8 + 2 * boxes.size());
 
@@ -1775,11 +1927,21 @@ void MapblockMeshGenerator::generate()
 {
 	ZoneScoped;
 
-	for (cur_node.p.Z = 0; cur_node.p.Z < data->m_side_length; cur_node.p.Z++)
-	for (cur_node.p.Y = 0; cur_node.p.Y < data->m_side_length; cur_node.p.Y++)
-	for (cur_node.p.X = 0; cur_node.p.X < data->m_side_length; cur_node.p.X++) {
+	VoxelArea area = data->m_update_area;
+	if (area.hasEmptyExtent())
+		area = VoxelArea(v3s16(0), v3s16(data->m_side_length - 1));
+
+	for (cur_node.p.Z = area.MinEdge.Z; cur_node.p.Z <= area.MaxEdge.Z; cur_node.p.Z++)
+	for (cur_node.p.Y = area.MinEdge.Y; cur_node.p.Y <= area.MaxEdge.Y; cur_node.p.Y++)
+	for (cur_node.p.X = area.MinEdge.X; cur_node.p.X <= area.MaxEdge.X; cur_node.p.X++) {
+		if (collector->record_nodes)
+			collector->node = cur_node.p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE +
+					cur_node.p.Y * MAP_BLOCKSIZE + cur_node.p.X;
 		cur_node.n = data->m_vmanip.getNodeNoEx(blockpos_nodes + cur_node.p);
 		cur_node.f = &nodedef->get(cur_node.n);
 		drawNode();
 	}
+
+	if (data->m_greedy_meshing)
+		drawGreedyFaces();
 }
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <vector>
 #include "nodedef.h"
 
 struct MeshMakeData;
@@ -91,6 +92,10 @@ class MapblockMeshGenerator
 	void drawAutoLightedCuboid(aabb3f box, const TileSpec *tiles, int tile_count, f32 const *txc = nullptr, u8 mask = 0);
 	u8 getNodeBoxMask(aabb3f box, u8 solid_neighbors, u8 sametype_neighbors) const;
 
+// nodebox-specific, kept to not allocate them for every node
+	std::vector<aabb3f> nodebox_boxes;
+	std::vector<float> nodebox_sections;
+
 // liquid-specific
 	struct LiquidData {
 		struct NeighborData {
@@ -149,6 +154,21 @@ class MapblockMeshGenerator
 	void drawFirelikeQuad(const TileSpec &tile, float rotation, float opening_angle,
 		float offset_h, float offset_v = 0.0);
 
+// greedy meshing of solid nodes
+	struct GreedyFace {
+		// face, position along its normal, then along the other two axes
+		u32 key;
+		// index in greedy_tiles + 1, 0 if the face was already drawn
+		u16 tile;
+		video::SColor color;
+	};
+	std::vector<GreedyFace> greedy_faces;
+	std::vector<TileSpec> greedy_tiles;
+
+	// Returns false if the face can't be merged and has to be drawn now
+	bool addGreedyFace(int face, const TileSpec &tile, video::SColor color);
+	void drawGreedyFaces();
+
 // drawtypes
 	void drawSolidNode();
 	void drawLiquidNode();
@@ -19,7 +19,9 @@
 #include "client/renderingengine.h"
 #include <array>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <optional>
 #include "client/texturesource.h"
 #include <SMesh.h>
 #include <IMeshBuffer.h>
@@ -51,13 +53,34 @@ void MeshMakeData::fillBlockDataBegin(const v3s16 &blockpos)
 	m_vmanip.addArea(voxel_area);
 }
 
+void MeshMakeData::fillBlockDataBegin(const v3s16 &blockpos,
+		const VoxelArea &update_area)
+{
+	m_blockpos = blockpos;
+	m_update_area = update_area;
+
+	v3s16 blockpos_nodes = m_blockpos*MAP_BLOCKSIZE;
+
+	m_vmanip.clear();
+	// nodes are drawn looking at their direct neighbors only
+	VoxelArea voxel_area = update_area + blockpos_nodes;
+	voxel_area.pad(v3s16(1,1,1));
+	voxel_area.addArea(VoxelArea(blockpos_nodes,
+			blockpos_nodes + v3s16(1,1,1) * (m_side_length - 1)));
+	m_vmanip.addArea(voxel_area);
+}
+
 void MeshMakeData::fillBlockData(const v3s16 &bp, MapNode *data)
 {
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
 	v3s16 blockpos_nodes = bp * MAP_BLOCKSIZE;
-	m_vmanip.copyFrom(data, data_area, v3s16(0,0,0), blockpos_nodes, data_size);
+	VoxelArea copy_area = m_vmanip.m_area.intersect(data_area + blockpos_nodes);
+	if (copy_area.hasEmptyExtent())
+		return;
+	m_vmanip.copyFrom(data, data_area, copy_area.MinEdge - blockpos_nodes,
+			copy_area.MinEdge, copy_area.MaxEdge - copy_area.MinEdge + v3s16(1));
 }
 
 void MeshMakeData::fillSingleNode(MapNode data, MapNode padding)
@@ -611,9 +634,20 @@ void PartialMeshBuffer::draw(video::IVideoDriver *driver) const
 	MapBlockMesh
 */
 
-MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data):
-	m_tsrc(client->getTextureSource()),
-	m_shdrsrc(client->getShaderSource()),
+static std::atomic<u32> next_mesh_id(1);
+
+MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data,
+		MeshCollector *collector):
+	MapBlockMesh(client->getTextureSource(), client->getShaderSource(), data,
+		collector)
+{
+}
+
+MapBlockMesh::MapBlockMesh(ITextureSource *tsrc, IShaderSource *shdrsrc,
+		MeshMakeData *data, MeshCollector *collector):
+	m_id(next_mesh_id++),
+	m_tsrc(tsrc),
+	m_shdrsrc(shdrsrc),
 	m_bounding_sphere_center((data->m_side_length * 0.5f - 0.5f) * BS),
 	m_animation_force_timer(0), // force initial animation
 	m_last_crack(-1)
@@ -648,27 +682,69 @@ MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data):
 	// algin vertices to mesh grid, not meshgen area
 	v3f offset = intToFloat((data->m_blockpos - mesh_grid.getMeshPos(data->m_blockpos)) * MAP_BLOCKSIZE, BS);
 
-	MeshCollector collector(m_bounding_sphere_center, offset);
+	std::optional<MeshCollector> own_collector;
+	if (collector) {
+		collector->reset(m_bounding_sphere_center, offset);
+	} else {
+		own_collector.emplace(m_bounding_sphere_center, offset);
+		collector = &*own_collector;
+	}
+	collector->size_hints = &data->m_prebuffer_sizes;
+	// Merged faces belong to many nodes, so these meshes are always made anew
+	collector->record_nodes = data->m_side_length == MAP_BLOCKSIZE &&
+			!data->m_greedy_meshing;
 
 	{
-		// Generate everything
-		MapblockMeshGenerator(data, &collector).generate();
+		// Generate everything, or the nodes which changed
+		MapblockMeshGenerator(data, collector).generate();
 	}
 
+	for (auto &prebuffers : collector->prebuffers)
+		for (PreMeshBuffer &p : prebuffers)
+			applyTileColor(p);
+
+	if (data->m_previous_mesh) {
+		// Take the geometry of the other nodes from the current mesh
+		for (u8 layer = 0; layer < MAX_TILE_LAYERS; layer++)
+		for (const PreMeshBuffer &p : data->m_previous_mesh->prebuffers[layer])
+		for (size_t i = 0; i < p.nodes.size(); i++) {
+			const PreMeshBuffer::NodeRange &range = p.nodes[i];
+			v3s16 pos(range.node % MAP_BLOCKSIZE,
+					range.node / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+					range.node / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+			if (data->m_update_area.contains(pos))
+				continue;
+			bool last = i + 1 == p.nodes.size();
+			u32 vertex_end = last ? p.vertices.size() : p.nodes[i + 1].first_vertex;
+			u32 index_end = last ? p.indices.size() : p.nodes[i + 1].first_index;
+			collector->node = range.node;
+			collector->appendFinal(p.layer, layer,
+					p.vertices.data() + range.first_vertex,
+					vertex_end - range.first_vertex,
+					p.indices.data() + range.first_index,
+					index_end - range.first_index, range.first_vertex);
+		}
+	}
+
+	collector->size_hints = nullptr;
+	collector->getSizes(m_prebuffer_sizes);
+	m_has_node_ranges = collector->record_nodes;
+
 	/*
 		Convert MeshCollector to SMesh
 	*/
 
-	m_bounding_radius = std::sqrt(collector.m_bounding_radius_sq);
+	m_bounding_radius = std::sqrt(collector->m_bounding_radius_sq);
 
 	for (int layer = 0; layer < MAX_TILE_LAYERS; layer++) {
 		scene::SMesh *mesh = static_cast<scene::SMesh *>(m_mesh[layer].get());
 
-		for(u32 i = 0; i < collector.prebuffers[layer].size(); i++)
+		for(u32 i = 0; i < collector->prebuffers[layer].size(); i++)
 		{
-			PreMeshBuffer &p = collector.prebuffers[layer][i];
+			PreMeshBuffer &p = collector->prebuffers[layer][i];
 
-			applyTileColor(p);
+			if (m_has_node_ranges)
+				m_buffer_nodes[layer].push_back({p.layer, p.nodes});
 
 			// Generate animation data
 			// - Cracks
@@ -762,6 +838,47 @@ MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data):
 		!m_animation_info.empty();
 }
 
+void MapBlockMesh::getGeometry(MeshGeometry &geometry) const
+{
+	geometry.mesh_id = m_id;
+	for (u8 layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+		auto &prebuffers = geometry.prebuffers[layer];
+		prebuffers.clear();
+		for (u32 i = 0; i < m_buffer_nodes[layer].size(); i++) {
+			const scene::IMeshBuffer *buf = m_mesh[layer]->getMeshBuffer(i);
+			PreMeshBuffer &p = prebuffers.emplace_back(m_buffer_nodes[layer][i].layer);
+			const auto *vertices = static_cast<const video::S3DVertex *>(buf->getVertices());
+			p.vertices.assign(vertices, vertices + buf->getVertexCount());
+			p.indices.assign(buf->getIndices(), buf->getIndices() + buf->getIndexCount());
+			p.nodes = m_buffer_nodes[layer][i].nodes;
+		}
+	}
+
+	// The indices of transparent buffers are only kept with the triangles,
+	// which are in the order of the buffers
+	const scene::IMeshBuffer *buf = nullptr;
+	PreMeshBuffer *p = nullptr;
+	for (const MeshTriangle &t : m_transparent_triangles) {
+		if (t.buffer != buf) {
+			buf = t.buffer;
+			p = nullptr;
+			for (u8 layer = 0; layer < MAX_TILE_LAYERS && !p; layer++) {
+				for (u32 i = 0; i < geometry.prebuffers[layer].size(); i++) {
+					if (m_mesh[layer]->getMeshBuffer(i) == buf) {
+						p = &geometry.prebuffers[layer][i];
+						break;
+					}
+				}
+			}
+		}
+		if (p) {
+			p->indices.push_back(t.p1);
+			p->indices.push_back(t.p2);
+			p->indices.push_back(t.p3);
+		}
+	}
+}
+
 MapBlockMesh::~MapBlockMesh()
 {
 	size_t sz = 0;
@@ -11,9 +11,11 @@
 
 #include "util/numeric.h"
 #include "client/tile.h"
+#include "client/meshgen/collector.h"
 #include "voxel.h"
 #include <array>
 #include <map>
+#include <memory>
 #include <unordered_map>
 
 namespace irr::video {
@@ -33,6 +35,18 @@ class ITextureSource;
 class MapBlock;
 struct MinimapMapblock;
 
+/*
+	The prebuffers of a MapBlockMesh, with the nodes their geometry belongs to.
+	Updating a few nodes of the mesh copies the geometry of all the other
+	nodes from here instead of generating it again.
+*/
+struct MeshGeometry
+{
+	// see MapBlockMesh::getId()
+	u32 mesh_id = 0;
+	std::array<std::vector<PreMeshBuffer>, MAX_TILE_LAYERS> prebuffers;
+};
+
 struct MeshMakeData
 {
 	VoxelManipulator m_vmanip;
@@ -50,7 +64,15 @@ struct MeshMakeData
 	v3s16 m_crack_pos_relative = v3s16(-1337,-1337,-1337);
 	bool m_generate_minimap = false;
 	bool m_smooth_lighting = false;
+	// merge faces of solid nodes which look the same
+	bool m_greedy_meshing = false;
 	bool m_enable_water_reflections = false;
+	// sizes of the prebuffers of the previous mesh of this block, if any
+	std::vector<PreMeshBufferSize> m_prebuffer_sizes;
+	// nodes to generate, relative to blockpos, all of them if empty
+	VoxelArea m_update_area;
+	// the current mesh, to take the geometry of the other nodes from
+	std::unique_ptr<MeshGeometry> m_previous_mesh;
 
 	const NodeDefManager *m_nodedef;
 
@@ -60,6 +82,9 @@ struct MeshMakeData
 		Copy block data manually (to allow optimizations by the caller)
 	*/
 	void fillBlockDataBegin(const v3s16 &blockpos);
+	// Only the nodes needed to generate update_area (relative to blockpos)
+	// are copied, and the block itself for the minimap
+	void fillBlockDataBegin(const v3s16 &blockpos, const VoxelArea &update_area);
 	void fillBlockData(const v3s16 &bp, MapNode *data);
 
 	/*
@@ -180,7 +205,12 @@ class MapBlockMesh
 {
 public:
 	// Builds the mesh given
-	MapBlockMesh(Client *client, MeshMakeData *data);
+	// collector: reused for the mesh if given, to save allocations
+	MapBlockMesh(Client *client, MeshMakeData *data,
+			MeshCollector *collector = nullptr);
+	// Builds the mesh without a client, e.g. for benchmarks
+	MapBlockMesh(ITextureSource *tsrc, IShaderSource *shdrsrc, MeshMakeData *data,
+			MeshCollector *collector = nullptr);
 	~MapBlockMesh();
 
 	// Main animation function, parameters:
@@ -223,6 +253,22 @@ class MapBlockMesh
 			m_animation_force_timer--;
 	}
 
+	/// Unique for every mesh.
+	u32 getId() const { return m_id; }
+
+	/// Whether single nodes of the mesh can be updated, see MeshMakeData.
+	bool canUpdateNodes() const { return m_has_node_ranges; }
+
+	/// Copies the geometry of the mesh, to update some nodes of it.
+	/// @warning only valid if canUpdateNodes()
+	void getGeometry(MeshGeometry &geometry) const;
+
+	/// Sizes of the prebuffers this mesh was made of, see MeshMakeData.
+	const std::vector<PreMeshBufferSize> &getPreBufferSizes() const
+	{
+		return m_prebuffer_sizes;
+	}
+
 	/// Radius of the bounding-sphere, in BS-space.
 	f32 getBoundingRadius() const { return m_bounding_radius; }
 
@@ -251,6 +297,13 @@ class MapBlockMesh
 		TileLayer tile;
 	};
 
+	// The nodes whose geometry a mesh buffer contains
+	struct BufferNodes {
+		TileLayer layer; // without the crack and animation
+		std::vector<PreMeshBuffer::NodeRange> nodes;
+	};
+
+	u32 m_id;
 	irr_ptr<scene::IMesh> m_mesh[MAX_TILE_LAYERS];
 	std::vector<MinimapMapblock*> m_minimap_mapblocks;
 	ITextureSource *m_tsrc;
@@ -259,6 +312,12 @@ class MapBlockMesh
 	f32 m_bounding_radius;
 	v3f m_bounding_sphere_center;
 
+	std::vector<PreMeshBufferSize> m_prebuffer_sizes;
+
+	// For every mesh buffer, if single nodes can be updated
+	bool m_has_node_ranges = false;
+	std::vector<BufferNodes> m_buffer_nodes[MAX_TILE_LAYERS];
+
 	// Must animate() be called before rendering?
 	bool m_has_animation;
 	int m_animation_force_timer;
@@ -23,6 +23,9 @@ static struct BlockPlaceholder {
 
 } block_placeholder;
 
+// Larger changes are meshed completely, which is faster than updating the nodes
+static constexpr u32 MAX_UPDATE_AREA_VOLUME = MapBlock::nodecount / 8;
+
 /*
 	QueuedMeshUpdate
 */
@@ -40,6 +43,7 @@ MeshUpdateQueue::MeshUpdateQueue(Client *client):
 	m_client(client)
 {
 	m_cache_smooth_lighting = g_settings->getBool("smooth_lighting");
+	m_cache_greedy_meshing = g_settings->getBool("greedy_meshing");
 	m_cache_enable_water_reflections = g_settings->getBool("enable_water_reflections");
 }
 
@@ -55,7 +59,8 @@ MeshUpdateQueue::~MeshUpdateQueue()
 	}
 }
 
-bool MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent)
+bool MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
+		const VoxelArea &update_area)
 {
 	MapBlock *main_block = map->getBlockNoCreateNoEx(p);
 	if (!main_block)
@@ -87,6 +92,15 @@ bool MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool
 			q->crack_level = m_client->getCrackLevel();
 			q->crack_pos = m_client->getCrackPos();
 			q->urgent |= urgent;
+			// Update some nodes only as long as all of the updates do
+			if (q->previous_mesh) {
+				q->update_area.addArea(update_area);
+				if (update_area.hasEmptyExtent() ||
+						q->update_area.getVolume() > MAX_UPDATE_AREA_VOLUME) {
+					q->update_area = VoxelArea();
+					q->previous_mesh.reset();
+				}
+			}
 			v3s16 pos;
 			int i = 0;
 			for (pos.X = q->p.X - 1; pos.X <= q->p.X + mesh_grid.cell_size; pos.X++)
@@ -131,6 +145,21 @@ bool MeshUpdateQueue::addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool
 	q->crack_pos = m_client->getCrackPos();
 	q->urgent = urgent;
 	q->map_blocks = std::move(map_blocks);
+	// The current mesh lives in the block at the mesh position
+	MapBlock *mesh_block = mesh_position == p ? main_block :
+			map->getBlockNoCreateNoEx(mesh_position);
+	if (mesh_block && mesh_block->mesh)
+		q->prebuffer_sizes = mesh_block->mesh->getPreBufferSizes();
+	// A mesh which is being made now would not have the current nodes
+	if (!update_area.hasEmptyExtent() &&
+			update_area.getVolume() <= MAX_UPDATE_AREA_VOLUME &&
+			mesh_grid.cell_size == 1 &&
+			mesh_block && mesh_block->mesh && mesh_block->mesh->canUpdateNodes() &&
+			m_inflight_blocks.find(mesh_position) == m_inflight_blocks.end()) {
+		q->update_area = update_area;
+		q->previous_mesh = std::make_unique<MeshGeometry>();
+		mesh_block->mesh->getGeometry(*q->previous_mesh);
+	}
 	m_queue.push_back(q);
 
 	return true;
@@ -181,7 +210,10 @@ void MeshUpdateQueue::fillDataFromMapBlocks(QueuedMeshUpdate *q)
 			MAP_BLOCKSIZE * mesh_grid.cell_size, mesh_grid);
 	q->data = data;
 
-	data->fillBlockDataBegin(q->p);
+	if (q->previous_mesh)
+		data->fillBlockDataBegin(q->p, q->update_area);
+	else
+		data->fillBlockDataBegin(q->p);
 
 	v3s16 pos;
 	int i = 0;
@@ -195,7 +227,10 @@ void MeshUpdateQueue::fillDataFromMapBlocks(QueuedMeshUpdate *q)
 	data->setCrack(q->crack_level, q->crack_pos);
 	data->m_generate_minimap = !!m_client->getMinimap();
 	data->m_smooth_lighting = m_cache_smooth_lighting;
+	data->m_greedy_meshing = m_cache_greedy_meshing;
 	data->m_enable_water_reflections = m_cache_enable_water_reflections;
+	data->m_prebuffer_sizes = std::move(q->prebuffer_sizes);
+	data->m_previous_mesh = std::move(q->previous_mesh);
 }
 
 /*
@@ -203,7 +238,8 @@ void MeshUpdateQueue::fillDataFromMapBlocks(QueuedMeshUpdate *q)
 */
 
 MeshUpdateWorkerThread::MeshUpdateWorkerThread(Client *client, MeshUpdateQueue *queue_in, MeshUpdateManager *manager) :
-		UpdateThread("Mesh"), m_client(client), m_queue_in(queue_in), m_manager(manager)
+		UpdateThread("Mesh"), m_client(client), m_queue_in(queue_in), m_manager(manager),
+		m_collector(v3f())
 {
 	m_generation_interval = g_settings->getU16("mesh_generation_interval");
 	m_generation_interval = rangelim(m_generation_interval, 0, 50);
@@ -220,11 +256,13 @@ void MeshUpdateWorkerThread::doUpdate()
 
 		ScopeProfiler sp(g_profiler, "Client: Mesh making (sum)");
 
-		MapBlockMesh *mesh_new = new MapBlockMesh(m_client, q->data);
+		MapBlockMesh *mesh_new = new MapBlockMesh(m_client, q->data, &m_collector);
 
 		MeshUpdateResult r;
 		r.p = q->p;
 		r.mesh = mesh_new;
+		if (q->data->m_previous_mesh)
+			r.previous_mesh_id = q->data->m_previous_mesh->mesh_id;
 		r.solid_sides = get_solid_sides(q->data);
 		r.ack_list = std::move(q->ack_list);
 		r.urgent = q->urgent;
@@ -280,6 +318,74 @@ void MeshUpdateManager::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
 	deferUpdate();
 }
 
+void MeshUpdateManager::rememberNodes(Map *map, v3s16 blockpos)
+{
+	m_remembered_pos = blockpos;
+	m_remembered_nodes.resize(m_remembered_blocks.size() * MapBlock::nodecount);
+	u32 i = 0;
+	v3s16 dp;
+	for (dp.Z = -1; dp.Z <= 1; dp.Z++)
+	for (dp.Y = -1; dp.Y <= 1; dp.Y++)
+	for (dp.X = -1; dp.X <= 1; dp.X++) {
+		MapBlock *block = map->getBlockNoCreateNoEx(blockpos + dp);
+		m_remembered_blocks[i] = block != nullptr;
+		if (block) {
+			std::copy_n(block->getData(), MapBlock::nodecount,
+					&m_remembered_nodes[i * MapBlock::nodecount]);
+		}
+		i++;
+	}
+}
+
+void MeshUpdateManager::updateChangedNodes(Map *map,
+		const std::map<v3s16, MapBlock *> &modified_blocks, bool urgent)
+{
+	// The nodes to update in every block, relative to it
+	std::map<v3s16, VoxelArea> update_areas;
+	const VoxelArea block_area(v3s16(0), v3s16(MAP_BLOCKSIZE - 1));
+
+	for (const auto &it : modified_blocks) {
+		v3s16 dp = it.first - m_remembered_pos;
+		u32 i_block = (dp.Z + 1) * 9 + (dp.Y + 1) * 3 + dp.X + 1;
+		if (abs(dp.X) > 1 || abs(dp.Y) > 1 || abs(dp.Z) > 1 ||
+				!m_remembered_blocks[i_block]) {
+			updateBlock(map, it.first, false, urgent, true);
+			continue;
+		}
+
+		const MapNode *old_nodes = &m_remembered_nodes[i_block * MapBlock::nodecount];
+		const MapNode *nodes = it.second->getData();
+		VoxelArea changed;
+		for (u32 i = 0; i < MapBlock::nodecount; i++) {
+			if (!(nodes[i] == old_nodes[i])) {
+				changed.addPoint(v3s16(i % MAP_BLOCKSIZE,
+						i / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+						i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE)));
+			}
+		}
+		if (changed.hasEmptyExtent())
+			continue;
+
+		// Nodes are drawn looking at their direct neighbors, which might be
+		// in the blocks around
+		changed.pad(v3s16(1));
+		changed = changed + it.first * MAP_BLOCKSIZE;
+		v3s16 bp;
+		v3s16 bp_min = getNodeBlockPos(changed.MinEdge);
+		v3s16 bp_max = getNodeBlockPos(changed.MaxEdge);
+		for (bp.Z = bp_min.Z; bp.Z <= bp_max.Z; bp.Z++)
+		for (bp.Y = bp_min.Y; bp.Y <= bp_max.Y; bp.Y++)
+		for (bp.X = bp_min.X; bp.X <= bp_max.X; bp.X++) {
+			update_areas[bp].addArea(
+					(changed - bp * MAP_BLOCKSIZE).intersect(block_area));
+		}
+	}
+
+	for (const auto &it : update_areas)
+		m_queue_in.addBlock(map, it.first, false, urgent, it.second);
+	deferUpdate();
+}
+
 void MeshUpdateManager::putResult(const MeshUpdateResult &result)
 {
 	if (result.urgent)
@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include <array>
 #include <ctime>
+#include <map>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
@@ -24,6 +26,12 @@ struct QueuedMeshUpdate
 	MeshMakeData *data = nullptr; // This is generated in MeshUpdateQueue::pop()
 	std::vector<MapBlock *> map_blocks;
 	bool urgent = false;
+	// Sizes of the current mesh of the block, see MeshMakeData
+	std::vector<PreMeshBufferSize> prebuffer_sizes;
+	// If only some nodes are updated: the nodes, relative to p, and the
+	// current mesh for the other nodes
+	VoxelArea update_area;
+	std::unique_ptr<MeshGeometry> previous_mesh;
 
 	QueuedMeshUpdate() = default;
 	~QueuedMeshUpdate();
@@ -47,7 +55,9 @@ class MeshUpdateQueue
 
 	// Caches the block at p and its neighbors (if needed) and queues a mesh
 	// update for the block at p
-	bool addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
+	// update_area: the nodes to update, relative to p, all of them if empty
+	bool addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
+			const VoxelArea &update_area = VoxelArea());
 
 	// Returned pointer must be deleted
 	// Returns NULL if queue is empty
@@ -71,6 +81,7 @@ class MeshUpdateQueue
 
 	// TODO: Add callback to update these when g_settings changes, and update all meshes
 	bool m_cache_smooth_lighting;
+	bool m_cache_greedy_meshing;
 	bool m_cache_enable_water_reflections;
 
 	void fillDataFromMapBlocks(QueuedMeshUpdate *q);
@@ -80,6 +91,8 @@ struct MeshUpdateResult
 {
 	v3s16 p = v3s16(-1338, -1338, -1338);
 	MapBlockMesh *mesh = nullptr;
+	// If only some nodes were updated, the id of the mesh they were updated in
+	u32 previous_mesh_id = 0;
 	u8 solid_sides;
 	std::vector<v3s16> ack_list;
 	bool urgent = false;
@@ -102,6 +115,8 @@ class MeshUpdateWorkerThread : public UpdateThread
 	Client *m_client;
 	MeshUpdateQueue *m_queue_in;
 	MeshUpdateManager *m_manager;
+	// Reused for all meshes made by this thread
+	MeshCollector m_collector;
 
 	// TODO: Add callback to update these when g_settings changes
 	int m_generation_interval;
@@ -116,6 +131,14 @@ class MeshUpdateManager
 	// update for the block at p
 	void updateBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent,
 			bool update_neighbors = false);
+
+	// Remembers the nodes around the block at blockpos, before some of them
+	// are changed
+	void rememberNodes(Map *map, v3s16 blockpos);
+	// Updates the nodes which changed since rememberNodes() and their
+	// neighbors. Blocks which were not remembered are updated completely.
+	void updateChangedNodes(Map *map,
+			const std::map<v3s16, MapBlock *> &modified_blocks, bool urgent);
 	void putResult(const MeshUpdateResult &r);
 	bool getNextResult(MeshUpdateResult &r);
 
@@ -135,4 +158,9 @@ class MeshUpdateManager
 	MutexedQueue<MeshUpdateResult> m_queue_out_urgent;
 
 	std::vector<std::unique_ptr<MeshUpdateWorkerThread>> m_workers;
+
+	// The blocks around m_remembered_pos, see rememberNodes()
+	v3s16 m_remembered_pos;
+	std::array<bool, 27> m_remembered_blocks{};
+	std::vector<MapNode> m_remembered_nodes;
 };
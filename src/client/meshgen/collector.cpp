@@ -7,6 +7,24 @@
 #include "log.h"
 #include "client/mesh.h"
 
+// Limits the memory kept by a collector which is reused
+#define MAX_SPARE_PREBUFFERS 64
+
+void MeshCollector::reset(const v3f center_pos, v3f offset)
+{
+	m_bounding_radius_sq = 0.0f;
+	m_center_pos = center_pos;
+	this->offset = offset;
+	for (std::vector<PreMeshBuffer> &buffers : prebuffers) {
+		for (PreMeshBuffer &p : buffers) {
+			if (m_spare.size() >= MAX_SPARE_PREBUFFERS)
+				break;
+			m_spare.push_back(std::move(p));
+		}
+		buffers.clear();
+	}
+}
+
 void MeshCollector::append(const TileSpec &tile, const video::S3DVertex *vertices,
 		u32 numVertices, const u16 *indices, u32 numIndices)
 {
@@ -24,6 +42,7 @@ void MeshCollector::append(const TileLayer &layer, const video::S3DVertex *verti
 		bool use_scale)
 {
 	PreMeshBuffer &p = findBuffer(layer, layernum, numVertices);
+	recordNode(p);
 
 	f32 scale = 1.0f;
 	if (use_scale)
@@ -41,6 +60,30 @@ void MeshCollector::append(const TileLayer &layer, const video::S3DVertex *verti
 		p.indices.push_back(indices[i] + vertex_count);
 }
 
+void MeshCollector::appendFinal(const TileLayer &layer, u8 layernum,
+		const video::S3DVertex *vertices, u32 numVertices,
+		const u16 *indices, u32 numIndices, u16 first_vertex)
+{
+	PreMeshBuffer &p = findBuffer(layer, layernum, numVertices);
+	recordNode(p);
+
+	u32 vertex_count = p.vertices.size();
+	p.vertices.insert(p.vertices.end(), vertices, vertices + numVertices);
+	for (u32 i = 0; i < numVertices; i++) {
+		m_bounding_radius_sq = std::max(m_bounding_radius_sq,
+				(vertices[i].Pos - offset - m_center_pos).getLengthSQ());
+	}
+
+	for (u32 i = 0; i < numIndices; i++)
+		p.indices.push_back(indices[i] - first_vertex + vertex_count);
+}
+
+void MeshCollector::recordNode(PreMeshBuffer &p)
+{
+	if (record_nodes && (p.nodes.empty() || p.nodes.back().node != node))
+		p.nodes.push_back({node, (u16)p.vertices.size(), (u32)p.indices.size()});
+}
+
 PreMeshBuffer &MeshCollector::findBuffer(
 		const TileLayer &layer, u8 layernum, u32 numVertices)
 {
@@ -51,6 +94,36 @@ PreMeshBuffer &MeshCollector::findBuffer(
 	for (PreMeshBuffer &p : buffers)
 		if (p.layer == layer && p.vertices.size() + numVertices <= U16_MAX)
 			return p;
-	buffers.emplace_back(layer);
-	return buffers.back();
+
+	if (m_spare.empty()) {
+		buffers.emplace_back(layer);
+	} else {
+		buffers.push_back(std::move(m_spare.back()));
+		m_spare.pop_back();
+		buffers.back().layer = layer;
+		buffers.back().vertices.clear();
+		buffers.back().indices.clear();
+		buffers.back().nodes.clear();
+	}
+	PreMeshBuffer &p = buffers.back();
+	if (size_hints) {
+		for (const PreMeshBufferSize &hint : *size_hints) {
+			if (hint.layernum == layernum && hint.layer == layer) {
+				p.vertices.reserve(hint.vertex_count);
+				p.indices.reserve(hint.index_count);
+				break;
+			}
+		}
+	}
+	return p;
+}
+
+void MeshCollector::getSizes(std::vector<PreMeshBufferSize> &sizes) const
+{
+	for (u8 layernum = 0; layernum < MAX_TILE_LAYERS; layernum++) {
+		for (const PreMeshBuffer &p : prebuffers[layernum]) {
+			sizes.push_back({p.layer, layernum, (u32)p.vertices.size(),
+				(u32)p.indices.size()});
+		}
+	}
 }
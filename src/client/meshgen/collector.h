@@ -12,14 +12,33 @@
 
 struct PreMeshBuffer
 {
+	// Where the geometry of a node starts. It ends where the next one starts.
+	struct NodeRange
+	{
+		u16 node; // index in the block
+		u16 first_vertex;
+		u32 first_index;
+	};
+
 	TileLayer layer;
 	std::vector<u16> indices;
 	std::vector<video::S3DVertex> vertices;
+	// Only filled if the collector records nodes
+	std::vector<NodeRange> nodes;
 
 	PreMeshBuffer() = default;
 	explicit PreMeshBuffer(const TileLayer &layer) : layer(layer) {}
 };
 
+// How large a prebuffer was, to reserve the memory for it next time
+struct PreMeshBufferSize
+{
+	TileLayer layer;
+	u8 layernum;
+	u32 vertex_count;
+	u32 index_count;
+};
+
 struct MeshCollector
 {
 	std::array<std::vector<PreMeshBuffer>, MAX_TILE_LAYERS> prebuffers;
@@ -27,20 +46,46 @@ struct MeshCollector
 	f32 m_bounding_radius_sq = 0.0f;
 	v3f m_center_pos;
 	v3f offset;
+	// Prebuffers which match one of these get its size reserved
+	const std::vector<PreMeshBufferSize> *size_hints = nullptr;
+	// Whether to record which node the geometry belongs to
+	bool record_nodes = false;
+	// The node which the appended geometry belongs to, index in the block
+	u16 node = 0;
 
 	// center_pos: pos to use for bounding-sphere, in BS-space
 	// offset: offset added to vertices
 	MeshCollector(const v3f center_pos, v3f offset = v3f()) : m_center_pos(center_pos), offset(offset) {}
 
+	/*
+		Starts collecting a new mesh. The memory of the current prebuffers is
+		kept for it, so a collector used for one mesh after the other barely
+		has to allocate anything.
+	*/
+	void reset(const v3f center_pos, v3f offset = v3f());
+
 	void append(const TileSpec &material,
 			const video::S3DVertex *vertices, u32 numVertices,
 			const u16 *indices, u32 numIndices);
 
+	// Appends geometry which is ready for the mesh, e.g. from an earlier one.
+	// indices: relative to first_vertex
+	void appendFinal(const TileLayer &layer, u8 layernum,
+			const video::S3DVertex *vertices, u32 numVertices,
+			const u16 *indices, u32 numIndices, u16 first_vertex);
+
+	// Appends the sizes of the prebuffers to sizes
+	void getSizes(std::vector<PreMeshBufferSize> &sizes) const;
+
 private:
+	// Emptied prebuffers, their memory is used again
+	std::vector<PreMeshBuffer> m_spare;
+
 	void append(const TileLayer &material,
 			const video::S3DVertex *vertices, u32 numVertices,
 			const u16 *indices, u32 numIndices,
 			u8 layernum, bool use_scale = false);
 
 	PreMeshBuffer &findBuffer(const TileLayer &layer, u8 layernum, u32 numVertices);
+	void recordNode(PreMeshBuffer &p);
 };
@@ -146,10 +146,12 @@ class TextureSource final : public IWritableTextureSource
 	// A texture id is index in this array.
 	// The first position contains a NULL texture.
 	std::vector<TextureInfo> m_textureinfo_cache;
-	// Maps a texture name to an index in the former.
-	std::map<std::string, u32> m_name_to_id;
-	// The two former containers are behind this mutex
+	// The former is behind this mutex
 	std::mutex m_textureinfo_cache_mutex;
+	// Maps a texture name to an index in m_textureinfo_cache. Mesh update
+	// threads look up the ids of their textures all the time, this doesn't
+	// make them wait for each other.
+	InsertOnlyMap<std::string, u32> m_name_to_id;
 
 	// Queued texture fetches (to be processed by the main thread)
 	RequestQueue<std::string, u32, std::thread::id, u8> m_get_texture_queue;
@@ -176,7 +178,7 @@ TextureSource::TextureSource()
 
 	// Add a NULL TextureInfo as the first index, named ""
 	m_textureinfo_cache.emplace_back(TextureInfo{""});
-	m_name_to_id[""] = 0;
+	m_name_to_id.insert("", 0);
 
 	// Cache some settings
 	// Note: Since this is only done once, the game must be restarted
@@ -212,12 +214,10 @@ TextureSource::~TextureSource()
 
 u32 TextureSource::getTextureId(const std::string &name)
 {
-	{ // See if texture already exists
-		MutexAutoLock lock(m_textureinfo_cache_mutex);
-		auto n = m_name_to_id.find(name);
-		if (n != m_name_to_id.end())
-			return n->second;
-	}
+	u32 id;
+	// See if texture already exists
+	if (m_name_to_id.get(name, &id))
+		return id;
 
 	// Get texture
 	if (std::this_thread::get_id() == m_main_thread) {
@@ -262,12 +262,10 @@ u32 TextureSource::generateTexture(const std::string &name)
 		return 0;
 	}
 
-	{ // See if texture already exists
-		MutexAutoLock lock(m_textureinfo_cache_mutex);
-		auto n = m_name_to_id.find(name);
-		if (n != m_name_to_id.end())
-			return n->second;
-	}
+	u32 id;
+	// See if texture already exists
+	if (m_name_to_id.get(name, &id))
+		return id;
 
 	// Calling only allowed from main thread
 	if (std::this_thread::get_id() != m_main_thread) {
@@ -297,10 +295,10 @@ u32 TextureSource::generateTexture(const std::string &name)
 
 	MutexAutoLock lock(m_textureinfo_cache_mutex);
 
-	u32 id = m_textureinfo_cache.size();
+	id = m_textureinfo_cache.size();
 	TextureInfo ti{name, tex, std::move(source_image_names)};
 	m_textureinfo_cache.emplace_back(std::move(ti));
-	m_name_to_id[name] = id;
+	m_name_to_id.insert(name, id);
 
 	return id;
 }
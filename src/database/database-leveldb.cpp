@@ -61,6 +61,24 @@ void Database_LevelDB::loadBlock(const v3s16 &pos, std::string *block)
 		block->clear();
 }
 
+void Database_LevelDB::loadBlocks(const std::vector<v3s16> &positions,
+	std::vector<std::string> &blocks)
+{
+	// Read all blocks from the same snapshot
+	leveldb::ReadOptions options;
+	options.snapshot = m_database->GetSnapshot();
+
+	blocks.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		leveldb::Status status = m_database->Get(options,
+			i64tos(getBlockAsInteger(positions[i])), &blocks[i]);
+		if (!status.ok())
+			blocks[i].clear();
+	}
+
+	m_database->ReleaseSnapshot(options.snapshot);
+}
+
 bool Database_LevelDB::deleteBlock(const v3s16 &pos)
 {
 	leveldb::Status status = m_database->Delete(leveldb::WriteOptions(),
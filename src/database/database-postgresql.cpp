@@ -20,7 +20,10 @@
 #include "settings.h"
 #include "remoteplayer.h"
 #include "server/player_sao.h"
+#include "util/string.h"
 #include <cstdlib>
+#include <cstring>
+#include <unordered_map>
 
 Database_PostgreSQL::Database_PostgreSQL(const std::string &connect_string,
 	const char *type) :
@@ -202,6 +205,13 @@ void MapDatabasePostgreSQL::initStatements()
 				"UPDATE SET data = $4::bytea");
 	}
 
+	if (getPGVersion() >= 90400) {
+		prepareStatement("read_blocks",
+			"SELECT posX, posY, posZ, data FROM blocks "
+				"WHERE (posX, posY, posZ) IN (SELECT * FROM "
+				"unnest($1::int4[], $2::int4[], $3::int4[]))");
+	}
+
 	prepareStatement("delete_block", "DELETE FROM blocks WHERE "
 		"posX = $1::int4 AND posY = $2::int4 AND posZ = $3::int4");
 
@@ -265,6 +275,66 @@ void MapDatabasePostgreSQL::loadBlock(const v3s16 &pos, std::string *block)
 	PQclear(results);
 }
 
+void MapDatabasePostgreSQL::loadBlocks(const std::vector<v3s16> &positions,
+	std::vector<std::string> &blocks)
+{
+	// multi-argument unnest() is not available before 9.4
+	if (getPGVersion() < 90400 || positions.size() < 2) {
+		MapDatabase::loadBlocks(positions, blocks);
+		return;
+	}
+
+	verifyDatabase();
+
+	blocks.resize(positions.size());
+	// A position may be asked for more than once, it is queried once and
+	// returned in all of its slots
+	std::unordered_map<v3s16, std::vector<size_t>> index;
+	std::string xs("{"), ys("{"), zs("{");
+	for (size_t i = 0; i < positions.size(); i++) {
+		const v3s16 &pos = positions[i];
+		blocks[i].clear();
+		std::vector<size_t> &slots = index[pos];
+		slots.push_back(i);
+		if (slots.size() > 1)
+			continue;
+		if (index.size() > 1) {
+			xs.append(",");
+			ys.append(",");
+			zs.append(",");
+		}
+		xs.append(itos(pos.X));
+		ys.append(itos(pos.Y));
+		zs.append(itos(pos.Z));
+	}
+	xs.append("}");
+	ys.append("}");
+	zs.append("}");
+
+	// Text parameters, binary results
+	const char *args[] = { xs.c_str(), ys.c_str(), zs.c_str() };
+
+	PGresult *results = execPrepared("read_blocks", ARRLEN(args), args,
+		false);
+
+	int numrows = PQntuples(results);
+	for (int row = 0; row < numrows; ++row) {
+		v3s16 pos;
+		for (int col = 0; col < 3; col++) {
+			u32 val;
+			memcpy(&val, PQgetvalue(results, row, col), sizeof(val));
+			pos[col] = (s32)ntohl(val);
+		}
+		auto it = index.find(pos);
+		if (it == index.end())
+			continue;
+		for (size_t i : it->second)
+			blocks[i] = pg_to_string(results, row, 3);
+	}
+
+	PQclear(results);
+}
+
 bool MapDatabasePostgreSQL::deleteBlock(const v3s16 &pos)
 {
 	verifyDatabase();
@@ -152,6 +152,67 @@ void Database_Redis::loadBlock(const v3s16 &pos, std::string *block)
 		"Redis command 'HGET %s %s' gave invalid reply."));
 }
 
+void Database_Redis::loadBlocks(const std::vector<v3s16> &positions,
+	std::vector<std::string> &blocks)
+{
+	blocks.resize(positions.size());
+	if (positions.empty())
+		return;
+
+	// Fetch all blocks in one round trip
+	std::vector<std::string> keys;
+	keys.reserve(positions.size());
+	for (const v3s16 &pos : positions)
+		keys.push_back(i64tos(getBlockAsInteger(pos)));
+
+	std::vector<const char *> argv;
+	std::vector<size_t> argvlen;
+	argv.reserve(keys.size() + 2);
+	argvlen.reserve(keys.size() + 2);
+	argv.push_back("HMGET");
+	argvlen.push_back(5);
+	argv.push_back(hash.c_str());
+	argvlen.push_back(hash.size());
+	for (const std::string &key : keys) {
+		argv.push_back(key.c_str());
+		argvlen.push_back(key.size());
+	}
+
+	redisReply *reply = static_cast<redisReply *>(redisCommandArgv(ctx,
+			argv.size(), argv.data(), argvlen.data()));
+
+	if (!reply) {
+		throw DatabaseException(std::string(
+			"Redis command 'HMGET %s ...' failed: ") + ctx->errstr);
+	}
+
+	if (reply->type == REDIS_REPLY_ERROR) {
+		std::string errstr(reply->str, reply->len);
+		freeReplyObject(reply);
+		errorstream << "loadBlocks: loading " << positions.size()
+			<< " blocks failed: " << errstr << std::endl;
+		throw DatabaseException(std::string(
+			"Redis command 'HMGET %s ...' errored: ") + errstr);
+	}
+
+	if (reply->type != REDIS_REPLY_ARRAY || reply->elements != positions.size()) {
+		errorstream << "loadBlocks: loading " << positions.size()
+			<< " blocks returned invalid reply type " << reply->type << std::endl;
+		freeReplyObject(reply);
+		throw DatabaseException(std::string(
+			"Redis command 'HMGET %s ...' gave invalid reply."));
+	}
+
+	for (size_t i = 0; i < reply->elements; i++) {
+		const redisReply *element = reply->element[i];
+		if (element->type == REDIS_REPLY_STRING)
+			blocks[i].assign(element->str, element->len);
+		else
+			blocks[i].clear();
+	}
+	freeReplyObject(reply);
+}
+
 bool Database_Redis::deleteBlock(const v3s16 &pos)
 {
 	std::string tmp = i64tos(getBlockAsInteger(pos));
@@ -276,6 +276,29 @@ void MapDatabaseSQLite3::loadBlock(const v3s16 &pos, std::string *block)
 	sqlite3_reset(m_stmt_read);
 }
 
+void MapDatabaseSQLite3::loadBlocks(const std::vector<v3s16> &positions,
+	std::vector<std::string> &blocks)
+{
+	verifyDatabase();
+
+	// Wrap the reads in one transaction so the lock is only taken once,
+	// unless we are already inside of one
+	const bool own_transaction = sqlite3_get_autocommit(m_database) != 0;
+	if (own_transaction)
+		beginSave();
+
+	try {
+		MapDatabase::loadBlocks(positions, blocks);
+	} catch (...) {
+		if (own_transaction)
+			endSave();
+		throw;
+	}
+
+	if (own_transaction)
+		endSave();
+}
+
 void MapDatabaseSQLite3::listAllLoadableBlocks(std::vector<v3s16> &dst)
 {
 	verifyDatabase();
@@ -41,6 +41,17 @@ s64 MapDatabase::getBlockAsInteger(const v3s16 &pos)
 }
 
 
+void MapDatabase::loadBlocks(const std::vector<v3s16> &positions,
+	std::vector<std::string> &blocks)
+{
+	blocks.resize(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		blocks[i].clear();
+		loadBlock(positions[i], &blocks[i]);
+	}
+}
+
+
 v3s16 MapDatabase::getIntegerAsBlock(s64 i)
 {
 	v3s16 pos;
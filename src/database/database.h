@@ -26,6 +26,11 @@ class MapDatabase : public Database
 
 	virtual bool saveBlock(const v3s16 &pos, std::string_view data) = 0;
 	virtual void loadBlock(const v3s16 &pos, std::string *block) = 0;
+	/// Loads several blocks at once, which is faster than separate calls on
+	/// most backends. `blocks` is resized to match `positions`, missing
+	/// blocks are returned as empty strings.
+	virtual void loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &blocks);
 	virtual bool deleteBlock(const v3s16 &pos) = 0;
 
 	static s64 getBlockAsInteger(const v3s16 &pos);
@@ -6,9 +6,13 @@
 
 #include "emerge_internal.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
+#include <unordered_set>
 
 #include "util/container.h"
+#include "util/directiontables.h"
 #include "config.h"
 #include "constants.h"
 #include "environment.h"
@@ -22,12 +26,14 @@
 #include "mapgen/mg_ore.h"
 #include "mapgen/mg_decoration.h"
 #include "mapgen/mg_schematic.h"
+#include "mapgen/noise_cache.h"
 #include "nodedef.h"
 #include "profiler.h"
 #include "scripting_server.h"
 #include "scripting_emerge.h"
 #include "server.h"
 #include "settings.h"
+#include "threading/thread_pool.h"
 #include "voxel.h"
 
 EmergeParams::~EmergeParams()
@@ -56,6 +62,108 @@ EmergeParams::EmergeParams(EmergeManager *parent, const BiomeGen *biomegen,
 	this->biomegen = biomegen->clone(this->biomemgr);
 }
 
+////
+//// Emerge queue
+////
+
+// How far ahead to look along the viewers' movement (in seconds)
+#define EMERGE_LOOKAHEAD 1.0f
+// After this many blocks in a row for players, the oldest other block is
+// emerged, so that mods and active blocks are not kept waiting forever
+#define EMERGE_PLAYER_STREAK 4
+
+f32 getEmergePriority(const std::vector<EmergeViewer> &viewers, v3s16 blockpos,
+	bool *in_range)
+{
+	const v3f center = v3f(blockpos.X, blockpos.Y, blockpos.Z) + v3f(0.5f);
+	f32 priority = FLT_MAX;
+	*in_range = false;
+
+	for (const EmergeViewer &viewer : viewers) {
+		const v3f d = center - viewer.pos;
+		const f32 dist = d.getLength();
+		if (dist <= viewer.range + 1.0f)
+			*in_range = true;
+
+		// Distance to where the viewer will be soon
+		f32 cost = (d - viewer.speed * EMERGE_LOOKAHEAD).getLength();
+		// Blocks in front take half as long as those to the side, those
+		// behind twice as long
+		if (dist > 0.001f) {
+			f32 cos_angle = d.dotProduct(viewer.dir) / dist;
+			cost *= cos_angle >= 0 ? 1.0f - 0.5f * cos_angle : 1.0f - cos_angle;
+		}
+		priority = std::min(priority, cost);
+	}
+
+	return priority;
+}
+
+
+void EmergeQueue::push(const Item &item)
+{
+	m_items.push_back(item);
+	m_by_player += item.by_player ? 1 : 0;
+}
+
+
+bool EmergeQueue::pop(Item &item)
+{
+	if (m_items.empty())
+		return false;
+
+	const size_t others = m_items.size() - m_by_player;
+	auto best = m_items.begin();
+	if (m_by_player > 0 && (others == 0 || m_player_streak < EMERGE_PLAYER_STREAK)) {
+		// Ties go to the block queued first
+		for (auto it = m_items.begin(); it != m_items.end(); ++it) {
+			if (it->by_player && (!best->by_player || it->priority < best->priority))
+				best = it;
+		}
+		m_by_player--;
+		m_player_streak = others > 0 ? m_player_streak + 1 : 0;
+	} else {
+		while (best->by_player)
+			++best;
+		m_player_streak = 0;
+	}
+
+	item = *best;
+	m_items.erase(best);
+	return true;
+}
+
+
+void EmergeQueue::peek(size_t n, std::vector<v3s16> &positions) const
+{
+	// Players' items by priority, ties by index like in pop()
+	std::vector<std::pair<f32, size_t>> players;
+	std::vector<size_t> others;
+	for (size_t i = 0; i < m_items.size(); i++) {
+		if (m_items[i].by_player)
+			players.emplace_back(m_items[i].priority, i);
+		else
+			others.push_back(i);
+	}
+	n = std::min(n, m_items.size());
+	const size_t sorted = std::min(n, players.size());
+	std::partial_sort(players.begin(), players.begin() + sorted, players.end());
+
+	size_t pi = 0, oi = 0;
+	u32 streak = m_player_streak;
+	for (size_t i = 0; i < n; i++) {
+		const bool others_left = oi < others.size();
+		if (pi < players.size() && (!others_left || streak < EMERGE_PLAYER_STREAK)) {
+			positions.push_back(m_items[players[pi++].second].pos);
+			streak = others_left ? streak + 1 : 0;
+		} else {
+			positions.push_back(m_items[others[oi++]].pos);
+			streak = 0;
+		}
+	}
+}
+
+
 ////
 //// EmergeManager
 ////
@@ -88,6 +196,10 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 			{{"status", emergeActionStrs[i]}}
 		);
 	}
+	m_queue_wait_counter = mb->addCounter("minetest_emerge_queue_wait_time",
+		"Time blocks spent in emerge queues (in microseconds)");
+	m_stolen_counter = mb->addCounter("minetest_emerge_stolen_blocks",
+		"Number of queued blocks idle emerge threads took over from busy ones");
 
 	s16 nthreads = 1;
 	g_settings->getS16NoEx("num_emerge_threads", nthreads);
@@ -113,7 +225,29 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 	for (s16 i = 0; i < nthreads; i++)
 		m_threads.push_back(new EmergeThread(server, i));
 
-	infostream << "EmergeManager: using " << nthreads << " threads" << std::endl;
+	m_load_batch_size = rangelim(g_settings->getU32("emerge_load_batch_size"), 1, 1024);
+
+	s16 nworkerthreads = g_settings->getS16("num_emerge_worker_threads");
+	// The emerge threads also do this work, so leave them a proc each
+	if (nworkerthreads < 0)
+		nworkerthreads = Thread::getNumberOfProcessors() - 1 - nthreads;
+	if (nworkerthreads < 0)
+		nworkerthreads = 0;
+	if (nworkerthreads > 0)
+		m_worker_pool = std::make_unique<ThreadPool>("EmergeWorker", nworkerthreads);
+
+	const u32 noise_cache_size = g_settings->getU32("emerge_noise_cache_size");
+	if (noise_cache_size > 0) {
+		m_noise_cache = std::make_unique<NoiseCache2D>(
+			(size_t)noise_cache_size * 1024 * 1024,
+			mb->addCounter("minetest_mapgen_noise_cache_hits",
+				"Number of 2D noise maps taken from the cache"),
+			mb->addCounter("minetest_mapgen_noise_cache_misses",
+				"Number of 2D noise maps that had to be calculated"));
+	}
+
+	infostream << "EmergeManager: using " << nthreads << " threads, "
+		<< nworkerthreads << " worker threads" << std::endl;
 }
 
 
@@ -140,6 +274,12 @@ EmergeManager::~EmergeManager()
 	delete oremgr;
 	delete decomgr;
 	delete schemmgr;
+
+	if (m_noise_cache) {
+		infostream << "EmergeManager: noise cache hits: "
+			<< m_noise_cache->getHits() << ", misses: "
+			<< m_noise_cache->getMisses() << std::endl;
+	}
 }
 
 
@@ -196,6 +336,9 @@ void EmergeManager::initMapgens(MapgenParams *params)
 	for (u32 i = 0; i != m_threads.size(); i++) {
 		EmergeParams *p = new EmergeParams(this, biomegen,
 			biomemgr, oremgr, decomgr, schemmgr);
+		p->oremgr->setThreadPool(m_worker_pool.get());
+		p->noise_cache = m_noise_cache.get();
+		p->biomegen->noise_cache = m_noise_cache.get();
 		infostream << "EmergeManager: Created params " << p
 			<< " for thread " << i << std::endl;
 		m_mapgens.push_back(Mapgen::createMapgen(params->mgtype, params, p));
@@ -291,8 +434,18 @@ bool EmergeManager::enqueueBlockEmergeEx(
 		if (entry_already_exists)
 			return true;
 
-		thread = getOptimalThread();
-		thread->pushBlock(blockpos);
+		thread = getOptimalThread(getChunkOf(blockpos));
+		queueBlock(thread, blockpos, peer_id != PEER_ID_INEXISTENT);
+
+		// Wake up an idle thread so that it can take over some blocks
+		if (!thread->m_idle) {
+			for (EmergeThread *other : m_threads) {
+				if (other->m_idle) {
+					other->signal();
+					break;
+				}
+			}
+		}
 	}
 
 	thread->signal();
@@ -420,12 +573,24 @@ bool EmergeManager::popBlockEmergeData(v3s16 pos, BlockEmergeData *bedata)
 }
 
 
-EmergeThread *EmergeManager::getOptimalThread()
+v3s16 EmergeManager::getChunkOf(v3s16 blockpos) const
+{
+	return getContainingChunk(blockpos, mgparams ? mgparams->chunksize : 1);
+}
+
+
+EmergeThread *EmergeManager::getOptimalThread(v3s16 chunk)
 {
 	size_t nthreads = m_threads.size();
 
 	FATAL_ERROR_IF(nthreads == 0, "No emerge threads!");
 
+	// A chunk can only be generated by one thread at a time, others would
+	// have to cancel their blocks
+	auto it = m_chunk_threads.find(chunk);
+	if (it != m_chunk_threads.end())
+		return it->second.thread;
+
 	size_t index = 0;
 	size_t nitems_lowest = m_threads[0]->m_block_queue.size();
 
@@ -437,9 +602,128 @@ EmergeThread *EmergeManager::getOptimalThread()
 		}
 	}
 
+	// Neighbouring chunks overlap, prefer the thread that works on one of
+	// them unless it has a lot more to do
+	const s16 csize = mgparams ? mgparams->chunksize : 1;
+	for (const v3s16 &dir : g_6dirs) {
+		it = m_chunk_threads.find(chunk + dir * csize);
+		if (it != m_chunk_threads.end() &&
+				it->second.thread->m_block_queue.size() <= nitems_lowest + 2)
+			return it->second.thread;
+	}
+
 	return m_threads[index];
 }
 
+
+void EmergeManager::queueBlock(EmergeThread *thread, v3s16 pos, bool by_player)
+{
+	auto &assignment = m_chunk_threads[getChunkOf(pos)];
+	assert(!assignment.thread || assignment.thread == thread);
+	assignment.thread = thread;
+	assignment.refs++;
+
+	f32 priority = 0;
+	if (by_player) {
+		bool in_range;
+		priority = getEmergePriority(m_viewers, pos, &in_range);
+	}
+	thread->pushBlock(pos, by_player, priority);
+}
+
+
+void EmergeManager::releaseChunk(v3s16 chunk)
+{
+	auto it = m_chunk_threads.find(chunk);
+	assert(it != m_chunk_threads.end() && it->second.refs > 0);
+	if (--it->second.refs == 0)
+		m_chunk_threads.erase(it);
+}
+
+
+bool EmergeManager::stealBlocks(EmergeThread *thief)
+{
+	EmergeThread *victim = nullptr;
+	for (EmergeThread *thread : m_threads) {
+		if (thread != thief && !thread->m_block_queue.empty() &&
+				(!victim || thread->m_block_queue.size() > victim->m_block_queue.size()))
+			victim = thread;
+	}
+	if (!victim)
+		return false;
+
+	// Take the chunk that the victim would get to last. The one it is working
+	// on right now has to stay there.
+	auto &queue = victim->m_block_queue;
+	std::optional<v3s16> chunk;
+	for (auto it = queue.items().rbegin(); it != queue.items().rend(); ++it) {
+		v3s16 c = getChunkOf(it->pos);
+		if (c != victim->m_active_chunk) {
+			chunk = c;
+			break;
+		}
+	}
+	if (!chunk)
+		return false;
+
+	u32 count = 0;
+	queue.removeIf([&] (const EmergeQueue::Item &item) {
+		if (getChunkOf(item.pos) != *chunk)
+			return false;
+		thief->m_block_queue.push(item);
+		count++;
+		return true;
+	});
+
+	victim->m_blocks_removed = true;
+	m_chunk_threads[*chunk].thread = thief;
+	m_stolen_counter->increment(count);
+	return true;
+}
+
+
+void EmergeManager::updateViewers(std::vector<EmergeViewer> &&viewers)
+{
+	MutexAutoLock queuelock(m_queue_mutex);
+
+	m_viewers = std::move(viewers);
+
+	u32 cancelled = 0;
+	for (EmergeThread *thread : m_threads) {
+		bool removed = false;
+		thread->m_block_queue.removeIf([&] (EmergeQueue::Item &item) {
+			if (!item.by_player)
+				return false;
+
+			bool in_range;
+			item.priority = getEmergePriority(m_viewers, item.pos, &in_range);
+			if (in_range)
+				return false;
+
+			// Cancel it unless a mod asked for it too. Clients ask again
+			// once they need it.
+			auto it = m_blocks_enqueued.find(item.pos);
+			assert(it != m_blocks_enqueued.end());
+			if (!it->second.callbacks.empty() ||
+					(it->second.flags & BLOCK_EMERGE_FORCE_QUEUE))
+				return false;
+
+			BlockEmergeData bedata;
+			popBlockEmergeData(item.pos, &bedata);
+			releaseChunk(getChunkOf(item.pos));
+			removed = true;
+			cancelled++;
+			return true;
+		});
+		if (removed)
+			thread->m_blocks_removed = true;
+	}
+
+	if (cancelled > 0)
+		m_completed_emerge_counter[EMERGE_CANCELLED]->increment(cancelled);
+}
+
+
 void EmergeManager::reportCompletedEmerge(EmergeAction action)
 {
 	assert((size_t)action < ARRLEN(m_completed_emerge_counter));
@@ -470,9 +754,9 @@ void EmergeThread::signal()
 }
 
 
-bool EmergeThread::pushBlock(v3s16 pos)
+bool EmergeThread::pushBlock(v3s16 pos, bool by_player, f32 priority)
 {
-	m_block_queue.push(pos);
+	m_block_queue.push({pos, porting::getTimeUs(), by_player, priority});
 	return true;
 }
 
@@ -481,17 +765,22 @@ void EmergeThread::cancelPendingItems()
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	while (!m_block_queue.empty()) {
-		BlockEmergeData bedata;
-		v3s16 pos;
+	if (m_active_chunk) {
+		m_emerge->releaseChunk(*m_active_chunk);
+		m_active_chunk.reset();
+	}
 
-		pos = m_block_queue.front();
-		m_block_queue.pop();
+	EmergeQueue::Item item;
+	while (m_block_queue.pop(item)) {
+		BlockEmergeData bedata;
+		v3s16 pos = item.pos;
 
+		m_emerge->releaseChunk(m_emerge->getChunkOf(pos));
 		m_emerge->popBlockEmergeData(pos, &bedata);
 
 		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
 	}
+	m_loaded_blocks.clear();
 }
 
 
@@ -516,20 +805,95 @@ bool EmergeThread::popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata)
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	if (m_block_queue.empty())
+	// The previous block is done
+	if (m_active_chunk) {
+		m_emerge->releaseChunk(*m_active_chunk);
+		m_active_chunk.reset();
+	}
+
+	// Blocks read from disk in advance may have been stolen or cancelled
+	if (m_blocks_removed) {
+		std::unordered_set<v3s16> queued;
+		for (const EmergeQueue::Item &item : m_block_queue.items())
+			queued.insert(item.pos);
+		for (auto it = m_loaded_blocks.begin(); it != m_loaded_blocks.end();) {
+			if (queued.count(it->first) == 0)
+				it = m_loaded_blocks.erase(it);
+			else
+				++it;
+		}
+		m_blocks_removed = false;
+	}
+
+	if (m_block_queue.empty() && !m_emerge->stealBlocks(this)) {
+		m_idle = true;
 		return false;
+	}
+	m_idle = false;
 
-	*pos = m_block_queue.front();
-	m_block_queue.pop();
+	EmergeQueue::Item item;
+	m_block_queue.pop(item);
+	*pos = item.pos;
+	m_emerge->m_queue_wait_counter->increment(porting::getTimeUs() - item.queued_at);
 
+	m_active_chunk = m_emerge->getChunkOf(*pos);
 	m_emerge->popBlockEmergeData(*pos, bedata);
 
 	return true;
 }
 
 
+void EmergeThread::loadBlocks(v3s16 pos)
+{
+	std::vector<v3s16> positions;
+	{
+		MutexAutoLock queuelock(m_emerge->m_queue_mutex);
+		// The blocks that will be popped next
+		m_block_queue.peek(m_emerge->m_load_batch_size - 1, positions);
+	}
+	auto it = std::remove_if(positions.begin(), positions.end(),
+		[this] (v3s16 p) { return m_loaded_blocks.count(p) > 0; });
+	positions.erase(it, positions.end());
+	positions.insert(positions.begin(), pos);
+
+	if (positions.size() > 1) {
+		// Only read what is not in memory yet
+		Server::EnvAutoLock envlock(m_server);
+		auto it = std::remove_if(positions.begin() + 1, positions.end(),
+			[this] (v3s16 p) {
+				return m_map->getBlockNoCreateNoEx(p) != nullptr ||
+					blockpos_over_max_limit(p);
+			});
+		positions.erase(it, positions.end());
+	}
+
+	// Anything written after this may be missing from what we read
+	u32 save_counter = m_map->getSaveCounter();
+	std::vector<std::string> blobs;
+	{
+		ScopeProfiler sp(g_profiler, "EmergeThread: load block - async (sum)");
+		auto &m_db = *m_emerge->m_db;
+		MutexAutoLock dblock(m_db.mutex);
+		m_db.loadBlocks(positions, blobs);
+	}
+	g_profiler->avg(m_name + ": blocks per load", positions.size());
+
+	std::vector<ServerMap::LoadedBlock> loaded(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		loaded[i].pos = positions[i];
+		loaded[i].blob = std::move(blobs[i]);
+		loaded[i].save_counter = save_counter;
+	}
+
+	m_map->decodeBlocks(loaded, m_emerge->m_worker_pool.get());
+
+	for (auto &it : loaded)
+		m_loaded_blocks[it.pos] = std::move(it);
+}
+
+
 EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 pos, bool allow_gen,
-	 const std::string *from_db, MapBlock **block, BlockMakeData *bmdata)
+	 ServerMap::LoadedBlock *from_db, MapBlock **block, BlockMakeData *bmdata)
 {
 	//TimeTaker tt("", nullptr, PRECISION_MICRO);
 	Server::EnvAutoLock envlock(m_server);
@@ -550,13 +914,14 @@ EmergeAction EmergeThread::getBlockOrStartGen(const v3s16 pos, bool allow_gen,
 			return EMERGE_FROM_MEMORY;
 		}
 	} else {
-		if (!from_db) {
-			// 2). We should attempt loading it
+		if (!from_db || from_db->save_counter != m_map->getSaveCounter()) {
+			// 2). We should attempt loading it (again, if the database
+			// changed since it was read)
 			return EMERGE_FROM_DISK;
 		}
 		// 2). Second invocation, we have the data
-		if (!from_db->empty()) {
-			*block = m_map->loadBlock(*from_db, pos);
+		if (!from_db->blob.empty()) {
+			*block = m_map->loadBlock(*from_db);
 			if (block_ok(*block))
 				return EMERGE_FROM_DISK;
 		}
@@ -665,7 +1030,6 @@ void *EmergeThread::run()
 
 	v3s16 pos;
 	std::map<v3s16, MapBlock*> modified_blocks;
-	std::string databuf;
 
 	m_map    = &m_server->m_env->getServerMap();
 	m_emerge = m_server->getEmergeManager();
@@ -687,6 +1051,7 @@ void *EmergeThread::run()
 		porting::TriggerMemoryTrim();
 
 		if (!popBlockEmerge(&pos, &bedata)) {
+			m_loaded_blocks.clear();
 			m_queue_event.wait();
 			continue;
 		}
@@ -703,15 +1068,21 @@ void *EmergeThread::run()
 
 		/* Try to load it */
 		if (action == EMERGE_FROM_DISK) {
-			auto &m_db = *m_emerge->m_db;
-			{
-				ScopeProfiler sp(g_profiler, "EmergeThread: load block - async (sum)");
-				MutexAutoLock dblock(m_db.mutex);
-				m_db.loadBlock(pos, databuf);
-			}
-			// actually load it, then decide again
-			action = getBlockOrStartGen(pos, allow_gen, &databuf, &block, &bmdata);
-			databuf.clear();
+			do {
+				auto it = m_loaded_blocks.find(pos);
+				if (it == m_loaded_blocks.end()) {
+					loadBlocks(pos);
+					it = m_loaded_blocks.find(pos);
+				}
+				ServerMap::LoadedBlock loaded = std::move(it->second);
+				m_loaded_blocks.erase(it);
+				// actually load it, then decide again
+				action = getBlockOrStartGen(pos, allow_gen, &loaded, &block, &bmdata);
+				// no block means what we read was outdated
+			} while (action == EMERGE_FROM_DISK && !block);
+		} else {
+			// Whatever was read from disk is outdated now
+			m_loaded_blocks.erase(pos);
 		}
 
 		/* Generate it */
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <deque>
 #include <map>
 #include <mutex>
 #include "network/networkprotocol.h"
@@ -30,6 +32,8 @@ class DecorationManager;
 class SchematicManager;
 class Server;
 class ModApiMapgen;
+class ThreadPool;
+class NoiseCache2D;
 struct MapDatabaseAccessor;
 
 // Structure containing inputs/outputs for chunk generation
@@ -81,6 +85,75 @@ struct BlockEmergeData {
 	EmergeCallbackList callbacks;
 };
 
+// What a player sees and where they go, for prioritizing emerges.
+// Everything is in blocks.
+struct EmergeViewer {
+	v3f pos;
+	v3f dir; // normalized look direction
+	v3f speed; // per second
+	f32 range; // blocks further away are not needed
+};
+
+/**
+ * Emerge priority of a block that was requested for players, lower values
+ * are emerged first. Blocks closer to where the viewers will be soon and
+ * blocks in front of them come first.
+ * @param in_range set to whether any viewer needs the block at all
+ */
+f32 getEmergePriority(const std::vector<EmergeViewer> &viewers, v3s16 blockpos,
+	bool *in_range);
+
+/*
+	Queue of blocks for one emerge thread. Blocks requested by players are
+	taken first, in order of priority. All others are taken in the order
+	they were queued.
+	Not thread-safe.
+*/
+class EmergeQueue {
+public:
+	struct Item {
+		v3s16 pos;
+		u64 queued_at; // microseconds
+		bool by_player;
+		f32 priority; // only if by_player
+	};
+
+	bool empty() const { return m_items.empty(); }
+	size_t size() const { return m_items.size(); }
+	const std::deque<Item> &items() const { return m_items; }
+
+	void push(const Item &item);
+	/// Takes the block that should be emerged next: The one with the best
+	/// priority of those queued for players, except for every few pops
+	/// where the oldest other one goes first.
+	/// @return false if the queue is empty
+	bool pop(Item &item);
+	/// Appends the positions of the next n items to be popped, in order.
+	void peek(size_t n, std::vector<v3s16> &positions) const;
+
+	/// Calls f(Item &) for every item, which may change its priority.
+	/// Items for which it returns true are removed.
+	template <typename F>
+	void removeIf(F f)
+	{
+		auto it = std::remove_if(m_items.begin(), m_items.end(),
+			[&] (Item &item) {
+				if (!f(item))
+					return false;
+				m_by_player -= item.by_player ? 1 : 0;
+				return true;
+			});
+		m_items.erase(it, m_items.end());
+	}
+
+private:
+	std::deque<Item> m_items;
+	// Number of items with by_player set
+	size_t m_by_player = 0;
+	// Items with by_player popped in a row while others were waiting
+	u32 m_player_streak = 0;
+};
+
 class EmergeParams {
 	friend class EmergeManager;
 public:
@@ -101,6 +174,8 @@ class EmergeParams {
 	DecorationManager *decomgr;
 	SchematicManager *schemmgr;
 
+	NoiseCache2D *noise_cache = nullptr; // shared, may be null
+
 	inline GenerateNotifier createNotifier() const {
 		return GenerateNotifier(gen_notify_on, gen_notify_on_deco_ids,
 			gen_notify_on_custom);
@@ -166,6 +241,7 @@ class EmergeManager {
 	void startThreads();
 	void stopThreads();
 	bool isRunning();
+	size_t getThreadCount() const { return m_threads.size(); }
 
 	bool enqueueBlockEmerge(
 		session_t peer_id,
@@ -183,6 +259,10 @@ class EmergeManager {
 	size_t getQueueSize();
 	bool isBlockInQueue(v3s16 pos);
 
+	/// Reprioritizes the blocks requested by players and cancels those
+	/// that no player needs anymore.
+	void updateViewers(std::vector<EmergeViewer> &&viewers);
+
 	Mapgen *getCurrentMapgen();
 
 	// Mapgen helpers methods
@@ -202,13 +282,33 @@ class EmergeManager {
 	std::mutex m_queue_mutex;
 	std::map<v3s16, BlockEmergeData> m_blocks_enqueued;
 	std::unordered_map<u16, u32> m_peer_queue_count;
+	std::vector<EmergeViewer> m_viewers;
 
 	u32 m_qlimit_total;
 	u32 m_qlimit_diskonly;
 	u32 m_qlimit_generate;
 
+	// Maximum number of blocks read from disk at once
+	u32 m_load_batch_size;
+	// Shared by the emerge threads for decoding blocks read from disk and
+	// placing ores
+	std::unique_ptr<ThreadPool> m_worker_pool;
+	// Shared by the mapgens of all emerge threads
+	std::unique_ptr<NoiseCache2D> m_noise_cache;
+
+	// Which thread handles the blocks of a mapchunk, so that a chunk is only
+	// ever generated by one thread
+	struct ChunkAssignment {
+		EmergeThread *thread;
+		// Number of blocks queued or being emerged
+		u32 refs;
+	};
+	std::unordered_map<v3s16, ChunkAssignment> m_chunk_threads;
+
 	// Emerge metrics
 	MetricCounterPtr m_completed_emerge_counter[5];
+	MetricCounterPtr m_queue_wait_counter;
+	MetricCounterPtr m_stolen_counter;
 
 	// Managers of various map generation-related components
 	// Note that each Mapgen gets a copy(!) of these to work with
@@ -218,8 +318,17 @@ class EmergeManager {
 	DecorationManager *decomgr;
 	SchematicManager *schemmgr;
 
+	v3s16 getChunkOf(v3s16 blockpos) const;
+
+	// Requires m_queue_mutex held
+	EmergeThread *getOptimalThread(v3s16 chunk);
+	// Requires m_queue_mutex held
+	void queueBlock(EmergeThread *thread, v3s16 pos, bool by_player);
+	// Requires m_queue_mutex held
+	void releaseChunk(v3s16 chunk);
+	// Moves the queued blocks of one mapchunk from the busiest thread to thief.
 	// Requires m_queue_mutex held
-	EmergeThread *getOptimalThread();
+	bool stealBlocks(EmergeThread *thief);
 
 	bool pushBlockEmergeData(
 		v3s16 pos,
@@ -10,8 +10,10 @@
 
 #include "emerge.h"
 
-#include <queue>
+#include <optional>
+#include <unordered_map>
 
+#include "servermap.h"
 #include "util/thread.h"
 #include "threading/event.h"
 
@@ -34,7 +36,7 @@ class EmergeThread : public Thread {
 	void signal();
 
 	// Requires queue mutex held
-	bool pushBlock(v3s16 pos);
+	bool pushBlock(v3s16 pos, bool by_player, f32 priority);
 
 	void cancelPendingItems();
 
@@ -58,25 +60,43 @@ class EmergeThread : public Thread {
 	UniqueQueue<v3s16> *m_trans_liquid; //< non-null only when generating a mapblock
 
 	Event m_queue_event;
-	std::queue<v3s16> m_block_queue;
+
+	// The following require the queue mutex held
+	EmergeQueue m_block_queue;
+	// Waiting for m_queue_event
+	bool m_idle = false;
+	// Mapchunk of the block currently being emerged
+	std::optional<v3s16> m_active_chunk;
+	// Another thread removed blocks from m_block_queue
+	bool m_blocks_removed = false;
+
+	// Blocks at the front of the queue that were already read from disk
+	std::unordered_map<v3s16, ServerMap::LoadedBlock> m_loaded_blocks;
 
 	bool initScripting();
 
 	bool popBlockEmerge(v3s16 *pos, BlockEmergeData *bedata);
 
+	/**
+	 * Reads the given block and the next few in the queue that are not in
+	 * memory from disk and decodes them, putting them into m_loaded_blocks.
+	 */
+	void loadBlocks(v3s16 pos);
+
 	/**
 	 * Try to get a block from memory and decide what to do.
 	 *
 	 * @param pos block position
-	 * @param from_db serialized block data, optional
-	 *                (for second call after EMERGE_FROM_DISK was returned)
+	 * @param from_db block read from disk, optional
+	 *                (for second call after EMERGE_FROM_DISK was returned,
+	 *                which is returned again if it is outdated)
 	 * @param allow_gen allow invoking mapgen?
 	 * @param block output pointer for block
 	 * @param data info for mapgen
 	 * @return what to do for this block
 	 */
 	EmergeAction getBlockOrStartGen(v3s16 pos, bool allow_gen,
-		const std::string *from_db,  MapBlock **block, BlockMakeData *data);
+		ServerMap::LoadedBlock *from_db, MapBlock **block, BlockMakeData *data);
 
 	MapBlock *finishGen(v3s16 pos, BlockMakeData *bmdata,
 		std::map<v3s16, MapBlock *> *modified_blocks);
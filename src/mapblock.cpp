@@ -312,12 +312,26 @@ static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
 }
 
 void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int compression_level)
+{
+	serializeImpl(os_compressed, version, disk, compression_level, true);
+}
+
+void MapBlock::serializeUncompressed(std::ostream &os, u8 version, bool disk)
+{
+	if (version < 29)
+		throw VersionMismatchException("ERROR: MapBlock format is always compressed");
+
+	serializeImpl(os, version, disk, 0, false);
+}
+
+void MapBlock::serializeImpl(std::ostream &os_compressed, u8 version, bool disk,
+	int compression_level, bool compress_result)
 {
 	if (!ser_ver_supported_write(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
 	std::ostringstream os_raw(std::ios_base::binary);
-	std::ostream &os = version >= 29 ? os_raw : os_compressed;
+	std::ostream &os = version >= 29 && compress_result ? os_raw : os_compressed;
 
 	// First byte
 	u8 flags = 0;
@@ -414,7 +428,7 @@ void MapBlock::serialize(std::ostream &os_compressed, u8 version, bool disk, int
 		}
 	}
 
-	if (version >= 29) {
+	if (version >= 29 && compress_result) {
 		// now compress the whole thing
 		compress(os_raw.str(), os_compressed, version, compression_level);
 	}
@@ -425,7 +439,8 @@ void MapBlock::serializeNetworkSpecific(std::ostream &os)
 	writeU8(os, 2); // version
 }
 
-void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
+void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk,
+		NameIdMapping *nimap_out)
 {
 	if (!ser_ver_supported_read(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
@@ -436,6 +451,8 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 
 	if(version <= 21)
 	{
+		if (nimap_out)
+			throw VersionMismatchException("ERROR: MapBlock format too old to decode separately");
 		deSerialize_pre22(in_compressed, version, disk);
 		return;
 	}
@@ -553,7 +570,8 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 		}
 
 		// Dynamically re-set ids based on node names
-		correctBlockNodeIds(&nimap, data, m_gamedef);
+		if (!nimap_out)
+			correctBlockNodeIds(&nimap, data, m_gamedef);
 
 		if(version >= 25){
 			TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
@@ -564,12 +582,20 @@ void MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 		u16 dummy;
 		m_is_air = nimap.size() == 1 && nimap.getId("air", dummy);
 		m_is_air_expired = false;
+
+		if (nimap_out)
+			*nimap_out = std::move(nimap);
 	}
 
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()
 			<<": Done."<<std::endl);
 }
 
+void MapBlock::correctNodeIds(const NameIdMapping &nimap)
+{
+	correctBlockNodeIds(&nimap, data, m_gamedef);
+}
+
 void MapBlock::deSerializeNetworkSpecific(std::istream &is)
 {
 	try {
@@ -21,6 +21,7 @@ class NodeMetadataList;
 class IGameDef;
 class MapBlockMesh;
 class VoxelManipulator;
+class NameIdMapping;
 
 #define BLOCK_TIMESTAMP_UNDEFINED 0xffffffff
 
@@ -50,6 +51,19 @@ enum ModReason : u32 {
 	MOD_REASON_UNKNOWN                    = 1 << 18,
 };
 
+// Modification reasons that only touch data which is never sent to clients
+constexpr u32 MOD_REASONS_DISK_ONLY =
+	MOD_REASON_SET_TIMESTAMP |
+	MOD_REASON_CLEAR_ALL_OBJECTS |
+	MOD_REASON_BLOCK_EXPIRED |
+	MOD_REASON_ADD_ACTIVE_OBJECT_RAW |
+	MOD_REASON_REMOVE_OBJECTS_REMOVE |
+	MOD_REASON_REMOVE_OBJECTS_DEACTIVATE |
+	MOD_REASON_TOO_MANY_OBJECTS |
+	MOD_REASON_STATIC_DATA_ADDED |
+	MOD_REASON_STATIC_DATA_REMOVED |
+	MOD_REASON_STATIC_DATA_CHANGED;
+
 ////
 //// MapBlock itself
 ////
@@ -100,6 +114,8 @@ class MapBlock
 		}
 		if (mod == MOD_STATE_WRITE_NEEDED)
 			contents.clear();
+		if (reason & ~MOD_REASONS_DISK_ONLY)
+			net_cache_valid = false;
 	}
 
 	inline u32 getModified()
@@ -414,9 +430,21 @@ class MapBlock
 	// Set disk to true for on-disk format, false for over-the-network format
 	// Precondition: version >= SER_FMT_VER_LOWEST_WRITE
 	void serialize(std::ostream &result, u8 version, bool disk, int compression_level);
+	// Same as serialize() but without the final compression step, which is
+	// the expensive part. Precondition: version >= 29
+	// compress() turns the result into what serialize() would have written.
+	void serializeUncompressed(std::ostream &result, u8 version, bool disk);
 	// If disk == true: In addition to doing other things, will add
 	// unknown blocks from id-name mapping to wndef
-	void deSerialize(std::istream &is, u8 version, bool disk);
+	// Unless nimap_out is given: Then the node definitions are not touched,
+	// the node ids are left as stored and the id-name mapping of the block
+	// is written to nimap_out. correctNodeIds() has to be called with it
+	// before the node data is usable. Legacy (pre-22) blocks are rejected.
+	void deSerialize(std::istream &is, u8 version, bool disk,
+		NameIdMapping *nimap_out = nullptr);
+	// Second half of deSerialize() with nimap_out, may add unknown nodes
+	// to the node definitions.
+	void correctNodeIds(const NameIdMapping &nimap);
 
 	void serializeNetworkSpecific(std::ostream &os);
 	void deSerializeNetworkSpecific(std::istream &is);
@@ -437,6 +465,9 @@ class MapBlock
 
 	void deSerialize_pre22(std::istream &is, u8 version, bool disk);
 
+	void serializeImpl(std::ostream &os_compressed, u8 version, bool disk,
+		int compression_level, bool compress_result);
+
 	/*
 	 * PLEASE NOTE: When adding something here be mindful of position and size
 	 * of member variables! This is also the reason for the weird public-private
@@ -493,6 +524,10 @@ class MapBlock
 	//// ABM optimizations ////
 	// True if we never want to cache content types for this block
 	bool do_not_cache_contents = false;
+	// Set by the server once a serialized copy of this block has been cached,
+	// cleared by any modification that changes what clients receive.
+	// See SerializedBlockCache.
+	bool net_cache_valid = false;
 	// Cache of content types
 	// This is actually a set but for the small sizes we have a vector should be
 	// more efficient.
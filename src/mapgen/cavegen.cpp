@@ -6,6 +6,7 @@
 
 #include "util/numeric.h"
 #include <cmath>
+#include <vector>
 #include "map.h"
 #include "mapgen.h"
 #include "mapgen_v5.h"
@@ -64,11 +65,40 @@ void CavesNoiseIntersection::generateCaves(MMVManip *vm,
 	noise_cave1->perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
 	noise_cave2->perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
 
+	// Find the tunnels first, row by row along X. These loops have no
+	// branches, so that the compiler can vectorize them.
+	const u32 ysize = m_csize.Y + 1;
+	std::vector<u8> in_tunnel(m_csize.X * ysize * m_csize.Z);
+	// Lowest noise row of a tunnel in each column, -1 if there is none
+	std::vector<s16> lowest_tunnel(m_csize.X * m_csize.Z, -1);
+	for (s16 z = 0; z < m_csize.Z; z++)
+	for (s16 y = ysize - 1; y >= 0; y--) {
+		const u32 row = z * m_zstride_1d + y * m_ystride;
+		const float *n1 = &noise_cave1->result[row];
+		const float *n2 = &noise_cave2->result[row];
+		u8 *tunnel = &in_tunnel[row];
+		s16 *lowest = &lowest_tunnel[z * m_csize.X];
+		for (s16 x = 0; x < m_csize.X; x++) {
+			// Same as contour()
+			float d1 = 1.0f - std::fabs(n1[x]);
+			float d2 = 1.0f - std::fabs(n2[x]);
+			d1 = d1 > 0.0f ? d1 : 0.0f;
+			d2 = d2 > 0.0f ? d2 : 0.0f;
+			tunnel[x] = d1 * d2 > m_cave_width;
+			lowest[x] = tunnel[x] ? y : lowest[x];
+		}
+	}
+
 	const v3s32 &em = vm->m_area.getExtent();
 	u32 index2d = 0;  // Biomemap index
 
 	for (s16 z = nmin.Z; z <= nmax.Z; z++)
 	for (s16 x = nmin.X; x <= nmax.X; x++, index2d++) {
+		// Nothing is changed in columns without tunnels
+		const s16 lowest = lowest_tunnel[index2d];
+		if (lowest < 0)
+			continue;
+
 		bool column_is_open = false;  // Is column open to overground
 		bool is_under_river = false;  // Is column under river water
 		bool is_under_tunnel = false;  // Is tunnel or is under tunnel
@@ -93,6 +123,10 @@ void CavesNoiseIntersection::generateCaves(MMVManip *vm,
 		for (s16 y = nmax.Y; y >= nmin.Y - 1; y--,
 				index3d -= m_ystride,
 				VoxelArea::add_y(em, vi, -1)) {
+			// Nothing more to change below the tunnels and their floors
+			if (y - (nmin.Y - 1) < lowest && !is_under_tunnel)
+				break;
+
 			// We need this check to make sure that biomes don't generate too far down
 			if (y <= biome_y_next) {
 				biome = m_bmgn->getBiomeAtIndex(index2d, v3s16(x, y, z));
@@ -121,10 +155,7 @@ void CavesNoiseIntersection::generateCaves(MMVManip *vm,
 			}
 
 			// Ground
-			float d1 = contour(noise_cave1->result[index3d]);
-			float d2 = contour(noise_cave2->result[index3d]);
-
-			if (d1 * d2 > m_cave_width && m_ndef->get(c).is_ground_content) {
+			if (in_tunnel[index3d] && m_ndef->get(c).is_ground_content) {
 				// In tunnel and ground content, excavate
 				vm->m_data[vi] = MapNode(CONTENT_AIR);
 				is_under_tunnel = true;
@@ -220,52 +251,44 @@ bool CavernsNoise::generateCaverns(MMVManip *vm, v3s16 nmin, v3s16 nmax)
 	// Calculate noise
 	noise_cavern->perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
 
-	// Cache cavern_amp values
-	float *cavern_amp = new float[m_csize.Y + 1];
-	u8 cavern_amp_index = 0;  // Index zero at column top
-	for (s16 y = nmax.Y; y >= nmin.Y - 1; y--, cavern_amp_index++) {
-		cavern_amp[cavern_amp_index] =
-			MYMIN((m_cavern_limit - y) / (float)m_cavern_taper, 1.0f);
-	}
-
 	//// Place nodes
-	bool near_cavern = false;
-	const v3s32 &em = vm->m_area.getExtent();
-	u32 index2d = 0;
-
+	// Rows along X are contiguous both in the noise and the voxelmanip.
+	// The threshold tests have no branches, so that the compiler can
+	// vectorize them, only the nodes to excavate are looked at one by one.
+	const float near_threshold = m_cavern_threshold - 0.1f;
+	std::vector<u8> in_cavern(m_csize.X);
+	u8 near_cavern = 0;
+
+	// Don't excavate the overgenerated stone at node_max.Y + 1,
+	// this creates a 'roof' over the cavern, preventing light in
+	// caverns at mapchunk borders when generating mapchunks upwards.
+	// This 'roof' is excavated when the mapchunk above is generated.
 	for (s16 z = nmin.Z; z <= nmax.Z; z++)
-	for (s16 x = nmin.X; x <= nmax.X; x++, index2d++) {
-		// Reset cave_amp index to column top
-		cavern_amp_index = 0;
-		// Initial voxelmanip index at column top
-		u32 vi = vm->m_area.index(x, nmax.Y, z);
-		// Initial 3D noise index at column top
-		u32 index3d = (z - nmin.Z) * m_zstride_1d + m_csize.Y * m_ystride +
-			(x - nmin.X);
-		// Don't excavate the overgenerated stone at node_max.Y + 1,
-		// this creates a 'roof' over the cavern, preventing light in
-		// caverns at mapchunk borders when generating mapchunks upwards.
-		// This 'roof' is excavated when the mapchunk above is generated.
-		for (s16 y = nmax.Y; y >= nmin.Y - 1; y--,
-				index3d -= m_ystride,
-				VoxelArea::add_y(em, vi, -1),
-				cavern_amp_index++) {
-			content_t c = vm->m_data[vi].getContent();
-			float n_absamp_cavern = std::fabs(noise_cavern->result[index3d]) *
-				cavern_amp[cavern_amp_index];
+	for (s16 y = nmin.Y - 1; y <= nmax.Y; y++) {
+		const float cavern_amp = MYMIN((m_cavern_limit - y) / (float)m_cavern_taper, 1.0f);
+		const float *noise = &noise_cavern->result[(z - nmin.Z) * m_zstride_1d +
+			(y - nmin.Y + 1) * m_ystride];
+
+		u8 any_in_cavern = 0;
+		for (s16 x = 0; x < m_csize.X; x++) {
+			float n_absamp_cavern = std::fabs(noise[x]) * cavern_amp;
 			// Disable CavesRandomWalk at a safe distance from caverns
 			// to avoid excessively spreading liquids in caverns.
-			if (n_absamp_cavern > m_cavern_threshold - 0.1f) {
-				near_cavern = true;
-				if (n_absamp_cavern > m_cavern_threshold &&
-						m_ndef->get(c).is_ground_content)
-					vm->m_data[vi] = MapNode(CONTENT_AIR);
-			}
+			near_cavern |= n_absamp_cavern > near_threshold;
+			in_cavern[x] = n_absamp_cavern > m_cavern_threshold;
+			any_in_cavern |= in_cavern[x];
+		}
+		if (!any_in_cavern)
+			continue;
+
+		const u32 vi = vm->m_area.index(nmin.X, y, z);
+		for (s16 x = 0; x < m_csize.X; x++) {
+			if (in_cavern[x] &&
+					m_ndef->get(vm->m_data[vi + x]).is_ground_content)
+				vm->m_data[vi + x] = MapNode(CONTENT_AIR);
 		}
 	}
 
-	delete[] cavern_amp;
-
 	return near_cavern;
 }
 
@@ -548,6 +571,39 @@ void CavesRandomWalk::carveRoute(v3f vec, float f, bool randomize_xz)
 
 	bool flat_cave_floor = !large_cave && ps->range(0, 2) == 2;
 
+	// Node to place in the cave: 'lower' at and below 'split_y', 'upper' above
+	MapNode upper = airnode;
+	MapNode lower = airnode;
+	s32 split_y = S32_MIN;
+	if (large_cave && flooded) {
+		int full_ymin = node_min.Y - MAP_BLOCKSIZE;
+		int full_ymax = node_max.Y + MAP_BLOCKSIZE;
+
+		if (full_ymin < water_level && full_ymax > water_level) {
+			lower = waternode;
+			split_y = water_level;
+		} else if (full_ymax < water_level) {
+			lower = liquidnode;
+			split_y = startp.Y - 5;
+		}
+	}
+
+	// Vertical extent of the tunnel, before rounding its cross section
+	s16 y_min = S16_MIN;
+	s16 y_max = S16_MAX;
+	// Make better floors in small caves
+	if (flat_cave_floor && rs <= 7)
+		y_min = -rs / 2 + 1;
+	// Make large caves not so tall
+	if (large_cave_is_flat && rs > 7) {
+		y_min = MYMAX(y_min, -(rs / 3) + 1);
+		y_max = rs / 3 - 1;
+	}
+
+	const VoxelArea &area = vm->m_area;
+	const v3s32 &em = area.getExtent();
+	const v3s16 center = cp + of;
+
 	for (s16 z0 = d0; z0 <= d1; z0++) {
 		s16 si = rs / 2 - MYMAX(0, abs(z0) - rs / 7 - 1);
 		for (s16 x0 = -si - ps->range(0,1); x0 <= si - 1 + ps->range(0,1); x0++) {
@@ -555,38 +611,25 @@ void CavesRandomWalk::carveRoute(v3f vec, float f, bool randomize_xz)
 
 			s16 si2 = rs / 2 - MYMAX(0, maxabsxz - rs / 7 - 1);
 
-			for (s16 y0 = -si2; y0 <= si2; y0++) {
-				// Make better floors in small caves
-				if (flat_cave_floor && y0 <= -rs / 2 && rs <= 7)
-					continue;
-
-				if (large_cave_is_flat) {
-					// Make large caves not so tall
-					if (rs > 7 && abs(y0) >= rs / 3)
-						continue;
-				}
-
-				v3s16 p(cp.X + x0, cp.Y + y0, cp.Z + z0);
-				p += of;
+			// Carve the column from bottom to top, clipped to the voxelmanip
+			s16 px = center.X + x0;
+			s16 pz = center.Z + z0;
+			if (px < area.MinEdge.X || px > area.MaxEdge.X ||
+					pz < area.MinEdge.Z || pz > area.MaxEdge.Z)
+				continue;
 
-				if (!vm->m_area.contains(p))
-					continue;
+			s32 py_min = MYMAX(center.Y + MYMAX(-si2, y_min), area.MinEdge.Y);
+			s32 py_max = MYMIN(center.Y + MYMIN(si2, y_max), area.MaxEdge.Y);
+			if (py_min > py_max)
+				continue;
 
-				u32 i = vm->m_area.index(p);
-				content_t c = vm->m_data[i].getContent();
-				if (!ndef->get(c).is_ground_content)
+			u32 i = area.index(px, py_min, pz);
+			for (s32 py = py_min; py <= py_max; py++, VoxelArea::add_y(em, i, 1)) {
+				if (!ndef->get(vm->m_data[i]).is_ground_content)
 					continue;
 
 				if (large_cave) {
-					int full_ymin = node_min.Y - MAP_BLOCKSIZE;
-					int full_ymax = node_max.Y + MAP_BLOCKSIZE;
-
-					if (flooded && full_ymin < water_level && full_ymax > water_level)
-						vm->m_data[i] = (p.Y <= water_level) ? waternode : airnode;
-					else if (flooded && full_ymax < water_level)
-						vm->m_data[i] = (p.Y < startp.Y - 4) ? liquidnode : airnode;
-					else
-						vm->m_data[i] = airnode;
+					vm->m_data[i] = py <= split_y ? lower : upper;
 				} else {
 					vm->m_data[i] = airnode;
 					vm->m_flags[i] |= VMANIP_FLAG_CAVE;
@@ -159,6 +159,9 @@ class CavesRandomWalk
 			bool is_large_cave, int max_stone_height, s16 *heightmap);
 
 private:
+	// Compares carveRoute() to the original algorithm
+	friend class TestMapgen;
+
 	void makeTunnel(bool dirswitch);
 	void carveRoute(v3f vec, float f, bool randomize_xz);
 
@@ -10,6 +10,7 @@
 #include "noise.h"
 #include "gamedef.h"
 #include "mg_biome.h"
+#include "noise_cache.h"
 #include "mapblock.h"
 #include "mapnode.h"
 #include "map.h"
@@ -623,6 +624,16 @@ MapgenBasic::~MapgenBasic()
 }
 
 
+float *MapgenBasic::calcNoise2D(Noise *noise, float *persistence_map)
+{
+	if (m_emerge->noise_cache) {
+		return m_emerge->noise_cache->perlinMap2D(noise, node_min.X, node_min.Z,
+			persistence_map);
+	}
+	return noise->perlinMap2D(node_min.X, node_min.Z, persistence_map);
+}
+
+
 void MapgenBasic::generateBiomes()
 {
 	// can't generate biomes without a biome generator!
@@ -632,7 +643,7 @@ void MapgenBasic::generateBiomes()
 	const v3s32 &em = vm->m_area.getExtent();
 	u32 index = 0;
 
-	noise_filler_depth->perlinMap2D(node_min.X, node_min.Z);
+	calcNoise2D(noise_filler_depth);
 
 	for (s16 z = node_min.Z; z <= node_max.Z; z++)
 	for (s16 x = node_min.X; x <= node_max.X; x++, index++) {
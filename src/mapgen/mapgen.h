@@ -291,6 +291,10 @@ class MapgenBasic : public Mapgen {
 	virtual void generateDungeons(s16 max_stone_y);
 
 protected:
+	// noise->perlinMap2D() at node_min, shared with the other mapchunks
+	// in this column if possible
+	float *calcNoise2D(Noise *noise, float *persistence_map = nullptr);
+
 	BiomeManager *m_bmgr;
 
 	Noise *noise_filler_depth;
@@ -429,20 +429,20 @@ int MapgenCarpathian::generateTerrain()
 	MapNode mn_water(c_water_source);
 
 	// Calculate noise for terrain generation
-	noise_height1->perlinMap2D(node_min.X, node_min.Z);
-	noise_height2->perlinMap2D(node_min.X, node_min.Z);
-	noise_height3->perlinMap2D(node_min.X, node_min.Z);
-	noise_height4->perlinMap2D(node_min.X, node_min.Z);
-	noise_hills_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_ridge_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_step_terrain->perlinMap2D(node_min.X, node_min.Z);
-	noise_hills->perlinMap2D(node_min.X, node_min.Z);
-	noise_ridge_mnt->perlinMap2D(node_min.X, node_min.Z);
-	noise_step_mnt->perlinMap2D(node_min.X, node_min.Z);
+	calcNoise2D(noise_height1);
+	calcNoise2D(noise_height2);
+	calcNoise2D(noise_height3);
+	calcNoise2D(noise_height4);
+	calcNoise2D(noise_hills_terrain);
+	calcNoise2D(noise_ridge_terrain);
+	calcNoise2D(noise_step_terrain);
+	calcNoise2D(noise_hills);
+	calcNoise2D(noise_ridge_mnt);
+	calcNoise2D(noise_step_mnt);
 	noise_mnt_var->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
 
 	if (spflags & MGCARPATHIAN_RIVERS)
-		noise_rivers->perlinMap2D(node_min.X, node_min.Z);
+		calcNoise2D(noise_rivers);
 
 	//// Place nodes
 	const v3s32 &em = vm->m_area.getExtent();
@@ -472,15 +472,15 @@ int MapgenV7::generateTerrain()
 	MapNode n_water(c_water_source);
 
 	//// Calculate noise for terrain generation
-	noise_terrain_persist->perlinMap2D(node_min.X, node_min.Z);
+	calcNoise2D(noise_terrain_persist);
 	float *persistmap = noise_terrain_persist->result;
 
-	noise_terrain_base->perlinMap2D(node_min.X, node_min.Z, persistmap);
-	noise_terrain_alt->perlinMap2D(node_min.X, node_min.Z, persistmap);
-	noise_height_select->perlinMap2D(node_min.X, node_min.Z);
+	calcNoise2D(noise_terrain_base, persistmap);
+	calcNoise2D(noise_terrain_alt, persistmap);
+	calcNoise2D(noise_height_select);
 
 	if (spflags & MGV7_MOUNTAINS) {
-		noise_mount_height->perlinMap2D(node_min.X, node_min.Z);
+		calcNoise2D(noise_mount_height);
 		noise_mountain->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
 	}
 
@@ -519,7 +519,7 @@ int MapgenV7::generateTerrain()
 		!gen_floatlands;
 	if (gen_rivers) {
 		noise_ridge->perlinMap3D(node_min.X, node_min.Y - 1, node_min.Z);
-		noise_ridge_uwater->perlinMap2D(node_min.X, node_min.Z);
+		calcNoise2D(noise_ridge_uwater);
 	}
 
 	//// Place nodes
@@ -5,6 +5,7 @@
 
 #include "mg_biome.h"
 #include "mg_decoration.h"
+#include "noise_cache.h"
 #include "emerge.h"
 #include "server.h"
 #include "nodedef.h"
@@ -185,10 +186,17 @@ void BiomeGenOriginal::calcBiomeNoise(v3s16 pmin)
 {
 	m_pmin = pmin;
 
-	noise_heat->perlinMap2D(pmin.X, pmin.Z);
-	noise_humidity->perlinMap2D(pmin.X, pmin.Z);
-	noise_heat_blend->perlinMap2D(pmin.X, pmin.Z);
-	noise_humidity_blend->perlinMap2D(pmin.X, pmin.Z);
+	if (noise_cache) {
+		noise_cache->perlinMap2D(noise_heat, pmin.X, pmin.Z);
+		noise_cache->perlinMap2D(noise_humidity, pmin.X, pmin.Z);
+		noise_cache->perlinMap2D(noise_heat_blend, pmin.X, pmin.Z);
+		noise_cache->perlinMap2D(noise_humidity_blend, pmin.X, pmin.Z);
+	} else {
+		noise_heat->perlinMap2D(pmin.X, pmin.Z);
+		noise_humidity->perlinMap2D(pmin.X, pmin.Z);
+		noise_heat_blend->perlinMap2D(pmin.X, pmin.Z);
+		noise_humidity_blend->perlinMap2D(pmin.X, pmin.Z);
+	}
 
 	for (s32 i = 0; i < m_csize.X * m_csize.Z; i++) {
 		noise_heat->result[i]     += noise_heat_blend->result[i];
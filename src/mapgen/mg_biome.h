@@ -12,6 +12,7 @@
 class Server;
 class Settings;
 class BiomeManager;
+class NoiseCache2D;
 
 ////
 //// Biome
@@ -129,6 +130,9 @@ class BiomeGen {
 	// Result of calcBiomes bulk computation.
 	biome_t *biomemap = nullptr;
 
+	// Shared with other biome generators, may be null
+	NoiseCache2D *noise_cache = nullptr;
+
 protected:
 	BiomeManager *m_bmgr = nullptr;
 	v3s16 m_pmin;
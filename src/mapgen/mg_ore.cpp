@@ -8,6 +8,7 @@
 #include "noise.h"
 #include "map.h"
 #include "log.h"
+#include "threading/thread_pool.h"
 #include "util/numeric.h"
 #include <cmath>
 #include <algorithm>
@@ -34,13 +35,63 @@ size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nma
 {
 	size_t nplaced = 0;
 
+	if (!m_pool || m_pool->getThreadCount() == 0) {
+		for (size_t i = 0; i != m_objects.size(); i++) {
+			Ore *ore = (Ore *)m_objects[i];
+			if (!ore)
+				continue;
+
+			nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+			blockseed++;
+		}
+
+		return nplaced;
+	}
+
+	/*
+		Most ores only look at the map to check c_wherein right before placing
+		a node. Those find their nodes in parallel first, then everything is
+		placed in order. That gives exactly the same result as placing them
+		one after the other.
+	*/
+	std::unordered_set<content_t> ore_nodes;
+	for (ObjDef *object : m_objects) {
+		if (object)
+			ore_nodes.insert(((Ore *)object)->c_ore);
+	}
+
+	std::vector<u32> seeds(m_objects.size());
+	std::vector<size_t> deferred;
+	for (size_t i = 0; i != m_objects.size(); i++) {
+		Ore *ore = (Ore *)m_objects[i];
+		if (!ore)
+			continue;
+
+		seeds[i] = blockseed++;
+		if (!ore->dependsOnOres(ore_nodes))
+			deferred.push_back(i);
+	}
+
+	std::vector<u8> generated(m_objects.size());
+	m_pool->parallelFor(deferred.size(), [&] (size_t k) {
+		const size_t i = deferred[k];
+		Ore *ore = (Ore *)m_objects[i];
+		generated[i] = ore->placeOre(mg, seeds[i], nmin, nmax, true);
+	});
+
+	auto next_deferred = deferred.begin();
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Ore *ore = (Ore *)m_objects[i];
 		if (!ore)
 			continue;
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
-		blockseed++;
+		if (next_deferred != deferred.end() && *next_deferred == i) {
+			ore->placeDeferred(mg->vm);
+			nplaced += generated[i];
+			++next_deferred;
+		} else {
+			nplaced += ore->placeOre(mg, seeds[i], nmin, nmax);
+		}
 	}
 
 	return nplaced;
@@ -81,8 +132,11 @@ void Ore::resolveNodeNames()
 }
 
 
-size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
+size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+	bool defer)
 {
+	m_deferred_nodes.clear();
+
 	if (nmin.Y > y_max || nmax.Y < y_min)
 		return 0;
 
@@ -93,12 +147,36 @@ size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax)
 
 	nmin.Y = actual_ymin;
 	nmax.Y = actual_ymax;
+	m_defer = defer;
 	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
+	m_defer = false;
 
 	return 1;
 }
 
 
+void Ore::placeDeferred(MMVManip *vm)
+{
+	MapNode n_ore(c_ore, 0, ore_param2);
+	for (u32 i : m_deferred_nodes) {
+		if (CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			vm->m_data[i] = n_ore;
+	}
+	m_deferred_nodes.clear();
+}
+
+
+inline void Ore::placeNode(MMVManip *vm, u32 i, MapNode n_ore)
+{
+	if (m_defer) {
+		m_deferred_nodes.push_back(i);
+		return;
+	}
+	if (CONTAINS(c_wherein, vm->m_data[i].getContent()))
+		vm->m_data[i] = n_ore;
+}
+
+
 void Ore::cloneTo(Ore *def) const
 {
 	ObjDef::cloneTo(def);
@@ -167,10 +245,7 @@ void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
 				continue;
 
 			u32 i = vm->m_area.index(x0 + x1, y0 + y1, z0 + z1);
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-				continue;
-
-			vm->m_data[i] = n_ore;
+			placeNode(vm, i, n_ore);
 		}
 	}
 }
@@ -236,10 +311,7 @@ void OreSheet::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-				continue;
-
-			vm->m_data[i] = n_ore;
+			placeNode(vm, i, n_ore);
 		}
 	}
 }
@@ -330,10 +402,7 @@ void OrePuff::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-				continue;
-
-			vm->m_data[i] = n_ore;
+			placeNode(vm, i, n_ore);
 		}
 	}
 }
@@ -407,12 +476,24 @@ void OreBlob::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			if (noiseval < nthresh)
 				continue;
 
-			vm->m_data[i] = n_ore;
+			placeNode(vm, i, n_ore);
 		}
 	}
 }
 
 
+bool OreBlob::dependsOnOres(const std::unordered_set<content_t> &ore_nodes) const
+{
+	// Blobs skip nodes not in c_wherein. Deferred, they see the map before
+	// any ore was placed, which only works if no ore turns into c_wherein.
+	for (content_t c : c_wherein) {
+		if (ore_nodes.count(c))
+			return true;
+	}
+	return false;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 
 
@@ -576,10 +657,7 @@ void OreStratum::generate(MMVManip *vm, int mapseed, u32 blockseed,
 			u32 i = vm->m_area.index(x, y, z);
 			if (!vm->m_area.contains(i))
 				continue;
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-				continue;
-
-			vm->m_data[i] = n_ore;
+			placeNode(vm, i, n_ore);
 		}
 	}
 }
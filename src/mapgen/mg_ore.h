@@ -15,6 +15,7 @@ typedef u16 biome_t;  // copy from mg_biome.h to avoid an unnecessary include
 class Noise;
 class Mapgen;
 class MMVManip;
+class ThreadPool;
 
 /////////////////// Ore generation flags
 
@@ -58,12 +59,33 @@ class Ore : public ObjDef, public NodeResolver {
 
 	virtual void resolveNodeNames();
 
-	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
+	/// @param defer only find the nodes to place the ore in, without changing
+	///        the map. placeDeferred() does that later.
+	size_t placeOre(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax,
+		bool defer = false);
+	/// Places the ore nodes found by a deferred placeOre().
+	void placeDeferred(MMVManip *vm);
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
 		v3s16 nmin, v3s16 nmax, biome_t *biomemap) = 0;
 
+	/// Whether the nodes generate() picks depend on where other ores were
+	/// placed before, beyond the c_wherein check of each node. Such ores can
+	/// not be deferred.
+	/// @param ore_nodes c_ore of all ores
+	virtual bool dependsOnOres(const std::unordered_set<content_t> &ore_nodes) const
+	{
+		return false;
+	}
+
 protected:
 	void cloneTo(Ore *def) const;
+
+	// Places the ore at vm index i if the node there is one of c_wherein
+	inline void placeNode(MMVManip *vm, u32 i, MapNode n_ore);
+
+private:
+	bool m_defer = false;
+	std::vector<u32> m_deferred_nodes;
 };
 
 class OreScatter : public Ore {
@@ -113,6 +135,7 @@ class OreBlob : public Ore {
 	OreBlob() : Ore(true) {}
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3s16 nmin, v3s16 nmax, biome_t *biomemap) override;
+	bool dependsOnOres(const std::unordered_set<content_t> &ore_nodes) const override;
 };
 
 class OreVein : public Ore {
@@ -128,6 +151,11 @@ class OreVein : public Ore {
 
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3s16 nmin, v3s16 nmax, biome_t *biomemap) override;
+	// Its random numbers depend on the nodes found
+	bool dependsOnOres(const std::unordered_set<content_t> &ore_nodes) const override
+	{
+		return true;
+	}
 };
 
 class OreStratum : public Ore {
@@ -178,8 +206,13 @@ class OreManager : public ObjDefManager {
 
 	void clear();
 
+	/// Ores are generated in parallel on this pool, if set
+	void setThreadPool(ThreadPool *pool) { m_pool = pool; }
+
 	size_t placeAllOres(Mapgen *mg, u32 blockseed, v3s16 nmin, v3s16 nmax);
 
 private:
 	OreManager() {};
+
+	ThreadPool *m_pool = nullptr;
 };
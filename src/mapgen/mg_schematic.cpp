@@ -105,13 +105,16 @@ void Schematic::resolveNodeNames()
 		// Unfold condensed ID layout to content_t
 		schemdata[i].setContent(c_nodes[c_original]);
 	}
+
+	invalidateCompiled();
 }
 
 
-void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+const CompiledSchematic &Schematic::getCompiled(Rotation rot)
 {
-	assert(schemdata && slice_probs);
-	sanity_check(m_ndef != NULL);
+	assert(rot >= ROTATE_0 && rot <= ROTATE_270);
+	if (m_compiled[rot])
+		return *m_compiled[rot];
 
 	int xstride = 1;
 	int ystride = size.X;
@@ -146,44 +149,115 @@ void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_pla
 			i_step_z = zstride;
 	}
 
+	auto cs = std::make_unique<CompiledSchematic>();
+	cs->size = v3s16(sx, sy, sz);
+	cs->rows.reserve(sy * sz + 1);
+
+	for (s16 y = 0; y != sy; y++)
+	for (s16 z = 0; z != sz; z++) {
+		cs->rows.push_back(cs->runs.size());
+		CompiledSchematic::Run *run = nullptr;
+
+		u32 i = z * i_step_z + y * ystride + i_start;
+		for (s16 x = 0; x != sx; x++, i += i_step_x) {
+			u8 param1 = schemdata[i].param1;
+			if (schemdata[i].getContent() == CONTENT_IGNORE ||
+					(param1 & MTSCHEM_PROB_MASK) == MTSCHEM_PROB_NEVER) {
+				run = nullptr;
+				continue;
+			}
+
+			if (!run) {
+				cs->runs.push_back({(u16)x, 0, (u32)cs->nodes.size(), true, true});
+				run = &cs->runs.back();
+			}
+			run->len++;
+			run->always &= (param1 & MTSCHEM_PROB_MASK) == MTSCHEM_PROB_ALWAYS;
+			run->force &= (param1 & MTSCHEM_FORCE_PLACE) != 0;
+
+			MapNode n = schemdata[i];
+			n.param1 = 0;
+			if (rot)
+				n.rotateAlongYAxis(m_ndef, rot);
+			cs->nodes.push_back(n);
+			cs->params.push_back(param1);
+		}
+	}
+	cs->rows.push_back(cs->runs.size());
+
+	m_compiled[rot] = std::move(cs);
+	return *m_compiled[rot];
+}
+
+
+void Schematic::invalidateCompiled()
+{
+	for (auto &cs : m_compiled)
+		cs.reset();
+}
+
+
+void Schematic::blitToVManip(MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+{
+	assert(schemdata && slice_probs);
+	sanity_check(m_ndef != NULL);
+
+	const CompiledSchematic &cs = getCompiled(rot);
+	const VoxelArea &area = vm->m_area;
+
 	s16 y_map = p.Y;
-	for (s16 y = 0; y != sy; y++) {
+	for (s16 y = 0; y != cs.size.Y; y++) {
 		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
 			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
 			continue;
 
-		for (s16 z = 0; z != sz; z++) {
-			u32 i = z * i_step_z + y * ystride + i_start;
-			for (s16 x = 0; x != sx; x++, i += i_step_x) {
-				v3s16 pos(p.X + x, y_map, p.Z + z);
-				if (!vm->m_area.contains(pos))
-					continue;
+		if (y_map < area.MinEdge.Y || y_map > area.MaxEdge.Y) {
+			y_map++;
+			continue;
+		}
 
-				if (schemdata[i].getContent() == CONTENT_IGNORE)
-					continue;
+		for (s16 z = 0; z != cs.size.Z; z++) {
+			s16 z_map = p.Z + z;
+			if (z_map < area.MinEdge.Z || z_map > area.MaxEdge.Z)
+				continue;
 
-				u8 placement_prob     = schemdata[i].param1 & MTSCHEM_PROB_MASK;
-				bool force_place_node = schemdata[i].param1 & MTSCHEM_FORCE_PLACE;
+			u32 row = y * cs.size.Z + z;
+			for (u32 r = cs.rows[row]; r != cs.rows[row + 1]; r++) {
+				const CompiledSchematic::Run &run = cs.runs[r];
 
-				if (placement_prob == MTSCHEM_PROB_NEVER)
+				// Clip the run to the voxel manipulator
+				s32 x_map = p.X + run.x;
+				s32 begin = MYMAX(0, area.MinEdge.X - x_map);
+				s32 end = MYMIN((s32)run.len, area.MaxEdge.X - x_map + 1);
+				if (begin >= end)
 					continue;
 
-				u32 vi = vm->m_area.index(pos);
-				if (!force_place && !force_place_node) {
-					content_t c = vm->m_data[vi].getContent();
-					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
-						continue;
-				}
+				u32 vi = area.index(x_map + begin, y_map, z_map);
+				const MapNode *nodes = &cs.nodes[run.i];
+				const u8 *params = &cs.params[run.i];
 
-				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
-					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+				if (run.always && (force_place || run.force)) {
+					memcpy(&vm->m_data[vi], &nodes[begin],
+						(end - begin) * sizeof(MapNode));
 					continue;
+				}
+
+				for (s32 k = begin; k != end; k++, vi++) {
+					u8 placement_prob     = params[k] & MTSCHEM_PROB_MASK;
+					bool force_place_node = params[k] & MTSCHEM_FORCE_PLACE;
 
-				vm->m_data[vi] = schemdata[i];
-				vm->m_data[vi].param1 = 0;
+					if (!force_place && !force_place_node) {
+						content_t c = vm->m_data[vi].getContent();
+						if (c != CONTENT_AIR && c != CONTENT_IGNORE)
+							continue;
+					}
 
-				if (rot)
-					vm->m_data[vi].rotateAlongYAxis(m_ndef, rot);
+					if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
+						(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+						continue;
+
+					vm->m_data[vi] = nodes[k];
+				}
 			}
 		}
 		y_map++;
@@ -323,6 +397,7 @@ bool Schematic::deserializeFromMts(std::istream *is)
 
 	delete []schemdata;
 	schemdata = new MapNode[nodecount];
+	invalidateCompiled();
 
 	std::stringstream d_ss(std::ios_base::binary | std::ios_base::in | std::ios_base::out);
 	decompress(ss, d_ss, MTSCHEM_MAPNODE_SER_FMT_VER);
@@ -545,6 +620,7 @@ bool Schematic::getSchematicFromMap(Map *map, v3s16 p1, v3s16 p2)
 		slice_probs[y] = MTSCHEM_PROB_ALWAYS;
 
 	schemdata = new MapNode[size.X * size.Y * size.Z];
+	invalidateCompiled();
 
 	u32 i = 0;
 	for (s16 z = p1.Z; z <= p2.Z; z++)
@@ -587,6 +663,8 @@ void Schematic::applyProbabilities(v3s16 p0,
 		if (slice < size.Y)
 			slice_probs[slice] = (*splist)[i].second;
 	}
+
+	invalidateCompiled();
 }
 
 
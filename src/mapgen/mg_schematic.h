@@ -6,6 +6,8 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <vector>
 #include "mg_decoration.h"
 #include "util/string.h"
 
@@ -76,6 +78,31 @@ enum SchematicFormatType {
 	SCHEM_FMT_LUA,
 };
 
+/*
+	Schematic data laid out for placing it with one rotation.
+
+	Nodes are stored in the order they are placed, already rotated and with
+	param1 cleared. Nodes which are never placed are left out, so each row
+	along X consists of runs of nodes which are placed next to each other.
+*/
+struct CompiledSchematic {
+	struct Run {
+		u16 x;       // Offset of the first node along the row
+		u16 len;
+		u32 i;       // Index of the first node in nodes and params
+		bool always; // All nodes have a probability of MTSCHEM_PROB_ALWAYS
+		bool force;  // All nodes have MTSCHEM_FORCE_PLACE set
+	};
+
+	v3s16 size; // Rotated size
+	std::vector<MapNode> nodes;
+	std::vector<u8> params; // Original param1: probability and force placement
+	std::vector<Run> runs;
+	// Runs of the row (y, z) are runs[rows[y * size.Z + z]] up to
+	// runs[rows[y * size.Z + z + 1]]
+	std::vector<u32> rows;
+};
+
 class Schematic : public ObjDef, public NodeResolver {
 public:
 	Schematic() = default;
@@ -103,6 +130,12 @@ class Schematic : public ObjDef, public NodeResolver {
 		std::vector<std::pair<v3s16, u8> > *plist,
 		std::vector<std::pair<s16, u8> > *splist);
 
+	// Compiled layout for the rotation, created on first use.
+	// Not thread-safe: every emerge thread has its own copy of the schematic.
+	const CompiledSchematic &getCompiled(Rotation rot);
+	// Must be called after schemdata was modified
+	void invalidateCompiled();
+
 	std::vector<content_t> c_nodes;
 	u32 flags = 0;
 	v3s16 size;
@@ -112,6 +145,8 @@ class Schematic : public ObjDef, public NodeResolver {
 private:
 	// Counterpart to the node resolver: Condense content_t to a sequential "m_nodenames" list
 	void condenseContentIds();
+
+	std::unique_ptr<CompiledSchematic> m_compiled[4];
 };
 
 class SchematicManager : public ObjDefManager {
@@ -0,0 +1,100 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "noise_cache.h"
+#include "noise.h"
+#include "threading/mutex_auto_lock.h"
+#include <cstring>
+
+static u32 float_bits(float f)
+{
+	u32 u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+
+size_t NoiseCache2D::KeyHash::operator()(const Key &key) const
+{
+	u64 h = 14695981039346656037ULL;
+	for (u32 word : key)
+		h = (h ^ word) * 1099511628211ULL;
+	return h;
+}
+
+
+NoiseCache2D::NoiseCache2D(size_t max_bytes, MetricCounterPtr hits,
+		MetricCounterPtr misses) :
+	m_max_bytes(max_bytes),
+	m_hits_counter(hits),
+	m_misses_counter(misses)
+{
+}
+
+
+float *NoiseCache2D::perlinMap2D(Noise *noise, float x, float z,
+	float *persistence_map)
+{
+	const u32 size = noise->sx * noise->sy;
+	const size_t bytes = size * sizeof(float);
+	if (bytes > m_max_bytes)
+		return noise->perlinMap2D(x, z, persistence_map);
+
+	// Results with a persistence map depend on its values
+	u64 persist_hash = 0;
+	if (persistence_map) {
+		persist_hash = 14695981039346656037ULL;
+		for (u32 i = 0; i < size; i++)
+			persist_hash = (persist_hash ^ float_bits(persistence_map[i])) * 1099511628211ULL;
+	}
+
+	const NoiseParams &np = noise->np;
+	const Key key = {
+		float_bits(np.offset), float_bits(np.scale),
+		float_bits(np.spread.X), float_bits(np.spread.Y), float_bits(np.spread.Z),
+		(u32)np.seed, np.octaves, float_bits(np.persist),
+		float_bits(np.lacunarity), np.flags,
+		(u32)noise->seed, float_bits(x), float_bits(z),
+		noise->sx | noise->sy << 16,
+		(u32)persist_hash, (u32)(persist_hash >> 32),
+	};
+
+	{
+		MutexAutoLock lock(m_mutex);
+		auto it = m_entries.find(key);
+		if (it != m_entries.end()) {
+			Entry &entry = it->second;
+			m_lru.splice(m_lru.begin(), m_lru, entry.lru_it);
+			memcpy(noise->result, entry.result.data(), bytes);
+			m_hits++;
+			if (m_hits_counter)
+				m_hits_counter->increment();
+			return noise->result;
+		}
+		m_misses++;
+		if (m_misses_counter)
+			m_misses_counter->increment();
+	}
+
+	// Other threads may calculate the same, which is harmless
+	noise->perlinMap2D(x, z, persistence_map);
+
+	MutexAutoLock lock(m_mutex);
+	if (m_entries.count(key))
+		return noise->result;
+
+	while (m_bytes + bytes > m_max_bytes) {
+		auto it = m_entries.find(m_lru.back());
+		m_bytes -= it->second.result.size() * sizeof(float);
+		m_entries.erase(it);
+		m_lru.pop_back();
+	}
+
+	m_lru.push_front(key);
+	Entry &entry = m_entries[key];
+	entry.result.assign(noise->result, noise->result + size);
+	entry.lru_it = m_lru.begin();
+	m_bytes += bytes;
+
+	return noise->result;
+}
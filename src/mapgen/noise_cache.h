@@ -0,0 +1,68 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "irrlichttypes.h"
+#include "util/basic_macros.h"
+#include "util/metricsbackend.h"
+
+class Noise;
+
+/*
+	Results of 2D noise maps, shared by the mapgens of all emerge threads.
+
+	2D noise only depends on X and Z, so all mapchunks stacked in a column
+	use the same values. With this cache each of them is only calculated
+	once per column, as long as it is not evicted in between.
+	The least recently used results are evicted first. Thread-safe.
+*/
+class NoiseCache2D
+{
+public:
+	/// @param max_bytes total size of the cached results
+	NoiseCache2D(size_t max_bytes, MetricCounterPtr hits = nullptr,
+		MetricCounterPtr misses = nullptr);
+	DISABLE_CLASS_COPY(NoiseCache2D)
+
+	/// Same as noise->perlinMap2D(x, z, persistence_map), but takes the
+	/// result from the cache if it was calculated before.
+	float *perlinMap2D(Noise *noise, float x, float z,
+		float *persistence_map = nullptr);
+
+	u64 getHits() const { return m_hits; }
+	u64 getMisses() const { return m_misses; }
+
+private:
+	// Noise parameters, seed, position, size and persistence map hash
+	typedef std::array<u32, 16> Key;
+
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+
+	struct Entry {
+		std::vector<float> result;
+		std::list<Key>::iterator lru_it;
+	};
+
+	const size_t m_max_bytes;
+	MetricCounterPtr m_hits_counter;
+	MetricCounterPtr m_misses_counter;
+
+	std::mutex m_mutex;
+	// The following require m_mutex held
+	std::unordered_map<Key, Entry, KeyHash> m_entries;
+	// Most recently used first
+	std::list<Key> m_lru;
+	size_t m_bytes = 0;
+
+	std::atomic<u64> m_hits{0};
+	std::atomic<u64> m_misses{0};
+};
@@ -1424,7 +1424,7 @@ ConnectionEventPtr Connection::waitEvent(u32 timeout_ms)
 void Connection::putCommand(ConnectionCommandPtr c)
 {
 	if (!m_shutting_down) {
-		m_command_queue.push_back(c);
+		m_command_queue.push(std::move(c));
 		m_sendThread->Trigger();
 	}
 }
@@ -10,6 +10,7 @@
 #include "util/pointer.h"
 #include "util/container.h"
 #include "util/numeric.h"
+#include "threading/mpsc_queue.h"
 #include "porting.h"
 #include "network/networkprotocol.h"
 #include <iostream>
@@ -271,8 +272,8 @@ class Connection final : public IConnection
 	u32 getActiveCount();
 
 	UDPSocket m_udpSocket;
-	// Command queue: user -> SendThread
-	MutexedQueue<ConnectionCommandPtr> m_command_queue;
+	// Command queue: user, ReceiveThread -> SendThread
+	MPSCQueue<ConnectionCommandPtr> m_command_queue;
 
 	void putEvent(ConnectionEventPtr e);
 
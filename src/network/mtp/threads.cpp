@@ -30,6 +30,11 @@ namespace con
 
 #define MAX_NEW_PEERS_PER_SEC 30
 
+// Maximum number of packets handed to the socket at once
+#define SEND_BATCH_SIZE 64
+// Maximum number of datagrams read from the socket at once
+#define RECEIVE_BATCH_SIZE 32
+
 static inline session_t readPeerId(const u8 *packetdata)
 {
 	return readU16(&packetdata[4]);
@@ -110,18 +115,19 @@ void *ConnectionSendThread::run()
 		}
 
 		/* translate commands to packets */
-		auto c = m_connection->m_command_queue.pop_frontNoEx(0);
-		while (c && c->type != CONNCMD_NONE) {
+		ConnectionCommandPtr c;
+		while (m_connection->m_command_queue.pop(c)) {
+			if (c->type == CONNCMD_NONE)
+				continue;
 			if (c->reliable)
 				processReliableCommand(c);
 			else
 				processNonReliableCommand(c);
-
-			c = m_connection->m_command_queue.pop_frontNoEx(0);
 		}
 
 		/* send queued packets */
 		sendPackets(dtime, calculate_quota());
+		flushSendBatch();
 
 		END_DEBUG_EXCEPTION_HANDLER
 	}
@@ -239,7 +245,7 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 				m_iteration_packets_avaialble = 0;
 
 			for (const auto &k : timed_outs)
-				resendReliable(channel, k.get(), resend_timeout);
+				resendReliable(channel, k, resend_timeout);
 
 			auto ws_old = channel.getWindowSize();
 			channel.UpdateTimers(dtime);
@@ -269,9 +275,10 @@ void ConnectionSendThread::runTimeouts(float dtime, u32 peer_packet_quota)
 	}
 }
 
-void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout)
+void ConnectionSendThread::resendReliable(Channel &channel,
+	const ConstSharedPtr<BufferedPacket> &k, float resend_timeout)
 {
-	assert(k);
+	assert(k.get());
 	u8 channelnum = readChannel(k->data);
 	u16 seqnum = k->getSeqnum();
 
@@ -296,19 +303,31 @@ void ConnectionSendThread::resendReliable(Channel &channel, const BufferedPacket
 	// lost or really takes more time to transmit
 }
 
-void ConnectionSendThread::rawSend(const BufferedPacket *p)
+void ConnectionSendThread::rawSend(const ConstSharedPtr<BufferedPacket> &p)
 {
-	assert(p);
-	try {
-		m_connection->m_udpSocket.Send(p->address, p->data, p->size());
-		//LOG(dout_con << m_connection->getDesc()
-		//	<< " rawSend: " << p->size()
-		//	<< " bytes sent" << std::endl);
-	} catch (SendFailedException &e) {
+	assert(p.get());
+	m_send_batch.push_back(p);
+	if (m_send_batch.size() >= SEND_BATCH_SIZE)
+		flushSendBatch();
+}
+
+void ConnectionSendThread::flushSendBatch()
+{
+	if (m_send_batch.empty())
+		return;
+
+	std::vector<UDPSocket::OutgoingDatagram> datagrams;
+	datagrams.reserve(m_send_batch.size());
+	for (const auto &p : m_send_batch)
+		datagrams.push_back({&p->address, p->data, (int)p->size()});
+
+	int failed = m_connection->m_udpSocket.SendBatch(datagrams.data(), datagrams.size());
+	if (failed > 0) {
 		LOG(derr_con << m_connection->getDesc()
-			<< "SendFailedException: " << e.what() << " to "
-			<< p->address.serializeString() << std::endl);
+			<< "Failed to send " << failed << " of "
+			<< m_send_batch.size() << " packets" << std::endl);
 	}
+	m_send_batch.clear();
 }
 
 void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *channel)
@@ -328,7 +347,7 @@ void ConnectionSendThread::sendAsPacketReliable(BufferedPacketPtr &p, Channel *c
 	}
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 }
 
 bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
@@ -381,7 +400,7 @@ bool ConnectionSendThread::rawSendAsPacket(session_t peer_id, u8 channelnum,
 		channelnum);
 
 	// Send the packet
-	rawSend(p.get());
+	rawSend(p);
 	return true;
 }
 
@@ -428,7 +447,7 @@ void ConnectionSendThread::processReliableCommand(ConnectionCommandPtr &c)
 			auto list = channel.outgoing_reliables_sent.getResend(0, 1);
 
 			if (!list.empty())
-				resendReliable(channel, list.front().get(), -1);
+				resendReliable(channel, list.front(), -1);
 
 			return;
 		}
@@ -844,7 +863,7 @@ void *ConnectionReceiveThread::run()
 	// theoretical reliable upper boundary of a udp packet for all IPv6 enabled
 	// infrastructure
 	const unsigned int packet_maxsize = 1500;
-	SharedBuffer<u8> packetdata(packet_maxsize);
+	SharedBuffer<u8> packetdata(packet_maxsize * RECEIVE_BATCH_SIZE);
 
 	bool packet_queued = true;
 
@@ -948,13 +967,28 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			packet_queued = false;
 		}
 
-		// Call Receive() to wait for incoming data
-		Address sender;
-		s32 received_size = m_connection->m_udpSocket.Receive(sender,
-			*packetdata, packetdata.getSize());
-		if (received_size < 0)
-			return;
+		// Wait for incoming data and take as much as is available
+		UDPSocket::IncomingDatagram datagrams[RECEIVE_BATCH_SIZE];
+		const u32 slot_size = packetdata.getSize() / RECEIVE_BATCH_SIZE;
+		for (u32 i = 0; i < RECEIVE_BATCH_SIZE; i++) {
+			datagrams[i].data = &packetdata[i * slot_size];
+			datagrams[i].capacity = slot_size;
+		}
+		int count = m_connection->m_udpSocket.ReceiveBatch(datagrams, RECEIVE_BATCH_SIZE);
+
+		for (int i = 0; i < count; i++) {
+			receiveDatagram(datagrams[i].sender, (u8 *)datagrams[i].data,
+				datagrams[i].size, packet_queued);
+		}
+	}
+	catch (InvalidIncomingDataException &e) {
+	}
+}
 
+void ConnectionReceiveThread::receiveDatagram(const Address &sender, u8 *packetdata,
+		s32 received_size, bool &packet_queued)
+{
+	try {
 		if ((received_size < BASE_HEADER_SIZE) ||
 				(readU32(&packetdata[0]) != m_connection->GetProtocolID())) {
 			LOG(derr_con << m_connection->getDesc()
@@ -966,8 +1000,8 @@ void ConnectionReceiveThread::receive(SharedBuffer<u8> &packetdata,
 			return;
 		}
 
-		session_t peer_id = readPeerId(*packetdata);
-		u8 channelnum = readChannel(*packetdata);
+		session_t peer_id = readPeerId(packetdata);
+		u8 channelnum = readChannel(packetdata);
 
 		if (channelnum >= CHANNEL_COUNT) {
 			LOG(derr_con << m_connection->getDesc()
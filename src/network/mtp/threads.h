@@ -59,8 +59,12 @@ class ConnectionSendThread : public Thread
 
 private:
 	void runTimeouts(float dtime, u32 peer_packet_quota);
-	void resendReliable(Channel &channel, const BufferedPacket *k, float resend_timeout);
-	void rawSend(const BufferedPacket *p);
+	void resendReliable(Channel &channel, const ConstSharedPtr<BufferedPacket> &k,
+			float resend_timeout);
+	// Queues a packet for sending, see flushSendBatch()
+	void rawSend(const ConstSharedPtr<BufferedPacket> &p);
+	// Hands all packets queued by rawSend() to the socket
+	void flushSendBatch();
 	bool rawSendAsPacket(session_t peer_id, u8 channelnum,
 			const SharedBuffer<u8> &data, bool reliable);
 
@@ -89,6 +93,7 @@ class ConnectionSendThread : public Thread
 	unsigned int m_max_packet_size;
 	float m_timeout;
 	std::queue<OutgoingPacket> m_outgoing_queue;
+	std::vector<ConstSharedPtr<BufferedPacket>> m_send_batch;
 	Semaphore m_send_sleep_semaphore;
 
 	unsigned int m_iteration_packets_avaialble;
@@ -111,6 +116,9 @@ class ConnectionReceiveThread : public Thread
 
 private:
 	void receive(SharedBuffer<u8> &packetdata, bool &packet_queued);
+	// Handles one datagram received from the socket
+	void receiveDatagram(const Address &sender, u8 *data, s32 size,
+			bool &packet_queued);
 
 	// Returns next data from a buffer if possible
 	// If found, returns true; if not, false.
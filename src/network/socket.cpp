@@ -35,6 +35,16 @@ typedef int socklen_t;
 #define SOCKET_ERR_STR(e) strerror(e)
 #endif
 
+// sendmmsg() and recvmmsg() are Linux-specific
+#ifdef __linux__
+#define HAVE_MMSG 1
+#else
+#define HAVE_MMSG 0
+#endif
+
+// Maximum number of datagrams per sendmmsg()/recvmmsg() call
+#define MMSG_BATCH_SIZE 64
+
 static bool g_sockets_initialized = false;
 
 // Initialize sockets
@@ -58,6 +68,35 @@ void sockets_cleanup()
 	g_sockets_initialized = false;
 }
 
+static socklen_t toSockaddr(const Address &addr, struct sockaddr_storage *ss)
+{
+	memset(ss, 0, sizeof(*ss));
+	if (addr.isIPv6()) {
+		auto *address = reinterpret_cast<struct sockaddr_in6 *>(ss);
+		address->sin6_family = AF_INET6;
+		address->sin6_addr = addr.getAddress6();
+		address->sin6_port = htons(addr.getPort());
+		return sizeof(struct sockaddr_in6);
+	}
+	auto *address = reinterpret_cast<struct sockaddr_in *>(ss);
+	address->sin_family = AF_INET;
+	address->sin_addr = addr.getAddress();
+	address->sin_port = htons(addr.getPort());
+	return sizeof(struct sockaddr_in);
+}
+
+static Address fromSockaddr(const struct sockaddr_storage &ss)
+{
+	if (ss.ss_family == AF_INET6) {
+		const auto *address = reinterpret_cast<const struct sockaddr_in6 *>(&ss);
+		const auto *bytes = reinterpret_cast<const IPv6AddressBytes *>
+			(address->sin6_addr.s6_addr);
+		return Address(bytes, ntohs(address->sin6_port));
+	}
+	const auto *address = reinterpret_cast<const struct sockaddr_in *>(&ss);
+	return Address(ntohl(address->sin_addr.s_addr), ntohs(address->sin_port));
+}
+
 /*
 	UDPSocket
 */
@@ -177,24 +216,11 @@ void UDPSocket::Send(const Address &destination, const void *data, int size)
 	if (destination.getFamily() != m_addr_family)
 		throw SendFailedException("Address family mismatch");
 
-	int sent;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address = {};
-		address.sin6_family = AF_INET6;
-		address.sin6_addr = destination.getAddress6();
-		address.sin6_port = htons(destination.getPort());
-
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in6));
-	} else {
-		struct sockaddr_in address = {};
-		address.sin_family = AF_INET;
-		address.sin_addr = destination.getAddress();
-		address.sin_port = htons(destination.getPort());
+	struct sockaddr_storage address;
+	socklen_t address_len = toSockaddr(destination, &address);
 
-		sent = sendto(m_handle, (const char *)data, size, 0,
-				(struct sockaddr *)&address, sizeof(struct sockaddr_in));
-	}
+	int sent = sendto(m_handle, (const char *)data, size, 0,
+			(struct sockaddr *)&address, address_len);
 
 	if (sent != size)
 		throw SendFailedException("Failed to send packet");
@@ -209,41 +235,118 @@ int UDPSocket::Receive(Address &sender, void *data, int size)
 
 	size = MYMAX(size, 0);
 
-	int received;
-	if (m_addr_family == AF_INET6) {
-		struct sockaddr_in6 address;
-		memset(&address, 0, sizeof(address));
-		socklen_t address_len = sizeof(address);
+	struct sockaddr_storage address;
+	memset(&address, 0, sizeof(address));
+	socklen_t address_len = sizeof(address);
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+	int received = recvfrom(m_handle, (char *)data, size, 0,
+			(struct sockaddr *)&address, &address_len);
 
-		if (received < 0)
-			return -1;
+	if (received < 0)
+		return -1;
 
-		u16 address_port = ntohs(address.sin6_port);
-		const auto *bytes = reinterpret_cast<IPv6AddressBytes*>
-			(address.sin6_addr.s6_addr);
-		sender = Address(bytes, address_port);
-	} else {
-		struct sockaddr_in address;
-		memset(&address, 0, sizeof(address));
+	sender = fromSockaddr(address);
 
-		socklen_t address_len = sizeof(address);
+	return received;
+}
 
-		received = recvfrom(m_handle, (char *)data, size, 0,
-				(struct sockaddr *)&address, &address_len);
+int UDPSocket::SendBatch(const OutgoingDatagram *datagrams, int count)
+{
+	int failed = 0;
+
+#if HAVE_MMSG
+	if (!INTERNET_SIMULATOR) {
+		struct mmsghdr msgs[MMSG_BATCH_SIZE];
+		struct iovec iov[MMSG_BATCH_SIZE];
+		struct sockaddr_storage addresses[MMSG_BATCH_SIZE];
+
+		while (count > 0) {
+			int n = 0;
+			for (; n < MMSG_BATCH_SIZE && count > 0; datagrams++, count--) {
+				const OutgoingDatagram &d = *datagrams;
+				if (d.destination->getFamily() != m_addr_family) {
+					failed++;
+					continue;
+				}
+				iov[n].iov_base = const_cast<void *>(d.data);
+				iov[n].iov_len = d.size;
+				memset(&msgs[n], 0, sizeof(msgs[n]));
+				msgs[n].msg_hdr.msg_name = &addresses[n];
+				msgs[n].msg_hdr.msg_namelen = toSockaddr(*d.destination, &addresses[n]);
+				msgs[n].msg_hdr.msg_iov = &iov[n];
+				msgs[n].msg_hdr.msg_iovlen = 1;
+				n++;
+			}
+
+			int done = 0;
+			while (done < n) {
+				int ret = sendmmsg(m_handle, msgs + done, n - done, 0);
+				if (ret > 0) {
+					done += ret;
+				} else if (ret < 0 && errno == EINTR) {
+					continue;
+				} else {
+					// The first remaining datagram failed, skip it
+					tracestream << (int)m_handle << ": sendmmsg failed: "
+						<< SOCKET_ERR_STR(LAST_SOCKET_ERR()) << std::endl;
+					failed++;
+					done++;
+				}
+			}
+		}
+		return failed;
+	}
+#endif
 
-		if (received < 0)
-			return -1;
+	for (int i = 0; i < count; i++) {
+		try {
+			Send(*datagrams[i].destination, datagrams[i].data, datagrams[i].size);
+		} catch (SendFailedException &e) {
+			failed++;
+		}
+	}
+	return failed;
+}
 
-		u32 address_ip = ntohl(address.sin_addr.s_addr);
-		u16 address_port = ntohs(address.sin_port);
+int UDPSocket::ReceiveBatch(IncomingDatagram *datagrams, int count)
+{
+	if (count <= 0)
+		return 0;
 
-		sender = Address(address_ip, address_port);
+#if HAVE_MMSG
+	assert(m_timeout_ms >= 0);
+	if (!WaitData(m_timeout_ms))
+		return 0;
+
+	count = MYMIN(count, MMSG_BATCH_SIZE);
+	struct mmsghdr msgs[MMSG_BATCH_SIZE];
+	struct iovec iov[MMSG_BATCH_SIZE];
+	struct sockaddr_storage addresses[MMSG_BATCH_SIZE];
+	for (int i = 0; i < count; i++) {
+		iov[i].iov_base = datagrams[i].data;
+		iov[i].iov_len = MYMAX(datagrams[i].capacity, 0);
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		memset(&addresses[i], 0, sizeof(addresses[i]));
+		msgs[i].msg_hdr.msg_name = &addresses[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
 	}
 
+	int received = recvmmsg(m_handle, msgs, count, MSG_DONTWAIT, nullptr);
+	if (received <= 0)
+		return 0;
+
+	for (int i = 0; i < received; i++) {
+		datagrams[i].size = msgs[i].msg_len;
+		datagrams[i].sender = fromSockaddr(addresses[i]);
+	}
 	return received;
+#else
+	IncomingDatagram &d = datagrams[0];
+	d.size = Receive(d.sender, d.data, d.capacity);
+	return d.size < 0 ? 0 : 1;
+#endif
 }
 
 void UDPSocket::setTimeoutMs(int timeout_ms)
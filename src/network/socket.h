@@ -26,6 +26,25 @@ class UDPSocket
 	void Send(const Address &destination, const void *data, int size);
 	// Returns -1 if there is no data
 	int Receive(Address &sender, void *data, int size);
+
+	struct OutgoingDatagram {
+		const Address *destination;
+		const void *data;
+		int size;
+	};
+	// Sends several datagrams, using a single system call where supported.
+	// Returns the number of datagrams that could not be sent.
+	int SendBatch(const OutgoingDatagram *datagrams, int count);
+
+	struct IncomingDatagram {
+		Address sender;
+		void *data; // buffer provided by the caller
+		int capacity; // size of the buffer
+		int size; // size of the received datagram
+	};
+	// Like Receive(), but returns as many waiting datagrams as possible
+	// (up to count) at once. Returns the number of datagrams received.
+	int ReceiveBatch(IncomingDatagram *datagrams, int count);
 	void setTimeoutMs(int timeout_ms);
 	// Returns true if there is data, false if timeout occurred
 	bool WaitData(int timeout_ms);
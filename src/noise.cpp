@@ -25,6 +25,7 @@
 
 #include <cmath>
 #include "noise.h"
+#include "noise_simd.h"
 #include <iostream>
 #include <cstring> // memset
 #include "debug.h"
@@ -401,6 +402,8 @@ void Noise::allocBuffers()
 		this->persist_buf  = NULL;
 		this->gradient_buf = new float[bufsize];
 		this->result       = new float[bufsize];
+		col_index.resize(sx);
+		col_frac.resize(sx);
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -469,7 +472,7 @@ void Noise::resizeNoiseBuf(bool is3d)
 
 	delete[] noise_buf;
 	try {
-		noise_buf = new float[nlx * nly * nlz];
+		noise_buf = new float[nlx * nly * nlz + noise_simd::ROW_PADDING];
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -493,8 +496,8 @@ void Noise::gradientMap2D(
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	float u, v;
+	u32 index, j, noisey;
 	u32 nlx, nly;
 	s32 x0, y0;
 
@@ -503,41 +506,22 @@ void Noise::gradientMap2D(
 	y0 = std::floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
 	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+		hashLatticeRow(&noise_buf[idx(0, j)], nlx, x0, y0 + j, 0, false, seed);
 
 	//calculate interpolations
+	fillColumns(u, step_x, eased);
 	index  = 0;
 	noisey = 0;
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			gradient_buf[index++] =
-				biLinearInterpolation(v00, v10, v01, v11, u, v, eased);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+		noise_simd::interpolateRow2D(&gradient_buf[index], sx,
+			&noise_buf[idx(0, noisey)], &noise_buf[idx(0, noisey + 1)],
+			col_index.data(), col_frac.data(), eased ? easeCurve(v) : v);
+		index += sx;
 
 		v += step_y;
 		if (v >= 1.0) {
@@ -555,10 +539,8 @@ void Noise::gradientMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	float u, v, w, orig_v;
+	u32 index, j, k, noisey, noisez;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
@@ -570,59 +552,34 @@ void Noise::gradientMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+			hashLatticeRow(&noise_buf[idx(0, j, k)], nlx, x0, y0 + j, z0 + k, true, seed);
 
 	//calculate interpolations
+	fillColumns(u, step_x, eased);
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
 	for (k = 0; k != sz; k++) {
+		const float ew = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				gradient_buf[index++] = triLinearInterpolation(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w,
-					eased);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			const float *rows[4] = {
+				&noise_buf[idx(0, noisey,     noisez)],
+				&noise_buf[idx(0, noisey + 1, noisez)],
+				&noise_buf[idx(0, noisey,     noisez + 1)],
+				&noise_buf[idx(0, noisey + 1, noisez + 1)],
+			};
+			noise_simd::interpolateRow3D(&gradient_buf[index], sx, rows,
+				col_index.data(), col_frac.data(), eased ? easeCurve(v) : v, ew);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
@@ -641,6 +598,37 @@ void Noise::gradientMap3D(
 #undef idx
 
 
+void Noise::hashLatticeRow(float *out, u32 count, s32 x, s32 y, s32 z,
+	bool is3d, s32 seed)
+{
+	// Same hash as noise2d() / noise3d(), see there
+	u32 start = (u32)NOISE_MAGIC_X * (u32)x + (u32)NOISE_MAGIC_Y * (u32)y
+		+ NOISE_MAGIC_SEED * (u32)seed;
+	if (is3d)
+		start += (u32)NOISE_MAGIC_Z * (u32)z;
+	noise_simd::hashRow(out, count, start, NOISE_MAGIC_X);
+}
+
+
+void Noise::fillColumns(float u, float step_x, bool eased)
+{
+	// Where each point of a row lies on the lattice is the same for all rows.
+	// u has to be accumulated exactly like this to get the same results as
+	// always.
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		col_index[i] = noisex;
+		col_frac[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
 float *Noise::perlinMap2D(float x, float y, float *persistence_map)
 {
 	float f = 1.0, g = 1.0;
@@ -28,6 +28,7 @@
 #include "irr_v3d.h"
 #include "exceptions.h"
 #include "util/string.h"
+#include <vector>
 
 #if defined(RANDOM_MIN)
 #undef RANDOM_MIN
@@ -198,6 +199,15 @@ class Noise {
 	void resizeNoiseBuf(bool is3d);
 	void updateResults(float g, float *gmap, const float *persistence_map,
 			size_t bufsize);
+	// Fills a row of the noise lattice, starting at (x, y, z)
+	void hashLatticeRow(float *out, u32 count, s32 x, s32 y, s32 z,
+			bool is3d, s32 seed);
+	// Computes col_index and col_frac for the current octave
+	void fillColumns(float u, float step_x, bool eased);
+
+	// Lattice column and (eased) fraction of every point along X
+	std::vector<u32> col_index;
+	std::vector<float> col_frac;
 
 };
 
@@ -0,0 +1,376 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "noise_simd.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+		(defined(__x86_64__) || defined(__i386__))
+	#define HAVE_NOISE_SIMD 1
+	#include <immintrin.h>
+	// Only the instruction sets named here may be used. In particular FMA must
+	// not be enabled, contracting a * b + c into one instruction rounds
+	// differently than the scalar code does.
+	#define TARGET_SSE41 __attribute__((target("sse4.1")))
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define HAVE_NOISE_SIMD 0
+#endif
+
+namespace noise_simd
+{
+
+/*
+	Scalar kernels
+*/
+
+static inline float hashToFloat(u32 n)
+{
+	n &= 0x7fffffff;
+	n = (n >> 13) ^ n;
+	n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
+	return 1.f - (float)(int)n / 0x40000000;
+}
+
+static inline float lerp(float v0, float v1, float t)
+{
+	return v0 + (v1 - v0) * t;
+}
+
+static void hashRow_scalar(float *out, u32 count, u32 start, u32 step)
+{
+	for (u32 i = 0; i != count; i++, start += step)
+		out[i] = hashToFloat(start);
+}
+
+static void interpolateRow2D_scalar(float *out, u32 sx,
+	const float *row0, const float *row1,
+	const u32 *col, const float *frac, float v)
+{
+	for (u32 i = 0; i != sx; i++) {
+		const u32 c = col[i];
+		float a = lerp(row0[c], row0[c + 1], frac[i]);
+		float b = lerp(row1[c], row1[c + 1], frac[i]);
+		out[i] = lerp(a, b, v);
+	}
+}
+
+static void interpolateRow3D_scalar(float *out, u32 sx, const float *const rows[4],
+	const u32 *col, const float *frac, float v, float w)
+{
+	for (u32 i = 0; i != sx; i++) {
+		const u32 c = col[i];
+		const float x = frac[i];
+		float a = lerp(
+			lerp(rows[0][c], rows[0][c + 1], x),
+			lerp(rows[1][c], rows[1][c + 1], x), v);
+		float b = lerp(
+			lerp(rows[2][c], rows[2][c + 1], x),
+			lerp(rows[3][c], rows[3][c + 1], x), v);
+		out[i] = lerp(a, b, w);
+	}
+}
+
+#if HAVE_NOISE_SIMD
+
+/*
+	SSE4.1 kernels, 4 points at a time
+*/
+
+TARGET_SSE41 static inline __m128 lerp4(__m128 v0, __m128 v1, __m128 t)
+{
+	return _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), t));
+}
+
+// Each point is at most one lattice column further than the one before, so
+// the lattice values for 4 points are among the 5 starting at col[0].
+// Instead of gathering them, they are loaded at once and shuffled in place.
+TARGET_SSE41 static inline __m128i shuffleMask4(const u32 *c)
+{
+	__m128i idx = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)c),
+		_mm_set1_epi32(c[0]));
+	// Byte offsets of the floats, 4 * idx + (0, 1, 2, 3)
+	idx = _mm_mullo_epi32(_mm_slli_epi32(idx, 2), _mm_set1_epi32(0x01010101));
+	return _mm_add_epi32(idx, _mm_set1_epi32(0x03020100));
+}
+
+TARGET_SSE41 static inline void loadPair4(const float *row, const u32 *c,
+	__m128i mask, __m128 &v0, __m128 &v1)
+{
+	v0 = _mm_castsi128_ps(_mm_shuffle_epi8(
+		_mm_loadu_si128((const __m128i *)(row + c[0])), mask));
+	v1 = _mm_castsi128_ps(_mm_shuffle_epi8(
+		_mm_loadu_si128((const __m128i *)(row + c[0] + 1)), mask));
+}
+
+TARGET_SSE41 static void hashRow_sse41(float *out, u32 count, u32 start, u32 step)
+{
+	const __m128i mask = _mm_set1_epi32(0x7fffffff);
+	const __m128i step4 = _mm_set1_epi32(step * 4);
+	const __m128 scale = _mm_set1_ps(1.f / 0x40000000);
+	__m128i h = _mm_setr_epi32(start, start + step, start + 2 * step, start + 3 * step);
+
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i n = _mm_and_si128(h, mask);
+		n = _mm_xor_si128(_mm_srli_epi32(n, 13), n);
+		__m128i t = _mm_mullo_epi32(_mm_mullo_epi32(n, n), _mm_set1_epi32(60493));
+		t = _mm_add_epi32(t, _mm_set1_epi32(19990303));
+		n = _mm_add_epi32(_mm_mullo_epi32(n, t), _mm_set1_epi32(1376312589));
+		n = _mm_and_si128(n, mask);
+		// Dividing by a power of two is exact, so is multiplying by its inverse
+		__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(n), scale);
+		_mm_storeu_ps(out + i, _mm_sub_ps(_mm_set1_ps(1.f), f));
+		h = _mm_add_epi32(h, step4);
+	}
+	hashRow_scalar(out + i, count - i, start + i * step, step);
+}
+
+TARGET_SSE41 static void interpolateRow2D_sse41(float *out, u32 sx,
+	const float *row0, const float *row1,
+	const u32 *col, const float *frac, float v)
+{
+	const __m128 vv = _mm_set1_ps(v);
+	u32 i = 0;
+	for (; i + 4 <= sx; i += 4) {
+		const u32 *c = col + i;
+		const __m128i mask = shuffleMask4(c);
+		const __m128 x = _mm_loadu_ps(frac + i);
+		__m128 v0, v1;
+		loadPair4(row0, c, mask, v0, v1);
+		__m128 a = lerp4(v0, v1, x);
+		loadPair4(row1, c, mask, v0, v1);
+		__m128 b = lerp4(v0, v1, x);
+		_mm_storeu_ps(out + i, lerp4(a, b, vv));
+	}
+	interpolateRow2D_scalar(out + i, sx - i, row0, row1, col + i, frac + i, v);
+}
+
+TARGET_SSE41 static void interpolateRow3D_sse41(float *out, u32 sx,
+	const float *const rows[4], const u32 *col, const float *frac, float v, float w)
+{
+	const __m128 vv = _mm_set1_ps(v);
+	const __m128 ww = _mm_set1_ps(w);
+	u32 i = 0;
+	for (; i + 4 <= sx; i += 4) {
+		const u32 *c = col + i;
+		const __m128i mask = shuffleMask4(c);
+		const __m128 x = _mm_loadu_ps(frac + i);
+		__m128 r[4];
+		for (int k = 0; k < 4; k++) {
+			__m128 v0, v1;
+			loadPair4(rows[k], c, mask, v0, v1);
+			r[k] = lerp4(v0, v1, x);
+		}
+		__m128 a = lerp4(r[0], r[1], vv);
+		__m128 b = lerp4(r[2], r[3], vv);
+		_mm_storeu_ps(out + i, lerp4(a, b, ww));
+	}
+	interpolateRow3D_scalar(out + i, sx - i, rows, col + i, frac + i, v, w);
+}
+
+/*
+	AVX2 kernels, 8 points at a time
+
+	The compiler doesn't reliably clear the upper halves of the registers
+	before tail calls into code without VEX encoding (like the scalar
+	kernels), which makes all SSE code after it very slow. This is done by
+	hand before leaving each kernel.
+*/
+
+TARGET_AVX2 static inline __m256 lerp8(__m256 v0, __m256 v1, __m256 t)
+{
+	return _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), t));
+}
+
+// Same as loadPair4(), with 8 points
+TARGET_AVX2 static inline void loadPair8(const float *row, u32 base,
+	__m256i idx, __m256 &v0, __m256 &v1)
+{
+	v0 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(row + base), idx);
+	v1 = _mm256_permutevar8x32_ps(_mm256_loadu_ps(row + base + 1), idx);
+}
+
+TARGET_AVX2 static void hashRow_avx2(float *out, u32 count, u32 start, u32 step)
+{
+	const __m256i mask = _mm256_set1_epi32(0x7fffffff);
+	const __m256i step8 = _mm256_set1_epi32(step * 8);
+	const __m256 scale = _mm256_set1_ps(1.f / 0x40000000);
+	__m256i h = _mm256_add_epi32(_mm256_set1_epi32(start),
+		_mm256_mullo_epi32(_mm256_set1_epi32(step),
+			_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i n = _mm256_and_si256(h, mask);
+		n = _mm256_xor_si256(_mm256_srli_epi32(n, 13), n);
+		__m256i t = _mm256_mullo_epi32(_mm256_mullo_epi32(n, n), _mm256_set1_epi32(60493));
+		t = _mm256_add_epi32(t, _mm256_set1_epi32(19990303));
+		n = _mm256_add_epi32(_mm256_mullo_epi32(n, t), _mm256_set1_epi32(1376312589));
+		n = _mm256_and_si256(n, mask);
+		__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(n), scale);
+		_mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_set1_ps(1.f), f));
+		h = _mm256_add_epi32(h, step8);
+	}
+	_mm256_zeroupper();
+	hashRow_scalar(out + i, count - i, start + i * step, step);
+}
+
+TARGET_AVX2 static void interpolateRow2D_avx2(float *out, u32 sx,
+	const float *row0, const float *row1,
+	const u32 *col, const float *frac, float v)
+{
+	const __m256 vv = _mm256_set1_ps(v);
+	u32 i = 0;
+	for (; i + 8 <= sx; i += 8) {
+		const u32 base = col[i];
+		const __m256i idx = _mm256_sub_epi32(
+			_mm256_loadu_si256((const __m256i *)(col + i)), _mm256_set1_epi32(base));
+		const __m256 x = _mm256_loadu_ps(frac + i);
+		__m256 v0, v1;
+		loadPair8(row0, base, idx, v0, v1);
+		__m256 a = lerp8(v0, v1, x);
+		loadPair8(row1, base, idx, v0, v1);
+		__m256 b = lerp8(v0, v1, x);
+		_mm256_storeu_ps(out + i, lerp8(a, b, vv));
+	}
+	_mm256_zeroupper();
+	interpolateRow2D_scalar(out + i, sx - i, row0, row1, col + i, frac + i, v);
+}
+
+TARGET_AVX2 static void interpolateRow3D_avx2(float *out, u32 sx,
+	const float *const rows[4], const u32 *col, const float *frac, float v, float w)
+{
+	const __m256 vv = _mm256_set1_ps(v);
+	const __m256 ww = _mm256_set1_ps(w);
+	u32 i = 0;
+	for (; i + 8 <= sx; i += 8) {
+		const u32 base = col[i];
+		const __m256i idx = _mm256_sub_epi32(
+			_mm256_loadu_si256((const __m256i *)(col + i)), _mm256_set1_epi32(base));
+		const __m256 x = _mm256_loadu_ps(frac + i);
+		__m256 r[4];
+		for (int k = 0; k < 4; k++) {
+			__m256 v0, v1;
+			loadPair8(rows[k], base, idx, v0, v1);
+			r[k] = lerp8(v0, v1, x);
+		}
+		__m256 a = lerp8(r[0], r[1], vv);
+		__m256 b = lerp8(r[2], r[3], vv);
+		_mm256_storeu_ps(out + i, lerp8(a, b, ww));
+	}
+	_mm256_zeroupper();
+	interpolateRow3D_scalar(out + i, sx - i, rows, col + i, frac + i, v, w);
+}
+
+static bool isSupported(Level level)
+{
+	__builtin_cpu_init();
+	switch (level) {
+	case LEVEL_SCALAR:
+		return true;
+	case LEVEL_SSE41:
+		return __builtin_cpu_supports("sse4.1");
+	case LEVEL_AVX2:
+		return __builtin_cpu_supports("avx2");
+	}
+	return false;
+}
+
+#else
+
+static bool isSupported(Level level)
+{
+	return level == LEVEL_SCALAR;
+}
+
+#endif
+
+static Level detectLevel()
+{
+	if (isSupported(LEVEL_AVX2))
+		return LEVEL_AVX2;
+	if (isSupported(LEVEL_SSE41))
+		return LEVEL_SSE41;
+	return LEVEL_SCALAR;
+}
+
+static Level g_level = detectLevel();
+
+Level getLevel()
+{
+	return g_level;
+}
+
+bool setLevel(Level level)
+{
+	if (!isSupported(level))
+		return false;
+	g_level = level;
+	return true;
+}
+
+const char *getLevelName(Level level)
+{
+	switch (level) {
+	case LEVEL_SCALAR:
+		return "scalar";
+	case LEVEL_SSE41:
+		return "sse4.1";
+	case LEVEL_AVX2:
+		return "avx2";
+	}
+	return "unknown";
+}
+
+void hashRow(float *out, u32 count, u32 start, u32 step)
+{
+	switch (g_level) {
+#if HAVE_NOISE_SIMD
+	case LEVEL_AVX2:
+		hashRow_avx2(out, count, start, step);
+		return;
+	case LEVEL_SSE41:
+		hashRow_sse41(out, count, start, step);
+		return;
+#endif
+	default:
+		hashRow_scalar(out, count, start, step);
+	}
+}
+
+void interpolateRow2D(float *out, u32 sx,
+	const float *row0, const float *row1,
+	const u32 *col, const float *frac, float v)
+{
+	switch (g_level) {
+#if HAVE_NOISE_SIMD
+	case LEVEL_AVX2:
+		interpolateRow2D_avx2(out, sx, row0, row1, col, frac, v);
+		return;
+	case LEVEL_SSE41:
+		interpolateRow2D_sse41(out, sx, row0, row1, col, frac, v);
+		return;
+#endif
+	default:
+		interpolateRow2D_scalar(out, sx, row0, row1, col, frac, v);
+	}
+}
+
+void interpolateRow3D(float *out, u32 sx, const float *const rows[4],
+	const u32 *col, const float *frac, float v, float w)
+{
+	switch (g_level) {
+#if HAVE_NOISE_SIMD
+	case LEVEL_AVX2:
+		interpolateRow3D_avx2(out, sx, rows, col, frac, v, w);
+		return;
+	case LEVEL_SSE41:
+		interpolateRow3D_sse41(out, sx, rows, col, frac, v, w);
+		return;
+#endif
+	default:
+		interpolateRow3D_scalar(out, sx, rows, col, frac, v, w);
+	}
+}
+
+}
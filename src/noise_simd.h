@@ -0,0 +1,56 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include "irrlichttypes.h"
+
+/*
+	Inner loops of Noise::gradientMap2D() and Noise::gradientMap3D().
+
+	There is a scalar version of every kernel and, on x86 with GCC or Clang,
+	SSE4.1 and AVX2 versions picked at runtime. All of them do exactly the
+	same floating point operations in the same order, so the results are
+	bit-identical and terrain does not depend on the CPU it was made on.
+*/
+namespace noise_simd
+{
+
+/// Number of floats that must be readable after the last lattice value
+/// used by the interpolation kernels. Their values don't matter.
+constexpr u32 ROW_PADDING = 8;
+
+enum Level {
+	LEVEL_SCALAR,
+	LEVEL_SSE41,
+	LEVEL_AVX2,
+};
+
+/// Kernels currently in use, the best supported ones by default.
+Level getLevel();
+
+/// Switches kernels, for tests and benchmarks.
+/// @return false if the CPU does not support them
+bool setLevel(Level level);
+
+const char *getLevelName(Level level);
+
+/// out[i] = the lattice value noise2d()/noise3d() return for the
+/// (unmasked) hash start + i * step.
+void hashRow(float *out, u32 count, u32 start, u32 step);
+
+/// Bilinear interpolation of a row of sx points between two lattice rows.
+/// Point i lies between lattice columns col[i] and col[i] + 1 at fraction
+/// frac[i]; v is the fraction between row0 and row1. Fractions are already
+/// eased if needed. col[i + 1] must be col[i] or col[i] + 1.
+void interpolateRow2D(float *out, u32 sx,
+	const float *row0, const float *row1,
+	const u32 *col, const float *frac, float v);
+
+/// Trilinear interpolation, like interpolateRow2D().
+/// rows[] are the lattice rows at (y, z), (y + 1, z), (y, z + 1) and
+/// (y + 1, z + 1).
+void interpolateRow3D(float *out, u32 sx, const float *const rows[4],
+	const u32 *col, const float *frac, float v, float w);
+
+}
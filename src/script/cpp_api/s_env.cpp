@@ -29,13 +29,14 @@ class LuaABM : public ActiveBlockModifier {
 	bool m_simple_catch_up;
 	s16 m_min_y;
 	s16 m_max_y;
+	bool m_bulk;
 public:
 	LuaABM(int id,
 			const std::vector<std::string> &trigger_contents,
 			const std::vector<std::string> &required_neighbors,
 			const std::vector<std::string> &without_neighbors,
 			float trigger_interval, u32 trigger_chance, bool simple_catch_up,
-			s16 min_y, s16 max_y):
+			s16 min_y, s16 max_y, bool bulk):
 		m_id(id),
 		m_trigger_contents(trigger_contents),
 		m_required_neighbors(required_neighbors),
@@ -44,7 +45,8 @@ class LuaABM : public ActiveBlockModifier {
 		m_trigger_chance(trigger_chance),
 		m_simple_catch_up(simple_catch_up),
 		m_min_y(min_y),
-		m_max_y(max_y)
+		m_max_y(max_y),
+		m_bulk(bulk)
 	{
 	}
 	virtual const std::vector<std::string> &getTriggerContents() const
@@ -79,6 +81,10 @@ class LuaABM : public ActiveBlockModifier {
 	{
 		return m_max_y;
 	}
+	virtual bool getBulk()
+	{
+		return m_bulk;
+	}
 
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 			u32 active_object_count, u32 active_object_count_wider)
@@ -86,6 +92,15 @@ class LuaABM : public ActiveBlockModifier {
 		auto *script = env->getScriptIface();
 		script->triggerABM(m_id, p, n, active_object_count, active_object_count_wider);
 	}
+
+	virtual void trigger(ServerEnvironment *env, MapBlock *block,
+			const std::vector<v3s16> &positions, const std::vector<MapNode> &nodes,
+			u32 active_object_count, u32 active_object_count_wider)
+	{
+		auto *script = env->getScriptIface();
+		script->triggerABMBulk(m_id, positions, nodes,
+			active_object_count, active_object_count_wider);
+	}
 };
 
 class LuaLBM : public LoadingBlockModifierDef
@@ -242,13 +257,17 @@ void ScriptApiEnv::readABMs()
 		s16 max_y = INT16_MAX;
 		getintfield(L, current_abm, "max_y", max_y);
 
-		lua_getfield(L, current_abm, "action");
+		lua_getfield(L, current_abm, "bulk_action");
+		bool bulk = !lua_isnil(L, -1);
+		lua_pop(L, 1);
+
+		lua_getfield(L, current_abm, bulk ? "bulk_action" : "action");
 		luaL_checktype(L, current_abm + 1, LUA_TFUNCTION);
 		lua_pop(L, 1);
 
 		LuaABM *abm = new LuaABM(id, trigger_contents, required_neighbors,
 			without_neighbors, trigger_interval, trigger_chance,
-			simple_catch_up, min_y, max_y);
+			simple_catch_up, min_y, max_y, bulk);
 
 		env->addActiveBlockModifier(abm);
 
@@ -457,6 +476,54 @@ void ScriptApiEnv::triggerABM(int id, v3s16 p, MapNode n,
 	lua_pop(L, 1); // Pop error handler
 }
 
+void ScriptApiEnv::triggerABMBulk(int id, const std::vector<v3s16> &positions,
+		const std::vector<MapNode> &nodes,
+		u32 active_object_count, u32 active_object_count_wider)
+{
+	SCRIPTAPI_PRECHECKHEADER
+	assert(positions.size() == nodes.size());
+
+	int error_handler = PUSH_ERROR_HANDLER(L);
+
+	// Get registered_abms
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "registered_abms");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	lua_remove(L, -2); // Remove core
+
+	// Get registered_abms[m_id]
+	lua_pushinteger(L, id);
+	lua_gettable(L, -2);
+	FATAL_ERROR_IF(lua_isnil(L, -1), "Entry with given id not found in registered_abms table");
+	lua_remove(L, -2); // Remove registered_abms
+
+	setOriginFromTable(-1);
+
+	// Call bulk_action
+	luaL_checktype(L, -1, LUA_TTABLE);
+	lua_getfield(L, -1, "bulk_action");
+	luaL_checktype(L, -1, LUA_TFUNCTION);
+	lua_remove(L, -2); // Remove registered_abms[m_id]
+	lua_createtable(L, positions.size(), 0);
+	for (size_t i = 0; i < positions.size(); i++) {
+		push_v3s16(L, positions[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_createtable(L, nodes.size(), 0);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		pushnode(L, nodes[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+	lua_pushnumber(L, active_object_count);
+	lua_pushnumber(L, active_object_count_wider);
+
+	int result = lua_pcall(L, 4, 0, error_handler);
+	if (result)
+		scriptError(result, "LuaABM::trigger");
+
+	lua_pop(L, 1); // Pop error handler
+}
+
 void ScriptApiEnv::triggerLBM(int id, MapBlock *block,
 		const std::unordered_set<v3s16> &positions, float dtime_s)
 {
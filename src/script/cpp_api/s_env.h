@@ -47,6 +47,10 @@ class ScriptApiEnv : virtual public ScriptApiBase
 	void triggerABM(int id, v3s16 p, MapNode n,
 			u32 active_object_count, u32 active_object_count_wider);
 
+	void triggerABMBulk(int id, const std::vector<v3s16> &positions,
+			const std::vector<MapNode> &nodes,
+			u32 active_object_count, u32 active_object_count_wider);
+
 	void triggerLBM(int id, MapBlock *block,
 		const std::unordered_set<v3s16> &positions, float dtime_s);
 
@@ -5,6 +5,7 @@
 #include "server.h"
 #include <iostream>
 #include <queue>
+#include <condition_variable>
 #include <algorithm>
 #include "irr_v2d.h"
 #include "network/connection.h"
@@ -12,6 +13,7 @@
 #include "network/networkprotocol.h"
 #include "network/serveropcodes.h"
 #include "server/ban.h"
+#include "server/serializedblockcache.h"
 #include "environment.h"
 #include "servermap.h"
 #include "threading/mutex_auto_lock.h"
@@ -327,6 +329,10 @@ Server::Server(
 
 	m_lag_gauge->set(g_settings->getFloat("dedicated_server_step"));
 
+	m_block_cache = std::make_unique<SerializedBlockCache>(
+			(size_t)g_settings->getU32("block_send_cache_size") * 1024 * 1024,
+			m_metrics_backend.get());
+
 	m_path_mod_data = porting::path_user + DIR_DELIM "mod_data";
 	if (!fs::CreateDir(m_path_mod_data))
 		throw ServerError("Failed to create mod data dir");
@@ -880,60 +886,52 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		{
 			ClientInterface::AutoLock clientlock(m_clients);
 			const RemoteClientMap &clients = m_clients.getClientList();
-			// Route data to every client
-			std::string reliable_data, unreliable_data;
-			for (const auto &client_it : clients) {
-				reliable_data.clear();
-				unreliable_data.clear();
-				RemoteClient *client = client_it.second;
-				PlayerSAO *player = getPlayerSAO(client->peer_id);
-				// Go through all objects in message buffer
-				for (const auto &buffered_message : buffered_messages) {
-					// If object does not exist or is not known by client, skip it
-					u16 id = buffered_message.first;
-					ServerActiveObject *sao = m_env->getActiveObject(id);
-					if (!sao || client->m_known_objects.find(id) == client->m_known_objects.end())
-						continue;
 
-					// Get message list of object
-					std::vector<ActiveObjectMessage>* list = buffered_message.second;
-					// Go through every message
-					for (const ActiveObjectMessage &aom : *list) {
-						// Send position updates to players who do not see the attachment
-						if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-							if (sao->getId() == player->getId())
-								continue;
-
-							// Do not send position updates for attached players
-							// as long the parent is known to the client
-							ServerActiveObject *parent = sao->getParent();
-							if (parent && client->m_known_objects.find(parent->getId()) !=
-									client->m_known_objects.end())
-								continue;
-						}
-
-						// Add full new data to appropriate buffer
-						std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-						char idbuf[2];
-						writeU16((u8*) idbuf, aom.id);
-						// u16 id
-						// std::string data
-						buffer.append(idbuf, sizeof(idbuf));
-						buffer.append(serializeString16(aom.datastring));
-					}
-				}
-				/*
-					reliable_data and unreliable_data are now ready.
-					Send them.
-				*/
-				if (!reliable_data.empty()) {
-					SendActiveObjectMessages(client->peer_id, reliable_data);
-				}
+			// Route each message only to the peers that know the object.
+			// Messages are serialized once and then appended to their buffers.
+			struct PeerData {
+				std::string reliable_data, unreliable_data;
+			};
+			std::unordered_map<session_t, PeerData> peer_data;
+			std::string serialized;
+			for (const auto &buffered_message : buffered_messages) {
+				// If object does not exist or is not known by any client, skip it
+				u16 id = buffered_message.first;
+				ServerActiveObject *sao = m_env->getActiveObject(id);
+				if (!sao || sao->m_known_by.empty())
+					continue;
 
-				if (!unreliable_data.empty()) {
-					SendActiveObjectMessages(client->peer_id, unreliable_data, false);
+				// Go through every message
+				for (const ActiveObjectMessage &aom : *buffered_message.second) {
+					// u16 id
+					// std::string data
+					serialized.resize(2);
+					writeU16((u8 *)&serialized[0], aom.id);
+					serialized.append(serializeString16(aom.datastring));
+
+					// Add full new data to appropriate buffer
+					sao->forEachMessageRecipient(aom, [&] (session_t peer_id) {
+						PeerData &data = peer_data[peer_id];
+						(aom.reliable ? data.reliable_data : data.unreliable_data)
+							.append(serialized);
+					});
 				}
 			}
+
+			/*
+				reliable_data and unreliable_data are now ready.
+				Send them.
+			*/
+			for (const auto &it : peer_data) {
+				if (clients.find(it.first) == clients.end())
+					continue;
+
+				if (!it.second.reliable_data.empty())
+					SendActiveObjectMessages(it.first, it.second.reliable_data);
+
+				if (!it.second.unreliable_data.empty())
+					SendActiveObjectMessages(it.first, it.second.unreliable_data, false);
+			}
 		}
 
 		// Clear buffered_messages
@@ -1046,6 +1044,41 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 		}
 	}
 
+	/*
+		Tell the emerge manager where players are going, so that it can
+		emerge what they see first and drop what they no longer need
+	*/
+	{
+		float &counter = m_emerge_viewers_timer;
+		counter -= dtime;
+		if (counter <= 0.0f) {
+			counter = 0.5f;
+
+			std::vector<EmergeViewer> viewers;
+			{
+				EnvAutoLock lock(this);
+				for (RemotePlayer *player : m_env->getPlayers()) {
+					PlayerSAO *sao = player->getPlayerSAO();
+					if (!sao)
+						continue;
+
+					EmergeViewer viewer;
+					viewer.pos = sao->getEyePosition() / (BS * MAP_BLOCKSIZE);
+					viewer.dir = v3f(0, 0, 1);
+					viewer.dir.rotateYZBy(sao->getLookPitch());
+					viewer.dir.rotateXZBy(sao->getRotation().Y);
+					if (sao->getCameraInverted())
+						viewer.dir = -viewer.dir;
+					viewer.speed = player->getSpeed() / (BS * MAP_BLOCKSIZE);
+					// Same limit the block sending uses
+					viewer.range = sao->getWantedRange() + 1;
+					viewers.push_back(viewer);
+				}
+			}
+			m_emerge->updateViewers(std::move(viewers));
+		}
+	}
+
 	// Save map, players and auth stuff
 	{
 		float &counter = m_savemap_timer;
@@ -2119,8 +2152,8 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 
 		// Remove from known objects
 		client->m_known_objects.erase(id);
-		if (obj && obj->m_known_by_count > 0)
-			obj->m_known_by_count--;
+		if (obj)
+			obj->removeKnownBy(client->peer_id);
 	}
 
 	// Note: Do yet NOT stop or remove object-attached sounds where the object goes out
@@ -2146,7 +2179,7 @@ void Server::SendActiveObjectRemoveAdd(RemoteClient *client, PlayerSAO *playersa
 
 		// Add to known objects
 		client->m_known_objects.insert(id);
-		obj->m_known_by_count++;
+		obj->m_known_by.push_back(client->peer_id);
 	}
 
 	Send(&pkt);
@@ -2416,16 +2449,11 @@ void Server::sendMetadataChanged(const std::unordered_set<v3s16> &positions, flo
 }
 
 void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache)
+		u16 net_proto_version)
 {
 	thread_local const int net_compression_level = rangelim(g_settings->getS16("map_compression_level_net"), -1, 9);
-	std::string s, *sptr = nullptr;
-
-	if (cache) {
-		auto it = cache->find({block->getPos(), ver});
-		if (it != cache->end())
-			sptr = &it->second;
-	}
+	std::string s;
+	const std::string *sptr = m_block_cache->get(block, ver);
 
 	// Serialize the block in the right format
 	if (!sptr) {
@@ -2442,8 +2470,8 @@ void Server::SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
 	Send(&pkt);
 
 	// Store away in cache
-	if (cache && sptr == &s)
-		(*cache)[{block->getPos(), ver}] = std::move(s);
+	if (sptr == &s)
+		m_block_cache->put(block, ver, std::move(s));
 }
 
 void Server::SendBlocks(float dtime)
@@ -2452,7 +2480,7 @@ void Server::SendBlocks(float dtime)
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
-	u32 total_sending = 0, unique_clients = 0;
+	u32 total_sending = 0;
 
 	{
 		ScopeProfiler sp2(g_profiler, "Server::SendBlocks(): Collect list");
@@ -2467,9 +2495,7 @@ void Server::SendBlocks(float dtime)
 				continue;
 
 			total_sending += client->getSendingCount();
-			const auto old_count = queue.size();
 			client->GetNextBlocks(m_env, m_emerge.get(), dtime, queue);
-			unique_clients += queue.size() > old_count ? 1 : 0;
 		}
 	}
 
@@ -2488,12 +2514,6 @@ void Server::SendBlocks(float dtime)
 	ScopeProfiler sp(g_profiler, "Server::SendBlocks(): Send to clients");
 	Map &map = m_env->getMap();
 
-	SerializedBlockCache cache, *cache_ptr = nullptr;
-	if (unique_clients > 1) {
-		// caching is pointless with a single client
-		cache_ptr = &cache;
-	}
-
 	for (const PrioritySortedBlockTransfer &block_to_send : queue) {
 		if (total_sending >= max_blocks_to_send)
 			break;
@@ -2508,7 +2528,7 @@ void Server::SendBlocks(float dtime)
 			continue;
 
 		SendBlockNoLock(block_to_send.peer_id, block, client->serialization_version,
-				client->net_proto_version, cache_ptr);
+				client->net_proto_version);
 
 		client->SentBlock(block_to_send.pos);
 		total_sending++;
@@ -4315,6 +4335,190 @@ bool Server::migrateModStorageDatabase(const GameParams &game_params, const Sett
 	return succeeded;
 }
 
+namespace {
+
+struct PregenerateState
+{
+	std::mutex mutex;
+	std::condition_variable done_cv;
+	u32 in_flight = 0;
+	u32 generated = 0;
+	u32 loaded = 0;
+	u32 failed = 0;
+};
+
+void pregenerate_callback(v3s16 blockpos, EmergeAction action, void *param)
+{
+	auto *state = reinterpret_cast<PregenerateState *>(param);
+	{
+		MutexAutoLock lock(state->mutex);
+		state->in_flight--;
+		if (action == EMERGE_GENERATED)
+			state->generated++;
+		else if (action == EMERGE_FROM_DISK || action == EMERGE_FROM_MEMORY)
+			state->loaded++;
+		else
+			state->failed++;
+	}
+	state->done_cv.notify_one();
+}
+
+}
+
+bool Server::pregenerateMap(const GameParams &game_params, const Settings &cmd_args)
+{
+	// "(x,y,z) (x,y,z)"
+	std::string area = cmd_args.get("pregenerate");
+	for (char &c : area) {
+		if (c == '(' || c == ')' || c == ',')
+			c = ' ';
+	}
+	std::istringstream is(area);
+	s32 coords[6];
+	for (s32 &c : coords)
+		is >> c;
+	if (is.fail()) {
+		errorstream << "Invalid area \"" << cmd_args.get("pregenerate")
+			<< "\", expected \"(x,y,z) (x,y,z)\"" << std::endl;
+		return false;
+	}
+	for (s32 &c : coords)
+		c = rangelim(c, -MAX_MAP_GENERATION_LIMIT, MAX_MAP_GENERATION_LIMIT);
+	v3s16 p1(coords[0], coords[1], coords[2]);
+	v3s16 p2(coords[3], coords[4], coords[5]);
+	sortBoxVerticies(p1, p2);
+	const v3s16 bpmin = getNodeBlockPos(p1);
+	const v3s16 bpmax = getNodeBlockPos(p2);
+
+	// Nobody is waiting for the blocks, so use all cores unless configured
+	if (!g_settings->existsLocal("num_emerge_threads"))
+		g_settings->setS16("num_emerge_threads", 0);
+
+	try {
+		Server server(game_params.world_path, game_params.game_spec, false,
+			Address(), false);
+		server.init();
+
+		EmergeManager *emerge = server.m_emerge.get();
+		ServerMap &map = server.m_env->getServerMap();
+		const s16 csize = map.getMapgenParams()->chunksize;
+		const v3s16 cmin = EmergeManager::getContainingChunk(bpmin, csize);
+		const v3s16 cmax = EmergeManager::getContainingChunk(bpmax, csize);
+		const v3s16 chunks = (cmax - cmin) / csize + v3s16(1, 1, 1);
+		const u32 total = chunks.X * chunks.Y * chunks.Z;
+
+		// Walk the chunk columns along a Hilbert curve, so that the
+		// neighbours of a chunk were mostly generated just before it and
+		// are still loaded. Each column is generated bottom to top.
+		u8 order = 0;
+		while ((1 << order) < std::max(chunks.X, chunks.Z))
+			order++;
+		const u32 curve_length = 1U << (order * 2);
+		u32 curve_d = 0;
+		s16 column_y = chunks.Y;
+		v2s16 column;
+
+		emerge->startThreads();
+		const u32 max_in_flight = 2 * emerge->getThreadCount();
+		actionstream << "Pregenerating " << total << " mapchunks between "
+			<< bpmin * MAP_BLOCKSIZE << " and "
+			<< (bpmax + 1) * MAP_BLOCKSIZE - 1 << " on "
+			<< emerge->getThreadCount() << " emerge threads" << std::endl;
+
+		PregenerateState state;
+		bool &kill = *porting::signal_handler_killstatus();
+		const u64 start_time = porting::getTimeMs();
+		u64 last_update_time = start_time;
+		u32 queued = 0;
+		while (!kill) {
+			{
+				std::unique_lock<std::mutex> lock(state.mutex);
+				state.done_cv.wait_for(lock, std::chrono::milliseconds(100), [&] {
+					return state.in_flight < max_in_flight;
+				});
+				if (queued == total && state.in_flight == 0)
+					break;
+			}
+
+			while (queued < total) {
+				{
+					MutexAutoLock lock(state.mutex);
+					if (state.in_flight >= max_in_flight)
+						break;
+				}
+				if (column_y == chunks.Y) {
+					do {
+						column = hilbertCurvePoint(order, curve_d++);
+					} while (column.X >= chunks.X || column.Y >= chunks.Z);
+					column_y = 0;
+				}
+				const v3s16 chunk = cmin + v3s16(column.X, column_y, column.Y) * csize;
+				column_y++;
+				queued++;
+
+				// Any block of the chunk generates all of it
+				v3s16 blockpos = chunk;
+				blockpos.X = rangelim(blockpos.X, bpmin.X, bpmax.X);
+				blockpos.Y = rangelim(blockpos.Y, bpmin.Y, bpmax.Y);
+				blockpos.Z = rangelim(blockpos.Z, bpmin.Z, bpmax.Z);
+				if (blockpos_over_max_limit(blockpos))
+					continue;
+
+				{
+					MutexAutoLock lock(state.mutex);
+					state.in_flight++;
+				}
+				if (!emerge->enqueueBlockEmergeEx(blockpos, PEER_ID_INEXISTENT,
+						BLOCK_EMERGE_ALLOW_GEN | BLOCK_EMERGE_FORCE_QUEUE,
+						pregenerate_callback, &state)) {
+					pregenerate_callback(blockpos, EMERGE_ERRORED, &state);
+				}
+			}
+			sanity_check(curve_d <= curve_length);
+
+			const u64 now = porting::getTimeMs();
+			if (now - last_update_time < 1000)
+				continue;
+
+			// Save and unload what the mapgen no longer needs. This saves all
+			// blocks in one transaction.
+			{
+				EnvAutoLock envlock(&server);
+				map.timerUpdate((now - last_update_time) / 1000.0f, 5.0f, -1);
+				map.step();
+				// There are no clients to send these to
+				while (!server.m_unsent_map_edit_queue.empty()) {
+					delete server.m_unsent_map_edit_queue.front();
+					server.m_unsent_map_edit_queue.pop();
+				}
+			}
+			last_update_time = now;
+
+			MutexAutoLock lock(state.mutex);
+			const u32 done = state.generated + state.loaded + state.failed;
+			std::cerr << " Pregenerated " << done << " of " << total
+				<< " mapchunks, " << (100.0f * done / total) << "% completed, "
+				<< (state.generated * csize * csize * csize * 1000.0f /
+					(now - start_time)) << " blocks/s.\r" << std::flush;
+		}
+		std::cerr << std::endl;
+
+		emerge->stopThreads();
+		const float seconds = std::max<u64>(porting::getTimeMs() - start_time, 1) / 1000.0f;
+		actionstream << "Pregenerated " << state.generated << " mapchunks ("
+			<< state.generated * csize * csize * csize << " blocks) in "
+			<< seconds << "s, " << state.generated * csize * csize * csize / seconds
+			<< " blocks/s. " << state.loaded << " mapchunks existed already, "
+			<< state.failed << " failed." << std::endl;
+
+		// The server saves the rest of the map when it is destroyed
+		return !kill && state.failed == 0;
+	} catch (BaseException &e) {
+		errorstream << "Pregenerating the map failed: " << e.what() << std::endl;
+		return false;
+	}
+}
+
 u16 Server::getProtocolVersionMin()
 {
 	u16 min_proto = g_settings->getU16("protocol_version_min");
@@ -62,6 +62,7 @@ struct Lighting;
 class ServerThread;
 class ServerModManager;
 class ServerInventoryManager;
+class SerializedBlockCache;
 struct PackedValue;
 struct ParticleParameters;
 struct ParticleSpawnerParameters;
@@ -439,6 +440,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	static bool migrateModStorageDatabase(const GameParams &game_params,
 			const Settings &cmd_args);
 
+	// Generates the map between two node positions without running the
+	// server, for "--pregenerate"
+	static bool pregenerateMap(const GameParams &game_params,
+			const Settings &cmd_args);
+
 	static u16 getProtocolVersionMin();
 	static u16 getProtocolVersionMax();
 
@@ -502,15 +508,6 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		std::unordered_set<session_t> waiting_players;
 	};
 
-	// The standard library does not implement std::hash for pairs so we have this:
-	struct SBCHash {
-		size_t operator() (const std::pair<v3s16, u16> &p) const {
-			return std::hash<v3s16>()(p.first) ^ p.second;
-		}
-	};
-
-	typedef std::unordered_map<std::pair<v3s16, u16>, std::string, SBCHash> SerializedBlockCache;
-
 	void init();
 
 	void SendMovement(session_t peer_id);
@@ -567,9 +564,10 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 			float far_d_nodes = 100);
 
 	// Environment and Connection must be locked when called
-	// `cache` may only be very short lived! (invalidation not handeled)
+	// The serialized block is kept in m_block_cache until the block is
+	// modified (MapBlock::net_cache_valid is cleared) or evicted.
 	void SendBlockNoLock(session_t peer_id, MapBlock *block, u8 ver,
-		u16 net_proto_version, SerializedBlockCache *cache = nullptr);
+		u16 net_proto_version);
 
 	// Sends blocks to clients (locks env and con on its own)
 	void SendBlocks(float dtime);
@@ -662,6 +660,7 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	float m_liquid_transform_every = 1.0f;
 	float m_masterserver_timer = 0.0f;
 	float m_emergethread_trigger_timer = 0.0f;
+	float m_emerge_viewers_timer = 0.0f;
 	float m_savemap_timer = 0.0f;
 	IntervalLimiter m_map_timer_and_unload_interval;
 	IntervalLimiter m_max_lag_decrease;
@@ -772,6 +771,9 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Inventory manager
 	std::unique_ptr<ServerInventoryManager> m_inventory_mgr;
 
+	// Serialized blocks kept for sending to clients
+	std::unique_ptr<SerializedBlockCache> m_block_cache;
+
 	// Global server metrics backend
 	std::unique_ptr<MetricsBackend> m_metrics_backend;
 
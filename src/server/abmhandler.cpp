@@ -0,0 +1,427 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#include "abmhandler.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "noise.h"
+#include "serverenvironment.h"
+#include "util/basic_macros.h"
+#include "util/numeric.h"
+
+#define CONTENT_TYPE_CACHE_MAX 64
+
+namespace {
+
+// Checks the Y limits, chance and neighbors of an ABM for the node at p0.
+// get_content(p1) returns the content of a node relative to the block.
+template <typename R, typename G>
+bool check_abm(const ActiveABM &aabm, v3s16 p0, v3s16 p, R &&random, G &&get_content)
+{
+	if ((p.Y < aabm.min_y) || (p.Y > aabm.max_y))
+		return false;
+
+	if (random() % aabm.chance != 0)
+		return false;
+
+	// Check neighbors
+	const bool check_required_neighbors = !aabm.required_neighbors.empty();
+	const bool check_without_neighbors = !aabm.without_neighbors.empty();
+	if (!check_required_neighbors && !check_without_neighbors)
+		return true;
+
+	v3s16 p1;
+	bool have_required = false;
+	for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
+	for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
+	for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
+	{
+		if(p1 == p0)
+			continue;
+		content_t c = get_content(p1);
+		if (check_required_neighbors && !have_required) {
+			if (CONTAINS(aabm.required_neighbors, c)) {
+				if (!check_without_neighbors)
+					return true;
+				have_required = true;
+			}
+		}
+		if (check_without_neighbors) {
+			if (CONTAINS(aabm.without_neighbors, c))
+				return false;
+		}
+	}
+	// No required neighbor found
+	return have_required || !check_required_neighbors;
+}
+
+}
+
+ABMHandler::ABMHandler(std::vector<ABMWithState> &abms, float dtime_s,
+		const NodeDefManager *ndef, bool use_timers)
+{
+	if (dtime_s < 0.001f)
+		return;
+	for (ABMWithState &abmws : abms) {
+		ActiveBlockModifier *abm = abmws.abm;
+		float trigger_interval = abm->getTriggerInterval();
+		if (trigger_interval < 0.001f)
+			trigger_interval = 0.001f;
+		float actual_interval = dtime_s;
+		if (use_timers) {
+			abmws.timer += dtime_s;
+			if(abmws.timer < trigger_interval)
+				continue;
+			abmws.timer -= trigger_interval;
+			actual_interval = trigger_interval;
+		}
+		float chance = abm->getTriggerChance();
+		if (chance == 0)
+			chance = 1;
+
+		ActiveABM aabm;
+		aabm.abm = abm;
+		if (abm->getSimpleCatchUp()) {
+			float intervals = actual_interval / trigger_interval;
+			if (intervals == 0)
+				continue;
+			aabm.chance = chance / intervals;
+			if (aabm.chance == 0)
+				aabm.chance = 1;
+		} else {
+			aabm.chance = chance;
+		}
+		// y limits
+		aabm.min_y = abm->getMinY();
+		aabm.max_y = abm->getMaxY();
+
+		if (abm->getBulk()) {
+			aabm.bulk_index = m_bulk.size();
+			m_bulk.push_back({abm, {}, {}});
+		}
+
+		// Trigger neighbors
+		for (const auto &s : abm->getRequiredNeighbors())
+			ndef->getIds(s, aabm.required_neighbors);
+		SORT_AND_UNIQUE(aabm.required_neighbors);
+
+		for (const auto &s : abm->getWithoutNeighbors())
+			ndef->getIds(s, aabm.without_neighbors);
+		SORT_AND_UNIQUE(aabm.without_neighbors);
+
+		// Trigger contents
+		std::vector<content_t> ids;
+		for (const auto &s : abm->getTriggerContents())
+			ndef->getIds(s, ids);
+		SORT_AND_UNIQUE(ids);
+		for (content_t c : ids) {
+			if (c >= m_aabms.size())
+				m_aabms.resize(c + 256, nullptr);
+			if (!m_aabms[c])
+				m_aabms[c] = new std::vector<ActiveABM>;
+			m_aabms[c]->push_back(aabm);
+		}
+	}
+}
+
+ABMHandler::~ABMHandler()
+{
+	for (auto &aabms : m_aabms)
+		delete aabms;
+}
+
+u32 ABMHandler::countObjects(MapBlock *block, Map *map, u32 &wider)
+{
+	wider = 0;
+	u32 wider_unknown_count = 0;
+	for(s16 x=-1; x<=1; x++)
+		for(s16 y=-1; y<=1; y++)
+			for(s16 z=-1; z<=1; z++)
+			{
+				MapBlock *block2 = map->getBlockNoCreateNoEx(
+					block->getPos() + v3s16(x,y,z));
+				if(block2==NULL){
+					wider_unknown_count++;
+					continue;
+				}
+				wider += block2->m_static_objects.size();
+			}
+	// Extrapolate
+	u32 active_object_count = block->m_static_objects.getActiveSize();
+	u32 wider_known_count = 3 * 3 * 3 - wider_unknown_count;
+	wider += wider_unknown_count * wider / wider_known_count;
+	return active_object_count;
+}
+
+bool ABMHandler::checkContentCache(MapBlock *block, int &blocks_cached) const
+{
+	if (m_aabms.empty())
+		return false;
+
+	// Check the content type cache first
+	// to see whether there are any ABMs
+	// to be run at all for this block.
+	if (!block->contents.empty()) {
+		assert(!block->do_not_cache_contents); // invariant
+		blocks_cached++;
+		bool run_abms = false;
+		for (content_t c : block->contents) {
+			if (c < m_aabms.size() && m_aabms[c]) {
+				run_abms = true;
+				break;
+			}
+		}
+		if (!run_abms)
+			return false;
+	}
+	return true;
+}
+
+template <typename F>
+void ABMHandler::forEachNode(MapBlock *block, F &&cb) const
+{
+	bool want_contents_cached = block->contents.empty() && !block->do_not_cache_contents;
+
+	v3s16 p0;
+	for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
+	for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
+	for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
+	{
+		MapNode n = block->getNodeNoCheck(p0);
+		content_t c = n.getContent();
+
+		// Cache content types as we go
+		if (want_contents_cached && !CONTAINS(block->contents, c)) {
+			if (block->contents.size() >= CONTENT_TYPE_CACHE_MAX) {
+				// Too many different nodes... don't try to cache
+				want_contents_cached = false;
+				block->do_not_cache_contents = true;
+				block->contents.clear();
+				block->contents.shrink_to_fit();
+			} else {
+				block->contents.push_back(c);
+			}
+		}
+
+		if (c >= m_aabms.size() || !m_aabms[c])
+			continue;
+
+		if (!cb(p0, n, *m_aabms[c]))
+			return;
+	}
+}
+
+void ABMHandler::apply(ServerEnvironment *env, MapBlock *block,
+		int &blocks_scanned, int &abms_run, int &blocks_cached)
+{
+	if (!checkContentCache(block, blocks_cached))
+		return;
+	blocks_scanned++;
+
+	ServerMap *map = &env->getServerMap();
+
+	u32 active_object_count_wider;
+	u32 active_object_count = countObjects(block, map, active_object_count_wider);
+	env->m_added_objects = 0;
+
+	auto get_content = [&] (v3s16 p1) -> content_t {
+		if (block->isValidPosition(p1)) {
+			// if the neighbor is found on the same map block
+			// get it straight from there
+			return block->getNodeNoCheck(p1).getContent();
+		}
+		// otherwise consult the map
+		return map->getNode(p1 + block->getPosRelative()).getContent();
+	};
+	auto random = [] () { return myrand(); };
+
+	forEachNode(block, [&] (v3s16 p0, MapNode n, std::vector<ActiveABM> &aabms) {
+		const content_t c = n.getContent();
+		v3s16 p = p0 + block->getPosRelative();
+		for (ActiveABM &aabm : aabms) {
+			if (!check_abm(aabm, p0, p, random, get_content))
+				continue;
+
+			if (aabm.bulk_index >= 0) {
+				addToBulk(aabm, p, n);
+				continue;
+			}
+
+			abms_run++;
+			// Call all the trigger variations
+			aabm.abm->trigger(env, p, n);
+			aabm.abm->trigger(env, p, n,
+				active_object_count, active_object_count_wider);
+
+			if (block->isOrphan())
+				return false;
+
+			// Count surrounding objects again if the abms added any
+			if(env->m_added_objects > 0) {
+				active_object_count = countObjects(block, map, active_object_count_wider);
+				env->m_added_objects = 0;
+			}
+
+			// Update and check node after possible modification
+			n = block->getNodeNoCheck(p0);
+			if (n.getContent() != c)
+				break;
+		}
+		return true;
+	});
+
+	triggerBulk(env, block, active_object_count, active_object_count_wider, abms_run);
+}
+
+void ABMHandler::addToBulk(const ActiveABM &aabm, v3s16 p, MapNode n)
+{
+	BulkBatch &batch = m_bulk[aabm.bulk_index];
+	batch.positions.push_back(p);
+	batch.nodes.push_back(n);
+}
+
+void ABMHandler::triggerBulk(ServerEnvironment *env, MapBlock *block,
+		u32 &active_object_count, u32 &active_object_count_wider, int &abms_run)
+{
+	ServerMap *map = &env->getServerMap();
+	const v3s16 pos_of_block = block->getPosRelative();
+
+	for (BulkBatch &batch : m_bulk) {
+		if (batch.positions.empty())
+			continue;
+		if (block->isOrphan()) {
+			batch.positions.clear();
+			batch.nodes.clear();
+			continue;
+		}
+
+		// Drop nodes an earlier ABM changed and refresh the others
+		size_t j = 0;
+		for (size_t i = 0; i < batch.positions.size(); i++) {
+			MapNode n = block->getNodeNoCheck(batch.positions[i] - pos_of_block);
+			if (n.getContent() != batch.nodes[i].getContent())
+				continue;
+			batch.positions[j] = batch.positions[i];
+			batch.nodes[j] = n;
+			j++;
+		}
+		batch.positions.resize(j);
+		batch.nodes.resize(j);
+
+		if (j > 0) {
+			abms_run += j;
+			batch.abm->trigger(env, block, batch.positions, batch.nodes,
+				active_object_count, active_object_count_wider);
+
+			// Count surrounding objects again if the abms added any
+			if (env->m_added_objects > 0 && !block->isOrphan()) {
+				active_object_count = countObjects(block, map, active_object_count_wider);
+				env->m_added_objects = 0;
+			}
+		}
+
+		batch.positions.clear();
+		batch.nodes.clear();
+	}
+}
+
+bool ABMHandler::prepareScan(Map *map, v3s16 blockpos, u64 seed, BlockScan &scan)
+{
+	v3s16 d;
+	int i = 0;
+	for (d.Z = -1; d.Z <= 1; d.Z++)
+	for (d.Y = -1; d.Y <= 1; d.Y++)
+	for (d.X = -1; d.X <= 1; d.X++)
+		scan.blocks[i++] = map->getBlockNoCreateNoEx(blockpos + d);
+	scan.pos = blockpos;
+	scan.seed = seed;
+	scan.scanned = scan.cached = false;
+	scan.triggers.clear();
+	return scan.getBlock() != nullptr;
+}
+
+void ABMHandler::scan(BlockScan &scan) const
+{
+	MapBlock *block = scan.getBlock();
+	int blocks_cached = 0;
+	bool run = checkContentCache(block, blocks_cached);
+	scan.cached = blocks_cached > 0;
+	if (!run)
+		return;
+	scan.scanned = true;
+
+	// Map::getNode() is not thread-safe, read the neighbors directly
+	auto get_content = [&] (v3s16 p1) -> content_t {
+		if (block->isValidPosition(p1))
+			return block->getNodeNoCheck(p1).getContent();
+		v3s16 bp(0, 0, 0);
+		for (int i = 0; i < 3; i++) {
+			if (p1[i] < 0) {
+				bp[i] = -1;
+				p1[i] += MAP_BLOCKSIZE;
+			} else if (p1[i] >= MAP_BLOCKSIZE) {
+				bp[i] = 1;
+				p1[i] -= MAP_BLOCKSIZE;
+			}
+		}
+		MapBlock *block2 = scan.blocks[(bp.Z + 1) * 9 + (bp.Y + 1) * 3 + (bp.X + 1)];
+		if (!block2)
+			return CONTENT_IGNORE;
+		return block2->getNodeNoCheck(p1).getContent();
+	};
+	PcgRandom pr(scan.seed);
+	auto random = [&pr] () { return pr.next(); };
+
+	forEachNode(block, [&] (v3s16 p0, MapNode n, const std::vector<ActiveABM> &aabms) {
+		v3s16 p = p0 + block->getPosRelative();
+		for (const ActiveABM &aabm : aabms) {
+			if (check_abm(aabm, p0, p, random, get_content))
+				scan.triggers.push_back({&aabm, p0, n.getContent()});
+		}
+		return true;
+	});
+}
+
+void ABMHandler::trigger(ServerEnvironment *env, const BlockScan &scan, int &abms_run)
+{
+	if (scan.triggers.empty())
+		return;
+	MapBlock *block = scan.getBlock();
+	ServerMap *map = &env->getServerMap();
+
+	u32 active_object_count_wider;
+	u32 active_object_count = countObjects(block, map, active_object_count_wider);
+	env->m_added_objects = 0;
+
+	for (const auto &t : scan.triggers) {
+		// Skip if an earlier ABM changed the node
+		MapNode n = block->getNodeNoCheck(t.p0);
+		if (n.getContent() != t.c)
+			continue;
+
+		v3s16 p = t.p0 + block->getPosRelative();
+		if (t.aabm->bulk_index >= 0) {
+			addToBulk(*t.aabm, p, n);
+			continue;
+		}
+
+		abms_run++;
+		// Call all the trigger variations
+		t.aabm->abm->trigger(env, p, n);
+		t.aabm->abm->trigger(env, p, n,
+			active_object_count, active_object_count_wider);
+
+		if (block->isOrphan())
+			break;
+
+		// Count surrounding objects again if the abms added any
+		if(env->m_added_objects > 0) {
+			active_object_count = countObjects(block, map, active_object_count_wider);
+			env->m_added_objects = 0;
+		}
+	}
+
+	triggerBulk(env, block, active_object_count, active_object_count_wider, abms_run);
+}
@@ -0,0 +1,113 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#pragma once
+
+#include <vector>
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include "util/basic_macros.h"
+
+class ActiveBlockModifier;
+struct ABMWithState;
+class Map;
+class MapBlock;
+class NodeDefManager;
+class ServerEnvironment;
+
+struct ActiveABM
+{
+	ActiveBlockModifier *abm;
+	std::vector<content_t> required_neighbors;
+	std::vector<content_t> without_neighbors;
+	int chance;
+	s16 min_y, max_y;
+	// Index into the bulk batches of the handler, -1 if not a bulk ABM
+	int bulk_index = -1;
+};
+
+class ABMHandler
+{
+public:
+	ABMHandler(std::vector<ABMWithState> &abms, float dtime_s,
+		const NodeDefManager *ndef, bool use_timers);
+	~ABMHandler();
+	DISABLE_CLASS_COPY(ABMHandler)
+
+	// Find out how many objects the given block and its neighbors contain.
+	// Returns the number of objects in the block, and also in 'wider' the
+	// number of objects in the block and all its neighbors. The latter
+	// may an estimate if any neighbors are unloaded.
+	static u32 countObjects(MapBlock *block, Map *map, u32 &wider);
+
+	// Runs the ABMs on a block, triggers are called as soon as they are found.
+	// Bulk ABMs are collected and called at the end of the block.
+	void apply(ServerEnvironment *env, MapBlock *block,
+		int &blocks_scanned, int &abms_run, int &blocks_cached);
+
+	/*
+		Split version of apply() for running the C++ side on worker threads:
+		scan() does the content, chance and neighbor checks and trigger() calls
+		the ABMs that passed on the main thread afterwards.
+		Note that all neighbor checks see the map as it was before any ABM
+		ran, unlike apply().
+	*/
+	struct BlockScan {
+		struct Trigger {
+			const ActiveABM *aabm;
+			v3s16 p0; // relative to block
+			content_t c;
+		};
+
+		v3s16 pos;
+		// Block to scan and its neighbors, index (z+1)*9 + (y+1)*3 + (x+1).
+		// Unloaded neighbors are nullptr.
+		MapBlock *blocks[27];
+		// Seed for the chance rolls
+		u64 seed;
+
+		// Results
+		bool scanned = false;
+		bool cached = false;
+		std::vector<Trigger> triggers;
+
+		MapBlock *getBlock() const { return blocks[13]; }
+	};
+
+	// Looks up the block and its neighbors in the map. Returns false if
+	// the block does not exist.
+	static bool prepareScan(Map *map, v3s16 blockpos, u64 seed, BlockScan &scan);
+
+	// Thread-safe for different blocks as long as the map is not modified
+	void scan(BlockScan &scan) const;
+
+	void trigger(ServerEnvironment *env, const BlockScan &scan, int &abms_run);
+
+private:
+	// Returns false if the content cache says that there is nothing to do
+	bool checkContentCache(MapBlock *block, int &blocks_cached) const;
+
+	// Calls cb(p0, n, aabms) for every node of the block that has ABMs,
+	// caching the content types of the block on the way.
+	// Stops if cb returns false.
+	template <typename F>
+	void forEachNode(MapBlock *block, F &&cb) const;
+
+	void addToBulk(const ActiveABM &aabm, v3s16 p, MapNode n);
+
+	// Calls the collected bulk ABMs, skipping nodes that were changed
+	// in the meantime
+	void triggerBulk(ServerEnvironment *env, MapBlock *block,
+		u32 &active_object_count, u32 &active_object_count_wider, int &abms_run);
+
+	struct BulkBatch {
+		ActiveBlockModifier *abm;
+		std::vector<v3s16> positions;
+		std::vector<MapNode> nodes;
+	};
+
+	std::vector<std::vector<ActiveABM> *> m_aabms;
+	std::vector<BulkBatch> m_bulk;
+};
@@ -2,6 +2,8 @@
 // SPDX-License-Identifier: LGPL-2.1-or-later
 // Copyright (C) 2010-2018 nerzhul, Loic BLOT <loic.blot@unix-experience.fr>
 
+#include <algorithm>
+#include <cmath>
 #include <log.h>
 #include "mapblock.h"
 #include "profiler.h"
@@ -25,12 +27,21 @@ void ActiveObjectMgr::clearIf(const std::function<bool(ServerActiveObject *, u16
 		if (!it.second)
 			continue;
 		if (cb(it.second.get(), it.first)) {
+			removeFromIndex(it.first);
 			// Remove reference from m_active_objects
 			m_active_objects.remove(it.first);
 		}
 	}
 }
 
+void ActiveObjectMgr::clear()
+{
+	// on_destruct could add new objects so this has to be a loop
+	do {
+		clearIf([] (ServerActiveObject *, u16) { return true; });
+	} while (!m_active_objects.empty());
+}
+
 void ActiveObjectMgr::step(
 		float dtime, const std::function<void(ServerActiveObject *)> &f)
 {
@@ -77,6 +88,7 @@ bool ActiveObjectMgr::registerObject(std::unique_ptr<ServerActiveObject> obj)
 	}
 
 	auto obj_id = obj->getId();
+	addToIndex(obj.get());
 	m_active_objects.put(obj_id, std::move(obj));
 
 	auto new_size = m_active_objects.size();
@@ -95,6 +107,7 @@ void ActiveObjectMgr::removeObject(u16 id)
 	verbosestream << "Server::ActiveObjectMgr::removeObject(): "
 			<< "id=" << id << std::endl;
 
+	removeFromIndex(id);
 	// this will take the object out of the map and then destruct it
 	bool ok = m_active_objects.remove(id);
 	if (!ok) {
@@ -113,39 +126,133 @@ void ActiveObjectMgr::invalidateActiveObjectObserverCaches()
 	}
 }
 
+v3s16 ActiveObjectMgr::getCell(const v3f &pos)
+{
+	constexpr float cell_size = MAP_BLOCKSIZE * BS;
+	auto to_cell = [] (float f) -> s16 {
+		f = std::floor(f / cell_size);
+		// NaN ends up in the first cell
+		if (!(f > S16_MIN))
+			return S16_MIN;
+		return f < S16_MAX ? f : S16_MAX;
+	};
+	return v3s16(to_cell(pos.X), to_cell(pos.Y), to_cell(pos.Z));
+}
+
+void ActiveObjectMgr::addToIndex(ServerActiveObject *obj)
+{
+	const v3s16 cell = getCell(obj->getBasePosition());
+	m_spatial_entries[obj->getId()] = {obj, cell};
+	m_spatial_grid[cell].push_back(obj);
+	if (obj->getType() == ACTIVEOBJECT_TYPE_PLAYER)
+		m_players.push_back(obj);
+}
+
+void ActiveObjectMgr::removeFromIndex(u16 id)
+{
+	auto it = m_spatial_entries.find(id);
+	if (it == m_spatial_entries.end())
+		return;
+	ServerActiveObject *obj = it->second.obj;
+
+	auto &objs = m_spatial_grid[it->second.cell];
+	objs.erase(std::find(objs.begin(), objs.end(), obj));
+	if (objs.empty())
+		m_spatial_grid.erase(it->second.cell);
+
+	if (obj->getType() == ACTIVEOBJECT_TYPE_PLAYER)
+		m_players.erase(std::find(m_players.begin(), m_players.end(), obj));
+
+	m_spatial_entries.erase(it);
+}
+
+template <typename F>
+void ActiveObjectMgr::forEachObjectNear(const aabb3f &box, F &&cb)
+{
+	const v3s16 minp = getCell(box.MinEdge), maxp = getCell(box.MaxEdge);
+	const s64 volume = (s64)(maxp.X - minp.X + 1) * (maxp.Y - minp.Y + 1) *
+			(maxp.Z - minp.Z + 1);
+
+	// Looking up every cell would be slower than looking at every object
+	if (volume <= 0 || (u64)volume > m_spatial_entries.size()) {
+		for (auto &it : m_spatial_entries)
+			cb(it.second.obj);
+		return;
+	}
+
+	for (s32 z = minp.Z; z <= maxp.Z; z++)
+	for (s32 y = minp.Y; y <= maxp.Y; y++)
+	for (s32 x = minp.X; x <= maxp.X; x++) {
+		auto it = m_spatial_grid.find(v3s16(x, y, z));
+		if (it == m_spatial_grid.end())
+			continue;
+		for (auto *obj : it->second)
+			cb(obj);
+	}
+}
+
+// Neither the grid nor the entries are in any useful order. Results used to
+// be ordered by id, which mods may rely on.
+static void sortById(std::vector<ServerActiveObject *>::iterator begin,
+		std::vector<ServerActiveObject *>::iterator end)
+{
+	std::sort(begin, end, [] (ServerActiveObject *a, ServerActiveObject *b) {
+		return a->getId() < b->getId();
+	});
+}
+
+void ActiveObjectMgr::updateObjectPos(ServerActiveObject *obj)
+{
+	auto it = m_spatial_entries.find(obj->getId());
+	// not registered (yet)
+	if (it == m_spatial_entries.end() || it->second.obj != obj)
+		return;
+
+	const v3s16 cell = getCell(obj->getBasePosition());
+	if (cell == it->second.cell)
+		return;
+
+	auto &old_objs = m_spatial_grid[it->second.cell];
+	old_objs.erase(std::find(old_objs.begin(), old_objs.end(), obj));
+	if (old_objs.empty())
+		m_spatial_grid.erase(it->second.cell);
+
+	m_spatial_grid[cell].push_back(obj);
+	it->second.cell = cell;
+}
+
 void ActiveObjectMgr::getObjectsInsideRadius(const v3f &pos, float radius,
 		std::vector<ServerActiveObject *> &result,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
+	const size_t old_size = result.size();
 	float r2 = radius * radius;
-	for (auto &activeObject : m_active_objects.iter()) {
-		ServerActiveObject *obj = activeObject.second.get();
-		if (!obj)
-			continue;
+	aabb3f box(pos - v3f(radius), pos + v3f(radius));
+	forEachObjectNear(box, [&] (ServerActiveObject *obj) {
 		const v3f &objectpos = obj->getBasePosition();
 		if (objectpos.getDistanceFromSQ(pos) > r2)
-			continue;
+			return;
 
 		if (!include_obj_cb || include_obj_cb(obj))
 			result.push_back(obj);
-	}
+	});
+	sortById(result.begin() + old_size, result.end());
 }
 
 void ActiveObjectMgr::getObjectsInArea(const aabb3f &box,
 		std::vector<ServerActiveObject *> &result,
 		std::function<bool(ServerActiveObject *obj)> include_obj_cb)
 {
-	for (auto &activeObject : m_active_objects.iter()) {
-		ServerActiveObject *obj = activeObject.second.get();
-		if (!obj)
-			continue;
+	const size_t old_size = result.size();
+	forEachObjectNear(box, [&] (ServerActiveObject *obj) {
 		const v3f &objectpos = obj->getBasePosition();
 		if (!box.isPointInside(objectpos))
-			continue;
+			return;
 
 		if (!include_obj_cb || include_obj_cb(obj))
 			result.push_back(obj);
-	}
+	});
+	sortById(result.begin() + old_size, result.end());
 }
 
 void ActiveObjectMgr::getAddedActiveObjectsAroundPos(
@@ -155,42 +262,55 @@ void ActiveObjectMgr::getAddedActiveObjectsAroundPos(
 		std::vector<u16> &added_objects)
 {
 	/*
-		Go through the object list,
+		Go through the objects near the player,
 		- discard removed/deactivated objects,
 		- discard objects that are too far away,
 		- discard objects that are found in current_objects,
 		- discard objects that are not observed by the player.
 		- add remaining objects to added_objects
 	*/
-	for (auto &ao_it : m_active_objects.iter()) {
-		u16 id = ao_it.first;
-
-		// Get object
-		ServerActiveObject *object = ao_it.second.get();
-		if (!object)
-			continue;
-
+	auto check_object = [&] (ServerActiveObject *object) {
 		if (object->isGone())
-			continue;
+			return;
 
 		f32 distance_f = object->getBasePosition().getDistanceFrom(player_pos);
 		if (object->getType() == ACTIVEOBJECT_TYPE_PLAYER) {
 			// Discard if too far
 			if (distance_f > player_radius && player_radius != 0)
-				continue;
+				return;
 		} else if (distance_f > radius)
-			continue;
+			return;
 
 		if (!object->isEffectivelyObservedBy(player_name))
-			continue;
+			return;
 
+		u16 id = object->getId();
 		// Discard if already on current_objects
 		auto n = current_objects.find(id);
 		if (n != current_objects.end())
-			continue;
+			return;
 		// Add to added_objects
 		added_objects.push_back(id);
+	};
+
+	const size_t old_size = added_objects.size();
+	// player_radius = 0 means players are sent regardless of distance
+	const bool all_players = player_radius == 0;
+
+	f32 search_radius = all_players ? radius : std::max(radius, player_radius);
+	aabb3f box(player_pos - v3f(search_radius), player_pos + v3f(search_radius));
+	forEachObjectNear(box, [&] (ServerActiveObject *object) {
+		if (all_players && object->getType() == ACTIVEOBJECT_TYPE_PLAYER)
+			return;
+		check_object(object);
+	});
+	if (all_players) {
+		for (auto *object : m_players)
+			check_object(object);
 	}
+
+	// Keep the order by id that iterating over all objects used to give
+	std::sort(added_objects.begin() + old_size, added_objects.end());
 }
 
 } // namespace server
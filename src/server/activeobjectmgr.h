@@ -5,6 +5,7 @@
 #pragma once
 
 #include <functional>
+#include <unordered_map>
 #include <vector>
 #include "../activeobjectmgr.h"
 #include "serveractiveobject.h"
@@ -18,6 +19,7 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 
 	// If cb returns true, the obj will be deleted
 	void clearIf(const std::function<bool(ServerActiveObject *, u16)> &cb);
+	void clear() override;
 	void step(float dtime,
 			const std::function<void(ServerActiveObject *)> &f) override;
 	bool registerObject(std::unique_ptr<ServerActiveObject> obj) override;
@@ -25,6 +27,10 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 
 	void invalidateActiveObjectObserverCaches();
 
+	// Has to be called when the base position of a registered object changes
+	void updateObjectPos(ServerActiveObject *obj);
+
+	// Note: include_obj_cb must not add or remove objects
 	void getObjectsInsideRadius(const v3f &pos, float radius,
 			std::vector<ServerActiveObject *> &result,
 			std::function<bool(ServerActiveObject *obj)> include_obj_cb);
@@ -36,5 +42,30 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 			f32 radius, f32 player_radius,
 			const std::set<u16> &current_objects,
 			std::vector<u16> &added_objects);
+
+private:
+	/*
+		Spatial index: objects are sorted into a uniform grid of
+		mapblock-sized cells, so that queries only look at objects
+		that are close to the queried area.
+	*/
+	struct SpatialEntry {
+		ServerActiveObject *obj;
+		v3s16 cell;
+	};
+
+	static v3s16 getCell(const v3f &pos);
+
+	void addToIndex(ServerActiveObject *obj);
+	void removeFromIndex(u16 id);
+
+	// Calls cb for every object that may be inside the box
+	template <typename F>
+	void forEachObjectNear(const aabb3f &box, F &&cb);
+
+	std::unordered_map<v3s16, std::vector<ServerActiveObject *>> m_spatial_grid;
+	std::unordered_map<u16, SpatialEntry> m_spatial_entries;
+	// Players are needed separately for the unlimited player transfer distance
+	std::vector<ServerActiveObject *> m_players;
 };
 } // namespace server
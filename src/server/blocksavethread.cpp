@@ -0,0 +1,171 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "blocksavethread.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+#include "database/database.h"
+#include "irrlicht_changes/printing.h"
+#include "log.h"
+#include "porting.h"
+#include "serialization.h"
+#include "servermap.h"
+
+// Maximum number of blocks written in one transaction
+#define SAVE_BATCH_SIZE 64
+
+BlockSaveThread::BlockSaveThread(MapDatabaseAccessor *db, int compression_level,
+		size_t max_queued, MetricsBackend *mb) :
+	Thread("BlockSave"),
+	m_db(db),
+	m_compression_level(compression_level),
+	m_max_queued(MYMAX(max_queued, 1))
+{
+	m_queue_gauge = mb->addGauge(
+		"minetest_map_save_queue_length", "Number of blocks waiting to be written");
+	m_latency_counter = mb->addCounter(
+		"minetest_map_save_latency", "Time from queueing blocks until they were written (in microseconds)");
+	m_written_counter = mb->addCounter(
+		"minetest_map_written_blocks", "Number of blocks written by the save thread");
+}
+
+BlockSaveThread::~BlockSaveThread()
+{
+	{
+		std::unique_lock lock(m_mutex);
+		stop();
+	}
+	m_work_cv.notify_all();
+	wait();
+}
+
+void BlockSaveThread::enqueue(v3s16 pos, std::string &&data)
+{
+	std::unique_lock lock(m_mutex);
+	m_done_cv.wait(lock, [this] { return m_queue.size() < m_max_queued; });
+
+	m_pending[pos]++;
+	m_queue.push_back({pos, std::move(data), porting::getTimeUs()});
+	updateQueueGauge();
+
+	lock.unlock();
+	m_work_cv.notify_one();
+}
+
+void BlockSaveThread::flush()
+{
+	std::unique_lock lock(m_mutex);
+	m_done_cv.wait(lock, [this] { return m_queue.empty() && m_writing.empty(); });
+}
+
+bool BlockSaveThread::getPending(v3s16 pos, std::string &ret)
+{
+	Item item;
+	{
+		std::unique_lock lock(m_mutex);
+		if (m_pending.find(pos) == m_pending.end())
+			return false;
+
+		// Newest data first
+		auto it = std::find_if(m_queue.rbegin(), m_queue.rend(),
+			[pos] (const Item &i) { return i.pos == pos; });
+		if (it != m_queue.rend()) {
+			item = *it;
+		} else {
+			auto it2 = std::find_if(m_writing.rbegin(), m_writing.rend(),
+				[pos] (const Item &i) { return i.pos == pos; });
+			assert(it2 != m_writing.rend());
+			item = *it2;
+		}
+	}
+
+	compressItem(item, ret);
+	return true;
+}
+
+size_t BlockSaveThread::getQueueLength()
+{
+	std::unique_lock lock(m_mutex);
+	return m_queue.size();
+}
+
+void BlockSaveThread::compressItem(const Item &item, std::string &ret) const
+{
+	assert(!item.data.empty());
+	const u8 version = item.data[0];
+
+	std::ostringstream os(std::ios_base::binary);
+	os.write(item.data.data(), 1);
+	compress(std::string_view(item.data).substr(1), os, version, m_compression_level);
+	ret = os.str();
+}
+
+void BlockSaveThread::updateQueueGauge()
+{
+	m_queue_gauge->set(m_queue.size());
+}
+
+void *BlockSaveThread::run()
+{
+	std::vector<std::string> compressed;
+
+	while (true) {
+		{
+			std::unique_lock lock(m_mutex);
+			m_work_cv.wait(lock, [this] { return !m_queue.empty() || stopRequested(); });
+			// Only stop once everything is written
+			if (m_queue.empty())
+				break;
+
+			size_t count = MYMIN(m_queue.size(), SAVE_BATCH_SIZE);
+			for (size_t i = 0; i < count; i++) {
+				m_writing.push_back(std::move(m_queue.front()));
+				m_queue.pop_front();
+			}
+			updateQueueGauge();
+		}
+		// There is space in the queue again
+		m_done_cv.notify_all();
+
+		// m_writing is only modified by this thread, reading it is fine
+		compressed.resize(m_writing.size());
+		for (size_t i = 0; i < m_writing.size(); i++)
+			compressItem(m_writing[i], compressed[i]);
+
+		try {
+			MutexAutoLock dblock(m_db->mutex);
+			m_db->dbase->beginSave();
+			for (size_t i = 0; i < m_writing.size(); i++) {
+				if (!m_db->dbase->saveBlock(m_writing[i].pos, compressed[i])) {
+					errorstream << "BlockSaveThread: Failed to save block "
+						<< m_writing[i].pos << std::endl;
+				}
+			}
+			m_db->dbase->endSave();
+		} catch (std::exception &e) {
+			errorstream << "BlockSaveThread: Failed to save "
+				<< m_writing.size() << " blocks: " << e.what() << std::endl;
+		}
+
+		const u64 now = porting::getTimeUs();
+		u64 latency = 0;
+		for (const Item &item : m_writing)
+			latency += now - item.queued_at;
+		m_latency_counter->increment(latency);
+		m_written_counter->increment(m_writing.size());
+
+		{
+			std::unique_lock lock(m_mutex);
+			for (const Item &item : m_writing) {
+				auto it = m_pending.find(item.pos);
+				if (--it->second == 0)
+					m_pending.erase(it);
+			}
+			m_writing.clear();
+		}
+		m_done_cv.notify_all();
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,87 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "irr_v3d.h"
+#include "threading/thread.h"
+#include "util/metricsbackend.h"
+
+struct MapDatabaseAccessor;
+
+/*
+	Writes map blocks to the database in the background.
+
+	The server thread only serializes blocks without compressing them
+	(MapBlock::serializeUncompressed()) and queues the result. This thread
+	compresses the data and writes it in batches, each batch in its own
+	transaction. The queue has a fixed length, queueing blocks when it is full
+	waits for the thread to catch up.
+
+	Blocks that are queued or being written are not in the database yet,
+	so readers have to check getPending() first.
+*/
+class BlockSaveThread : public Thread
+{
+public:
+	/// @param db database to write to, must outlive this
+	/// @param max_queued maximum number of blocks waiting to be written
+	BlockSaveThread(MapDatabaseAccessor *db, int compression_level,
+		size_t max_queued, MetricsBackend *mb);
+	/// Writes everything that is still queued, then stops the thread.
+	~BlockSaveThread();
+
+	/// Queues a block for writing. Waits if the queue is full.
+	/// @param data serialization version followed by the output of
+	///             MapBlock::serializeUncompressed()
+	void enqueue(v3s16 pos, std::string &&data);
+
+	/// Waits until everything queued so far is in the database.
+	void flush();
+
+	/// If a block is waiting to be written, puts its data (in the format
+	/// MapDatabase::loadBlock() would return) into ret.
+	/// @return whether the block was found
+	bool getPending(v3s16 pos, std::string &ret);
+
+	size_t getQueueLength();
+
+protected:
+	void *run() override;
+
+private:
+	struct Item {
+		v3s16 pos;
+		std::string data;
+		u64 queued_at; // microseconds
+	};
+
+	// Turns the queued format into the database format
+	void compressItem(const Item &item, std::string &ret) const;
+
+	// Requires m_mutex held
+	void updateQueueGauge();
+
+	MapDatabaseAccessor *m_db;
+	const int m_compression_level;
+	const size_t m_max_queued;
+
+	std::mutex m_mutex;
+	std::condition_variable m_work_cv;
+	std::condition_variable m_done_cv;
+	std::deque<Item> m_queue;
+	// Items taken from the queue that are currently being written
+	std::vector<Item> m_writing;
+	// Number of occurrences of each position in m_queue and m_writing
+	std::unordered_map<v3s16, u32> m_pending;
+
+	MetricGaugePtr m_queue_gauge;
+	MetricCounterPtr m_latency_counter;
+	MetricCounterPtr m_written_counter;
+};
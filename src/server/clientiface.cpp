@@ -861,8 +861,8 @@ void ClientInterface::DeleteClient(session_t peer_id)
 		// Get object
 		ServerActiveObject* obj = m_env->getActiveObject(id);
 
-		if(obj && obj->m_known_by_count > 0)
-			obj->m_known_by_count--;
+		if (obj)
+			obj->removeKnownBy(peer_id);
 	}
 
 	// Delete client
@@ -0,0 +1,548 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#include "liquidtransformer.h"
+#include <algorithm>
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "rollback_interface.h"
+#include "serverenvironment.h"
+#include "scripting_server.h"
+#include "threading/thread_pool.h"
+#include "voxelalgorithms.h"
+
+// Number of nodes decided at once with a thread pool
+#define LIQUID_BATCH_SIZE 1024
+// Number of nodes a worker thread decides per task
+#define LIQUID_TASK_SIZE 128
+
+#define WATER_DROP_BOOST 4
+
+namespace {
+
+// Nodes changed in a batch are marked in a hash table without collision
+// handling. A collision only means that a node is decided again.
+constexpr size_t WRITTEN_SIZE = 1 << 18;
+
+inline size_t written_index(v3s16 p)
+{
+	return ((u32)p.X * 73856093U ^ (u32)p.Y * 19349663U ^ (u32)p.Z * 83492791U) &
+		(WRITTEN_SIZE - 1);
+}
+
+const v3s16 liquid_6dirs[6] = {
+	// order: upper before same level before lower
+	v3s16( 0, 1, 0),
+	v3s16( 0, 0, 1),
+	v3s16( 1, 0, 0),
+	v3s16( 0, 0,-1),
+	v3s16(-1, 0, 0),
+	v3s16( 0,-1, 0)
+};
+
+enum NeighborType : u8 {
+	NEIGHBOR_UPPER,
+	NEIGHBOR_SAME_LEVEL,
+	NEIGHBOR_LOWER
+};
+
+struct NodeNeighbor {
+	MapNode n;
+	NeighborType t;
+	v3s16 p;
+
+	NodeNeighbor()
+		: n(CONTENT_AIR), t(NEIGHBOR_SAME_LEVEL)
+	{ }
+
+	NodeNeighbor(const MapNode &node, NeighborType n_type, const v3s16 &pos)
+		: n(node),
+		  t(n_type),
+		  p(pos)
+	{ }
+};
+
+s8 get_max_liquid_level(NodeNeighbor nb, s8 current_max_node_level)
+{
+	s8 max_node_level = current_max_node_level;
+	u8 nb_liquid_level = (nb.n.param2 & LIQUID_LEVEL_MASK);
+	switch (nb.t) {
+		case NEIGHBOR_UPPER:
+			if (nb_liquid_level + WATER_DROP_BOOST > current_max_node_level) {
+				max_node_level = LIQUID_LEVEL_MAX;
+				if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+					max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+			} else if (nb_liquid_level > current_max_node_level) {
+				max_node_level = nb_liquid_level;
+			}
+			break;
+		case NEIGHBOR_LOWER:
+			break;
+		case NEIGHBOR_SAME_LEVEL:
+			if ((nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+					nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+				max_node_level = nb_liquid_level - 1;
+			break;
+	}
+	return max_node_level;
+}
+
+}
+
+
+LiquidTransformer::LiquidTransformer(Map *map, IGameDef *gamedef, ThreadPool *pool) :
+	m_map(map),
+	m_gamedef(gamedef),
+	m_ndef(gamedef->ndef()),
+	m_pool(pool)
+{
+}
+
+
+u32 LiquidTransformer::transform(UniqueQueue<v3s16> &queue, u32 max_count,
+		std::map<v3s16, MapBlock*> &modified_blocks, ServerEnvironment *env)
+{
+	m_must_reflow.clear();
+	m_changed_nodes.clear();
+	m_check_for_falling.clear();
+
+	max_count = std::min(max_count, queue.size());
+	auto get_node = [this] (v3s16 p) { return m_map->getNode(p); };
+
+	if (!m_pool || m_pool->getThreadCount() == 0) {
+		Decision d;
+		for (u32 i = 0; i < max_count; i++) {
+			const v3s16 p0 = queue.front();
+			queue.pop_front();
+			decide(p0, get_node, d);
+			apply(p0, d, queue, modified_blocks, env);
+		}
+	} else {
+		auto is_written = [this] (v3s16 p0) {
+			if (m_written[written_index(p0)])
+				return true;
+			for (const v3s16 &dir : liquid_6dirs) {
+				if (m_written[written_index(p0 + dir)])
+					return true;
+			}
+			return false;
+		};
+
+		u32 count = 0;
+		while (count < max_count) {
+			// Decide the next nodes of the queue against the current map
+			const u32 batch_size = std::min<u32>(LIQUID_BATCH_SIZE, max_count - count);
+			m_batch.clear();
+			for (auto it = queue.begin(); m_batch.size() < batch_size; ++it)
+				m_batch.push_back(*it);
+			m_decisions.resize(batch_size);
+			prepareBlocks(m_batch);
+
+			const size_t num_tasks = (batch_size + LIQUID_TASK_SIZE - 1) / LIQUID_TASK_SIZE;
+			m_pool->parallelFor(num_tasks, [&] (size_t task) {
+				v3s16 last_blockpos(S16_MAX, S16_MAX, S16_MAX);
+				MapBlock *last_block = nullptr;
+				auto get_prepared_node = [&] (v3s16 p) -> MapNode {
+					const v3s16 blockpos = getNodeBlockPos(p);
+					if (blockpos != last_blockpos) {
+						last_blockpos = blockpos;
+						last_block = getPreparedBlock(blockpos);
+					}
+					if (!last_block)
+						return {CONTENT_IGNORE};
+					return last_block->getNodeNoCheck(p - blockpos * MAP_BLOCKSIZE);
+				};
+				const size_t end = std::min<size_t>((task + 1) * LIQUID_TASK_SIZE, batch_size);
+				for (size_t i = task * LIQUID_TASK_SIZE; i < end; i++)
+					decide(m_batch[i], get_prepared_node, m_decisions[i]);
+			});
+
+			// Apply them in order, deciding again where earlier nodes
+			// changed the neighborhood. A Lua callback may change anything.
+			m_written.assign(WRITTEN_SIZE, false);
+			bool callback_run = false;
+			for (u32 i = 0; i < batch_size; i++) {
+				const v3s16 p0 = m_batch[i];
+				queue.pop_front();
+				Decision &d = m_decisions[i];
+				if (callback_run || is_written(p0))
+					decide(p0, get_node, d);
+				if (apply(p0, d, queue, modified_blocks, env))
+					m_written[written_index(p0)] = true;
+				if (d.changed && d.flood && env)
+					callback_run = true;
+			}
+			count += batch_size;
+		}
+	}
+
+	for (const v3s16 &p : m_must_reflow)
+		queue.push_back(p);
+
+	voxalgo::update_lighting_nodes(m_map, m_changed_nodes, modified_blocks);
+
+	if (env) {
+		for (const v3s16 &p : m_check_for_falling)
+			env->getScriptIface()->check_for_falling(p);
+
+		env->getScriptIface()->on_liquid_transformed(m_changed_nodes);
+	}
+
+	return m_changed_nodes.size();
+}
+
+
+template <typename F>
+void LiquidTransformer::decide(v3s16 p0, F &&get_node, Decision &d) const
+{
+	d = Decision();
+	MapNode n0 = get_node(p0);
+	d.n00 = n0;
+
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = m_ndef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = cf.liquid_alternative_flowing_id;
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+		case LiquidType_END:
+			break;
+	}
+
+	/*
+		Collect information about the environment
+	 */
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	bool floating_node_above = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 0:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 5:
+				nt = NEIGHBOR_LOWER;
+				break;
+			default:
+				break;
+		}
+		v3s16 npos = p0 + liquid_6dirs[i];
+		NodeNeighbor nb(get_node(npos), nt, npos);
+		const ContentFeatures &cfnb = m_ndef->get(nb.n);
+		if (nt == NEIGHBOR_UPPER && cfnb.floats)
+			floating_node_above = true;
+		switch (cfnb.liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						d.queue_always[d.num_queue_always++] = npos;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
+						if (nb.t == NEIGHBOR_LOWER)
+							flowing_down = true;
+						else
+							ignored_sources = true;
+					}
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = cfnb.liquid_alternative_flowing_id;
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(nt != NEIGHBOR_LOWER)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				if (nb.t != NEIGHBOR_SAME_LEVEL ||
+					(nb.n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK) {
+					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+					// but exclude falling liquids on the same level, they cannot flow here anyway
+
+					// used to determine if the neighbor can even flow into this node
+					s8 max_level_from_neighbor = get_max_liquid_level(nb, -1);
+					u8 range = m_ndef->get(cfnb.liquid_alternative_flowing_id).liquid_range;
+
+					if (liquid_kind == CONTENT_AIR &&
+							max_level_from_neighbor >= (LIQUID_LEVEL_MAX + 1 - range))
+						liquid_kind = cfnb.liquid_alternative_flowing_id;
+				}
+				if (cfnb.liquid_alternative_flowing_id != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+			case LiquidType_END:
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = m_ndef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && m_ndef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = m_ndef->get(liquid_kind).liquid_alternative_source_id;
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighboring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			max_node_level = get_max_liquid_level(flows[i], max_node_level);
+		}
+
+		u8 viscosity = m_ndef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				d.reflow = true;
+		} else {
+			new_node_level = max_node_level;
+		}
+
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, just continue with the next node.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(m_ndef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
+	d.changed = true;
+
+	/*
+		check if there is a floating node above that needs to be updated.
+	 */
+	if (floating_node_above && new_node_content == CONTENT_AIR)
+		d.check_for_falling = true;
+
+	/*
+		update the current node
+	 */
+	//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
+	if (m_ndef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bits to 0
+		n0.param2 &= ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+
+	// change the node.
+	n0.setContent(new_node_content);
+	d.n0 = n0;
+
+	// on_flood() the node
+	d.flood = floodable_node != CONTENT_AIR;
+
+	/*
+		enqueue neighbors for update if necessary
+	 */
+	switch (m_ndef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					d.queue_changed[d.num_queue_changed++] = flows[i].p;
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					d.queue_changed[d.num_queue_changed++] = airs[i].p;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				d.queue_changed[d.num_queue_changed++] = flows[i].p;
+			break;
+		case LiquidType_END:
+			break;
+	}
+}
+
+
+bool LiquidTransformer::apply(v3s16 p0, const Decision &d, UniqueQueue<v3s16> &queue,
+		std::map<v3s16, MapBlock*> &modified_blocks, ServerEnvironment *env)
+{
+	for (u8 i = 0; i < d.num_queue_always; i++)
+		queue.push_back(d.queue_always[i]);
+
+	if (d.reflow)
+		m_must_reflow.push_back(p0);
+
+	if (!d.changed)
+		return false;
+
+	if (d.check_for_falling)
+		m_check_for_falling.push_back(p0);
+
+	MapNode n0 = d.n0;
+	if (d.flood && env) {
+		if (env->getScriptIface()->node_on_flood(p0, d.n00, n0))
+			return false;
+	}
+
+	// Ignore light (because calling voxalgo::update_lighting_nodes)
+	ContentLightingFlags f0 = m_ndef->getLightingFlags(n0);
+	n0.setLight(LIGHTBANK_DAY, 0, f0);
+	n0.setLight(LIGHTBANK_NIGHT, 0, f0);
+
+	// Find out whether there is a suspect for this action
+	std::string suspect;
+	if (m_gamedef->rollback())
+		suspect = m_gamedef->rollback()->getSuspect(p0, 83, 1);
+
+	if (m_gamedef->rollback() && !suspect.empty()) {
+		// Blame suspect
+		RollbackScopeActor rollback_scope(m_gamedef->rollback(), suspect, true);
+		// Get old node for rollback
+		RollbackNode rollback_oldnode(m_map, p0, m_gamedef);
+		// Set node
+		m_map->setNode(p0, n0);
+		// Report
+		RollbackNode rollback_newnode(m_map, p0, m_gamedef);
+		RollbackAction action;
+		action.setSetNode(p0, rollback_oldnode, rollback_newnode);
+		m_gamedef->rollback()->reportAction(action);
+	} else {
+		// Set node
+		m_map->setNode(p0, n0);
+	}
+
+	v3s16 blockpos = getNodeBlockPos(p0);
+	MapBlock *block = m_map->getBlockNoCreateNoEx(blockpos);
+	if (block != NULL) {
+		modified_blocks[blockpos] =  block;
+		m_changed_nodes.emplace_back(p0, d.n00);
+	}
+
+	for (u8 i = 0; i < d.num_queue_changed; i++)
+		queue.push_back(d.queue_changed[i]);
+
+	return true;
+}
+
+
+void LiquidTransformer::prepareBlocks(const std::vector<v3s16> &nodes)
+{
+	m_blocks.clear();
+	v3s16 last_blockpos(S16_MAX, S16_MAX, S16_MAX);
+	for (const v3s16 &p : nodes) {
+		const v3s16 blockpos = getNodeBlockPos(p);
+		const v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+		// Neighbors at the border are in the next blocks
+		v3s16 bmin = blockpos, bmax = blockpos;
+		for (int axis = 0; axis < 3; axis++) {
+			if (relpos[axis] == 0)
+				bmin[axis]--;
+			else if (relpos[axis] == MAP_BLOCKSIZE - 1)
+				bmax[axis]++;
+		}
+		if (bmin == bmax && blockpos == last_blockpos)
+			continue;
+		last_blockpos = blockpos;
+
+		v3s16 bp;
+		for (bp.Z = bmin.Z; bp.Z <= bmax.Z; bp.Z++)
+		for (bp.Y = bmin.Y; bp.Y <= bmax.Y; bp.Y++)
+		for (bp.X = bmin.X; bp.X <= bmax.X; bp.X++) {
+			if (m_blocks.find(bp) == m_blocks.end())
+				m_blocks.emplace(bp, m_map->getBlockNoCreateNoEx(bp));
+		}
+	}
+}
+
+
+MapBlock *LiquidTransformer::getPreparedBlock(v3s16 blockpos) const
+{
+	auto it = m_blocks.find(blockpos);
+	return it == m_blocks.end() ? nullptr : it->second;
+}
@@ -0,0 +1,99 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+// Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "mapnode.h"
+#include "util/basic_macros.h"
+#include "util/container.h"
+
+class IGameDef;
+class Map;
+class MapBlock;
+class NodeDefManager;
+class ServerEnvironment;
+class ThreadPool;
+
+/*
+	The liquid simulation: transforms queued nodes according to the liquids
+	around them.
+
+	With a thread pool the next nodes of the queue are first decided on the
+	worker threads, all against the map as it is. The decisions are then
+	applied in queue order. A node whose neighborhood was changed by an
+	earlier node in the meantime is decided again, so the result is always
+	the same as transforming the nodes one after the other.
+*/
+class LiquidTransformer
+{
+public:
+	LiquidTransformer(Map *map, IGameDef *gamedef, ThreadPool *pool = nullptr);
+	DISABLE_CLASS_COPY(LiquidTransformer)
+
+	/*
+		Transforms up to max_count nodes from the front of the queue,
+		neighbors which have to follow are added to its back.
+		The blocks of all changed nodes are added to modified_blocks.
+		env runs the Lua callbacks, it may be nullptr.
+		Returns the number of changed nodes.
+	*/
+	u32 transform(UniqueQueue<v3s16> &queue, u32 max_count,
+		std::map<v3s16, MapBlock*> &modified_blocks, ServerEnvironment *env);
+
+private:
+	// What transforming one node does
+	struct Decision {
+		// Neighbors queued in any case
+		v3s16 queue_always[6];
+		u8 num_queue_always = 0;
+		// Neighbors queued if the node changes
+		v3s16 queue_changed[6];
+		u8 num_queue_changed = 0;
+		// Not at its final level yet because of viscosity
+		bool reflow = false;
+		bool changed = false;
+		bool check_for_falling = false;
+		// The node is floodable, on_flood() has to be called
+		bool flood = false;
+		// Old and new node
+		MapNode n00, n0;
+	};
+
+	// get_node(p) returns the node at p
+	template <typename F>
+	void decide(v3s16 p0, F &&get_node, Decision &d) const;
+
+	// Returns true if the node was changed
+	bool apply(v3s16 p0, const Decision &d, UniqueQueue<v3s16> &queue,
+		std::map<v3s16, MapBlock*> &modified_blocks, ServerEnvironment *env);
+
+	// Looks up the blocks the worker threads read for the given nodes
+	void prepareBlocks(const std::vector<v3s16> &nodes);
+
+	// Thread-safe, nullptr if the block is not loaded
+	MapBlock *getPreparedBlock(v3s16 blockpos) const;
+
+	Map *m_map;
+	IGameDef *m_gamedef;
+	const NodeDefManager *m_ndef;
+	ThreadPool *m_pool;
+
+	// Per call of transform()
+	std::vector<v3s16> m_must_reflow;
+	std::vector<std::pair<v3s16, MapNode>> m_changed_nodes;
+	std::vector<v3s16> m_check_for_falling;
+
+	// Used with a thread pool
+	std::vector<v3s16> m_batch;
+	std::vector<Decision> m_decisions;
+	std::unordered_map<v3s16, MapBlock*> m_blocks;
+	// Nodes changed since the current batch was decided
+	std::vector<bool> m_written;
+};
@@ -130,7 +130,7 @@ class PlayerSAO : public UnitSAO
 
 	void setPlayer(RemotePlayer *player) { m_player = player; }
 	RemotePlayer *getPlayer() { return m_player; }
-	session_t getPeerID() const;
+	session_t getPeerID() const override;
 
 	// Cheat prevention
 
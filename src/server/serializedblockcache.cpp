@@ -0,0 +1,88 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "serializedblockcache.h"
+#include "mapblock.h"
+
+SerializedBlockCache::SerializedBlockCache(size_t max_bytes, MetricsBackend *mb) :
+	m_max_bytes(max_bytes)
+{
+	if (!mb)
+		return;
+
+	m_hit_counter = mb->addCounter(
+			"minetest_core_block_cache_hits",
+			"Number of block sends served from the serialized block cache");
+	m_miss_counter = mb->addCounter(
+			"minetest_core_block_cache_misses",
+			"Number of block sends that had to serialize the block");
+	m_size_gauge = mb->addGauge(
+			"minetest_core_block_cache_bytes",
+			"Size of data in the serialized block cache (in bytes)");
+}
+
+const std::string *SerializedBlockCache::get(MapBlock *block, u8 ver)
+{
+	auto it = m_entries.find(block->getPos());
+	if (it != m_entries.end()) {
+		if (block->net_cache_valid && it->second.ver == ver) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+			if (m_hit_counter)
+				m_hit_counter->increment();
+			return &it->second.data;
+		}
+		// Stale or wrong format, it will be replaced by the caller anyway
+		erase(it);
+	}
+
+	if (m_miss_counter)
+		m_miss_counter->increment();
+	return nullptr;
+}
+
+void SerializedBlockCache::put(MapBlock *block, u8 ver,
+		std::string &&data)
+{
+	const v3s16 pos = block->getPos();
+
+	auto it = m_entries.find(pos);
+	if (it != m_entries.end())
+		erase(it);
+
+	// Entries larger than the whole budget are not worth keeping
+	if (data.size() > m_max_bytes)
+		return;
+
+	while (m_used_bytes + data.size() > m_max_bytes && !m_lru.empty())
+		erase(m_entries.find(m_lru.back()));
+
+	m_lru.push_front(pos);
+	m_used_bytes += data.size();
+	Entry &e = m_entries[pos];
+	e.ver = ver;
+	e.data = std::move(data);
+	e.lru_it = m_lru.begin();
+
+	block->net_cache_valid = true;
+
+	if (m_size_gauge)
+		m_size_gauge->set(m_used_bytes);
+}
+
+void SerializedBlockCache::clear()
+{
+	m_entries.clear();
+	m_lru.clear();
+	m_used_bytes = 0;
+	if (m_size_gauge)
+		m_size_gauge->set(0);
+}
+
+void SerializedBlockCache::erase(std::unordered_map<v3s16, Entry>::iterator it)
+{
+	m_used_bytes -= it->second.data.size();
+	m_lru.erase(it->second.lru_it);
+	m_entries.erase(it);
+	if (m_size_gauge)
+		m_size_gauge->set(m_used_bytes);
+}
@@ -0,0 +1,63 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "util/metricsbackend.h"
+#include <list>
+#include <string>
+#include <unordered_map>
+
+class MapBlock;
+
+/*
+	Keeps the network serialization (as sent in TOCLIENT_BLOCKDATA) of recently
+	sent blocks around, so re-sending an unchanged block is a plain buffer copy.
+
+	An entry is only valid while MapBlock::net_cache_valid is set; any
+	modification of the block clears it and the entry is dropped on the next
+	lookup. Least recently used entries are evicted once the total size of
+	cached data exceeds the budget.
+
+	Not thread-safe, only use with the environment lock held.
+*/
+class SerializedBlockCache
+{
+public:
+	// max_bytes = 0 disables the cache
+	SerializedBlockCache(size_t max_bytes, MetricsBackend *mb = nullptr);
+
+	// Returns the cached data for this block or nullptr if there is none.
+	const std::string *get(MapBlock *block, u8 ver);
+
+	// Stores data for this block, may evict other entries.
+	void put(MapBlock *block, u8 ver, std::string &&data);
+
+	void clear();
+
+	size_t size() const { return m_entries.size(); }
+	size_t getUsedBytes() const { return m_used_bytes; }
+	size_t getMaxBytes() const { return m_max_bytes; }
+
+private:
+	struct Entry {
+		u8 ver;
+		std::string data;
+		std::list<v3s16>::iterator lru_it;
+	};
+
+	void erase(std::unordered_map<v3s16, Entry>::iterator it);
+
+	size_t m_max_bytes;
+	size_t m_used_bytes = 0;
+
+	std::unordered_map<v3s16, Entry> m_entries;
+	// Most recently used at the front
+	std::list<v3s16> m_lru;
+
+	MetricCounterPtr m_hit_counter;
+	MetricCounterPtr m_miss_counter;
+	MetricGaugePtr m_size_gauge;
+};
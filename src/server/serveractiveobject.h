@@ -4,14 +4,20 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <unordered_set>
 #include <optional>
+#include <vector>
 #include "irrlichttypes_bloated.h"
 #include "activeobject.h"
+#include "constants.h" // PEER_ID_INEXISTENT
 #include "itemgroup.h"
+#include "util/basic_macros.h"
 #include "util/container.h"
 
+typedef u16 session_t;
+
 
 /*
 
@@ -63,7 +69,7 @@ class ServerActiveObject : public ActiveObject
 		Some simple getters/setters
 	*/
 	v3f getBasePosition() const { return m_base_position; }
-	void setBasePosition(v3f pos){ m_base_position = pos; }
+	void setBasePosition(v3f pos);
 	ServerEnvironment* getEnv(){ return m_env; }
 
 	/*
@@ -160,6 +166,8 @@ class ServerActiveObject : public ActiveObject
 	virtual const std::unordered_set<object_t> &getAttachmentChildIds() const
 	{ static std::unordered_set<object_t> rv; return rv; }
 	virtual ServerActiveObject *getParent() const { return nullptr; }
+	// Peer controlling this object, if it is a player
+	virtual session_t getPeerID() const { return PEER_ID_INEXISTENT; }
 	virtual ObjectProperties *accessObjectProperties()
 	{ return NULL; }
 	virtual void notifyObjectPropertiesModified()
@@ -192,11 +200,45 @@ class ServerActiveObject : public ActiveObject
 	void dumpAOMessagesToQueue(std::queue<ActiveObjectMessage> &queue);
 
 	/*
-		Number of players which know about this object. Object won't be
-		deleted until this is 0 to keep the id preserved for the right
-		object.
+		Peers which know about this object. Active object messages are
+		only sent to these. Object won't be deleted until this is empty
+		to keep the id preserved for the right object.
 	*/
-	u16 m_known_by_count = 0;
+	std::vector<session_t> m_known_by;
+
+	void removeKnownBy(session_t peer_id)
+	{
+		auto it = std::find(m_known_by.begin(), m_known_by.end(), peer_id);
+		if (it != m_known_by.end()) {
+			*it = m_known_by.back();
+			m_known_by.pop_back();
+		}
+	}
+
+	/*
+		Calls f(peer_id) for every peer in m_known_by that gets the message.
+		Position updates are neither sent to the player of this object nor
+		to peers that know the parent it is attached to.
+	*/
+	template <typename F>
+	void forEachMessageRecipient(const ActiveObjectMessage &aom, F &&f) const
+	{
+		if (aom.datastring.empty() || aom.datastring[0] != AO_CMD_UPDATE_POSITION) {
+			for (session_t peer_id : m_known_by)
+				f(peer_id);
+			return;
+		}
+
+		const session_t own_peer_id = getPeerID();
+		const ServerActiveObject *parent = getParent();
+		for (session_t peer_id : m_known_by) {
+			if (peer_id == own_peer_id)
+				continue;
+			if (parent && CONTAINS(parent->m_known_by, peer_id))
+				continue;
+			f(peer_id);
+		}
+	}
 
 	/*
 		A getter that unifies the above to answer the question:
@@ -23,6 +23,7 @@
 #include "util/basic_macros.h"
 #include "util/pointedthing.h"
 #include "threading/mutex_auto_lock.h"
+#include "threading/thread_pool.h"
 #include "filesys.h"
 #include "gameparams.h"
 #include "database/database-dummy.h"
@@ -35,6 +36,7 @@
 #include "database/database-leveldb.h"
 #endif
 #include "irrlicht_changes/printing.h"
+#include "server/abmhandler.h"
 #include "server/luaentity_sao.h"
 #include "server/player_sao.h"
 
@@ -315,27 +317,12 @@ void LBMManager::applyLBMs(ServerEnvironment *env, MapBlock *block,
 	ActiveBlockList
 */
 
-static void fillRadiusBlock(v3s16 p0, s16 r, std::set<v3s16> &list)
-{
-	v3s16 p;
-	for(p.X=p0.X-r; p.X<=p0.X+r; p.X++)
-		for(p.Y=p0.Y-r; p.Y<=p0.Y+r; p.Y++)
-			for(p.Z=p0.Z-r; p.Z<=p0.Z+r; p.Z++)
-			{
-				// limit to a sphere
-				if (p.getDistanceFrom(p0) <= r) {
-					// Set in list
-					list.insert(p);
-				}
-			}
-}
-
 static void fillViewConeBlock(v3s16 p0,
 	const s16 r,
 	const v3f camera_pos,
 	const v3f camera_dir,
 	const float camera_fov,
-	std::set<v3s16> &list)
+	std::vector<v3s16> &list)
 {
 	v3s16 p;
 	const s16 r_nodes = r * BS * MAP_BLOCKSIZE;
@@ -343,97 +330,192 @@ static void fillViewConeBlock(v3s16 p0,
 	for (p.Y = p0.Y - r; p.Y <= p0.Y+r; p.Y++)
 	for (p.Z = p0.Z - r; p.Z <= p0.Z+r; p.Z++) {
 		if (isBlockInSight(p, camera_pos, camera_dir, camera_fov, r_nodes)) {
-			list.insert(p);
+			list.push_back(p);
 		}
 	}
 }
 
-void ActiveBlockList::update(std::vector<PlayerSAO*> &active_players,
+bool ActiveBlockList::PlayerView::operator==(const PlayerView &other) const
+{
+	return id == other.id && blockpos == other.blockpos &&
+		wanted_range == other.wanted_range && camera_pos == other.camera_pos &&
+		camera_dir == other.camera_dir && fov == other.fov;
+}
+
+ActiveBlockList::PlayerView ActiveBlockList::makeView(const PlayerSAO *playersao)
+{
+	PlayerView view;
+	view.id = playersao->getId();
+	view.blockpos = getNodeBlockPos(floatToInt(playersao->getBasePosition(), BS));
+	view.wanted_range = playersao->getWantedRange();
+	view.camera_pos = playersao->getEyePosition();
+	view.camera_dir = v3f(0,0,1);
+	view.camera_dir.rotateYZBy(playersao->getLookPitch());
+	view.camera_dir.rotateXZBy(playersao->getRotation().Y);
+	if (playersao->getCameraInverted())
+		view.camera_dir = -view.camera_dir;
+	view.fov = playersao->getFov();
+	return view;
+}
+
+void ActiveBlockList::addRef(std::unordered_map<v3s16, u32> &refs, v3s16 p)
+{
+	if (refs[p]++ == 0)
+		m_touched.push_back(p);
+}
+
+void ActiveBlockList::removeRef(std::unordered_map<v3s16, u32> &refs, v3s16 p)
+{
+	auto it = refs.find(p);
+	assert(it != refs.end());
+	if (--it->second == 0) {
+		refs.erase(it);
+		m_touched.push_back(p);
+	}
+}
+
+void ActiveBlockList::fillSphere(v3s16 center, s16 radius, std::vector<v3s16> &list)
+{
+	if (radius != m_sphere_radius) {
+		m_sphere.clear();
+		v3s16 p;
+		for (p.X = -radius; p.X <= radius; p.X++)
+		for (p.Y = -radius; p.Y <= radius; p.Y++)
+		for (p.Z = -radius; p.Z <= radius; p.Z++) {
+			// limit to a sphere
+			if (p.getDistanceFrom(v3s16(0)) <= radius)
+				m_sphere.push_back(p);
+		}
+		m_sphere_radius = radius;
+	}
+	list.clear();
+	for (v3s16 offset : m_sphere)
+		list.push_back(center + offset);
+}
+
+void ActiveBlockList::updateRefs(std::unordered_map<v3s16, u32> &refs,
+	const std::vector<v3s16> &new_list, const std::vector<v3s16> &old_list)
+{
+	// Both lists are sorted, blocks in both don't need to be touched
+	auto n = new_list.begin();
+	auto o = old_list.begin();
+	while (n != new_list.end() || o != old_list.end()) {
+		if (o == old_list.end() || (n != new_list.end() && *n < *o)) {
+			addRef(refs, *n++);
+		} else if (n == new_list.end() || *o < *n) {
+			removeRef(refs, *o++);
+		} else {
+			++n;
+			++o;
+		}
+	}
+}
+
+void ActiveBlockList::update(const std::vector<PlayerView> &active_players,
 	s16 active_block_range,
 	s16 active_object_range,
-	std::set<v3s16> &blocks_removed,
-	std::set<v3s16> &blocks_added,
-	std::set<v3s16> &extra_blocks_added)
+	std::vector<v3s16> &blocks_removed,
+	std::vector<v3s16> &blocks_added,
+	std::vector<v3s16> &extra_blocks_added)
 {
 	/*
-		Create the new list
+		Count forceloaded blocks like players
 	*/
-	std::set<v3s16> newlist = m_forceloaded_list;
-	std::set<v3s16> extralist;
-	m_abm_list = m_forceloaded_list;
-	for (const PlayerSAO *playersao : active_players) {
-		v3s16 pos = getNodeBlockPos(floatToInt(playersao->getBasePosition(), BS));
-		fillRadiusBlock(pos, active_block_range, m_abm_list);
-		fillRadiusBlock(pos, active_block_range, newlist);
-
-		s16 player_ao_range = std::min(active_object_range, playersao->getWantedRange());
-		// only do this if this would add blocks
-		if (player_ao_range > active_block_range) {
-			v3f camera_dir = v3f(0,0,1);
-			camera_dir.rotateYZBy(playersao->getLookPitch());
-			camera_dir.rotateXZBy(playersao->getRotation().Y);
-			if (playersao->getCameraInverted())
-				camera_dir = -camera_dir;
-			fillViewConeBlock(pos,
-				player_ao_range,
-				playersao->getEyePosition(),
-				camera_dir,
-				playersao->getFov(),
-				extralist);
+	if (m_forceloaded_counted != m_forceloaded_list) {
+		for (v3s16 p : m_forceloaded_list) {
+			if (m_forceloaded_counted.find(p) == m_forceloaded_counted.end())
+				addRef(m_refs, p);
 		}
+		for (v3s16 p : m_forceloaded_counted) {
+			if (m_forceloaded_list.find(p) == m_forceloaded_list.end())
+				removeRef(m_refs, p);
+		}
+		m_forceloaded_counted = m_forceloaded_list;
 	}
 
 	/*
-		Find out which blocks on the new list are not on the old list
+		Update the blocks of players that moved, turned or joined
 	*/
-	for (v3s16 p : newlist) {
-		// also remove duplicate blocks from the extra list
-		extralist.erase(p);
-		// If not on old list, it's been added
-		if (m_list.find(p) == m_list.end())
-			blocks_added.insert(p);
+	for (auto &it : m_players)
+		it.second.seen = false;
+
+	std::vector<v3s16> old_list;
+	for (const PlayerView &view : active_players) {
+		auto [it, is_new] = m_players.try_emplace(view.id);
+		PlayerState &state = it->second;
+		state.seen = true;
+		if (!is_new && state.view == view && state.radius == active_block_range)
+			continue;
+
+		// Sphere of active blocks
+		if (is_new || state.view.blockpos != view.blockpos ||
+				state.radius != active_block_range) {
+			old_list.swap(state.blocks);
+			fillSphere(view.blockpos, active_block_range, state.blocks);
+			updateRefs(m_refs, state.blocks, old_list);
+			state.radius = active_block_range;
+		}
+
+		// Extra blocks in the view cone, only if this would add blocks
+		old_list.swap(state.extra);
+		state.extra.clear();
+		s16 player_ao_range = std::min(active_object_range, view.wanted_range);
+		if (player_ao_range > active_block_range) {
+			fillViewConeBlock(view.blockpos,
+				player_ao_range,
+				view.camera_pos,
+				view.camera_dir,
+				view.fov,
+				state.extra);
+		}
+		updateRefs(m_extra_refs, state.extra, old_list);
+
+		state.view = view;
 	}
-	/*
-		Find out which blocks on the extra list are not on the old list
-	*/
-	for (v3s16 p : extralist) {
-		// also make sure newlist has all blocks
-		newlist.insert(p);
-		// If not on old list, it's been added
-		if (m_list.find(p) == m_list.end())
-			extra_blocks_added.insert(p);
+
+	// Players that are gone
+	for (auto it = m_players.begin(); it != m_players.end(); ) {
+		if (it->second.seen) {
+			++it;
+			continue;
+		}
+		updateRefs(m_refs, {}, it->second.blocks);
+		updateRefs(m_extra_refs, {}, it->second.extra);
+		it = m_players.erase(it);
 	}
 
 	/*
-		Find out which blocks on the old list are not on the new + extra list
+		Find out which blocks changed state
 	*/
-	std::set_difference(m_list.begin(), m_list.end(), newlist.begin(), newlist.end(),
-			std::inserter(blocks_removed, blocks_removed.end()));
+	for (v3s16 p : m_touched) {
+		const bool in_range = m_refs.find(p) != m_refs.end();
+		const bool active = in_range || m_extra_refs.find(p) != m_extra_refs.end();
 
-	/*
-		Do some least-effort sanity checks to hopefully catch code bugs.
-	*/
-	assert(newlist.size() >= extralist.size());
-	assert(blocks_removed.size() <= m_list.size());
-	if (!blocks_added.empty()) {
-		assert(newlist.count(*blocks_added.begin()) > 0);
-		assert(blocks_removed.count(*blocks_added.begin()) == 0);
-	}
-	if (!extra_blocks_added.empty()) {
-		assert(newlist.count(*extra_blocks_added.begin()) > 0);
-		assert(extralist.count(*extra_blocks_added.begin()) > 0);
-		assert(blocks_added.count(*extra_blocks_added.begin()) == 0);
-	}
-	if (!blocks_removed.empty()) {
-		assert(newlist.count(*blocks_removed.begin()) == 0);
-		assert(extralist.count(*blocks_removed.begin()) == 0);
-		assert(m_list.count(*blocks_removed.begin()) > 0);
+		if (in_range)
+			m_abm_list.insert(p);
+		else
+			m_abm_list.erase(p);
+
+		if (active) {
+			// If not on old list, it's been added
+			if (m_list.insert(p).second)
+				(in_range ? blocks_added : extra_blocks_added).push_back(p);
+		} else if (m_list.erase(p) > 0) {
+			blocks_removed.push_back(p);
+		}
 	}
+	m_touched.clear();
+}
 
-	/*
-		Update m_list
-	*/
-	m_list = std::move(newlist);
+void ActiveBlockList::clear()
+{
+	m_list.clear();
+	m_abm_list.clear();
+	m_players.clear();
+	m_refs.clear();
+	m_extra_refs.clear();
+	m_forceloaded_counted.clear();
+	m_touched.clear();
 }
 
 /*
@@ -467,6 +549,10 @@ ServerEnvironment::ServerEnvironment(std::unique_ptr<ServerMap> map,
 
 	m_active_object_gauge = mb->addGauge(
 		"minetest_env_active_objects", "Number of active objects");
+
+	u16 abm_threads = g_settings->getU16("num_abm_threads");
+	if (abm_threads > 0)
+		m_abm_thread_pool = std::make_unique<ThreadPool>("ABMWorker", abm_threads);
 }
 
 void ServerEnvironment::init()
@@ -798,251 +884,6 @@ void ServerEnvironment::loadDefaultMeta()
 	m_lbm_mgr.loadIntroductionTimes("", m_server, m_game_time);
 }
 
-struct ActiveABM
-{
-	ActiveBlockModifier *abm;
-	std::vector<content_t> required_neighbors;
-	std::vector<content_t> without_neighbors;
-	int chance;
-	s16 min_y, max_y;
-};
-
-#define CONTENT_TYPE_CACHE_MAX 64
-
-class ABMHandler
-{
-private:
-	ServerEnvironment *m_env;
-	std::vector<std::vector<ActiveABM> *> m_aabms;
-public:
-	ABMHandler(std::vector<ABMWithState> &abms,
-		float dtime_s, ServerEnvironment *env,
-		bool use_timers):
-		m_env(env)
-	{
-		if (dtime_s < 0.001f)
-			return;
-		const NodeDefManager *ndef = env->getGameDef()->ndef();
-		for (ABMWithState &abmws : abms) {
-			ActiveBlockModifier *abm = abmws.abm;
-			float trigger_interval = abm->getTriggerInterval();
-			if (trigger_interval < 0.001f)
-				trigger_interval = 0.001f;
-			float actual_interval = dtime_s;
-			if (use_timers) {
-				abmws.timer += dtime_s;
-				if(abmws.timer < trigger_interval)
-					continue;
-				abmws.timer -= trigger_interval;
-				actual_interval = trigger_interval;
-			}
-			float chance = abm->getTriggerChance();
-			if (chance == 0)
-				chance = 1;
-
-			ActiveABM aabm;
-			aabm.abm = abm;
-			if (abm->getSimpleCatchUp()) {
-				float intervals = actual_interval / trigger_interval;
-				if (intervals == 0)
-					continue;
-				aabm.chance = chance / intervals;
-				if (aabm.chance == 0)
-					aabm.chance = 1;
-			} else {
-				aabm.chance = chance;
-			}
-			// y limits
-			aabm.min_y = abm->getMinY();
-			aabm.max_y = abm->getMaxY();
-
-			// Trigger neighbors
-			for (const auto &s : abm->getRequiredNeighbors())
-				ndef->getIds(s, aabm.required_neighbors);
-			SORT_AND_UNIQUE(aabm.required_neighbors);
-
-			for (const auto &s : abm->getWithoutNeighbors())
-				ndef->getIds(s, aabm.without_neighbors);
-			SORT_AND_UNIQUE(aabm.without_neighbors);
-
-			// Trigger contents
-			std::vector<content_t> ids;
-			for (const auto &s : abm->getTriggerContents())
-				ndef->getIds(s, ids);
-			SORT_AND_UNIQUE(ids);
-			for (content_t c : ids) {
-				if (c >= m_aabms.size())
-					m_aabms.resize(c + 256, nullptr);
-				if (!m_aabms[c])
-					m_aabms[c] = new std::vector<ActiveABM>;
-				m_aabms[c]->push_back(aabm);
-			}
-		}
-	}
-
-	~ABMHandler()
-	{
-		for (auto &aabms : m_aabms)
-			delete aabms;
-	}
-
-	// Find out how many objects the given block and its neighbors contain.
-	// Returns the number of objects in the block, and also in 'wider' the
-	// number of objects in the block and all its neighbors. The latter
-	// may an estimate if any neighbors are unloaded.
-	u32 countObjects(MapBlock *block, ServerMap * map, u32 &wider)
-	{
-		wider = 0;
-		u32 wider_unknown_count = 0;
-		for(s16 x=-1; x<=1; x++)
-			for(s16 y=-1; y<=1; y++)
-				for(s16 z=-1; z<=1; z++)
-				{
-					MapBlock *block2 = map->getBlockNoCreateNoEx(
-						block->getPos() + v3s16(x,y,z));
-					if(block2==NULL){
-						wider_unknown_count++;
-						continue;
-					}
-					wider += block2->m_static_objects.size();
-				}
-		// Extrapolate
-		u32 active_object_count = block->m_static_objects.getActiveSize();
-		u32 wider_known_count = 3 * 3 * 3 - wider_unknown_count;
-		wider += wider_unknown_count * wider / wider_known_count;
-		return active_object_count;
-	}
-	void apply(MapBlock *block, int &blocks_scanned, int &abms_run, int &blocks_cached)
-	{
-		if (m_aabms.empty())
-			return;
-
-		// Check the content type cache first
-		// to see whether there are any ABMs
-		// to be run at all for this block.
-		if (!block->contents.empty()) {
-			assert(!block->do_not_cache_contents); // invariant
-			blocks_cached++;
-			bool run_abms = false;
-			for (content_t c : block->contents) {
-				if (c < m_aabms.size() && m_aabms[c]) {
-					run_abms = true;
-					break;
-				}
-			}
-			if (!run_abms)
-				return;
-		}
-		blocks_scanned++;
-
-		ServerMap *map = &m_env->getServerMap();
-
-		u32 active_object_count_wider;
-		u32 active_object_count = this->countObjects(block, map, active_object_count_wider);
-		m_env->m_added_objects = 0;
-
-		bool want_contents_cached = block->contents.empty() && !block->do_not_cache_contents;
-
-		v3s16 p0;
-		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
-		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
-		for(p0.X=0; p0.X<MAP_BLOCKSIZE; p0.X++)
-		{
-			MapNode n = block->getNodeNoCheck(p0);
-			content_t c = n.getContent();
-
-			// Cache content types as we go
-			if (want_contents_cached && !CONTAINS(block->contents, c)) {
-				if (block->contents.size() >= CONTENT_TYPE_CACHE_MAX) {
-					// Too many different nodes... don't try to cache
-					want_contents_cached = false;
-					block->do_not_cache_contents = true;
-					block->contents.clear();
-					block->contents.shrink_to_fit();
-				} else {
-					block->contents.push_back(c);
-				}
-			}
-
-			if (c >= m_aabms.size() || !m_aabms[c])
-				continue;
-
-			v3s16 p = p0 + block->getPosRelative();
-			for (ActiveABM &aabm : *m_aabms[c]) {
-				if ((p.Y < aabm.min_y) || (p.Y > aabm.max_y))
-					continue;
-
-				if (myrand() % aabm.chance != 0)
-					continue;
-
-				// Check neighbors
-				const bool check_required_neighbors = !aabm.required_neighbors.empty();
-				const bool check_without_neighbors = !aabm.without_neighbors.empty();
-				if (check_required_neighbors || check_without_neighbors) {
-					v3s16 p1;
-					bool have_required = false;
-					for(p1.X = p0.X-1; p1.X <= p0.X+1; p1.X++)
-					for(p1.Y = p0.Y-1; p1.Y <= p0.Y+1; p1.Y++)
-					for(p1.Z = p0.Z-1; p1.Z <= p0.Z+1; p1.Z++)
-					{
-						if(p1 == p0)
-							continue;
-						content_t c;
-						if (block->isValidPosition(p1)) {
-							// if the neighbor is found on the same map block
-							// get it straight from there
-							const MapNode &n = block->getNodeNoCheck(p1);
-							c = n.getContent();
-						} else {
-							// otherwise consult the map
-							MapNode n = map->getNode(p1 + block->getPosRelative());
-							c = n.getContent();
-						}
-						if (check_required_neighbors && !have_required) {
-							if (CONTAINS(aabm.required_neighbors, c)) {
-								if (!check_without_neighbors)
-									goto neighbor_found;
-								have_required = true;
-							}
-						}
-						if (check_without_neighbors) {
-							if (CONTAINS(aabm.without_neighbors, c))
-								goto neighbor_invalid;
-						}
-					}
-					if (have_required || !check_required_neighbors)
-						goto neighbor_found;
-					// No required neighbor found
-					neighbor_invalid:
-					continue;
-				}
-
-				neighbor_found:
-
-				abms_run++;
-				// Call all the trigger variations
-				aabm.abm->trigger(m_env, p, n);
-				aabm.abm->trigger(m_env, p, n,
-					active_object_count, active_object_count_wider);
-
-				if (block->isOrphan())
-					return;
-
-				// Count surrounding objects again if the abms added any
-				if(m_env->m_added_objects > 0) {
-					active_object_count = countObjects(block, map, active_object_count_wider);
-					m_env->m_added_objects = 0;
-				}
-
-				// Update and check node after possible modification
-				n = block->getNodeNoCheck(p0);
-				if (n.getContent() != c)
-					break;
-			}
-		}
-	}
-};
-
 void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 {
 	// Reset usage timer immediately, otherwise a block that becomes active
@@ -1269,7 +1110,7 @@ void ServerEnvironment::clearObjects(ClearObjectsMode mode)
 		obj->markForRemoval();
 
 		// If known by some client, don't delete immediately
-		if (obj->m_known_by_count > 0)
+		if (!obj->m_known_by.empty())
 			return false;
 
 		processActiveObjectRemove(obj);
@@ -1403,7 +1244,7 @@ void ServerEnvironment::step(float dtime)
 		/*
 			Get player block positions
 		*/
-		std::vector<PlayerSAO*> players;
+		std::vector<ActiveBlockList::PlayerView> players;
 		players.reserve(m_players.size());
 		for (RemotePlayer *player : m_players) {
 			// Ignore disconnected players
@@ -1413,7 +1254,7 @@ void ServerEnvironment::step(float dtime)
 			PlayerSAO *playersao = player->getPlayerSAO();
 			assert(playersao);
 
-			players.push_back(playersao);
+			players.push_back(ActiveBlockList::makeView(playersao));
 		}
 
 		/*
@@ -1425,9 +1266,9 @@ void ServerEnvironment::step(float dtime)
 				g_settings->getS16("active_object_send_range_blocks");
 		static thread_local const s16 active_block_range =
 				g_settings->getS16("active_block_range");
-		std::set<v3s16> blocks_removed;
-		std::set<v3s16> blocks_added;
-		std::set<v3s16> extra_blocks_added;
+		std::vector<v3s16> blocks_removed;
+		std::vector<v3s16> blocks_added;
+		std::vector<v3s16> extra_blocks_added;
 		m_active_blocks.update(players, active_block_range, active_object_range,
 			blocks_removed, blocks_added, extra_blocks_added);
 
@@ -1522,7 +1363,7 @@ void ServerEnvironment::step(float dtime)
 		std::shuffle(m_abms.begin(), m_abms.end(), MyRandGenerator());
 
 		// Initialize handling of ActiveBlockModifiers
-		ABMHandler abmhandler(m_abms, m_cache_abm_interval, this, true);
+		ABMHandler abmhandler(m_abms, m_cache_abm_interval, m_server->ndef(), true);
 
 		int blocks_scanned = 0;
 		int abms_run = 0;
@@ -1538,26 +1379,69 @@ void ServerEnvironment::step(float dtime)
 		int i = 0;
 		// determine the time budget for ABMs
 		u32 max_time_ms = m_cache_abm_interval * 1000 * m_cache_abm_time_budget;
-		for (const v3s16 &p : output) {
-			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
-			if (!block)
-				continue;
-
-			i++;
-
-			// Set current time as timestamp
-			block->setTimestampNoChangedFlag(m_game_time);
-
-			/* Handle ActiveBlockModifiers */
-			abmhandler.apply(block, blocks_scanned, abms_run, blocks_cached);
-
+		auto check_time_budget = [&] () -> bool {
 			u32 time_ms = timer.getTimerTime();
-
 			if (time_ms > max_time_ms) {
 				warningstream << "active block modifiers took "
 					  << time_ms << "ms (processed " << i << " of "
 					  << output.size() << " active blocks)" << std::endl;
-				break;
+				return false;
+			}
+			return true;
+		};
+
+		if (m_abm_thread_pool) {
+			// Check all blocks on the worker threads first, the triggers
+			// are then run here in the same order as in the serial case.
+			std::vector<ABMHandler::BlockScan> scans(output.size());
+			size_t scan_count = 0;
+			// The chance rolls of a block only depend on this and its position
+			const u64 seed = myrand();
+			for (const v3s16 &p : output) {
+				u64 block_seed = seed ^ (std::hash<v3s16>()(p) * 0x9E3779B97F4A7C15ULL);
+				if (ABMHandler::prepareScan(m_map.get(), p, block_seed, scans[scan_count]))
+					scan_count++;
+			}
+			scans.resize(scan_count);
+
+			m_abm_thread_pool->parallelFor(scans.size(), [&] (size_t j) {
+				abmhandler.scan(scans[j]);
+			});
+
+			for (const auto &scan : scans) {
+				MapBlock *block = scan.getBlock();
+				// An ABM may have removed the block in the meantime
+				if (m_map->getBlockNoCreateNoEx(scan.pos) != block)
+					continue;
+
+				i++;
+				blocks_scanned += scan.scanned ? 1 : 0;
+				blocks_cached += scan.cached ? 1 : 0;
+
+				// Set current time as timestamp
+				block->setTimestampNoChangedFlag(m_game_time);
+
+				abmhandler.trigger(this, scan, abms_run);
+
+				if (!check_time_budget())
+					break;
+			}
+		} else {
+			for (const v3s16 &p : output) {
+				MapBlock *block = m_map->getBlockNoCreateNoEx(p);
+				if (!block)
+					continue;
+
+				i++;
+
+				// Set current time as timestamp
+				block->setTimestampNoChangedFlag(m_game_time);
+
+				/* Handle ActiveBlockModifiers */
+				abmhandler.apply(this, block, blocks_scanned, abms_run, blocks_cached);
+
+				if (!check_time_budget())
+					break;
 			}
 		}
 		g_profiler->avg("ServerEnv: active blocks", m_active_blocks.m_abm_list.size());
@@ -1972,7 +1856,7 @@ u16 ServerEnvironment::addActiveObjectRaw(std::unique_ptr<ServerActiveObject> ob
 }
 
 /*
-	Remove objects that satisfy (isGone() && m_known_by_count==0)
+	Remove objects that satisfy (isGone() && m_known_by.empty())
 */
 void ServerEnvironment::removeRemovedObjects()
 {
@@ -1992,8 +1876,8 @@ void ServerEnvironment::removeRemovedObjects()
 			deleteStaticFromBlock(obj, id, MOD_REASON_REMOVE_OBJECTS_REMOVE, false);
 
 		// If still known by clients, don't actually remove. On some future
-		// invocation this will be 0, which is when removal will continue.
-		if (obj->m_known_by_count > 0)
+		// invocation this will be empty, which is when removal will continue.
+		if (!obj->m_known_by.empty())
 			return false;
 
 		/*
@@ -2133,7 +2017,7 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 /*
 	Convert objects that are not standing inside active blocks to static.
 
-	If m_known_by_count != 0, active object is not deleted, but static
+	If m_known_by is not empty, active object is not deleted, but static
 	data is still updated.
 
 	If force_delete is set, active object is deleted nevertheless. It
@@ -2189,7 +2073,7 @@ void ServerEnvironment::deactivateFarObjects(const bool _force_delete)
 					  << blockpos_o << std::endl;
 
 		// If known by some client, don't immediately delete.
-		bool pending_delete = (obj->m_known_by_count > 0 && !force_delete);
+		bool pending_delete = (!obj->m_known_by.empty() && !force_delete);
 
 		/*
 			Update the static data
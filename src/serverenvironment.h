@@ -5,6 +5,8 @@
 #pragma once
 
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #include "activeobject.h"
@@ -27,6 +29,7 @@ struct StaticObject;
 class ServerActiveObject;
 class Server;
 class ServerScripting;
+class ThreadPool;
 enum AccessDeniedCode : u8;
 typedef u16 session_t;
 
@@ -65,6 +68,14 @@ class ActiveBlockModifier
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n){};
 	virtual void trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 		u32 active_object_count, u32 active_object_count_wider){};
+	// Whether to call the bulk trigger below instead of the ones above
+	virtual bool getBulk() { return false; }
+	/// @brief Called once per block with all nodes that passed the checks
+	/// @param positions node positions (absolute)
+	/// @param nodes nodes at these positions, same order
+	virtual void trigger(ServerEnvironment *env, MapBlock *block,
+		const std::vector<v3s16> &positions, const std::vector<MapNode> &nodes,
+		u32 active_object_count, u32 active_object_count_wider){};
 };
 
 struct ABMWithState
@@ -158,17 +169,34 @@ class LBMManager
 
 /*
 	List of active blocks, used by ServerEnvironment
+
+	Keeps a reference count per block of how many players (or forceloads)
+	cover it, so that update() only has to do work for players that moved
+	or looked around.
 */
 
 class ActiveBlockList
 {
 public:
-	void update(std::vector<PlayerSAO*> &active_players,
+	// What update() needs to know about a player
+	struct PlayerView {
+		u16 id; // anything that identifies the player between calls
+		v3s16 blockpos;
+		s16 wanted_range;
+		v3f camera_pos, camera_dir;
+		f32 fov;
+
+		bool operator==(const PlayerView &other) const;
+	};
+
+	static PlayerView makeView(const PlayerSAO *playersao);
+
+	void update(const std::vector<PlayerView> &active_players,
 		s16 active_block_range,
 		s16 active_object_range,
-		std::set<v3s16> &blocks_removed,
-		std::set<v3s16> &blocks_added,
-		std::set<v3s16> &extra_blocks_added);
+		std::vector<v3s16> &blocks_removed,
+		std::vector<v3s16> &blocks_added,
+		std::vector<v3s16> &extra_blocks_added);
 
 	bool contains(v3s16 p) const {
 		return (m_list.find(p) != m_list.end());
@@ -178,19 +206,51 @@ class ActiveBlockList
 		return m_list.size();
 	}
 
-	void clear() {
-		m_list.clear();
-	}
+	void clear();
 
+	// The block is added back in the next update() if still in range
 	void remove(v3s16 p) {
-		m_list.erase(p);
+		if (m_list.erase(p) > 0)
+			m_touched.push_back(p);
 		m_abm_list.erase(p);
 	}
 
-	std::set<v3s16> m_list;
-	std::set<v3s16> m_abm_list;
+	std::unordered_set<v3s16> m_list;
+	std::unordered_set<v3s16> m_abm_list;
 	// list of blocks that are always active, not modified by this class
 	std::set<v3s16> m_forceloaded_list;
+
+private:
+	struct PlayerState {
+		PlayerView view;
+		s16 radius;
+		// Blocks within radius, sorted
+		std::vector<v3s16> blocks;
+		// Blocks in the view cone, sorted. Only used if it reaches further
+		// than radius.
+		std::vector<v3s16> extra;
+		bool seen;
+	};
+
+	void addRef(std::unordered_map<v3s16, u32> &refs, v3s16 p);
+	void removeRef(std::unordered_map<v3s16, u32> &refs, v3s16 p);
+	// Adds references for blocks only in new_list, removes those only in old_list
+	void updateRefs(std::unordered_map<v3s16, u32> &refs,
+		const std::vector<v3s16> &new_list, const std::vector<v3s16> &old_list);
+	void fillSphere(v3s16 center, s16 radius, std::vector<v3s16> &list);
+
+	std::unordered_map<u16, PlayerState> m_players;
+	// Number of players and forceloads covering each block
+	std::unordered_map<v3s16, u32> m_refs;
+	// Number of player view cones covering each block
+	std::unordered_map<v3s16, u32> m_extra_refs;
+	// m_forceloaded_list as of the last update
+	std::set<v3s16> m_forceloaded_counted;
+	// Blocks whose state might have changed since the last update
+	std::vector<v3s16> m_touched;
+	// Block offsets within a sphere of radius m_sphere_radius
+	std::vector<v3s16> m_sphere;
+	s16 m_sphere_radius = -1;
 };
 
 /*
@@ -348,6 +408,12 @@ class ServerEnvironment final : public Environment
 		return m_ao_manager.getObjectsInArea(box, objects, include_obj_cb);
 	}
 
+	// Called by objects whose base position changed
+	void updateActiveObjectPos(ServerActiveObject *obj)
+	{
+		m_ao_manager.updateObjectPos(obj);
+	}
+
 	// Clear objects, loading and going through every MapBlock
 	void clearObjects(ClearObjectsMode mode);
 
@@ -419,7 +485,7 @@ class ServerEnvironment final : public Environment
 			const StaticObject *from_static, u32 dtime_s);
 
 	/*
-		Remove all objects that satisfy (isGone() && m_known_by_count==0)
+		Remove all objects that satisfy (isGone() && m_known_by.empty())
 	*/
 	void removeRemovedObjects();
 
@@ -431,7 +497,7 @@ class ServerEnvironment final : public Environment
 	/*
 		Convert objects that are not in active blocks to static.
 
-		If m_known_by_count != 0, active object is not deleted, but static
+		If m_known_by is not empty, active object is not deleted, but static
 		data is still updated.
 
 		If force_delete is set, active object is deleted nevertheless. It
@@ -486,6 +552,8 @@ class ServerEnvironment final : public Environment
 	u32 m_last_clear_objects_time = 0;
 	// Active block modifiers
 	std::vector<ABMWithState> m_abms;
+	// Worker threads for checking ABMs, only exists if enabled
+	std::unique_ptr<ThreadPool> m_abm_thread_pool;
 	LBMManager m_lbm_mgr;
 	// An interval for generally sending object positions and stuff
 	float m_recommended_send_interval = 0.1f;
@@ -6,8 +6,10 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 
 #include "map.h"
+#include "nameidmapping.h"
 #include "util/container.h" // UniqueQueue
 #include "util/metricsbackend.h" // ptr typedefs
 #include "map_settings_manager.h"
@@ -19,6 +21,9 @@ class EmergeManager;
 class ServerEnvironment;
 struct BlockMakeData;
 class MetricsBackend;
+class ThreadPool;
+class LiquidTransformer;
+class BlockSaveThread;
 
 // TODO: this could wrap all calls to MapDatabase, including locking
 struct MapDatabaseAccessor {
@@ -28,10 +33,17 @@ struct MapDatabaseAccessor {
 	MapDatabase *dbase = nullptr;
 	/// Fallback database for read operations
 	MapDatabase *dbase_ro = nullptr;
+	/// Blocks waiting to be written to dbase (optional)
+	BlockSaveThread *save_thread = nullptr;
 
 	/// Load a block, taking dbase_ro into account.
 	/// @note call locked
 	void loadBlock(v3s16 blockpos, std::string &ret);
+
+	/// Load several blocks at once, taking dbase_ro into account.
+	/// @note call locked
+	void loadBlocks(const std::vector<v3s16> &positions,
+		std::vector<std::string> &ret);
 };
 
 /*
@@ -119,6 +131,33 @@ class ServerMap : public Map
 	/// @return non-null block (but can be blank)
 	MapBlock *loadBlock(const std::string &blob, v3s16 p, bool save_after_load=false);
 
+	/// A block that was read from disk but is not part of the map yet
+	struct LoadedBlock {
+		v3s16 pos;
+		std::string blob;
+		/// Deserialized block, nullptr if this has to happen on insertion
+		std::unique_ptr<MapBlock> block;
+		/// Id-name mapping of the block, its node ids are not corrected yet
+		NameIdMapping nimap;
+		/// getSaveCounter() from before the blob was read
+		u32 save_counter = 0;
+	};
+
+	/// Changes whenever a block is written to or deleted from the database.
+	/// A LoadedBlock read before that may be outdated.
+	u32 getSaveCounter() const { return m_save_counter; }
+
+	/// Deserializes blocks that were read from disk, in parallel if a pool
+	/// is given. Does not touch the map or the node definitions, so the env
+	/// lock is not needed. Node ids are corrected by loadBlock(), blocks
+	/// that fail to deserialize are left for it to deal with.
+	void decodeBlocks(std::vector<LoadedBlock> &blocks, ThreadPool *pool);
+
+	/// Load a block that was already read from disk and possibly decoded.
+	/// Used by EmergeManager.
+	/// @return non-null block (but can be blank)
+	MapBlock *loadBlock(LoadedBlock &loaded, bool save_after_load=false);
+
 	// Helper for deserializing blocks from disk
 	// @throws SerializationError
 	static void deSerializeBlock(MapBlock *block, std::istream &is);
@@ -165,6 +204,9 @@ class ServerMap : public Map
 private:
 	friend class ModApiMapgen; // for m_transforming_liquid
 
+	MapBlock *loadBlock(const std::string &blob, std::unique_ptr<MapBlock> decoded,
+		const NameIdMapping *nimap, v3s16 p, bool save_after_load);
+
 	// Emerge manager
 	EmergeManager *m_emerge;
 
@@ -180,6 +222,8 @@ class ServerMap : public Map
 
 	// Queued transforming water nodes
 	UniqueQueue<v3s16> m_transforming_liquid;
+	std::unique_ptr<ThreadPool> m_liquid_thread_pool;
+	std::unique_ptr<LiquidTransformer> m_liquid_transformer;
 	f32 m_transforming_liquid_loop_count_multiplier = 1.0f;
 	u32 m_unprocessed_count = 0;
 	u64 m_inc_trending_up_start_time = 0; // milliseconds
@@ -192,6 +236,10 @@ class ServerMap : public Map
 	bool m_map_metadata_changed = true;
 
 	MapDatabaseAccessor m_db;
+	// Writes blocks in the background if enabled
+	std::unique_ptr<BlockSaveThread> m_save_thread;
+	// Read by emerge threads without the env lock
+	std::atomic<u32> m_save_counter{0};
 
 	// Map metrics
 	MetricGaugePtr m_loaded_blocks_gauge;
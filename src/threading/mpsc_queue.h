@@ -0,0 +1,80 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include "util/basic_macros.h"
+
+/*
+	Unbounded lock-free queue for any number of producers and one consumer.
+
+	push() is wait-free: one allocation and one atomic exchange. pop() may
+	only be called from a single thread at a time. A value whose push() has
+	not fully completed yet may not be visible to pop() right away, so
+	consumers have to be woken up by other means (e.g. a Semaphore) after
+	pushing.
+
+	Based on Dmitry Vyukov's non-intrusive MPSC node-based queue.
+*/
+template<typename T>
+class MPSCQueue
+{
+public:
+	MPSCQueue()
+	{
+		m_tail = new Node();
+		m_head.store(m_tail, std::memory_order_relaxed);
+	}
+
+	~MPSCQueue()
+	{
+		while (m_tail) {
+			Node *next = m_tail->next.load(std::memory_order_relaxed);
+			delete m_tail;
+			m_tail = next;
+		}
+	}
+
+	DISABLE_CLASS_COPY(MPSCQueue);
+
+	void push(T value)
+	{
+		Node *node = new Node();
+		node->value = std::move(value);
+		Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	/// Consumer only.
+	/// @return false if the queue was empty
+	bool pop(T &ret)
+	{
+		Node *next = m_tail->next.load(std::memory_order_acquire);
+		if (!next)
+			return false;
+		ret = std::move(next->value);
+		// next becomes the new stub node
+		delete m_tail;
+		m_tail = next;
+		return true;
+	}
+
+	/// Consumer only. May miss values that are currently being pushed.
+	bool empty() const
+	{
+		return !m_tail->next.load(std::memory_order_acquire);
+	}
+
+private:
+	struct Node {
+		std::atomic<Node*> next{nullptr};
+		T value{};
+	};
+
+	// Last pushed node, written by producers
+	alignas(64) std::atomic<Node*> m_head;
+	// Stub node before the first value, owned by the consumer
+	alignas(64) Node *m_tail;
+};
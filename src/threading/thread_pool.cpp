@@ -0,0 +1,147 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "threading/thread_pool.h"
+#include "threading/thread.h"
+#include "exceptions.h"
+#include "log.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+class ThreadPool::Worker : public Thread
+{
+public:
+	Worker(ThreadPool *pool, const std::string &name) :
+		Thread(name), m_pool(pool)
+	{}
+
+protected:
+	void *run() override
+	{
+		std::function<void()> task;
+		while (m_pool->popTask(task)) {
+			try {
+				task();
+			} catch (std::exception &e) {
+				errorstream << m_name << ": uncaught exception in task: "
+					<< e.what() << std::endl;
+			}
+			task = nullptr;
+		}
+		return nullptr;
+	}
+
+private:
+	ThreadPool *m_pool;
+};
+
+ThreadPool::ThreadPool(const std::string &name, unsigned int num_threads)
+{
+	for (unsigned int i = 0; i < num_threads; i++) {
+		m_threads.emplace_back(std::make_unique<Worker>(this,
+			name + std::to_string(i)));
+		if (!m_threads.back()->start())
+			throw BaseException("Failed to start thread " + name);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cv.notify_all();
+	for (auto &thread : m_threads) {
+		thread->stop();
+		thread->wait();
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cv.notify_one();
+}
+
+bool ThreadPool::popTask(std::function<void()> &task)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+	// remaining tasks are dropped on shutdown
+	if (m_stopping)
+		return false;
+	task = std::move(m_tasks.front());
+	m_tasks.pop_front();
+	return true;
+}
+
+namespace {
+
+struct ParallelForJob
+{
+	const std::function<void(size_t)> *fn;
+	size_t count;
+	std::atomic<size_t> next{0};
+	std::atomic<size_t> done{0};
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::exception_ptr error;
+
+	void run()
+	{
+		size_t i;
+		while ((i = next++) < count) {
+			try {
+				(*fn)(i);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error)
+					error = std::current_exception();
+			}
+			if (++done == count) {
+				std::lock_guard<std::mutex> lock(mutex);
+				cv.notify_all();
+			}
+		}
+	}
+};
+
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)> &fn)
+{
+	if (count == 0)
+		return;
+	if (count == 1 || m_threads.empty()) {
+		for (size_t i = 0; i < count; i++)
+			fn(i);
+		return;
+	}
+
+	// Helpers that only get to run after everything is done return immediately,
+	// so they may outlive this call and hold on to the job.
+	auto job = std::make_shared<ParallelForJob>();
+	job->fn = &fn;
+	job->count = count;
+
+	size_t helpers = std::min<size_t>(m_threads.size(), count - 1);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < helpers; i++)
+			m_tasks.emplace_back([job] () { job->run(); });
+	}
+	m_cv.notify_all();
+
+	job->run();
+
+	std::unique_lock<std::mutex> lock(job->mutex);
+	job->cv.wait(lock, [&] { return job->done == job->count; });
+	if (job->error)
+		std::rethrow_exception(job->error);
+}
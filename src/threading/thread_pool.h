@@ -0,0 +1,58 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "util/basic_macros.h"
+
+class Thread;
+
+/**
+ * A fixed set of worker threads that run queued tasks.
+ *
+ * A pool with zero threads is valid, `parallelFor` then runs everything on the
+ * calling thread.
+ */
+class ThreadPool
+{
+public:
+	/// @param name prefix for thread names
+	/// @param num_threads number of worker threads to start
+	ThreadPool(const std::string &name, unsigned int num_threads);
+	~ThreadPool();
+	DISABLE_CLASS_COPY(ThreadPool)
+
+	unsigned int getThreadCount() const { return m_threads.size(); }
+
+	/// Queues a task to be run on any worker thread.
+	/// Exceptions thrown by the task are logged and otherwise ignored.
+	void enqueue(std::function<void()> task);
+
+	/**
+	 * Calls `fn(i)` for every `i` in `[0, count)` and waits until all calls
+	 * have returned. The calling thread takes part in the work, so this is
+	 * safe to use from inside a task.
+	 * The first exception thrown by `fn` is rethrown after all calls finished.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+	class Worker;
+	friend class Worker;
+
+	bool popTask(std::function<void()> &task);
+
+	std::vector<std::unique_ptr<Worker>> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::function<void()>> m_tasks;
+	bool m_stopping = false;
+};
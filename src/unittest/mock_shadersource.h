@@ -0,0 +1,24 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include "client/shader.h"
+
+// Every shader is the plain solid material
+class MockShaderSource : public IShaderSource
+{
+public:
+	ShaderInfo getShaderInfo(u32 id) override { return ShaderInfo(); }
+
+	u32 getShader(const std::string &name, MaterialType material_type,
+			NodeDrawType drawtype = NDT_NORMAL) override
+	{
+		return 0;
+	}
+
+	u32 getShaderRaw(const std::string &name, bool blendAlpha = false) override
+	{
+		return 0;
+	}
+};
@@ -0,0 +1,62 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#pragma once
+
+#include "client/texturesource.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Gives out texture ids by name, without creating any textures
+class MockTextureSource : public ITextureSource
+{
+public:
+	MockTextureSource()
+	{
+		// id 0 is no texture
+		m_names.emplace_back();
+	}
+
+	u32 getTextureId(const std::string &name) override
+	{
+		auto it = m_ids.find(name);
+		if (it != m_ids.end())
+			return it->second;
+		u32 id = m_names.size();
+		m_names.push_back(name);
+		m_ids[name] = id;
+		return id;
+	}
+
+	std::string getTextureName(u32 id) override
+	{
+		return id < m_names.size() ? m_names[id] : "";
+	}
+
+	video::ITexture *getTexture(u32 id) override { return nullptr; }
+
+	video::ITexture *getTexture(const std::string &name, u32 *id = nullptr) override
+	{
+		u32 new_id = getTextureId(name);
+		if (id)
+			*id = new_id;
+		return nullptr;
+	}
+
+	video::ITexture *getTextureForMesh(const std::string &name, u32 *id = nullptr) override
+	{
+		return getTexture(name, id);
+	}
+
+	Palette *getPalette(const std::string &name) override { return nullptr; }
+	bool isKnownSourceImage(const std::string &name) override { return false; }
+	video::SColor getTextureAverageColor(const std::string &name) override
+	{
+		return video::SColor(0);
+	}
+
+private:
+	std::vector<std::string> m_names;
+	std::unordered_map<std::string, u32> m_ids;
+};
@@ -0,0 +1,218 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "test.h"
+
+#include <algorithm>
+#include "constants.h"
+#include "serverenvironment.h"
+#include "util/numeric.h"
+
+class TestActiveBlockList : public TestBase
+{
+public:
+	TestActiveBlockList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestActiveBlockList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testRandomWalk();
+	void testRemove();
+	void testForceload();
+};
+
+static TestActiveBlockList g_test_instance;
+
+void TestActiveBlockList::runTests(IGameDef *gamedef)
+{
+	TEST(testRandomWalk);
+	TEST(testRemove);
+	TEST(testForceload);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+typedef ActiveBlockList::PlayerView PlayerView;
+
+static const s16 BLOCK_RANGE = 2;
+static const s16 OBJECT_RANGE = 4;
+
+static PlayerView make_view(u16 id, v3f pos, f32 yaw)
+{
+	PlayerView view;
+	view.id = id;
+	view.blockpos = getNodeBlockPos(floatToInt(pos, BS));
+	view.wanted_range = OBJECT_RANGE;
+	view.camera_pos = pos;
+	view.camera_dir = v3f(0, 0, 1);
+	view.camera_dir.rotateXZBy(yaw);
+	view.fov = 1.2f;
+	return view;
+}
+
+// Computes both lists from scratch
+static void compute_reference(const std::vector<PlayerView> &views,
+	const std::set<v3s16> &forceloaded,
+	std::set<v3s16> &list, std::set<v3s16> &abm_list)
+{
+	abm_list = forceloaded;
+	for (const PlayerView &view : views) {
+		v3s16 p;
+		const s16 r = BLOCK_RANGE;
+		for (p.X = -r; p.X <= r; p.X++)
+		for (p.Y = -r; p.Y <= r; p.Y++)
+		for (p.Z = -r; p.Z <= r; p.Z++) {
+			if (p.getDistanceFrom(v3s16(0)) <= r)
+				abm_list.insert(view.blockpos + p);
+		}
+	}
+
+	list = abm_list;
+	for (const PlayerView &view : views) {
+		const s16 r = std::min(OBJECT_RANGE, view.wanted_range);
+		v3s16 p;
+		for (p.X = view.blockpos.X - r; p.X <= view.blockpos.X + r; p.X++)
+		for (p.Y = view.blockpos.Y - r; p.Y <= view.blockpos.Y + r; p.Y++)
+		for (p.Z = view.blockpos.Z - r; p.Z <= view.blockpos.Z + r; p.Z++) {
+			if (isBlockInSight(p, view.camera_pos, view.camera_dir, view.fov,
+					r * BS * MAP_BLOCKSIZE))
+				list.insert(p);
+		}
+	}
+}
+
+template <typename C>
+static std::set<v3s16> to_set(const C &c)
+{
+	return std::set<v3s16>(c.begin(), c.end());
+}
+
+static void update(ActiveBlockList &abl, const std::vector<PlayerView> &views,
+	std::set<v3s16> &removed, std::set<v3s16> &added)
+{
+	std::vector<v3s16> blocks_removed, blocks_added, extra_blocks_added;
+	abl.update(views, BLOCK_RANGE, OBJECT_RANGE,
+		blocks_removed, blocks_added, extra_blocks_added);
+
+	UASSERTEQ(size_t, to_set(blocks_removed).size(), blocks_removed.size());
+	UASSERTEQ(size_t, to_set(blocks_added).size(), blocks_added.size());
+	removed = to_set(blocks_removed);
+	added = to_set(blocks_added);
+	for (v3s16 p : extra_blocks_added) {
+		UASSERT(added.insert(p).second);
+		// Extra blocks are only those outside of the ABM range
+		UASSERT(abl.m_abm_list.count(p) == 0);
+	}
+}
+
+void TestActiveBlockList::testRandomWalk()
+{
+	ActiveBlockList abl;
+	std::vector<v3f> pos;
+	std::vector<f32> yaw;
+	std::vector<PlayerView> views;
+	std::set<v3s16> ref_list, ref_abm_list, removed, added;
+
+	for (int step = 0; step < 200; step++) {
+		// Players join, leave, walk and turn
+		if (pos.size() < 5 && myrand_range(0, 9) == 0) {
+			pos.emplace_back(myrand_range(-100, 100) * BS, 0, myrand_range(-100, 100) * BS);
+			yaw.push_back(myrand_range(0, 359));
+		} else if (!pos.empty() && myrand_range(0, 19) == 0) {
+			size_t i = myrand_range(0, pos.size() - 1);
+			pos.erase(pos.begin() + i);
+			yaw.erase(yaw.begin() + i);
+		}
+		views.clear();
+		for (size_t i = 0; i < pos.size(); i++) {
+			if (myrand_range(0, 1) == 0) {
+				pos[i] += v3f(myrand_range(-8, 8), myrand_range(-2, 2),
+					myrand_range(-8, 8)) * BS;
+				yaw[i] += myrand_range(-30, 30);
+			}
+			// ids are stable as long as nobody leaves, good enough here
+			views.push_back(make_view(i + 1, pos[i], yaw[i]));
+		}
+
+		const std::set<v3s16> old_list = to_set(abl.m_list);
+		update(abl, views, removed, added);
+		compute_reference(views, {}, ref_list, ref_abm_list);
+
+		UASSERT(to_set(abl.m_list) == ref_list);
+		UASSERT(to_set(abl.m_abm_list) == ref_abm_list);
+		for (v3s16 p : removed)
+			UASSERT(old_list.count(p) && !ref_list.count(p));
+		for (v3s16 p : added)
+			UASSERT(!old_list.count(p) && ref_list.count(p));
+		UASSERTEQ(size_t, old_list.size() - removed.size() + added.size(),
+			ref_list.size());
+	}
+
+	// Everyone leaves
+	update(abl, {}, removed, added);
+	UASSERT(abl.m_list.empty());
+	UASSERT(abl.m_abm_list.empty());
+}
+
+void TestActiveBlockList::testRemove()
+{
+	ActiveBlockList abl;
+	std::vector<PlayerView> views{make_view(1, v3f(0, 0, 0), 0)};
+	std::set<v3s16> removed, added;
+
+	update(abl, views, removed, added);
+	const v3s16 p(0, 0, 0);
+	UASSERT(abl.contains(p));
+
+	// A block that could not be loaded is retried in the next update
+	abl.remove(p);
+	UASSERT(!abl.contains(p));
+	UASSERT(!abl.m_abm_list.count(p));
+	update(abl, views, removed, added);
+	UASSERT(removed.empty());
+	UASSERT(added == std::set<v3s16>{p});
+	UASSERT(abl.contains(p));
+	UASSERT(abl.m_abm_list.count(p));
+
+	// Starting over re-adds everything
+	const size_t size = abl.size();
+	abl.clear();
+	UASSERTEQ(size_t, abl.size(), 0);
+	update(abl, views, removed, added);
+	UASSERTEQ(size_t, added.size(), size);
+}
+
+void TestActiveBlockList::testForceload()
+{
+	ActiveBlockList abl;
+	std::set<v3s16> removed, added;
+	const v3s16 far(1000, 0, 0), near(0, 0, 1);
+
+	abl.m_forceloaded_list.insert(far);
+	abl.m_forceloaded_list.insert(near);
+	update(abl, {}, removed, added);
+	UASSERT(added == (std::set<v3s16>{far, near}));
+	UASSERT(abl.m_abm_list.count(far) && abl.m_abm_list.count(near));
+
+	// A player covering a forceloaded block
+	std::vector<PlayerView> views{make_view(1, v3f(0, 0, 0), 0)};
+	update(abl, views, removed, added);
+	UASSERT(removed.empty());
+	UASSERT(!added.count(near));
+
+	// Neither going away alone deactivates the block
+	abl.m_forceloaded_list.erase(near);
+	update(abl, views, removed, added);
+	UASSERT(removed.empty());
+	UASSERT(abl.contains(near));
+
+	abl.m_forceloaded_list.insert(near);
+	update(abl, {}, removed, added);
+	UASSERT(abl.contains(near));
+	UASSERT(!removed.count(near));
+
+	abl.m_forceloaded_list.clear();
+	update(abl, {}, removed, added);
+	UASSERT(removed == (std::set<v3s16>{far, near}));
+	UASSERT(abl.m_list.empty());
+}
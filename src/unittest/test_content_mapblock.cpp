@@ -5,14 +5,19 @@
 #include "test.h"
 
 #include <algorithm>
+#include <array>
+#include <map>
 #include <numeric>
 
 #include "gamedef.h"
+#include "mapblock.h"
 #include "dummygamedef.h"
 #include "client/content_mapblock.h"
 #include "client/mapblock_mesh.h"
 #include "client/meshgen/collector.h"
 #include "mesh_compare.h"
+#include "mock_shadersource.h"
+#include "mock_texturesource.h"
 #include "util/directiontables.h"
 
 namespace {
@@ -144,6 +149,10 @@ class TestMapblockMeshGenerator : public TestBase {
 	void testSurroundedNode();
 	void testInterliquidSame();
 	void testInterliquidDifferent();
+	void testGreedyMeshing();
+	void testMapBlockMesh();
+	void testReusedCollector();
+	void testNodeUpdate();
 };
 
 static TestMapblockMeshGenerator g_test_instance;
@@ -155,6 +164,10 @@ void TestMapblockMeshGenerator::runTests(IGameDef *gamedef)
 	TEST(testSurroundedNode);
 	TEST(testInterliquidSame);
 	TEST(testInterliquidDifferent);
+	TEST(testGreedyMeshing);
+	TEST(testMapBlockMesh);
+	TEST(testReusedCollector);
+	TEST(testNodeUpdate);
 }
 
 namespace quad {
@@ -252,4 +265,248 @@ void TestMapblockMeshGenerator::testInterliquidDifferent()
 	UASSERT(checkMeshEqual(buf.vertices, buf.indices, {quad::xn, quad::xp, quad::yn, quad::yp, quad::zn, quad::zp}));
 }
 
+void TestMapblockMeshGenerator::testGreedyMeshing()
+{
+	MockGameDef gamedef;
+	content_t stone = gamedef.addSimpleNode("stone", 42);
+	content_t wood = gamedef.addSimpleNode("wood", 13);
+	gamedef.finalize();
+
+	// A slab of stone with a wood node in its top
+	constexpr s16 side = 4;
+	MeshMakeData data{gamedef.ndef(), side, MeshGrid{1}};
+	data.m_blockpos = {0, 0, 0};
+	for (s16 x = -1; x <= side; x++)
+	for (s16 y = -1; y <= side; y++)
+	for (s16 z = -1; z <= side; z++) {
+		content_t c = y >= 0 && y < 2 && x >= 0 && x < side && z >= 0 && z < side ?
+			stone : CONTENT_AIR;
+		data.m_vmanip.setNode({x, y, z}, {c, 0, 0});
+	}
+	data.m_vmanip.setNode({1, 1, 2}, {wood, 0, 0});
+
+	for (bool smooth_lighting : {false, true}) {
+		data.m_smooth_lighting = smooth_lighting;
+
+		data.m_greedy_meshing = false;
+		MeshCollector plain{{}};
+		MapblockMeshGenerator(&data, &plain).generate();
+		data.m_greedy_meshing = true;
+		MeshCollector greedy{{}};
+		MapblockMeshGenerator(&data, &greedy).generate();
+
+		// Area of the faces and vertex count by texture
+		auto measure = [] (const MeshCollector &col, u32 texture_id,
+				f32 &area, size_t &vertex_count) {
+			area = 0.0f;
+			vertex_count = 0;
+			for (const PreMeshBuffer &buf : col.prebuffers[0]) {
+				if (buf.layer.texture_id != texture_id)
+					continue;
+				vertex_count += buf.vertices.size();
+				for (size_t i = 0; i + 2 < buf.indices.size(); i += 3) {
+					const v3f &a = buf.vertices[buf.indices[i]].Pos;
+					const v3f &b = buf.vertices[buf.indices[i + 1]].Pos;
+					const v3f &c = buf.vertices[buf.indices[i + 2]].Pos;
+					area += (b - a).crossProduct(c - a).getLength() / 2;
+				}
+			}
+		};
+		f32 plain_area, greedy_area;
+		size_t plain_count, greedy_count;
+		measure(plain, 42, plain_area, plain_count);
+		measure(greedy, 42, greedy_area, greedy_count);
+		UASSERT(std::fabs(plain_area - greedy_area) < 0.01f * BS * BS);
+		UASSERT(greedy_count < plain_count / 4);
+		// The wood node is not merged with anything
+		measure(plain, 13, plain_area, plain_count);
+		measure(greedy, 13, greedy_area, greedy_count);
+		UASSERTEQ(size_t, greedy_count, plain_count);
+
+		// Texture coordinates and colors are the same at the corners
+		// of the merged faces as at the corners of the single ones
+		for (const PreMeshBuffer &buf : greedy.prebuffers[0])
+		for (const video::S3DVertex &v : buf.vertices) {
+			bool found = false;
+			for (const PreMeshBuffer &buf2 : plain.prebuffers[0])
+				found = found || std::any_of(buf2.vertices.begin(), buf2.vertices.end(),
+					[&] (const video::S3DVertex &v2) {
+						return v2.Pos == v.Pos && v2.Normal == v.Normal &&
+							v2.TCoords == v.TCoords && v2.Color == v.Color;
+					});
+			UASSERT(found);
+		}
+	}
+}
+
+void TestMapblockMeshGenerator::testMapBlockMesh()
+{
+	MockGameDef gamedef;
+	content_t stone = gamedef.addSimpleNode("stone", 42);
+	content_t wood = gamedef.addSimpleNode("wood", 13);
+	gamedef.finalize();
+
+	MeshMakeData data{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	data.fillBlockDataBegin({0, 0, 0});
+	MapNode nodes[MapBlock::nodecount];
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		nodes[i] = MapNode(CONTENT_AIR);
+	for (s16 x = -1; x <= 1; x++)
+	for (s16 y = -1; y <= 1; y++)
+	for (s16 z = -1; z <= 1; z++)
+		data.fillBlockData({x, y, z}, nodes);
+	data.m_vmanip.setNode({0, 0, 0}, {stone, 0, 0});
+	data.m_vmanip.setNode({3, 0, 0}, {wood, 0, 0});
+	data.m_vmanip.setNode({4, 0, 0}, {wood, 0, 0});
+
+	MockTextureSource tsrc;
+	MockShaderSource shdrsrc;
+	MapBlockMesh mesh(&tsrc, &shdrsrc, &data);
+	scene::IMesh *m = mesh.getMesh(0);
+	UASSERTEQ(u32, m->getMeshBufferCount(), 2);
+	UASSERTEQ(u32, m->getMeshBuffer(0)->getVertexCount() +
+		m->getMeshBuffer(1)->getVertexCount(), (6 + 10) * 4);
+	UASSERTEQ(u32, mesh.getMesh(1)->getMeshBufferCount(), 0);
+}
+
+void TestMapblockMeshGenerator::testReusedCollector()
+{
+	MockGameDef gamedef;
+	content_t stone = gamedef.addSimpleNode("stone", 42);
+	content_t wood = gamedef.addSimpleNode("wood", 13);
+	gamedef.finalize();
+
+	MapNode nodes[MapBlock::nodecount];
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		nodes[i] = MapNode(CONTENT_AIR);
+	auto make_data = [&] (MeshMakeData &data) {
+		data.fillBlockDataBegin({0, 0, 0});
+		for (s16 x = -1; x <= 1; x++)
+		for (s16 y = -1; y <= 1; y++)
+		for (s16 z = -1; z <= 1; z++)
+			data.fillBlockData({x, y, z}, nodes);
+	};
+
+	MockTextureSource tsrc;
+	MockShaderSource shdrsrc;
+	MeshCollector collector{{}};
+
+	MeshMakeData data1{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	make_data(data1);
+	data1.m_vmanip.setNode({0, 0, 0}, {stone, 0, 0});
+	data1.m_vmanip.setNode({3, 0, 0}, {wood, 0, 0});
+	MapBlockMesh mesh1(&tsrc, &shdrsrc, &data1, &collector);
+	const std::vector<PreMeshBufferSize> &sizes = mesh1.getPreBufferSizes();
+	UASSERTEQ(size_t, sizes.size(), 2);
+	for (const PreMeshBufferSize &size : sizes) {
+		UASSERTEQ(int, size.layernum, 0);
+		UASSERTEQ(u32, size.vertex_count, 6 * 4);
+		UASSERTEQ(u32, size.index_count, 6 * 6);
+	}
+
+	// Only the stone is left, the buffer of the wood must not show up again
+	MeshMakeData data2{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	make_data(data2);
+	data2.m_vmanip.setNode({0, 0, 0}, {stone, 0, 0});
+	data2.m_prebuffer_sizes = sizes;
+	MapBlockMesh mesh2(&tsrc, &shdrsrc, &data2, &collector);
+	UASSERTEQ(u32, mesh2.getMesh(0)->getMeshBufferCount(), 1);
+	UASSERTEQ(u32, mesh2.getMesh(0)->getMeshBuffer(0)->getVertexCount(), 6 * 4);
+	UASSERTEQ(size_t, mesh2.getPreBufferSizes().size(), 1);
+	UASSERTEQ(u32, mesh2.getPreBufferSizes()[0].layer.texture_id, 42);
+}
+
+void TestMapblockMeshGenerator::testNodeUpdate()
+{
+	MockGameDef gamedef;
+	content_t stone = gamedef.addSimpleNode("stone", 42);
+	content_t water = gamedef.addLiquidSource("water", 7);
+	ContentFeatures f = gamedef.ndef()->get(water);
+	for (TileSpec &tile : f.tiles)
+		tile.layers[0].material_type = TILE_MATERIAL_LIQUID_TRANSPARENT;
+	gamedef.node_mgr()->set(f.name, f);
+	gamedef.finalize();
+
+	// Stone below y = 4 with a pool of water at the top, lit from above
+	std::vector<MapNode> nodes(MapBlock::nodecount);
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		v3s16 p(i % MAP_BLOCKSIZE, i / MAP_BLOCKSIZE % MAP_BLOCKSIZE,
+				i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+		if (p.Y < 3 || (p.Y == 3 && (p.X < 4 || p.X > 9)))
+			nodes[i] = MapNode(stone);
+		else if (p.Y == 3)
+			nodes[i] = MapNode(water, LIGHT_MAX - 1);
+		else
+			nodes[i] = MapNode(CONTENT_AIR, p.Y + 1);
+	}
+	std::vector<MapNode> air(MapBlock::nodecount, MapNode(CONTENT_AIR, LIGHT_SUN));
+
+	auto make_data = [&] (MeshMakeData &data, const VoxelArea &update_area) {
+		data.m_smooth_lighting = true;
+		if (update_area.hasEmptyExtent())
+			data.fillBlockDataBegin({0, 0, 0});
+		else
+			data.fillBlockDataBegin({0, 0, 0}, update_area);
+		for (s16 x = -1; x <= 1; x++)
+		for (s16 y = -1; y <= 1; y++)
+		for (s16 z = -1; z <= 1; z++)
+			data.fillBlockData({x, y, z}, x || y || z ? air.data() : nodes.data());
+	};
+
+	// Sorted triangles of every texture
+	auto triangles = [] (const MapBlockMesh &mesh) {
+		std::map<u32, std::vector<std::array<video::S3DVertex, 3>>> ret;
+		MeshGeometry geometry;
+		mesh.getGeometry(geometry);
+		for (const auto &prebuffers : geometry.prebuffers)
+		for (const PreMeshBuffer &p : prebuffers) {
+			auto &list = ret[p.layer.texture_id];
+			for (u32 i = 0; i < p.indices.size(); i += 3) {
+				list.push_back({p.vertices[p.indices[i]], p.vertices[p.indices[i + 1]],
+						p.vertices[p.indices[i + 2]]});
+			}
+		}
+		for (auto &it : ret)
+			std::sort(it.second.begin(), it.second.end());
+		return ret;
+	};
+
+	MockTextureSource tsrc;
+	MockShaderSource shdrsrc;
+
+	MeshMakeData data{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	make_data(data, VoxelArea());
+	MapBlockMesh mesh(&tsrc, &shdrsrc, &data);
+	UASSERT(mesh.canUpdateNodes());
+
+	// Dig a stone at the edge of the pool and put one into the water
+	nodes[3 * 256 + 3 * 16 + 3] = MapNode(CONTENT_AIR, LIGHT_MAX - 2);
+	nodes[3 * 256 + 3 * 16 + 6] = MapNode(stone);
+	VoxelArea update_area(v3s16(2, 2, 2), v3s16(7, 4, 4));
+
+	MeshMakeData full_data{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	make_data(full_data, VoxelArea());
+	MapBlockMesh full_mesh(&tsrc, &shdrsrc, &full_data);
+
+	MeshMakeData update_data{gamedef.ndef(), MAP_BLOCKSIZE, MeshGrid{1}};
+	make_data(update_data, update_area);
+	update_data.m_previous_mesh = std::make_unique<MeshGeometry>();
+	mesh.getGeometry(*update_data.m_previous_mesh);
+	UASSERTEQ(u32, update_data.m_previous_mesh->mesh_id, mesh.getId());
+	MapBlockMesh updated_mesh(&tsrc, &shdrsrc, &update_data);
+
+	auto full = triangles(full_mesh);
+	UASSERT(full.count(42) && full.count(7));
+	UASSERT(full != triangles(mesh));
+	UASSERT(full == triangles(updated_mesh));
+	UASSERT(updated_mesh.getId() != mesh.getId());
+
+	// Can be updated again
+	UASSERT(updated_mesh.canUpdateNodes());
+	update_data.m_previous_mesh = std::make_unique<MeshGeometry>();
+	updated_mesh.getGeometry(*update_data.m_previous_mesh);
+	MapBlockMesh updated_twice(&tsrc, &shdrsrc, &update_data);
+	UASSERT(full == triangles(updated_twice));
+}
+
 }
@@ -5,6 +5,9 @@
 #include "test.h"
 
 #include "util/container.h"
+#include <atomic>
+#include <string>
+#include <thread>
 
 class TestDataStructures : public TestBase
 {
@@ -19,6 +22,8 @@ class TestDataStructures : public TestBase
 	void testMap3();
 	void testMap4();
 	void testMap5();
+	void testInsertOnlyMap();
+	void testInsertOnlyMapThreads();
 };
 
 static TestDataStructures g_test_instance;
@@ -31,6 +36,10 @@ void TestDataStructures::runTests(IGameDef *gamedef)
 	TEST(testMap3);
 	TEST(testMap4);
 	TEST(testMap5);
+
+	rawstream << "-------- InsertOnlyMap" << std::endl;
+	TEST(testInsertOnlyMap);
+	TEST(testInsertOnlyMapThreads);
 }
 
 namespace {
@@ -168,3 +177,55 @@ void TestDataStructures::testMap5()
 		break;
 	}
 }
+
+void TestDataStructures::testInsertOnlyMap()
+{
+	InsertOnlyMap<std::string, u32> map;
+	u32 value = 0;
+	UASSERT(!map.get("stone.png", &value));
+
+	UASSERT(map.insert("stone.png", 1));
+	UASSERT(!map.insert("stone.png", 2));
+	UASSERT(map.get("stone.png", &value));
+	UASSERTEQ(u32, value, 1);
+	UASSERT(map.get("stone.png", nullptr));
+
+	// Enough to grow the table a few times
+	for (u32 i = 2; i < 1000; i++)
+		UASSERT(map.insert("stone.png^crack" + std::to_string(i), i));
+	UASSERTEQ(size_t, map.size(), 999);
+	for (u32 i = 2; i < 1000; i++) {
+		UASSERT(map.get("stone.png^crack" + std::to_string(i), &value));
+		UASSERTEQ(u32, value, i);
+	}
+	UASSERT(!map.get("stone.png^crack1000", &value));
+	UASSERT(map.get("stone.png", &value));
+	UASSERTEQ(u32, value, 1);
+}
+
+void TestDataStructures::testInsertOnlyMapThreads()
+{
+	InsertOnlyMap<u32, u32> map;
+	constexpr u32 count = 20000;
+	std::atomic<bool> wrong(false);
+
+	// Readers must see either nothing or the right value, while the
+	// table grows under them
+	std::vector<std::thread> readers;
+	for (int t = 0; t < 4; t++) {
+		readers.emplace_back([&] {
+			u32 value;
+			for (u32 i = 0; i < count; i++) {
+				if (map.get(i, &value) && value != i * 3)
+					wrong = true;
+			}
+		});
+	}
+	for (u32 i = 0; i < count; i++)
+		map.insert(i, i * 3);
+	for (auto &reader : readers)
+		reader.join();
+
+	UASSERT(!wrong);
+	UASSERTEQ(size_t, map.size(), count);
+}
@@ -22,7 +22,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <unordered_set>
 #include <unordered_map>
 #include "mapblock.h"
+#include "dummygamedef.h"
 #include "dummymap.h"
+#include "nodedef.h"
+#include "noise.h"
+#include "server/liquidtransformer.h"
+#include "threading/thread_pool.h"
 
 class TestMap : public TestBase
 {
@@ -36,6 +41,7 @@ class TestMap : public TestBase
 	void testForEachNodeInArea(IGameDef *gamedef);
 	void testForEachNodeInAreaBlank(IGameDef *gamedef);
 	void testForEachNodeInAreaEmpty(IGameDef *gamedef);
+	void testTransformLiquidsParallel();
 };
 
 static TestMap g_test_instance;
@@ -46,6 +52,7 @@ void TestMap::runTests(IGameDef *gamedef)
 	TEST(testForEachNodeInArea, gamedef);
 	TEST(testForEachNodeInAreaBlank, gamedef);
 	TEST(testForEachNodeInAreaEmpty, gamedef);
+	TEST(testTransformLiquidsParallel);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -169,3 +176,89 @@ void TestMap::testForEachNodeInAreaEmpty(IGameDef *gamedef)
 		return true;
 	});
 }
+
+void TestMap::testTransformLiquidsParallel()
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+	auto add_liquid = [&] (const std::string &name, u8 viscosity, bool renewable) {
+		ContentFeatures f;
+		f.light_propagates = true;
+		f.param_type = CPT_LIGHT;
+		f.liquid_alternative_source = name + "_source";
+		f.liquid_alternative_flowing = name + "_flowing";
+		f.liquid_viscosity = viscosity;
+		f.liquid_renewable = renewable;
+		f.name = f.liquid_alternative_source;
+		f.liquid_type = LIQUID_SOURCE;
+		content_t source = ndef->set(f.name, f);
+		f.name = f.liquid_alternative_flowing;
+		f.liquid_type = LIQUID_FLOWING;
+		f.param_type_2 = CPT2_FLOWINGLIQUID;
+		ndef->set(f.name, f);
+		return source;
+	};
+	ContentFeatures f;
+	f.name = "stone";
+	const content_t c_stone = ndef->set(f.name, f);
+	f.name = "plant";
+	f.floodable = true;
+	f.walkable = false;
+	const content_t c_plant = ndef->set(f.name, f);
+	const content_t c_water = add_liquid("water", 1, true);
+	const content_t c_lava = add_liquid("lava", 7, false);
+	ndef->resolveCrossrefs();
+
+	// Stepped terrain with holes and plants, liquid sources above it
+	const v3s16 bpmin(-2, -1, -2), bpmax(1, 1, 1);
+	DummyMap serial_map(&gamedef, bpmin, bpmax), parallel_map(&gamedef, bpmin, bpmax);
+	UniqueQueue<v3s16> serial_queue, parallel_queue;
+	PcgRandom pr(42);
+	const v3s16 pmin = bpmin * MAP_BLOCKSIZE, pmax = (bpmax + 1) * MAP_BLOCKSIZE - 1;
+	v3s16 p;
+	for (p.Z = pmin.Z; p.Z <= pmax.Z; p.Z++)
+	for (p.Y = pmin.Y; p.Y <= pmax.Y; p.Y++)
+	for (p.X = pmin.X; p.X <= pmax.X; p.X++) {
+		content_t c = CONTENT_AIR;
+		if (p.Y < (p.X + p.Z) / 8 && pr.range(0, 20) != 0)
+			c = c_stone;
+		else if (pr.range(0, 30) == 0)
+			c = c_plant;
+		else if (p.Y > 10 && pr.range(0, 300) == 0)
+			c = pr.range(0, 3) == 0 ? c_lava : c_water;
+		serial_map.setNode(p, MapNode(c));
+		parallel_map.setNode(p, MapNode(c));
+		if (c == c_water || c == c_lava) {
+			serial_queue.push_back(p);
+			parallel_queue.push_back(p);
+		}
+	}
+
+	ThreadPool pool("TestLiquids", 3);
+	LiquidTransformer serial(&serial_map, &gamedef);
+	LiquidTransformer parallel(&parallel_map, &gamedef, &pool);
+	u32 changed = 0;
+	for (int step = 0; step < 40; step++) {
+		// Also with a limit that cuts batches
+		const u32 max_count = step % 3 == 0 ? 1500 : U32_MAX;
+		std::map<v3s16, MapBlock*> serial_modified, parallel_modified;
+		const u32 serial_changed = serial.transform(serial_queue, max_count,
+			serial_modified, nullptr);
+		UASSERTEQ(u32, parallel.transform(parallel_queue, max_count,
+			parallel_modified, nullptr), serial_changed);
+		changed += serial_changed;
+
+		UASSERT(std::equal(serial_queue.begin(), serial_queue.end(),
+			parallel_queue.begin(), parallel_queue.end()));
+		UASSERTEQ(size_t, parallel_modified.size(), serial_modified.size());
+		for (p.Z = pmin.Z; p.Z <= pmax.Z; p.Z++)
+		for (p.Y = pmin.Y; p.Y <= pmax.Y; p.Y++)
+		for (p.X = pmin.X; p.X <= pmax.X; p.X++) {
+			MapNode a = serial_map.getNode(p), b = parallel_map.getNode(p);
+			UASSERT(a.param0 == b.param0 && a.param1 == b.param1 &&
+				a.param2 == b.param2);
+		}
+	}
+	// The liquids actually flowed
+	UASSERT(changed > 1000);
+}
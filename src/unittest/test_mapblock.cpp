@@ -7,6 +7,7 @@
 #include "gamedef.h"
 #include "nodedef.h"
 #include "mapblock.h"
+#include "nameidmapping.h"
 #include "serialization.h"
 #include "noise.h"
 #include "inventory.h"
@@ -201,6 +202,19 @@ void TestMapBlock::testLoad29(IGameDef *gamedef)
 	iss.str(std::string(buf));
 	u8 version = readU8(iss);
 	UASSERTEQ(int, version, 29);
+
+	// decoding separately must not allocate ids
+	{
+		std::istringstream iss2(iss.str());
+		readU8(iss2);
+		MapBlock block({}, gamedef);
+		NameIdMapping nimap;
+		block.deSerialize(iss2, version, true, &nimap);
+		u16 id;
+		UASSERT(nimap.getId("default:chest", id));
+		UASSERT(ndef->getId("default:chest") == CONTENT_IGNORE);
+	}
+
 	MapBlock block({}, gamedef);
 	block.deSerialize(iss, version, true);
 
@@ -0,0 +1,164 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "cmake_config.h"
+
+#include "test.h"
+
+#include <cstdlib>
+#include "database/database-dummy.h"
+#include "database/database-sqlite3.h"
+#if USE_POSTGRESQL
+#include "database/database-postgresql.h"
+#endif
+#include "server/blocksavethread.h"
+#include "serialization.h"
+#include "servermap.h"
+#include "util/metricsbackend.h"
+
+class TestMapDatabase : public TestBase
+{
+public:
+	TestMapDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testLoadBlocks(MapDatabase *db);
+	void testLoadBlocksInTransaction(MapDatabase *db);
+	void testSaveThread(MapDatabase *db);
+};
+
+static TestMapDatabase g_test_instance;
+
+void TestMapDatabase::runTests(IGameDef *gamedef)
+{
+	{
+		rawstream << "-------- Dummy database" << std::endl;
+		Database_Dummy db;
+		TEST(testLoadBlocks, &db);
+		TEST(testLoadBlocksInTransaction, &db);
+		TEST(testSaveThread, &db);
+	}
+
+	{
+		rawstream << "-------- SQLite3 database" << std::endl;
+		MapDatabaseSQLite3 db(getTestTempDirectory());
+		TEST(testLoadBlocks, &db);
+		TEST(testLoadBlocksInTransaction, &db);
+		TEST(testSaveThread, &db);
+	}
+
+#if USE_POSTGRESQL
+	const char *env_postgresql_connect_string = getenv("MINETEST_POSTGRESQL_CONNECT_STRING");
+	if (env_postgresql_connect_string) {
+		rawstream << "-------- PostgreSQL database" << std::endl;
+		MapDatabasePostgreSQL db(env_postgresql_connect_string);
+		TEST(testLoadBlocks, &db);
+		TEST(testLoadBlocksInTransaction, &db);
+		TEST(testSaveThread, &db);
+	}
+#endif // USE_POSTGRESQL
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMapDatabase::testLoadBlocks(MapDatabase *db)
+{
+	const v3s16 a(1, 2, 3), b(-2048, 0, 2047), missing(7, 7, 7);
+	UASSERT(db->saveBlock(a, "block a"));
+	// Blocks may contain null bytes
+	UASSERT(db->saveBlock(b, std::string("block\0b", 7)));
+
+	std::vector<v3s16> positions{missing, b, a, b};
+	std::vector<std::string> blocks{"stale data"};
+	db->loadBlocks(positions, blocks);
+
+	UASSERTEQ(size_t, blocks.size(), 4);
+	UASSERT(blocks[0].empty());
+	UASSERTEQ(std::string, blocks[1], std::string("block\0b", 7));
+	UASSERTEQ(std::string, blocks[2], "block a");
+	UASSERTEQ(std::string, blocks[3], blocks[1]);
+
+	db->loadBlocks({}, blocks);
+	UASSERT(blocks.empty());
+
+	UASSERT(db->deleteBlock(a));
+	UASSERT(db->deleteBlock(b));
+}
+
+void TestMapDatabase::testLoadBlocksInTransaction(MapDatabase *db)
+{
+	const v3s16 a(0, -1, 0);
+
+	db->beginSave();
+	UASSERT(db->saveBlock(a, "in transaction"));
+	std::vector<std::string> blocks;
+	db->loadBlocks({a}, blocks);
+	db->endSave();
+
+	UASSERTEQ(size_t, blocks.size(), 1);
+	UASSERTEQ(std::string, blocks[0], "in transaction");
+
+	UASSERT(db->deleteBlock(a));
+}
+
+static std::string make_queued(const std::string &payload)
+{
+	std::string ret(1, (char)SER_FMT_VER_HIGHEST_WRITE);
+	return ret + payload;
+}
+
+static std::string make_stored(const std::string &payload)
+{
+	std::ostringstream os(std::ios_base::binary);
+	os.put((char)SER_FMT_VER_HIGHEST_WRITE);
+	compress(payload, os, SER_FMT_VER_HIGHEST_WRITE);
+	return os.str();
+}
+
+void TestMapDatabase::testSaveThread(MapDatabase *db)
+{
+	const v3s16 a(5, 0, -5), b(0, 100, 0);
+	MetricsBackend mb;
+	MapDatabaseAccessor acc;
+	acc.dbase = db;
+	std::string data;
+
+	{
+		BlockSaveThread thread(&acc, -1, 2, &mb);
+		acc.save_thread = &thread;
+		thread.start();
+
+		thread.enqueue(a, make_queued("old"));
+		thread.enqueue(a, make_queued("new"));
+		thread.enqueue(b, make_queued("b"));
+
+		// Readers see the newest data, whether it was written yet or not
+		{
+			MutexAutoLock dblock(acc.mutex);
+			acc.loadBlock(a, data);
+			UASSERTEQ(std::string, data, make_stored("new"));
+			std::vector<std::string> blocks;
+			acc.loadBlocks({b, a}, blocks);
+			UASSERTEQ(std::string, blocks[0], make_stored("b"));
+			UASSERTEQ(std::string, blocks[1], make_stored("new"));
+		}
+
+		thread.flush();
+		UASSERTEQ(size_t, thread.getQueueLength(), 0);
+		UASSERT(!thread.getPending(a, data));
+		db->loadBlock(a, &data);
+		UASSERTEQ(std::string, data, make_stored("new"));
+
+		// Stopping writes everything still queued
+		thread.enqueue(b, make_queued("last"));
+		acc.save_thread = nullptr;
+	}
+
+	db->loadBlock(b, &data);
+	UASSERTEQ(std::string, data, make_stored("last"));
+
+	UASSERT(db->deleteBlock(a));
+	UASSERT(db->deleteBlock(b));
+}
@@ -4,10 +4,19 @@
 
 #include "test.h"
 
+#include "dummymap.h"
 #include "emerge.h"
+#include "mapgen/cavegen.h"
 #include "mapgen/mapgen.h"
 #include "mapgen/mg_biome.h"
+#include "mapgen/mg_ore.h"
+#include "mapgen/noise_cache.h"
 #include "mock_server.h"
+#include "noise.h"
+#include "threading/thread_pool.h"
+#include "util/numeric.h"
+#include <cmath>
+#include <cstring>
 
 class TestMapgen : public TestBase
 {
@@ -18,6 +27,9 @@ class TestMapgen : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testBiomeGen(IGameDef *gamedef);
+	void testParallelOres(IGameDef *gamedef);
+	void testNoiseCache2D();
+	void testCaveGen(IGameDef *gamedef);
 };
 
 static TestMapgen g_test_instance;
@@ -37,6 +49,9 @@ namespace {
 void TestMapgen::runTests(IGameDef *gamedef)
 {
 	TEST(testBiomeGen, gamedef);
+	TEST(testParallelOres, gamedef);
+	TEST(testNoiseCache2D);
+	TEST(testCaveGen, gamedef);
 }
 
 void TestMapgen::testBiomeGen(IGameDef *gamedef)
@@ -123,3 +138,586 @@ void TestMapgen::testBiomeGen(IGameDef *gamedef)
 	}
 }
 
+
+static void add_ores(OreManager &oremgr)
+{
+	NoiseParams np(0, 1, v3f(20, 20, 20), 4567, 3, 0.7f, 2.0f);
+
+	// Scatter into stone, also into what an earlier ore placed
+	for (int i = 0; i < 3; i++) {
+		Ore *ore = OreManager::create(ORE_SCATTER);
+		ore->c_ore = i == 1 ? t_CONTENT_TORCH : t_CONTENT_BRICK;
+		ore->c_wherein = i == 2 ? std::vector<content_t>{t_CONTENT_STONE, t_CONTENT_BRICK} :
+			std::vector<content_t>{t_CONTENT_STONE};
+		ore->clust_scarcity = 8 * 8 * 8;
+		ore->clust_num_ores = 8;
+		ore->clust_size = 3;
+		ore->y_min = -100;
+		ore->y_max = 100;
+		ore->ore_param2 = i;
+		oremgr.add(ore);
+	}
+
+	Ore *ore = OreManager::create(ORE_SHEET);
+	ore->c_ore = t_CONTENT_WATER;
+	ore->ore_param2 = 0;
+	ore->c_wherein = {t_CONTENT_STONE, t_CONTENT_TORCH};
+	ore->clust_size = 1;
+	ore->y_min = -100;
+	ore->y_max = 100;
+	ore->nthresh = 0;
+	ore->np = np;
+	((OreSheet *)ore)->column_height_min = 1;
+	((OreSheet *)ore)->column_height_max = 4;
+	((OreSheet *)ore)->column_midpoint_factor = 0.5f;
+	oremgr.add(ore);
+
+	ore = OreManager::create(ORE_PUFF);
+	ore->c_ore = t_CONTENT_LAVA;
+	ore->ore_param2 = 0;
+	ore->c_wherein = {t_CONTENT_STONE};
+	ore->clust_size = 1;
+	ore->y_min = -100;
+	ore->y_max = 100;
+	ore->nthresh = 0.2f;
+	ore->np = np;
+	((OrePuff *)ore)->np_puff_top = NoiseParams(4, 2, v3f(40, 40, 40), 47, 3, 0.7f, 2.0f);
+	((OrePuff *)ore)->np_puff_bottom = NoiseParams(4, 2, v3f(40, 40, 40), 11, 3, 0.7f, 2.0f);
+	oremgr.add(ore);
+
+	// Blobs into stone can be deferred, blobs into lava can not
+	for (int i = 0; i < 2; i++) {
+		ore = OreManager::create(ORE_BLOB);
+		ore->c_ore = t_CONTENT_GRASS;
+		ore->ore_param2 = 0;
+		ore->c_wherein = {i == 0 ? t_CONTENT_STONE : t_CONTENT_LAVA};
+		ore->clust_scarcity = 12 * 12 * 12;
+		ore->clust_size = 5;
+		ore->y_min = -100;
+		ore->y_max = 100;
+		ore->nthresh = 0;
+		ore->np = NoiseParams(0, 1, v3f(4, 4, 4), 17 + i, 1, 0.7f, 2.0f);
+		oremgr.add(ore);
+	}
+
+	ore = OreManager::create(ORE_VEIN);
+	ore->c_ore = t_CONTENT_TORCH;
+	ore->ore_param2 = 0;
+	ore->c_wherein = {t_CONTENT_STONE};
+	ore->clust_size = 1;
+	ore->y_min = -100;
+	ore->y_max = 100;
+	ore->nthresh = 0.5f;
+	ore->np = np;
+	((OreVein *)ore)->random_factor = 0.3f;
+	oremgr.add(ore);
+
+	ore = OreManager::create(ORE_STRATUM);
+	ore->c_ore = t_CONTENT_BRICK;
+	ore->ore_param2 = 0;
+	ore->c_wherein = {t_CONTENT_STONE};
+	ore->clust_scarcity = 3;
+	ore->clust_size = 1;
+	ore->y_min = -100;
+	ore->y_max = 100;
+	ore->flags = OREFLAG_USE_NOISE;
+	ore->np = NoiseParams(0, 8, v3f(40, 40, 40), 23, 3, 0.7f, 2.0f);
+	((OreStratum *)ore)->stratum_thickness = 6;
+	oremgr.add(ore);
+}
+
+void TestMapgen::testParallelOres(IGameDef *gamedef)
+{
+	const v3s16 bpmin(-2, -2, -2), bpmax(1, 1, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	MMVManip vm(&map);
+	vm.initialEmerge(bpmin, bpmax, false);
+	const u32 volume = vm.m_area.getVolume();
+
+	// Some stone with holes
+	std::vector<MapNode> initial(volume);
+	for (u32 i = 0; i < volume; i++)
+		initial[i] = MapNode(myrand_range(0, 9) == 0 ? CONTENT_AIR : t_CONTENT_STONE);
+
+	const v3s16 nmin = bpmin * MAP_BLOCKSIZE + v3s16(MAP_BLOCKSIZE);
+	const v3s16 nmax = (bpmax + 1) * MAP_BLOCKSIZE - v3s16(1) - v3s16(MAP_BLOCKSIZE);
+
+	Mapgen mg;
+	mg.seed = 1234;
+	mg.vm = &vm;
+	mg.ndef = gamedef->ndef();
+
+	// Placing them one by one
+	OreManager serial(gamedef);
+	add_ores(serial);
+	std::copy(initial.begin(), initial.end(), vm.m_data);
+	size_t nplaced = serial.placeAllOres(&mg, 5678, nmin, nmax);
+	const std::vector<MapNode> expected(vm.m_data, vm.m_data + volume);
+
+	// Must not be a trivial case
+	u32 changed = 0;
+	for (u32 i = 0; i < volume; i++)
+		changed += !(expected[i] == initial[i]);
+	UASSERT(changed > volume / 100);
+
+	ThreadPool pool("TestOres", 3);
+	OreManager parallel(gamedef);
+	add_ores(parallel);
+	parallel.setThreadPool(&pool);
+	for (int run = 0; run < 3; run++) {
+		std::copy(initial.begin(), initial.end(), vm.m_data);
+		UASSERTEQ(size_t, parallel.placeAllOres(&mg, 5678, nmin, nmax), nplaced);
+		for (u32 i = 0; i < volume; i++)
+			UASSERT(vm.m_data[i] == expected[i]);
+	}
+}
+
+void TestMapgen::testNoiseCache2D()
+{
+	constexpr u32 SIZE = 16;
+	NoiseParams np(0, 1, v3f(20, 20, 20), 4567, 3, 0.7f, 2.0f);
+	NoiseParams np_persist(0.6f, 0.1f, v3f(30, 30, 30), 12, 2, 0.5f, 2.0f);
+	Noise noise(&np, 1, SIZE, SIZE), reference(&np, 1, SIZE, SIZE);
+	Noise persist(&np_persist, 1, SIZE, SIZE);
+
+	// Room for three results
+	NoiseCache2D cache(3 * SIZE * SIZE * sizeof(float));
+
+	auto check = [&] (float x, float z, float *persist_map) {
+		cache.perlinMap2D(&noise, x, z, persist_map);
+		reference.perlinMap2D(x, z, persist_map);
+		for (u32 i = 0; i < SIZE * SIZE; i++)
+			UASSERT(noise.result[i] == reference.result[i]);
+	};
+
+	check(0, 0, nullptr);
+	check(0, 0, nullptr);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	UASSERTEQ(u64, cache.getMisses(), 1);
+
+	// Another position, seed or persistence map is another result
+	check(SIZE, 0, nullptr);
+	noise.seed = reference.seed = 2;
+	check(0, 0, nullptr);
+	persist.perlinMap2D(0, 0);
+	check(0, 0, persist.result);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	UASSERTEQ(u64, cache.getMisses(), 4);
+
+	// The least recently used one was evicted
+	noise.seed = reference.seed = 1;
+	check(0, 0, nullptr);
+	UASSERTEQ(u64, cache.getMisses(), 5);
+	noise.seed = reference.seed = 2;
+	check(0, 0, persist.result);
+	UASSERTEQ(u64, cache.getHits(), 2);
+}
+
+
+// CavesNoiseIntersection::generateCaves() as it was before the tunnels were
+// found row by row
+static void generate_caves_reference(MMVManip *vm, v3s16 nmin, v3s16 nmax,
+	const NodeDefManager *ndef, BiomeManager *bmgr, BiomeGen *bmgn,
+	biome_t *biomemap, NoiseParams *np_cave1, NoiseParams *np_cave2,
+	s32 seed, float cave_width)
+{
+	const v3s16 csize = nmax - nmin + v3s16(1);
+	const u32 ystride = csize.X;
+	const u32 zstride_1d = csize.X * (csize.Y + 1);
+	Noise noise_cave1(np_cave1, seed, csize.X, csize.Y + 1, csize.Z);
+	Noise noise_cave2(np_cave2, seed, csize.X, csize.Y + 1, csize.Z);
+	noise_cave1.perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
+	noise_cave2.perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
+
+	const v3s32 &em = vm->m_area.getExtent();
+	u32 index2d = 0;
+
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 x = nmin.X; x <= nmax.X; x++, index2d++) {
+		bool column_is_open = false;
+		bool is_under_river = false;
+		bool is_under_tunnel = false;
+		bool is_top_filler_above = false;
+		u32 vi = vm->m_area.index(x, nmax.Y, z);
+		u32 index3d = (z - nmin.Z) * zstride_1d + csize.Y * ystride + (x - nmin.X);
+		Biome *biome = (Biome *)bmgr->getRaw(biomemap[index2d]);
+		u16 depth_top = biome->depth_top;
+		u16 base_filler = depth_top + biome->depth_filler;
+		u16 depth_riverbed = biome->depth_riverbed;
+		u16 nplaced = 0;
+
+		s16 biome_y_next = bmgn->getNextTransitionY(nmax.Y);
+
+		for (s16 y = nmax.Y; y >= nmin.Y - 1; y--,
+				index3d -= ystride,
+				VoxelArea::add_y(em, vi, -1)) {
+			if (y <= biome_y_next) {
+				biome = bmgn->getBiomeAtIndex(index2d, v3s16(x, y, z));
+				biome_y_next = bmgn->getNextTransitionY(y);
+			}
+
+			content_t c = vm->m_data[vi].getContent();
+
+			if (c == CONTENT_AIR || c == biome->c_water_top ||
+					c == biome->c_water) {
+				column_is_open = true;
+				is_top_filler_above = false;
+				continue;
+			}
+
+			if (c == biome->c_river_water) {
+				column_is_open = true;
+				is_under_river = true;
+				is_top_filler_above = false;
+				continue;
+			}
+
+			float d1 = contour(noise_cave1.result[index3d]);
+			float d2 = contour(noise_cave2.result[index3d]);
+
+			if (d1 * d2 > cave_width && ndef->get(c).is_ground_content) {
+				vm->m_data[vi] = MapNode(CONTENT_AIR);
+				is_under_tunnel = true;
+				if (is_top_filler_above)
+					vm->m_data[vi + em.X] = MapNode(biome->c_stone);
+				is_top_filler_above = false;
+			} else if (column_is_open && is_under_tunnel &&
+					(c == biome->c_stone || c == biome->c_filler)) {
+				if (is_under_river) {
+					if (nplaced < depth_riverbed) {
+						vm->m_data[vi] = MapNode(biome->c_riverbed);
+						is_top_filler_above = true;
+						nplaced++;
+					} else {
+						column_is_open = false;
+						is_under_river = false;
+						is_under_tunnel = false;
+					}
+				} else if (nplaced < depth_top) {
+					vm->m_data[vi] = MapNode(biome->c_top);
+					is_top_filler_above = true;
+					nplaced++;
+				} else if (nplaced < base_filler) {
+					vm->m_data[vi] = MapNode(biome->c_filler);
+					is_top_filler_above = true;
+					nplaced++;
+				} else {
+					column_is_open = false;
+					is_under_tunnel = false;
+				}
+			} else {
+				if (c == biome->c_top || c == biome->c_filler)
+					is_top_filler_above = true;
+
+				column_is_open = false;
+			}
+		}
+	}
+}
+
+// CavernsNoise::generateCaverns() as it was before it walked rows
+static bool generate_caverns_reference(MMVManip *vm, v3s16 nmin, v3s16 nmax,
+	const NodeDefManager *ndef, NoiseParams *np_cavern, s32 seed,
+	float cavern_limit, float cavern_taper, float cavern_threshold)
+{
+	const v3s16 csize = nmax - nmin + v3s16(1);
+	const u32 ystride = csize.X;
+	const u32 zstride_1d = csize.X * (csize.Y + 1);
+	Noise noise_cavern(np_cavern, seed, csize.X, csize.Y + 1, csize.Z);
+	noise_cavern.perlinMap3D(nmin.X, nmin.Y - 1, nmin.Z);
+
+	std::vector<float> cavern_amp(csize.Y + 1);
+	u32 cavern_amp_index = 0;
+	for (s16 y = nmax.Y; y >= nmin.Y - 1; y--, cavern_amp_index++) {
+		cavern_amp[cavern_amp_index] =
+			MYMIN((cavern_limit - y) / (float)cavern_taper, 1.0f);
+	}
+
+	bool near_cavern = false;
+	const v3s32 &em = vm->m_area.getExtent();
+
+	for (s16 z = nmin.Z; z <= nmax.Z; z++)
+	for (s16 x = nmin.X; x <= nmax.X; x++) {
+		cavern_amp_index = 0;
+		u32 vi = vm->m_area.index(x, nmax.Y, z);
+		u32 index3d = (z - nmin.Z) * zstride_1d + csize.Y * ystride + (x - nmin.X);
+		for (s16 y = nmax.Y; y >= nmin.Y - 1; y--,
+				index3d -= ystride,
+				VoxelArea::add_y(em, vi, -1),
+				cavern_amp_index++) {
+			content_t c = vm->m_data[vi].getContent();
+			float n_absamp_cavern = std::fabs(noise_cavern.result[index3d]) *
+				cavern_amp[cavern_amp_index];
+			if (n_absamp_cavern > cavern_threshold - 0.1f) {
+				near_cavern = true;
+				if (n_absamp_cavern > cavern_threshold &&
+						ndef->get(c).is_ground_content)
+					vm->m_data[vi] = MapNode(CONTENT_AIR);
+			}
+		}
+	}
+
+	return near_cavern;
+}
+
+// CavesRandomWalk::carveRoute() as it was before it carved whole columns
+static void carve_route_reference(CavesRandomWalk &cave, v3f vec, float f,
+	bool randomize_xz)
+{
+	MMVManip *vm = cave.vm;
+	PseudoRandom *ps = cave.ps;
+	const s16 rs = cave.rs;
+
+	MapNode airnode(CONTENT_AIR);
+	MapNode waternode(cave.c_water_source);
+	MapNode lavanode(cave.c_lava_source);
+
+	v3s16 startp(cave.orp.X, cave.orp.Y, cave.orp.Z);
+	startp += cave.of;
+
+	v3f fp = cave.orp + vec * f;
+	fp.X += 0.1f * ps->range(-10, 10);
+	fp.Z += 0.1f * ps->range(-10, 10);
+	v3s16 cp(fp.X, fp.Y, fp.Z);
+
+	MapNode liquidnode = CONTENT_IGNORE;
+	if (cave.flooded) {
+		if (cave.use_biome_liquid) {
+			liquidnode = cave.c_biome_liquid;
+		} else {
+			float nval = NoisePerlin3D(cave.np_caveliquids, startp.X,
+				startp.Y, startp.Z, cave.seed);
+			liquidnode = (nval < 0.40f && cave.node_max.Y < cave.water_level - 256) ?
+				lavanode : waternode;
+		}
+	}
+
+	s16 d0 = -rs / 2;
+	s16 d1 = d0 + rs;
+	if (randomize_xz) {
+		d0 += ps->range(-1, 1);
+		d1 += ps->range(-1, 1);
+	}
+
+	bool flat_cave_floor = !cave.large_cave && ps->range(0, 2) == 2;
+
+	for (s16 z0 = d0; z0 <= d1; z0++) {
+		s16 si = rs / 2 - MYMAX(0, abs(z0) - rs / 7 - 1);
+		for (s16 x0 = -si - ps->range(0,1); x0 <= si - 1 + ps->range(0,1); x0++) {
+			s16 maxabsxz = MYMAX(abs(x0), abs(z0));
+
+			s16 si2 = rs / 2 - MYMAX(0, maxabsxz - rs / 7 - 1);
+
+			for (s16 y0 = -si2; y0 <= si2; y0++) {
+				if (flat_cave_floor && y0 <= -rs / 2 && rs <= 7)
+					continue;
+
+				if (cave.large_cave_is_flat) {
+					if (rs > 7 && abs(y0) >= rs / 3)
+						continue;
+				}
+
+				v3s16 p(cp.X + x0, cp.Y + y0, cp.Z + z0);
+				p += cave.of;
+
+				if (!vm->m_area.contains(p))
+					continue;
+
+				u32 i = vm->m_area.index(p);
+				content_t c = vm->m_data[i].getContent();
+				if (!cave.ndef->get(c).is_ground_content)
+					continue;
+
+				if (cave.large_cave) {
+					int full_ymin = cave.node_min.Y - MAP_BLOCKSIZE;
+					int full_ymax = cave.node_max.Y + MAP_BLOCKSIZE;
+
+					if (cave.flooded && full_ymin < cave.water_level &&
+							full_ymax > cave.water_level)
+						vm->m_data[i] = (p.Y <= cave.water_level) ? waternode : airnode;
+					else if (cave.flooded && full_ymax < cave.water_level)
+						vm->m_data[i] = (p.Y < startp.Y - 4) ? liquidnode : airnode;
+					else
+						vm->m_data[i] = airnode;
+				} else {
+					vm->m_data[i] = airnode;
+					vm->m_flags[i] |= VMANIP_FLAG_CAVE;
+				}
+			}
+		}
+	}
+}
+
+void TestMapgen::testCaveGen(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->getNodeDefManager();
+	MockServer server(getTestTempDirectory());
+	MockBiomeManager bmgr(&server);
+	bmgr.setNodeDefManager(ndef);
+
+	// A biome border at y = 0, lava stands in for river water
+	for (int i = 0; i < 2; i++) {
+		Biome *b = BiomeManager::create(BIOMETYPE_NORMAL);
+		b->name = i == 0 ? "upper" : "lower";
+		b->c_top = t_CONTENT_GRASS;
+		b->depth_top = i == 0 ? 1 : 2;
+		b->c_filler = t_CONTENT_BRICK;
+		b->depth_filler = i == 0 ? 3 : 5;
+		b->c_stone = t_CONTENT_STONE;
+		b->c_water_top = t_CONTENT_WATER;
+		b->c_water = t_CONTENT_WATER;
+		b->c_river_water = t_CONTENT_LAVA;
+		b->c_riverbed = t_CONTENT_BRICK;
+		b->depth_riverbed = 2;
+		b->c_cave_liquid = {CONTENT_IGNORE};
+		if (i == 0)
+			b->min_pos.Y = 1;
+		else
+			b->max_pos.Y = 0;
+		UASSERT(bmgr.add(b) != OBJDEF_INVALID_HANDLE);
+	}
+
+	constexpr s16 CSIZE = 32;
+	std::unique_ptr<BiomeParams> params(BiomeManager::createBiomeParams(BIOMEGEN_ORIGINAL));
+	std::unique_ptr<BiomeGen> biomegen(
+		bmgr.createBiomeGen(BIOMEGEN_ORIGINAL, params.get(), v3s16(CSIZE)));
+
+	NoiseParams np_cave1(0, 3, v3f(31, 31, 31), 52534, 3, 0.5f, 2.0f);
+	NoiseParams np_cave2(0, 3, v3f(37, 37, 37), 10325, 3, 0.5f, 2.0f);
+	NoiseParams np_cavern(0, 1, v3f(48, 24, 48), 723, 4, 0.63f, 2.0f);
+
+	// At the surface, with water, rivers and the biome border, and deep down
+	const v3s16 chunks[] = {{-16, -20, -16}, {32, -100, -48}};
+	u32 caves_changed = 0, caverns_changed = 0, carved = 0;
+
+	for (v3s16 nmin : chunks) {
+		const v3s16 nmax = nmin + v3s16(CSIZE - 1);
+		const v3s16 bpmin = getNodeBlockPos(nmin) - v3s16(1);
+		const v3s16 bpmax = getNodeBlockPos(nmax) + v3s16(1);
+		DummyMap map(gamedef, bpmin, bpmax);
+		MMVManip vm(&map);
+		vm.initialEmerge(bpmin, bpmax, false);
+		const VoxelArea &area = vm.m_area;
+		const u32 volume = area.getVolume();
+
+		// Hills with a grass and brick surface, water up to y = 0, diagonal
+		// rivers and some nodes that are not ground content
+		std::vector<s16> heightmap(CSIZE * CSIZE);
+		std::vector<MapNode> initial(volume);
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			const bool river = ((x - z / 2) % 13 + 13) % 13 < 3;
+			const s16 h = 4 + 6 * std::sin(x * 0.21f) * std::cos(z * 0.17f) -
+				(river ? 3 : 0);
+			if (x >= nmin.X && x <= nmax.X && z >= nmin.Z && z <= nmax.Z)
+				heightmap[(z - nmin.Z) * CSIZE + (x - nmin.X)] = h;
+			for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+				content_t c;
+				if (y > h)
+					c = river && y <= h + 2 ? t_CONTENT_LAVA :
+						y <= 0 ? t_CONTENT_WATER : CONTENT_AIR;
+				else if (y == h)
+					c = t_CONTENT_GRASS;
+				else if (y >= h - 6)
+					c = t_CONTENT_BRICK;
+				else if ((x * 7 + y * 13 + z * 5) % 37 == 0)
+					c = t_CONTENT_TORCH;
+				else
+					c = t_CONTENT_STONE;
+				initial[area.index(x, y, z)] = MapNode(c);
+			}
+		}
+		biomegen->calcBiomeNoise(nmin);
+		biome_t *biomemap = biomegen->getBiomes(heightmap.data(), nmin);
+
+		auto reset = [&] () {
+			std::copy(initial.begin(), initial.end(), vm.m_data);
+			memset(vm.m_flags, 0, volume);
+		};
+		auto count_changes = [&] () {
+			u32 n = 0;
+			for (u32 i = 0; i < volume; i++)
+				n += !(vm.m_data[i] == initial[i]);
+			return n;
+		};
+
+		for (s32 seed = 1; seed <= 3; seed++) {
+			reset();
+			CavesNoiseIntersection caves(ndef, &bmgr, biomegen.get(), v3s16(CSIZE),
+				&np_cave1, &np_cave2, seed, 0.01f);
+			caves.generateCaves(&vm, nmin, nmax, biomemap);
+			const std::vector<MapNode> expected(vm.m_data, vm.m_data + volume);
+			caves_changed += count_changes();
+
+			reset();
+			generate_caves_reference(&vm, nmin, nmax, ndef, &bmgr, biomegen.get(),
+				biomemap, &np_cave1, &np_cave2, seed, 0.01f);
+			for (u32 i = 0; i < volume; i++)
+				UASSERT(vm.m_data[i] == expected[i]);
+
+			// Tapered towards the middle of the chunk
+			const float limit = nmin.Y + CSIZE / 2, taper = 16;
+			const float threshold = 0.3f + 0.2f * seed;
+			reset();
+			CavernsNoise caverns(ndef, v3s16(CSIZE), &np_cavern, seed, limit,
+				taper, threshold);
+			bool near_cavern = caverns.generateCaverns(&vm, nmin, nmax);
+			const std::vector<MapNode> expected_caverns(vm.m_data, vm.m_data + volume);
+			caverns_changed += count_changes();
+
+			reset();
+			UASSERT(generate_caverns_reference(&vm, nmin, nmax, ndef, &np_cavern,
+				seed, limit, taper, threshold) == near_cavern);
+			for (u32 i = 0; i < volume; i++)
+				UASSERT(vm.m_data[i] == expected_caverns[i]);
+		}
+
+		// Random walk caves: carve single routes from all kinds of states,
+		// after makeCave() has set the cave up
+		reset();
+		PseudoRandom ps_setup(nmin.X);
+		CavesRandomWalk cave(ndef, nullptr, 1, 1, t_CONTENT_WATER, t_CONTENT_LAVA,
+			0.5f, nullptr);
+		cave.makeCave(&vm, nmin, nmax, &ps_setup, true, nmax.Y, heightmap.data());
+		initial.assign(vm.m_data, vm.m_data + volume);
+
+		PseudoRandom pr(nmin.Z);
+		for (int i = 0; i < 100; i++) {
+			cave.large_cave = pr.range(0, 1);
+			cave.large_cave_is_flat = pr.range(0, 1);
+			cave.flooded = pr.range(0, 1);
+			cave.water_level = pr.range(nmin.Y - 40, nmax.Y + 40);
+			cave.rs = pr.range(2, 24);
+			// Also routes that start outside of the voxelmanip
+			cave.orp = v3f(pr.range(-24, cave.ar.X + 24), pr.range(-24, cave.ar.Y + 24),
+				pr.range(-24, cave.ar.Z + 24)) + v3f(0.5f);
+			const v3f vec(pr.range(-20, 20), pr.range(-20, 20), pr.range(-20, 20));
+			const float f = pr.range(0, 10) / 10.0f;
+			const bool randomize_xz = pr.range(0, 1);
+			const s32 route_seed = pr.next();
+
+			reset();
+			PseudoRandom ps(route_seed);
+			cave.ps = &ps;
+			cave.carveRoute(vec, f, randomize_xz);
+			const std::vector<MapNode> expected(vm.m_data, vm.m_data + volume);
+			const std::vector<u8> expected_flags(vm.m_flags, vm.m_flags + volume);
+			carved += count_changes();
+
+			reset();
+			PseudoRandom ps_ref(route_seed);
+			cave.ps = &ps_ref;
+			carve_route_reference(cave, vec, f, randomize_xz);
+			UASSERT(ps.next() == ps_ref.next());
+			for (u32 j = 0; j < volume; j++) {
+				UASSERT(vm.m_data[j] == expected[j]);
+				UASSERT(vm.m_flags[j] == expected_flags[j]);
+			}
+		}
+	}
+
+	// Must not be trivial cases
+	UASSERT(caves_changed > 1000);
+	UASSERT(caverns_changed > 1000);
+	UASSERT(carved > 1000);
+}
@@ -7,6 +7,9 @@
 #include <cmath>
 #include "exceptions.h"
 #include "noise.h"
+#include "noise_simd.h"
+#include <cstring>
+#include <vector>
 
 class TestNoise : public TestBase {
 public:
@@ -26,6 +29,7 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testNoiseMapKernels();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
@@ -46,6 +50,7 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testNoiseMapKernels);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -160,6 +165,134 @@ void TestNoise::testNoiseInvalidParams()
 	UASSERT(exception_thrown);
 }
 
+// The straightforward implementation of Noise::gradientMap2D(), which the
+// vectorized one has to match exactly
+static void reference_gradient_map_2d(std::vector<float> &out, u32 sx, u32 sy,
+	float x, float y, float step_x, float step_y, s32 seed, bool eased)
+{
+	auto lerp = [] (float v0, float v1, float t) { return v0 + (v1 - v0) * t; };
+	s32 x0 = std::floor(x), y0 = std::floor(y);
+	float v = y - (float)y0;
+	const float orig_u = x - (float)x0;
+
+	out.clear();
+	for (u32 j = 0; j != sy; j++) {
+		float u = orig_u;
+		s32 noisex = 0;
+		const float ev = eased ? easeCurve(v) : v;
+		for (u32 i = 0; i != sx; i++) {
+			const float eu = eased ? easeCurve(u) : u;
+			float a = lerp(noise2d(x0 + noisex, y0, seed),
+				noise2d(x0 + noisex + 1, y0, seed), eu);
+			float b = lerp(noise2d(x0 + noisex, y0 + 1, seed),
+				noise2d(x0 + noisex + 1, y0 + 1, seed), eu);
+			out.push_back(lerp(a, b, ev));
+
+			u += step_x;
+			if (u >= 1.0) {
+				u -= 1.0;
+				noisex++;
+			}
+		}
+		v += step_y;
+		if (v >= 1.0) {
+			v -= 1.0;
+			y0++;
+		}
+	}
+}
+
+static void reference_gradient_map_3d(std::vector<float> &out, u32 sx, u32 sy, u32 sz,
+	float x, float y, float z, float step_x, float step_y, float step_z,
+	s32 seed, bool eased)
+{
+	auto lerp = [] (float v0, float v1, float t) { return v0 + (v1 - v0) * t; };
+	s32 x0 = std::floor(x), y0_orig = std::floor(y), z0 = std::floor(z);
+	const float orig_u = x - (float)x0;
+	const float orig_v = y - (float)y0_orig;
+	float w = z - (float)z0;
+
+	out.clear();
+	for (u32 k = 0; k != sz; k++) {
+		float v = orig_v;
+		s32 y0 = y0_orig;
+		const float ew = eased ? easeCurve(w) : w;
+		for (u32 j = 0; j != sy; j++) {
+			float u = orig_u;
+			s32 x1 = x0;
+			const float ev = eased ? easeCurve(v) : v;
+			for (u32 i = 0; i != sx; i++) {
+				const float eu = eased ? easeCurve(u) : u;
+				auto n = [&] (s32 dx, s32 dy, s32 dz) {
+					return noise3d(x1 + dx, y0 + dy, z0 + dz, seed);
+				};
+				float a = lerp(lerp(n(0, 0, 0), n(1, 0, 0), eu),
+					lerp(n(0, 1, 0), n(1, 1, 0), eu), ev);
+				float b = lerp(lerp(n(0, 0, 1), n(1, 0, 1), eu),
+					lerp(n(0, 1, 1), n(1, 1, 1), eu), ev);
+				out.push_back(lerp(a, b, ew));
+
+				u += step_x;
+				if (u >= 1.0) {
+					u -= 1.0;
+					x1++;
+				}
+			}
+			v += step_y;
+			if (v >= 1.0) {
+				v -= 1.0;
+				y0++;
+			}
+		}
+		w += step_z;
+		if (w >= 1.0) {
+			w -= 1.0;
+			z0++;
+		}
+	}
+}
+
+void TestNoise::testNoiseMapKernels()
+{
+	const noise_simd::Level orig_level = noise_simd::getLevel();
+	std::vector<float> expected;
+
+	for (int l = noise_simd::LEVEL_SCALAR; l <= noise_simd::LEVEL_AVX2; l++) {
+		const auto level = (noise_simd::Level)l;
+		if (!noise_simd::setLevel(level)) {
+			rawstream << "  (" << noise_simd::getLevelName(level)
+				<< " not supported)" << std::endl;
+			continue;
+		}
+
+		for (u32 flags : {0, NOISE_FLAG_EASED})
+		for (v3f spread : {v3f(97, 31, 57), v3f(1.05f, 1.5f, 1.2f)}) {
+			// Odd sizes exercise the scalar tails of the vector kernels
+			NoiseParams np(0, 1, spread, 0, 1, 0.5, 2.0, flags);
+			Noise noise(&np, 0, 37, 19, 11);
+			const v3f step = v3f(1, 1, 1) / spread;
+
+			for (int seed : {0, -1337, 0x7fffffff}) {
+				float x = -2018.3f / spread.X, y = 46.1f / spread.Y,
+					z = 1000.7f / spread.Z;
+				noise.gradientMap2D(x, y, step.X, step.Y, seed);
+				reference_gradient_map_2d(expected, noise.sx, noise.sy,
+					x, y, step.X, step.Y, seed, flags != 0);
+				UASSERT(!memcmp(noise.gradient_buf, expected.data(),
+					expected.size() * sizeof(float)));
+
+				noise.gradientMap3D(x, y, z, step.X, step.Y, step.Z, seed);
+				reference_gradient_map_3d(expected, noise.sx, noise.sy, noise.sz,
+					x, y, z, step.X, step.Y, step.Z, seed, flags != 0);
+				UASSERT(!memcmp(noise.gradient_buf, expected.data(),
+					expected.size() * sizeof(float)));
+			}
+		}
+	}
+
+	noise_simd::setLevel(orig_level);
+}
+
 const float TestNoise::expected_2d_results[10 * 10] = {
 	19.11726, 18.49626, 16.48476, 15.02135, 14.75713, 16.26008, 17.54822,
 	18.06860, 18.57016, 18.48407, 18.49649, 17.89160, 15.94162, 14.54901,
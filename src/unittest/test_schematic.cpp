@@ -7,6 +7,8 @@
 #include "mapgen/mg_schematic.h"
 #include "gamedef.h"
 #include "nodedef.h"
+#include "dummymap.h"
+#include "util/numeric.h"
 
 class TestSchematic : public TestBase {
 public:
@@ -18,6 +20,7 @@ class TestSchematic : public TestBase {
 	void testMtsSerializeDeserialize(const NodeDefManager *ndef);
 	void testLuaTableSerialize(const NodeDefManager *ndef);
 	void testFileSerializeDeserialize(const NodeDefManager *ndef);
+	void testBlitToVManip(IGameDef *gamedef);
 
 	static const content_t test_schem1_data[7 * 6 * 4];
 	static const content_t test_schem2_data[3 * 3 * 3];
@@ -37,6 +40,7 @@ void TestSchematic::runTests(IGameDef *gamedef)
 	TEST(testMtsSerializeDeserialize, ndef);
 	TEST(testLuaTableSerialize, ndef);
 	TEST(testFileSerializeDeserialize, ndef);
+	TEST(testBlitToVManip, gamedef);
 
 	ndef->resetNodeResolveState();
 }
@@ -172,6 +176,148 @@ void TestSchematic::testFileSerializeDeserialize(const NodeDefManager *ndef)
 }
 
 
+// Places the schematic node by node, like blitToVManip() used to
+static void blit_reference(const Schematic &schem, const NodeDefManager *ndef,
+	MMVManip *vm, v3s16 p, Rotation rot, bool force_place)
+{
+	const v3s16 size = schem.size;
+	int xstride = 1;
+	int ystride = size.X;
+	int zstride = size.X * size.Y;
+
+	s16 sx = size.X;
+	s16 sy = size.Y;
+	s16 sz = size.Z;
+
+	int i_start, i_step_x, i_step_z;
+	switch (rot) {
+		case ROTATE_90:
+			i_start  = sx - 1;
+			i_step_x = zstride;
+			i_step_z = -xstride;
+			std::swap(sx, sz);
+			break;
+		case ROTATE_180:
+			i_start  = zstride * (sz - 1) + sx - 1;
+			i_step_x = -xstride;
+			i_step_z = -zstride;
+			break;
+		case ROTATE_270:
+			i_start  = zstride * (sz - 1);
+			i_step_x = -zstride;
+			i_step_z = xstride;
+			std::swap(sx, sz);
+			break;
+		default:
+			i_start  = 0;
+			i_step_x = xstride;
+			i_step_z = zstride;
+	}
+
+	s16 y_map = p.Y;
+	for (s16 y = 0; y != sy; y++) {
+		if ((schem.slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
+			(schem.slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+			continue;
+
+		for (s16 z = 0; z != sz; z++) {
+			u32 i = z * i_step_z + y * ystride + i_start;
+			for (s16 x = 0; x != sx; x++, i += i_step_x) {
+				v3s16 pos(p.X + x, y_map, p.Z + z);
+				if (!vm->m_area.contains(pos))
+					continue;
+
+				const MapNode &n = schem.schemdata[i];
+				u8 placement_prob = n.param1 & MTSCHEM_PROB_MASK;
+				if (n.getContent() == CONTENT_IGNORE ||
+						placement_prob == MTSCHEM_PROB_NEVER)
+					continue;
+
+				u32 vi = vm->m_area.index(pos);
+				if (!force_place && !(n.param1 & MTSCHEM_FORCE_PLACE)) {
+					content_t c = vm->m_data[vi].getContent();
+					if (c != CONTENT_AIR && c != CONTENT_IGNORE)
+						continue;
+				}
+
+				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
+					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+					continue;
+
+				vm->m_data[vi] = n;
+				vm->m_data[vi].param1 = 0;
+				if (rot)
+					vm->m_data[vi].rotateAlongYAxis(ndef, rot);
+			}
+		}
+		y_map++;
+	}
+}
+
+
+void TestSchematic::testBlitToVManip(IGameDef *gamedef)
+{
+	static const v3s16 size(7, 6, 4);
+	static const u32 volume = size.X * size.Y * size.Z;
+	static const content_t content_map[] = {
+		CONTENT_AIR,
+		t_CONTENT_STONE,
+		t_CONTENT_BRICK,
+		CONTENT_IGNORE,
+	};
+	const NodeDefManager *ndef = gamedef->ndef();
+
+	// All kinds of node and slice probabilities and force placement
+	Schematic schem;
+	schem.m_ndef = ndef;
+	schem.size = size;
+	schem.schemdata = new MapNode[volume];
+	schem.slice_probs = new u8[size.Y];
+	for (u32 i = 0; i != volume; i++) {
+		content_t c = content_map[test_schem1_data[i]];
+		u8 prob = i % 5 == 0 ? myrand_range(0, MTSCHEM_PROB_ALWAYS) :
+			c == CONTENT_AIR ? MTSCHEM_PROB_NEVER : MTSCHEM_PROB_ALWAYS;
+		if (i % 3 == 0)
+			prob |= MTSCHEM_FORCE_PLACE;
+		schem.schemdata[i] = MapNode(c, prob, i % 24);
+	}
+	for (s16 y = 0; y != size.Y; y++)
+		schem.slice_probs[y] = y == 2 ? 64 : MTSCHEM_PROB_ALWAYS;
+
+	const v3s16 bpmin(0, 0, 0), bpmax(0, 0, 0);
+	DummyMap map(gamedef, bpmin, bpmax);
+	MMVManip vm(&map);
+	vm.initialEmerge(bpmin, bpmax, false);
+	const u32 vm_volume = vm.m_area.getVolume();
+
+	// Some stone to not replace
+	std::vector<MapNode> initial(vm_volume);
+	for (u32 i = 0; i < vm_volume; i++)
+		initial[i] = MapNode(myrand_range(0, 3) == 0 ? t_CONTENT_STONE : CONTENT_AIR);
+
+	// Inside, and cut off at every side of the voxel manipulator
+	static const v3s16 positions[] = {
+		v3s16(4, 4, 4), v3s16(-3, 5, 6), v3s16(12, 3, 5),
+		v3s16(5, -4, 7), v3s16(6, 13, 2), v3s16(3, 6, -2), v3s16(8, 2, 14),
+	};
+
+	for (int rot = ROTATE_0; rot <= ROTATE_270; rot++)
+	for (bool force_place : {false, true})
+	for (v3s16 p : positions) {
+		std::copy(initial.begin(), initial.end(), vm.m_data);
+		mysrand(rot * 100 + p.X);
+		blit_reference(schem, ndef, &vm, p, (Rotation)rot, force_place);
+		const std::vector<MapNode> expected(vm.m_data, vm.m_data + vm_volume);
+
+		std::copy(initial.begin(), initial.end(), vm.m_data);
+		mysrand(rot * 100 + p.X);
+		schem.blitToVManip(&vm, p, (Rotation)rot, force_place);
+		for (u32 i = 0; i < vm_volume; i++)
+			UASSERT(vm.m_data[i] == expected[i]);
+	}
+}
+
+
 // Should form a cross-shaped-thing...?
 const content_t TestSchematic::test_schem1_data[7 * 6 * 4] = {
 	3, 3, 1, 1, 1, 3, 3, // Y=0, Z=0
@@ -0,0 +1,96 @@
+// Luanti
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+#include "test.h"
+
+#include "mapblock.h"
+#include "serialization.h"
+#include "server/serializedblockcache.h"
+
+class TestSerializedBlockCache : public TestBase
+{
+public:
+	TestSerializedBlockCache() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestSerializedBlockCache"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testHitMiss(IGameDef *gamedef);
+	void testInvalidation(IGameDef *gamedef);
+	void testEviction(IGameDef *gamedef);
+};
+
+static TestSerializedBlockCache g_test_instance;
+
+void TestSerializedBlockCache::runTests(IGameDef *gamedef)
+{
+	TEST(testHitMiss, gamedef);
+	TEST(testInvalidation, gamedef);
+	TEST(testEviction, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+constexpr u8 VER = SER_FMT_VER_HIGHEST_WRITE;
+
+void TestSerializedBlockCache::testHitMiss(IGameDef *gamedef)
+{
+	SerializedBlockCache cache(1024);
+	MapBlock block({1, 2, 3}, gamedef);
+
+	UASSERT(!cache.get(&block, VER));
+	cache.put(&block, VER, "data");
+	UASSERT(block.net_cache_valid);
+
+	const std::string *s = cache.get(&block, VER);
+	UASSERT(s && *s == "data");
+
+	// Other format is a miss and replaces the entry
+	UASSERT(!cache.get(&block, VER - 1));
+	UASSERTEQ(size_t, cache.size(), 0);
+
+	// Same position, different block object
+	cache.put(&block, VER, "data");
+	MapBlock block2({1, 2, 3}, gamedef);
+	UASSERT(!cache.get(&block2, VER));
+	UASSERTEQ(size_t, cache.getUsedBytes(), 0);
+}
+
+void TestSerializedBlockCache::testInvalidation(IGameDef *gamedef)
+{
+	SerializedBlockCache cache(1024);
+	MapBlock block({}, gamedef);
+
+	cache.put(&block, VER, "data");
+	// Does not change what is sent to clients
+	block.setTimestamp(123);
+	UASSERT(cache.get(&block, VER));
+
+	block.setNode({0, 0, 0}, MapNode(CONTENT_AIR));
+	UASSERT(!block.net_cache_valid);
+	UASSERT(!cache.get(&block, VER));
+	UASSERTEQ(size_t, cache.size(), 0);
+}
+
+void TestSerializedBlockCache::testEviction(IGameDef *gamedef)
+{
+	SerializedBlockCache cache(10);
+	MapBlock a({0, 0, 0}, gamedef), b({1, 0, 0}, gamedef), c({2, 0, 0}, gamedef);
+
+	cache.put(&a, VER, "aaaa");
+	cache.put(&b, VER, "bbbb");
+	// touch a so that b is least recently used
+	UASSERT(cache.get(&a, VER));
+	cache.put(&c, VER, "cccc");
+
+	UASSERTEQ(size_t, cache.size(), 2);
+	UASSERTEQ(size_t, cache.getUsedBytes(), 8);
+	UASSERT(cache.get(&a, VER));
+	UASSERT(!cache.get(&b, VER));
+	UASSERT(cache.get(&c, VER));
+
+	// too large to be cached at all
+	cache.put(&b, VER, std::string(11, 'b'));
+	UASSERT(!cache.get(&b, VER));
+	UASSERTEQ(size_t, cache.size(), 2);
+}
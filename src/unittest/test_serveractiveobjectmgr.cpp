@@ -10,6 +10,7 @@
 #include "server/activeobjectmgr.h"
 
 #include "profiler.h"
+#include "util/numeric.h"
 
 
 class TestServerActiveObjectMgr : public TestBase
@@ -25,6 +26,8 @@ class TestServerActiveObjectMgr : public TestBase
 	void testRemoveObject();
 	void testGetObjectsInsideRadius();
 	void testGetAddedActiveObjectsAroundPos();
+	void testSpatialIndex();
+	void testMessageRecipients();
 };
 
 static TestServerActiveObjectMgr g_test_instance;
@@ -36,6 +39,8 @@ void TestServerActiveObjectMgr::runTests(IGameDef *gamedef)
 	TEST(testRemoveObject)
 	TEST(testGetObjectsInsideRadius);
 	TEST(testGetAddedActiveObjectsAroundPos);
+	TEST(testSpatialIndex);
+	TEST(testMessageRecipients);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -170,3 +175,122 @@ void TestServerActiveObjectMgr::testGetAddedActiveObjectsAroundPos()
 
 	saomgr.clear();
 }
+
+void TestServerActiveObjectMgr::testSpatialIndex()
+{
+	server::ActiveObjectMgr saomgr;
+	std::vector<ServerActiveObject *> objs;
+	for (int i = 0; i < 500; i++) {
+		v3f p(myrand_range(-2000, 2000), myrand_range(-2000, 2000),
+			myrand_range(-2000, 2000));
+		auto sao_u = std::make_unique<MockServerActiveObject>(nullptr, p);
+		objs.push_back(sao_u.get());
+		UASSERT(saomgr.registerObject(std::move(sao_u)));
+	}
+
+	// Move some objects around and remove a few others
+	for (int i = 0; i < 100; i++) {
+		auto *obj = objs[myrand_range(0, (int)objs.size() - 1)];
+		obj->setBasePosition(obj->getBasePosition() + v3f(myrand_range(-500, 500), 0, 0));
+		// done by the environment normally
+		saomgr.updateObjectPos(obj);
+	}
+	for (int i = 0; i < 50; i++) {
+		auto it = objs.begin() + myrand_range(0, (int)objs.size() - 1);
+		saomgr.removeObject((*it)->getId());
+		objs.erase(it);
+	}
+
+	// Compare to a plain search through all objects, results are ordered by id
+	std::sort(objs.begin(), objs.end(), [] (ServerActiveObject *a, ServerActiveObject *b) {
+		return a->getId() < b->getId();
+	});
+	for (int i = 0; i < 50; i++) {
+		v3f pos(myrand_range(-2000, 2000), myrand_range(-2000, 2000),
+			myrand_range(-2000, 2000));
+		float radius = myrand_range(0, 1000);
+
+		std::vector<ServerActiveObject *> result, expected;
+		saomgr.getObjectsInsideRadius(pos, radius, result, nullptr);
+		for (auto *obj : objs) {
+			if (obj->getBasePosition().getDistanceFrom(pos) <= radius)
+				expected.push_back(obj);
+		}
+		UASSERT(result == expected);
+
+		aabb3f box(pos, pos + v3f(myrand_range(0, 800)));
+		result.clear();
+		expected.clear();
+		saomgr.getObjectsInArea(box, result, nullptr);
+		for (auto *obj : objs) {
+			if (box.isPointInside(obj->getBasePosition()))
+				expected.push_back(obj);
+		}
+		UASSERT(result == expected);
+	}
+
+	saomgr.clear();
+}
+
+namespace {
+
+class MockPlayerObject : public MockServerActiveObject
+{
+public:
+	ServerActiveObject *getParent() const override { return parent; }
+	session_t getPeerID() const override { return peer_id; }
+
+	ServerActiveObject *parent = nullptr;
+	session_t peer_id = PEER_ID_INEXISTENT;
+};
+
+std::vector<session_t> get_recipients(const ServerActiveObject &obj, u8 cmd)
+{
+	ActiveObjectMessage aom(obj.getId(), true, std::string(1, cmd));
+	std::vector<session_t> peers;
+	obj.forEachMessageRecipient(aom, [&] (session_t peer_id) {
+		peers.push_back(peer_id);
+	});
+	std::sort(peers.begin(), peers.end());
+	return peers;
+}
+
+}
+
+void TestServerActiveObjectMgr::testMessageRecipients()
+{
+	using Peers = std::vector<session_t>;
+	MockServerActiveObject parent;
+	MockPlayerObject obj;
+	obj.peer_id = 3;
+
+	UASSERT(get_recipients(obj, AO_CMD_SET_PROPERTIES).empty());
+
+	// Peers learn about the object
+	obj.m_known_by = {2, 3, 4};
+	UASSERT(get_recipients(obj, AO_CMD_SET_PROPERTIES) == Peers({2, 3, 4}));
+	// The player does not get its own position
+	UASSERT(get_recipients(obj, AO_CMD_UPDATE_POSITION) == Peers({2, 4}));
+
+	// A peer forgets about the object, another one learns about it
+	obj.removeKnownBy(2);
+	obj.removeKnownBy(7);
+	obj.m_known_by.push_back(5);
+	UASSERT(get_recipients(obj, AO_CMD_SET_PROPERTIES) == Peers({3, 4, 5}));
+	UASSERT(get_recipients(obj, AO_CMD_UPDATE_POSITION) == Peers({4, 5}));
+
+	// Peers that know the parent get no position updates of attached objects
+	obj.parent = &parent;
+	parent.m_known_by = {4};
+	UASSERT(get_recipients(obj, AO_CMD_SET_PROPERTIES) == Peers({3, 4, 5}));
+	UASSERT(get_recipients(obj, AO_CMD_UPDATE_POSITION) == Peers({5}));
+	parent.removeKnownBy(4);
+	UASSERT(get_recipients(obj, AO_CMD_UPDATE_POSITION) == Peers({4, 5}));
+
+	// Everyone forgets about the object
+	obj.removeKnownBy(3);
+	obj.removeKnownBy(4);
+	obj.removeKnownBy(5);
+	UASSERT(obj.m_known_by.empty());
+	UASSERT(get_recipients(obj, AO_CMD_UPDATE_POSITION).empty());
+}
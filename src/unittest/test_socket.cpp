@@ -22,6 +22,7 @@ class TestSocket : public TestBase {
 
 	void testIPv4Socket();
 	void testIPv6Socket();
+	void testBatch();
 
 	static const int port = 30003;
 };
@@ -31,6 +32,7 @@ static TestSocket g_test_instance;
 void TestSocket::runTests(IGameDef *gamedef)
 {
 	TEST(testIPv4Socket);
+	TEST(testBatch);
 
 	if (g_settings->getBool("enable_ipv6"))
 		TEST(testIPv6Socket);
@@ -132,3 +134,56 @@ void TestSocket::testIPv6Socket()
 				Address(&bytes, 0).getAddress6().s6_addr, 16) == 0);
 	}
 }
+
+void TestSocket::testBatch()
+{
+	Address address(127, 0, 0, 1, port);
+	Address bind_addr(0, 0, 0, 0, port);
+	// See testIPv4Socket()
+	std::string bind_str = g_settings->get("bind_address");
+	try {
+		bind_addr.Resolve(bind_str.c_str());
+		if (!bind_addr.isIPv6() && bind_addr != Address(0, 0, 0, 0, port))
+			address = bind_addr;
+	} catch (ResolveError &e) {
+	}
+
+	UDPSocket socket(false);
+	socket.Bind(address);
+
+	// Datagrams of different sizes, including an empty one
+	constexpr int count = 10;
+	std::string payloads[count];
+	UDPSocket::OutgoingDatagram out[count];
+	for (int i = 0; i < count; i++) {
+		payloads[i] = std::string(i * 10, 'a' + i);
+		out[i] = {&address, payloads[i].data(), (int)payloads[i].size()};
+	}
+	UASSERTEQ(int, socket.SendBatch(out, count), 0);
+
+	sleep_ms(50);
+
+	char buffers[count][128];
+	UDPSocket::IncomingDatagram in[count];
+	for (int i = 0; i < count; i++) {
+		in[i].data = buffers[i];
+		in[i].capacity = sizeof(buffers[i]);
+	}
+
+	// Some platforms only return one datagram per call
+	socket.setTimeoutMs(100);
+	int received = 0;
+	while (received < count) {
+		int n = socket.ReceiveBatch(in + received, count - received);
+		if (n == 0)
+			break;
+		received += n;
+	}
+	UASSERTEQ(int, received, count);
+
+	for (int i = 0; i < count; i++) {
+		UASSERTEQ(int, in[i].size, payloads[i].size());
+		UASSERT(std::string(buffers[i], in[i].size) == payloads[i]);
+		UASSERT(in[i].sender == address);
+	}
+}
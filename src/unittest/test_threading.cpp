@@ -6,8 +6,12 @@
 
 #include <atomic>
 #include <iostream>
+#include <thread>
+#include "porting.h"
+#include "threading/mpsc_queue.h"
 #include "threading/semaphore.h"
 #include "threading/thread.h"
+#include "threading/thread_pool.h"
 
 
 class TestThreading : public TestBase {
@@ -19,6 +23,8 @@ class TestThreading : public TestBase {
 	void testStartStopWait();
 	void testAtomicSemaphoreThread();
 	void testTLS();
+	void testThreadPool();
+	void testMPSCQueue();
 };
 
 static TestThreading g_test_instance;
@@ -28,6 +34,8 @@ void TestThreading::runTests(IGameDef *gamedef)
 	TEST(testStartStopWait);
 	TEST(testAtomicSemaphoreThread);
 	TEST(testTLS);
+	TEST(testThreadPool);
+	TEST(testMPSCQueue);
 }
 
 class SimpleTestThread : public Thread {
@@ -227,3 +235,116 @@ void TestThreading::testTLS()
 		}
 	}
 }
+
+
+void TestThreading::testThreadPool()
+{
+	for (unsigned int threads : {0, 1, 4}) {
+		// must outlive the pool
+		Semaphore done;
+		ThreadPool pool("TestPool", threads);
+		UASSERTEQ(unsigned int, pool.getThreadCount(), threads);
+
+		std::vector<int> out(1000, 0);
+		pool.parallelFor(out.size(), [&] (size_t i) {
+			out[i] += i;
+		});
+		for (size_t i = 0; i < out.size(); i++)
+			UASSERTEQ(int, out[i], i);
+
+		// nested use from inside a task
+		std::atomic<int> count(0);
+		pool.parallelFor(8, [&] (size_t) {
+			pool.parallelFor(8, [&] (size_t) { count++; });
+		});
+		UASSERTEQ(int, count, 64);
+
+		bool caught = false;
+		try {
+			pool.parallelFor(10, [] (size_t i) {
+				if (i == 5)
+					throw std::runtime_error("test");
+			});
+		} catch (std::runtime_error &e) {
+			caught = true;
+		}
+		UASSERT(caught);
+
+		// queued tasks
+		for (int i = 0; i < 10; i++)
+			pool.enqueue([&] () { done.post(); });
+		if (threads > 0) {
+			for (int i = 0; i < 10; i++)
+				UASSERT(done.wait(5000));
+		}
+	}
+}
+
+class QueueProducerThread : public Thread {
+public:
+	QueueProducerThread(MPSCQueue<std::pair<u32, u32>> &queue, u32 id) :
+		Thread("QueueProducer"),
+		queue(queue),
+		id(id)
+	{
+	}
+
+	static constexpr u32 count = 20000;
+
+private:
+	void *run()
+	{
+		for (u32 i = 0; i < count; i++)
+			queue.push({id, i});
+		return nullptr;
+	}
+
+	MPSCQueue<std::pair<u32, u32>> &queue;
+	const u32 id;
+};
+
+void TestThreading::testMPSCQueue()
+{
+	MPSCQueue<std::pair<u32, u32>> queue;
+	std::pair<u32, u32> v;
+	UASSERT(queue.empty());
+	UASSERT(!queue.pop(v));
+
+	queue.push({1, 2});
+	queue.push({3, 4});
+	UASSERT(!queue.empty());
+	UASSERT(queue.pop(v) && v == std::make_pair(1U, 2U));
+	UASSERT(queue.pop(v) && v == std::make_pair(3U, 4U));
+	UASSERT(!queue.pop(v));
+
+	// Values of each producer arrive in order
+	constexpr u32 num_threads = 4;
+	std::vector<std::unique_ptr<QueueProducerThread>> threads;
+	for (u32 i = 0; i < num_threads; i++) {
+		threads.emplace_back(std::make_unique<QueueProducerThread>(queue, i));
+		UASSERT(threads.back()->start());
+	}
+
+	std::vector<u32> next(num_threads, 0);
+	u32 received = 0;
+	const u64 deadline = porting::getTimeMs() + 10000;
+	while (received < num_threads * QueueProducerThread::count &&
+			porting::getTimeMs() < deadline) {
+		if (!queue.pop(v)) {
+			std::this_thread::yield();
+			continue;
+		}
+		UASSERT(v.first < num_threads);
+		UASSERTEQ(u32, v.second, next[v.first]);
+		next[v.first]++;
+		received++;
+	}
+	for (auto &thread : threads)
+		thread->wait();
+
+	UASSERTEQ(u32, received, num_threads * QueueProducerThread::count);
+	UASSERT(!queue.pop(v));
+
+	// Leftover values are freed by the destructor
+	queue.push({0, 0});
+}
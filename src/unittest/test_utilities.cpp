@@ -10,6 +10,7 @@
 #include "util/string.h"
 #include "util/base64.h"
 #include "util/colorize.h"
+#include <set>
 
 class TestUtilities : public TestBase {
 public:
@@ -45,6 +46,7 @@ class TestUtilities : public TestBase {
 	void testBase64();
 	void testSanitizeDirName();
 	void testIsBlockInSight();
+	void testHilbertCurvePoint();
 	void testColorizeURL();
 	void testSanitizeUntrusted();
 };
@@ -80,6 +82,7 @@ void TestUtilities::runTests(IGameDef *gamedef)
 	TEST(testBase64);
 	TEST(testSanitizeDirName);
 	TEST(testIsBlockInSight);
+	TEST(testHilbertCurvePoint);
 	TEST(testColorizeURL);
 	TEST(testSanitizeUntrusted);
 }
@@ -656,6 +659,28 @@ C apply_all(const C &co, F functor)
 	return ret;
 }
 
+void TestUtilities::testHilbertCurvePoint()
+{
+	UASSERT(hilbertCurvePoint(0, 0) == v2s16(0, 0));
+
+	for (u8 order = 1; order <= 4; order++) {
+		const s16 side = 1 << order;
+		std::set<std::pair<s16, s16>> seen;
+		v2s16 prev = hilbertCurvePoint(order, 0);
+		UASSERT(prev == v2s16(0, 0));
+		for (u32 d = 0; d < (u32)side * side; d++) {
+			v2s16 p = hilbertCurvePoint(order, d);
+			// Fills the square, every point once
+			UASSERT(p.X >= 0 && p.X < side && p.Y >= 0 && p.Y < side);
+			UASSERT(seen.emplace(p.X, p.Y).second);
+			// One step at a time
+			if (d > 0)
+				UASSERTEQ(int, std::abs(p.X - prev.X) + std::abs(p.Y - prev.Y), 1);
+			prev = p;
+		}
+	}
+}
+
 #define cast_v3(T, other) T((other).X, (other).Y, (other).Z)
 
 void TestUtilities::testIsBlockInSight()
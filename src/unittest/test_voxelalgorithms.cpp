@@ -6,9 +6,14 @@
 
 #include "gamedef.h"
 #include "voxelalgorithms.h"
+#include "util/directiontables.h"
 #include "util/numeric.h"
 #include "dummymap.h"
+#include "mapblock.h"
 #include "nodedef.h"
+#include "noise.h"
+#include <algorithm>
+#include <cmath>
 
 class TestVoxelAlgorithms : public TestBase {
 public:
@@ -19,6 +24,7 @@ class TestVoxelAlgorithms : public TestBase {
 
 	void testVoxelLineIterator();
 	void testLighting(IGameDef *gamedef);
+	void testLightingUpdates(IGameDef *gamedef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -27,6 +33,7 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 {
 	TEST(testVoxelLineIterator);
 	TEST(testLighting, gamedef);
+	TEST(testLightingUpdates, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -153,3 +160,210 @@ void TestVoxelAlgorithms::testLighting(IGameDef *gamedef)
 		UASSERTEQ(int, n.getParam1(), 153);
 	}
 }
+
+/*
+	Computes the light of the nodes in the area from scratch, indexed like
+	the area. Sunlight comes in from above the area, nothing from its sides.
+*/
+static std::vector<u8> compute_light(Map *map, const NodeDefManager *ndef,
+	const VoxelArea &area, LightBank bank)
+{
+	std::vector<u8> light(area.getVolume(), 0);
+	std::vector<bool> propagates(area.getVolume(), false);
+	std::vector<v3s16> queue[LIGHT_SUN + 1];
+	for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+	for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+		bool sunlit = bank == LIGHTBANK_DAY;
+		for (s16 y = area.MaxEdge.Y; y >= area.MinEdge.Y; y--) {
+			v3s16 p(x, y, z);
+			ContentLightingFlags f = ndef->getLightingFlags(map->getNode(p));
+			sunlit = sunlit && f.sunlight_propagates;
+			u32 i = area.index(p);
+			propagates[i] = f.light_propagates;
+			light[i] = sunlit ? LIGHT_SUN : f.light_source;
+			if (light[i] > 0)
+				queue[light[i]].push_back(p);
+		}
+	}
+	// Brightest first, so every node is final when it spreads
+	for (u8 level = LIGHT_SUN; level > 1; level--) {
+		for (v3s16 p : queue[level]) {
+			if (light[area.index(p)] != level)
+				continue;
+			for (v3s16 dir : g_6dirs) {
+				v3s16 p2 = p + dir;
+				if (!area.contains(p2))
+					continue;
+				u32 i2 = area.index(p2);
+				if (propagates[i2] && light[i2] < level - 1) {
+					light[i2] = level - 1;
+					queue[level - 1].push_back(p2);
+				}
+			}
+		}
+	}
+	return light;
+}
+
+// The directions of the lighting complete flags of a map block
+static const v3s16 light_dirs[6] = {
+	v3s16(1, 0, 0), v3s16(0, 1, 0), v3s16(0, 0, 1),
+	v3s16(0, 0, -1), v3s16(0, -1, 0), v3s16(-1, 0, 0),
+};
+
+static void check_light(Map *map, const NodeDefManager *ndef,
+	const VoxelArea &area, const char *after)
+{
+	for (LightBank bank : {LIGHTBANK_DAY, LIGHTBANK_NIGHT}) {
+		std::vector<u8> expected = compute_light(map, ndef, area, bank);
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			MapNode n = map->getNode(v3s16(x, y, z));
+			int light = n.getLight(bank, ndef->getLightingFlags(n));
+			int e = expected[area.index(x, y, z)];
+			UTEST(light == e, "%s: %s light at (%d,%d,%d) is %d instead of %d",
+				after, bank == LIGHTBANK_DAY ? "day" : "night", x, y, z, light, e);
+		}
+	}
+}
+
+void TestVoxelAlgorithms::testLightingUpdates(IGameDef *gamedef)
+{
+	const NodeDefManager *ndef = gamedef->ndef();
+	const v3s16 bpmin(-1, -1, -1), bpmax(1, 1, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	for (s16 z = bpmin.Z; z <= bpmax.Z; z++)
+	for (s16 y = bpmin.Y; y <= bpmax.Y; y++)
+	for (s16 x = bpmin.X; x <= bpmax.X; x++)
+		map.getBlockNoCreateNoEx(v3s16(x, y, z))->setGenerated(true);
+	const VoxelArea area(bpmin * MAP_BLOCKSIZE,
+		bpmax * MAP_BLOCKSIZE + MAP_BLOCKSIZE - 1);
+
+	PcgRandom pr(12345);
+	const content_t contents[] = {CONTENT_AIR, CONTENT_AIR, t_CONTENT_STONE,
+		t_CONTENT_STONE, t_CONTENT_WATER, t_CONTENT_TORCH, t_CONTENT_LAVA};
+	auto random_node = [&] () {
+		return MapNode(contents[pr.range(0, (s32)ARRLEN(contents) - 1)]);
+	};
+	auto random_pos = [&] (const VoxelArea &a) {
+		return v3s16(pr.range(a.MinEdge.X, a.MaxEdge.X),
+			pr.range(a.MinEdge.Y, a.MaxEdge.Y),
+			pr.range(a.MinEdge.Z, a.MaxEdge.Z));
+	};
+	auto random_block = [&] () {
+		MapBlock *block = map.getBlockNoCreateNoEx(random_pos(VoxelArea(bpmin, bpmax)));
+		UASSERT(block);
+		return block;
+	};
+	std::map<v3s16, MapBlock*> modified_blocks;
+
+	// Hills with caves, lakes and light sources
+	{
+		MMVManip vm(&map);
+		vm.initialEmerge(bpmin, bpmax, false);
+		for (s16 z = area.MinEdge.Z; z <= area.MaxEdge.Z; z++)
+		for (s16 x = area.MinEdge.X; x <= area.MaxEdge.X; x++) {
+			s16 height = 8 * std::sin(x / 7.0f) * std::cos(z / 9.0f);
+			for (s16 y = area.MinEdge.Y; y <= area.MaxEdge.Y; y++) {
+				MapNode n(CONTENT_AIR);
+				if (y < height)
+					n = MapNode(pr.range(0, 5) == 0 ? CONTENT_AIR :
+						pr.range(0, 99) == 0 ? t_CONTENT_LAVA : t_CONTENT_STONE);
+				else if (y < 0)
+					n = MapNode(t_CONTENT_WATER);
+				else if (pr.range(0, 199) == 0)
+					n = MapNode(t_CONTENT_TORCH);
+				vm.setNodeNoEmerge(v3s16(x, y, z), n);
+			}
+		}
+		voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+	}
+	check_light(&map, ndef, area, "initial blit");
+
+	for (int i = 0; i < 40; i++) {
+		map.addNodeAndUpdate(random_pos(area), random_node(), modified_blocks);
+		check_light(&map, ndef, area, "node edit");
+	}
+
+	// Several nodes close to each other at once
+	for (int i = 0; i < 15; i++) {
+		v3s16 center = random_pos(area);
+		std::vector<std::pair<v3s16, MapNode>> oldnodes;
+		for (int j = 0; j < 6; j++) {
+			v3s16 p = center + v3s16(pr.range(-2, 2), pr.range(-2, 2), pr.range(-2, 2));
+			if (!area.contains(p) || std::find_if(oldnodes.begin(), oldnodes.end(),
+					[&] (const auto &it) { return it.first == p; }) != oldnodes.end())
+				continue;
+			oldnodes.emplace_back(p, map.getNode(p));
+			// Without light, as update_lighting_nodes requires
+			map.setNode(p, random_node());
+		}
+		voxalgo::update_lighting_nodes(&map, oldnodes, modified_blocks);
+		check_light(&map, ndef, area, "multiple node edit");
+	}
+
+	for (int i = 0; i < 8; i++) {
+		v3s16 b1 = random_pos(VoxelArea(bpmin, bpmax));
+		v3s16 b2 = random_pos(VoxelArea(bpmin, bpmax));
+		MMVManip vm(&map);
+		vm.initialEmerge(componentwise_min(b1, b2), componentwise_max(b1, b2), false);
+		for (int j = 0; j < 300; j++)
+			vm.setNodeNoEmerge(random_pos(vm.m_area), random_node());
+		voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+		check_light(&map, ndef, area, "blit");
+	}
+
+	// Wrong light on one side of a block. No two of the nodes touch, so
+	// each of them is wrong compared to its neighbors.
+	for (int i = 0; i < 8; i++) {
+		MapBlock *block = random_block();
+		u8 dir = pr.range(0, 5);
+		if (!map.getBlockNoCreateNoEx(block->getPos() + light_dirs[dir]))
+			continue;
+		v3s16 pmin = block->getPosRelative();
+		v3s16 pmax = pmin + MAP_BLOCKSIZE - 1;
+		VoxelArea side(pmin, pmax);
+		if (light_dirs[dir].X != 0)
+			side.MinEdge.X = side.MaxEdge.X = light_dirs[dir].X > 0 ? pmax.X : pmin.X;
+		if (light_dirs[dir].Y != 0)
+			side.MinEdge.Y = side.MaxEdge.Y = light_dirs[dir].Y > 0 ? pmax.Y : pmin.Y;
+		if (light_dirs[dir].Z != 0)
+			side.MinEdge.Z = side.MaxEdge.Z = light_dirs[dir].Z > 0 ? pmax.Z : pmin.Z;
+		for (int j = 0; j < 40; j++) {
+			v3s16 p = random_pos(side);
+			if ((p.X + p.Y + p.Z) % 2 != 0)
+				continue;
+			MapNode n = map.getNode(p);
+			ContentLightingFlags f = ndef->getLightingFlags(n);
+			if (!f.has_light || f.light_source > 0)
+				continue;
+			for (LightBank bank : {LIGHTBANK_DAY, LIGHTBANK_NIGHT}) {
+				// Sunlight is not repaired at borders
+				if (n.getLight(bank, f) < LIGHT_SUN)
+					n.setLight(bank, pr.range(0, LIGHT_MAX), f);
+			}
+			map.setNode(p, n);
+		}
+		for (LightBank bank : {LIGHTBANK_DAY, LIGHTBANK_NIGHT})
+			block->setLightingComplete(bank, dir, false);
+		voxalgo::update_block_border_lighting(&map, block, modified_blocks);
+		check_light(&map, ndef, area, "border update");
+	}
+
+	// Wrong light anywhere in a block
+	for (int i = 0; i < 8; i++) {
+		MapBlock *block = random_block();
+		MapNode *data = block->getData();
+		for (size_t j = 0; j < MapBlock::nodecount; j++) {
+			if (pr.range(0, 1) == 0)
+				data[j].setLight(LIGHTBANK_DAY, pr.range(0, LIGHT_SUN),
+					ndef->getLightingFlags(data[j]));
+			if (pr.range(0, 1) == 0)
+				data[j].setLight(LIGHTBANK_NIGHT, pr.range(0, LIGHT_SUN),
+					ndef->getLightingFlags(data[j]));
+		}
+		voxalgo::repair_block_light(&map, block, &modified_blocks);
+		check_light(&map, ndef, area, "block repair");
+	}
+}
@@ -19,6 +19,7 @@ class TestVoxelManipulator : public TestBase {
 
 	void testVoxelArea();
 	void testVoxelManipulator(const NodeDefManager *nodedef);
+	void testCopyFromPart();
 };
 
 static TestVoxelManipulator g_test_instance;
@@ -27,6 +28,7 @@ void TestVoxelManipulator::runTests(IGameDef *gamedef)
 {
 	TEST(testVoxelArea);
 	TEST(testVoxelManipulator, gamedef->getNodeDefManager());
+	TEST(testCopyFromPart);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -91,3 +93,24 @@ void TestVoxelManipulator::testVoxelManipulator(const NodeDefManager *nodedef)
 	UASSERT(v.getNode(v3s16(-1,0,-1)).getContent() == t_CONTENT_GRASS);
 	EXCEPTION_CHECK(InvalidPositionException, v.getNode(v3s16(0,1,1)));
 }
+
+void TestVoxelManipulator::testCopyFromPart()
+{
+	// Every node has its own param1
+	VoxelArea src_area(v3s16(0,0,0), v3s16(3,3,3));
+	MapNode src[4 * 4 * 4];
+	for (u8 i = 0; i < 4 * 4 * 4; i++)
+		src[i] = MapNode(CONTENT_AIR, i);
+
+	VoxelManipulator v;
+	v.addArea(VoxelArea(v3s16(10,10,10), v3s16(12,12,12)));
+	v.copyFrom(src, src_area, v3s16(1,1,1), v3s16(10,10,10), v3s16(2,2,2));
+
+	v3s16 p;
+	for (p.Z = 0; p.Z < 2; p.Z++)
+	for (p.Y = 0; p.Y < 2; p.Y++)
+	for (p.X = 0; p.X < 2; p.X++) {
+		UASSERTEQ(int, v.getNode(v3s16(10,10,10) + p).param1,
+				src_area.index(v3s16(1,1,1) + p));
+	}
+}
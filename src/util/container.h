@@ -14,8 +14,13 @@
 #include <map>
 #include <set>
 #include <queue>
+#include <deque>
+#include <unordered_set>
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <limits>
+#include <memory>
 
 /*
 	Queue with unique values with fast checking of value existence
@@ -36,7 +41,7 @@ class UniqueQueue
 	{
 		if (m_set.insert(value).second)
 		{
-			m_queue.push(value);
+			m_queue.push_back(value);
 			return true;
 		}
 		return false;
@@ -45,7 +50,7 @@ class UniqueQueue
 	void pop_front()
 	{
 		m_set.erase(m_queue.front());
-		m_queue.pop();
+		m_queue.pop_front();
 	}
 
 	const Value& front() const
@@ -58,9 +63,20 @@ class UniqueQueue
 		return m_queue.size();
 	}
 
+	// Iterate the queued values from front to back
+	typename std::deque<Value>::const_iterator begin() const
+	{
+		return m_queue.begin();
+	}
+
+	typename std::deque<Value>::const_iterator end() const
+	{
+		return m_queue.end();
+	}
+
 private:
-	std::set<Value> m_set;
-	std::queue<Value> m_queue;
+	std::unordered_set<Value> m_set;
+	std::deque<Value> m_queue;
 };
 
 /*
@@ -107,6 +123,111 @@ class MutexedMap
 	mutable std::mutex m_mutex;
 };
 
+/*
+	Thread-safe map for values which are looked up far more often than added
+
+	Lookups take no lock and never wait: entries can't be removed or changed
+	once they are in, and a table which got too small stays around until the
+	map is destroyed since readers might still be probing it. Inserts are
+	serialized by a mutex.
+*/
+
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class InsertOnlyMap
+{
+public:
+	InsertOnlyMap()
+	{
+		m_tables.push_back(std::make_unique<Table>(16));
+		m_table.store(m_tables.back().get(), std::memory_order_release);
+	}
+
+	DISABLE_CLASS_COPY(InsertOnlyMap)
+
+	bool get(const Key &key, Value *result) const
+	{
+		const size_t hash = Hash()(key);
+		const Table *table = m_table.load(std::memory_order_acquire);
+		// There is always a free slot, the table is at most half full
+		for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+			const Entry *entry = table->slots[i].load(std::memory_order_acquire);
+			if (!entry)
+				return false;
+			if (entry->hash == hash && entry->key == key) {
+				if (result)
+					*result = entry->value;
+				return true;
+			}
+		}
+	}
+
+	/*
+		Return value:
+		true: value added
+		false: key already exists, nothing was changed
+	*/
+	bool insert(const Key &key, const Value &value)
+	{
+		MutexAutoLock lock(m_mutex);
+		if (get(key, nullptr))
+			return false;
+
+		Table *table = m_tables.back().get();
+		if ((m_entries.size() + 1) * 2 > table->mask + 1) {
+			m_tables.push_back(std::make_unique<Table>((table->mask + 1) * 2));
+			table = m_tables.back().get();
+			for (const auto &entry : m_entries)
+				table->place(entry.get());
+			m_table.store(table, std::memory_order_release);
+		}
+
+		m_entries.push_back(std::make_unique<Entry>(Entry{Hash()(key), key, value}));
+		table->place(m_entries.back().get());
+		return true;
+	}
+
+	size_t size() const
+	{
+		MutexAutoLock lock(m_mutex);
+		return m_entries.size();
+	}
+
+private:
+	struct Entry {
+		size_t hash;
+		Key key;
+		Value value;
+	};
+
+	// Open addressing with linear probing, the capacity is a power of two
+	struct Table {
+		Table(size_t capacity) :
+			mask(capacity - 1),
+			slots(new std::atomic<const Entry *>[capacity])
+		{
+			for (size_t i = 0; i < capacity; i++)
+				slots[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		void place(const Entry *entry)
+		{
+			size_t i = entry->hash & mask;
+			while (slots[i].load(std::memory_order_relaxed))
+				i = (i + 1) & mask;
+			slots[i].store(entry, std::memory_order_release);
+		}
+
+		const size_t mask;
+		std::unique_ptr<std::atomic<const Entry *>[]> slots;
+	};
+
+	std::atomic<const Table *> m_table;
+	// All tables made so far, the last one is the current one
+	std::vector<std::unique_ptr<Table>> m_tables;
+	std::vector<std::unique_ptr<Entry>> m_entries;
+	mutable std::mutex m_mutex;
+};
+
 
 /*
 	Thread-safe double-ended queue
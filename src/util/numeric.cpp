@@ -10,6 +10,7 @@
 #include "threading/mutex_auto_lock.h"
 #include <cstring>
 #include <cmath>
+#include <cassert>
 
 
 // myrand
@@ -206,3 +207,25 @@ v3f getPitchYawRollRad(const core::matrix4 &m)
 
 	return v3f(a2, a3, a1);
 }
+
+v2s16 hilbertCurvePoint(u8 order, u32 d)
+{
+	assert(order < 16);
+	v2s16 p(0, 0);
+	for (u32 s = 1; s < (1U << order); s *= 2) {
+		u32 rx = 1 & (d / 2);
+		u32 ry = 1 & (d ^ rx);
+		// Rotate the quadrant
+		if (ry == 0) {
+			if (rx == 1) {
+				p.X = s - 1 - p.X;
+				p.Y = s - 1 - p.Y;
+			}
+			std::swap(p.X, p.Y);
+		}
+		p.X += s * rx;
+		p.Y += s * ry;
+		d /= 4;
+	}
+	return p;
+}
@@ -281,6 +281,13 @@ bool isBlockInSight(v3s16 blockpos_b, v3f camera_pos, v3f camera_dir,
 
 s16 adjustDist(s16 dist, float zoom_fov);
 
+/*
+	Returns the point at distance d along a Hilbert curve which fills a
+	square with a side length of 2^order. Consecutive points are neighbours,
+	so walking along the curve stays close to where it has already been.
+*/
+v2s16 hilbertCurvePoint(u8 order, u32 d);
+
 /*
 	Returns nearest 32-bit integer for given floating point number.
 	<cmath> and <math.h> in VC++ don't provide round().
@@ -200,7 +200,8 @@ void VoxelManipulator::copyFrom(MapNode *src, const VoxelArea& src_area,
 	 * dest      <--------------------------------------------->
 	 *
 	 * dest_mod (it's essentially a modulus) is added to the destination index
-	 * after every full iteration of the y span.
+	 * after every full iteration of the y span. src_mod does the same for the
+	 * source data, if only a part of it is copied.
 	 *
 	 * This method falls under the category "linear array and incrementing
 	 * index".
@@ -211,6 +212,9 @@ void VoxelManipulator::copyFrom(MapNode *src, const VoxelArea& src_area,
 	s32 dest_mod = m_area.index(to_pos.X, to_pos.Y, to_pos.Z + 1)
 			- m_area.index(to_pos.X, to_pos.Y, to_pos.Z)
 			- dest_step * size.Y;
+	s32 src_mod = src_area.index(from_pos.X, from_pos.Y, from_pos.Z + 1)
+			- src_area.index(from_pos.X, from_pos.Y, from_pos.Z)
+			- src_step * size.Y;
 
 	s32 i_src = src_area.index(from_pos.X, from_pos.Y, from_pos.Z);
 	s32 i_local = m_area.index(to_pos.X, to_pos.Y, to_pos.Z);
@@ -222,6 +226,7 @@ void VoxelManipulator::copyFrom(MapNode *src, const VoxelArea& src_area,
 			i_src += src_step;
 			i_local += dest_step;
 		}
+		i_src += src_mod;
 		i_local += dest_mod;
 	}
 }
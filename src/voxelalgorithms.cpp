@@ -2,7 +2,10 @@
 // SPDX-License-Identifier: LGPL-2.1-or-later
 // Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
 
+#include <algorithm>
 #include <array>
+#include <unordered_map>
+#include <vector>
 
 #include "voxelalgorithms.h"
 #include "nodedef.h"
@@ -36,52 +39,218 @@ typedef v3s16 relative_v3;
  */
 typedef v3s16 mapblock_v3;
 
+/*!
+ * neighbor_dirs[i] points towards
+ * the direction i.
+ * See the definition of the type "direction"
+ */
+const static v3s16 neighbor_dirs[6] = {
+	v3s16(1, 0, 0), // right
+	v3s16(0, 1, 0), // top
+	v3s16(0, 0, 1), // back
+	v3s16(0, 0, -1), // front
+	v3s16(0, -1, 0), // bottom
+	v3s16(-1, 0, 0), // left
+};
+
+static constexpr LightBank banks[] = { LIGHTBANK_DAY, LIGHTBANK_NIGHT };
+
+static_assert(MAP_BLOCKSIZE == 16, "step_node_index() assumes 16 nodes per block side");
+
+//! Returns the index of a node in the node array of its map block.
+inline u16 node_index(relative_v3 rel_pos)
+{
+	return rel_pos.Z * MapBlock::zstride + rel_pos.Y * MapBlock::ystride + rel_pos.X;
+}
+
+/*!
+ * Transforms the given node index by one node towards
+ * the specified direction.
+ * \returns true if the node is in the neighboring map block
+ * \param dir the direction of the transformation
+ * \param index the node's index in its map block
+ */
+inline bool step_node_index(direction dir, u16 &index)
+{
+	static constexpr u8 shift[6] = {0, 4, 8, 8, 4, 0};
+	static constexpr u16 edge[6] = {15, 15, 15, 0, 0, 0};
+	static constexpr s16 step[6] = {1, 16, 256, -256, -16, -1};
+	if (((index >> shift[dir]) & 15) == edge[dir]) {
+		index -= 15 * step[dir];
+		return true;
+	}
+	index += step[dir];
+	return false;
+}
+
+/*!
+ * The map blocks a light update works on.
+ *
+ * Light is spread directly in the flat node arrays of the blocks. Each block
+ * remembers its neighbors, so stepping into the next block does not look up
+ * the map. Blocks whose light changed are collected and reported once, at
+ * the end of the update.
+ */
+class LightBlocks {
+public:
+	//! Index of a block that is not loaded.
+	static constexpr u32 MISSING = U32_MAX;
+
+	void reset(Map *map)
+	{
+		m_map = map;
+		m_blocks.clear();
+		m_indices.clear();
+	}
+
+	//! Returns the index of the block at the given position, or MISSING.
+	u32 get(mapblock_v3 pos)
+	{
+		auto it = m_indices.find(pos);
+		if (it != m_indices.end())
+			return it->second;
+		u32 index = MISSING;
+		if (MapBlock *block = m_map->getBlockNoCreateNoEx(pos)) {
+			index = m_blocks.size();
+			Block &b = m_blocks.emplace_back();
+			b.block = block;
+			b.data = block->getData();
+			b.pos = pos;
+			b.neighbors.fill(UNKNOWN);
+		}
+		m_indices.emplace(pos, index);
+		return index;
+	}
+
+	//! Returns the index of the block next to the given one, or MISSING.
+	u32 neighbor(u32 index, direction dir)
+	{
+		u32 neighbor = m_blocks[index].neighbors[dir];
+		if (neighbor == UNKNOWN) {
+			neighbor = get(m_blocks[index].pos + neighbor_dirs[dir]);
+			m_blocks[index].neighbors[dir] = neighbor;
+		}
+		return neighbor;
+	}
+
+	MapBlock *block(u32 index) const { return m_blocks[index].block; }
+
+	MapNode &node(u32 index, u16 node) { return m_blocks[index].data[node]; }
+
+	void setModified(u32 index) { m_blocks[index].modified = true; }
+
+	/*!
+	 * Marks the blocks whose light changed as modified and adds them
+	 * to modified_blocks.
+	 */
+	void finish(std::map<v3s16, MapBlock*> &modified_blocks)
+	{
+		for (Block &b : m_blocks) {
+			if (!b.modified)
+				continue;
+			b.block->raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
+			modified_blocks[b.pos] = b.block;
+			b.modified = false;
+		}
+	}
+
+private:
+	static constexpr u32 UNKNOWN = U32_MAX - 1;
+
+	struct Block {
+		MapBlock *block;
+		MapNode *data;
+		mapblock_v3 pos;
+		std::array<u32, 6> neighbors;
+		bool modified = false;
+	};
+
+	Map *m_map = nullptr;
+	std::vector<Block> m_blocks;
+	std::unordered_map<v3s16, u32> m_indices;
+};
+
 //! Contains information about a node whose light is about to change.
 struct ChangingLight {
-	//! Pointer to the node's block.
-	MapBlock *block = nullptr;
-	//! Relative position of the node in its map block.
-	relative_v3 rel_position;
-	//! Position of the node's block.
-	mapblock_v3 block_position;
+	//! Index of the node's block in LightBlocks.
+	u32 block;
+	//! Index of the node in its map block.
+	u16 node;
 	/*!
 	 * Direction from the node that caused this node's changing
 	 * to this node.
 	 */
-	direction source_direction = 6;
+	direction source_direction;
+	//! The light bank which changes.
+	u8 bank;
+};
 
-	ChangingLight() = default;
+/*!
+ * A FIFO of ChangingLights in a ring buffer.
+ * The buffer keeps its size when it is cleared, it only grows
+ * (to twice its size) if it is full.
+ */
+class LightRing {
+public:
+	size_t size() const { return m_size; }
 
-	ChangingLight(relative_v3 rel_pos, mapblock_v3 block_pos,
-		MapBlock *b, direction source_dir) :
-		block(b),
-		rel_position(rel_pos),
-		block_position(block_pos),
-		source_direction(source_dir)
-	{}
+	bool empty() const { return m_size == 0; }
+
+	void clear()
+	{
+		m_head = 0;
+		m_size = 0;
+	}
+
+	void push(const ChangingLight &data)
+	{
+		if (m_size == m_buffer.size())
+			grow();
+		m_buffer[(m_head + m_size) & (m_buffer.size() - 1)] = data;
+		m_size++;
+	}
+
+	ChangingLight pop()
+	{
+		ChangingLight data = m_buffer[m_head];
+		m_head = (m_head + 1) & (m_buffer.size() - 1);
+		m_size--;
+		return data;
+	}
+
+	//! The i-th element from the front
+	const ChangingLight &operator[](size_t i) const
+	{
+		return m_buffer[(m_head + i) & (m_buffer.size() - 1)];
+	}
+
+private:
+	void grow()
+	{
+		std::vector<ChangingLight> buffer(std::max<size_t>(m_buffer.size() * 2, 64));
+		for (size_t i = 0; i < m_size; i++)
+			buffer[i] = (*this)[i];
+		m_buffer = std::move(buffer);
+		m_head = 0;
+	}
+
+	// The size is a power of two
+	std::vector<ChangingLight> m_buffer;
+	size_t m_head = 0;
+	size_t m_size = 0;
 };
 
 /*!
  * A fast, priority queue-like container to contain ChangingLights.
  * The ChangingLights are ordered by the given light levels.
  * The brightest ChangingLight is returned first.
+ * Both light banks can be in the same queue.
  */
 struct LightQueue {
-	//! For each light level there is a vector.
-	std::array<std::vector<ChangingLight>, LIGHT_SUN + 1> lights;
+	//! For each light level there is a ring.
+	std::array<LightRing, LIGHT_SUN + 1> lights;
 	//! Light of the brightest ChangingLight in the queue.
-	u8 max_light;
-
-	/*!
-	 * Creates a LightQueue.
-	 * \param reserve for each light level that many slots are reserved.
-	 */
-	LightQueue(size_t reserve)
-	{
-		max_light = LIGHT_SUN;
-		for (auto &l : lights)
-			l.reserve(reserve);
-	}
+	u8 max_light = LIGHT_SUN;
 
 	//! Clears a LightQueue.
 	void clear() {
@@ -108,22 +277,19 @@ struct LightQueue {
 			max_light--;
 		}
 		light = max_light;
-		data = lights[max_light].back();
-		lights[max_light].pop_back();
+		data = lights[max_light].pop();
 		return true;
 	}
 
 	/*!
 	 * Adds an element to the queue.
-	 * The parameters are the same as in ChangingLight's constructor.
 	 * \param light light level of the ChangingLight
 	 */
-	inline void push(u8 light, relative_v3 rel_pos,
-		mapblock_v3 block_pos, MapBlock *block,
-		direction source_dir)
+	inline void push(u8 light, u32 block, u16 node, direction source_dir,
+		LightBank bank)
 	{
 		assert(light <= LIGHT_SUN);
-		lights[light].emplace_back(rel_pos, block_pos, block, source_dir);
+		lights[light].push({block, node, source_dir, (u8)bank});
 	}
 };
 
@@ -146,118 +312,29 @@ typedef LightQueue UnlightQueue;
  */
 typedef LightQueue ReLightQueue;
 
-/*!
- * neighbor_dirs[i] points towards
- * the direction i.
- * See the definition of the type "direction"
- */
-const static v3s16 neighbor_dirs[6] = {
-	v3s16(1, 0, 0), // right
-	v3s16(0, 1, 0), // top
-	v3s16(0, 0, 1), // back
-	v3s16(0, 0, -1), // front
-	v3s16(0, -1, 0), // bottom
-	v3s16(-1, 0, 0), // left
-};
-
-/*!
- * Transforms the given map block offset by one node towards
- * the specified direction.
- * \param dir the direction of the transformation
- * \param rel_pos the node's relative position in its map block
- * \param block_pos position of the node's block
- */
-bool step_rel_block_pos(direction dir, relative_v3 &rel_pos,
-	mapblock_v3 &block_pos)
-{
-	switch (dir) {
-	case 0:
-		if (rel_pos.X < MAP_BLOCKSIZE - 1) {
-			rel_pos.X++;
-		} else {
-			rel_pos.X = 0;
-			block_pos.X++;
-			return true;
-		}
-		break;
-	case 1:
-		if (rel_pos.Y < MAP_BLOCKSIZE - 1) {
-			rel_pos.Y++;
-		} else {
-			rel_pos.Y = 0;
-			block_pos.Y++;
-			return true;
-		}
-		break;
-	case 2:
-		if (rel_pos.Z < MAP_BLOCKSIZE - 1) {
-			rel_pos.Z++;
-		} else {
-			rel_pos.Z = 0;
-			block_pos.Z++;
-			return true;
-		}
-		break;
-	case 3:
-		if (rel_pos.Z > 0) {
-			rel_pos.Z--;
-		} else {
-			rel_pos.Z = MAP_BLOCKSIZE - 1;
-			block_pos.Z--;
-			return true;
-		}
-		break;
-	case 4:
-		if (rel_pos.Y > 0) {
-			rel_pos.Y--;
-		} else {
-			rel_pos.Y = MAP_BLOCKSIZE - 1;
-			block_pos.Y--;
-			return true;
-		}
-		break;
-	case 5:
-		if (rel_pos.X > 0) {
-			rel_pos.X--;
-		} else {
-			rel_pos.X = MAP_BLOCKSIZE - 1;
-			block_pos.X--;
-			return true;
-		}
-		break;
-	}
-	return false;
-}
-
 /*
  * Removes all light that is potentially emitted by the specified
  * light sources. These nodes will have zero light.
  * Returns all nodes whose light became zero but should be re-lighted.
  *
- * \param bank the light bank in which the procedure operates
  * \param from_nodes nodes whose light is removed
  * \param light_sources nodes that should be re-lighted
- * \param modified_blocks output, all modified map blocks are added to this
  */
-void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
-	UnlightQueue &from_nodes, ReLightQueue &light_sources,
-	std::map<v3s16, MapBlock*> &modified_blocks)
+void unspread_light(LightBlocks &blocks, const NodeDefManager *nodemgr,
+	UnlightQueue &from_nodes, ReLightQueue &light_sources)
 {
 	// Stores data popped from from_nodes
 	u8 current_light;
 	ChangingLight current;
-	// Data of the current neighbor
-	mapblock_v3 neighbor_block_pos;
-	relative_v3 neighbor_rel_pos;
-	// Direction of the brightest neighbor of the node
-	direction source_dir;
 	while (from_nodes.next(current_light, current)) {
 		// For all nodes that need unlighting
+		const LightBank bank = (LightBank)current.bank;
 
-		// There is no brightest neighbor
-		source_dir = 6;
+		// Direction of the brightest neighbor of the node,
+		// there is none yet
+		direction source_dir = 6;
 		// The current node
-		const MapNode &node = current.block->getNodeNoCheck(current.rel_position);
+		const MapNode &node = blocks.node(current.block, current.node);
 		ContentLightingFlags f = nodemgr->getLightingFlags(node);
 		// If the node emits light, it behaves like it had a
 		// brighter neighbor.
@@ -271,22 +348,18 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 				continue;
 			}
 			// Get the neighbor's position and block
-			neighbor_rel_pos = current.rel_position;
-			neighbor_block_pos = current.block_position;
-			MapBlock *neighbor_block;
-			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
-				neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
-				if (neighbor_block == NULL) {
-					current.block->setLightingComplete(bank, i, false);
+			u16 neighbor_node = current.node;
+			u32 neighbor_block = current.block;
+			if (step_node_index(i, neighbor_node)) {
+				neighbor_block = blocks.neighbor(current.block, i);
+				if (neighbor_block == LightBlocks::MISSING) {
+					blocks.block(current.block)->setLightingComplete(bank, i, false);
 					continue;
 				}
-			} else {
-				neighbor_block = current.block;
 			}
 			// Get the neighbor itself
-			MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos);
-			ContentLightingFlags neighbor_f = nodemgr->getLightingFlags(
-				neighbor.getContent());
+			MapNode &neighbor = blocks.node(neighbor_block, neighbor_node);
+			ContentLightingFlags neighbor_f = nodemgr->getLightingFlags(neighbor);
 			u8 neighbor_light = neighbor.getLightRaw(bank, neighbor_f);
 			// If the neighbor has at least as much light as this node, then
 			// it won't lose its light, since it should have been added to
@@ -295,14 +368,9 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 				// Unlight, but only if the node has light.
 				if (neighbor_light > 0) {
 					neighbor.setLight(bank, 0, neighbor_f);
-					neighbor_block->setNodeNoCheck(neighbor_rel_pos, neighbor);
-					from_nodes.push(neighbor_light, neighbor_rel_pos,
-						neighbor_block_pos, neighbor_block, i);
-					// The current node was modified earlier, so its block
-					// is in modified_blocks.
-					if (current.block != neighbor_block) {
-						modified_blocks[neighbor_block_pos] = neighbor_block;
-					}
+					blocks.setModified(neighbor_block);
+					from_nodes.push(neighbor_light, neighbor_block,
+						neighbor_node, i, bank);
 				}
 			} else {
 				// The neighbor can light up this node.
@@ -319,10 +387,36 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 		// then add this node to the output nodes.
 		if (brightest_neighbor_light > 1 && f.light_propagates) {
 			brightest_neighbor_light--;
-			light_sources.push(brightest_neighbor_light, current.rel_position,
-				current.block_position, current.block,
-				(source_dir == 6) ? 6 : 5 - source_dir
-				/* with opposite direction*/);
+			light_sources.push(brightest_neighbor_light, current.block,
+				current.node, (source_dir == 6) ? 6 : 5 - source_dir,
+				/* with opposite direction*/ bank);
+		}
+	}
+}
+
+/*
+ * Sets the light of the nodes in the queue to the level they were queued
+ * with, to prepare spreading. If a node is queued multiple times, the
+ * brightest occurrence counts. Light is never decreased here.
+ *
+ * \param max_day_light day light is only set up to this level
+ */
+void init_queued_lights(LightBlocks &blocks, const NodeDefManager *nodemgr,
+	const LightQueue &light_sources, u8 max_day_light = LIGHT_SUN)
+{
+	for (u8 light = 0; light <= LIGHT_SUN; light++) {
+		const LightRing &lights = light_sources.lights[light];
+		for (size_t i = 0; i < lights.size(); i++) {
+			const ChangingLight &it = lights[i];
+			const LightBank bank = (LightBank)it.bank;
+			if (bank == LIGHTBANK_DAY && light > max_day_light)
+				continue;
+			MapNode &n = blocks.node(it.block, it.node);
+			ContentLightingFlags f = nodemgr->getLightingFlags(n);
+			if (f.has_light && n.getLightRaw(bank, f) < light) {
+				n.setLight(bank, light, f);
+				blocks.setModified(it.block);
+			}
 		}
 	}
 }
@@ -335,22 +429,17 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
  * light_sources (if the queue contains a node multiple times, the brightest
  * occurrence counts).
  *
- * \param bank the light bank in which the procedure operates
  * \param light_sources starting nodes
- * \param modified_blocks output, all modified map blocks are added to this
  */
-void spread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
-	LightQueue &light_sources,
-	std::map<v3s16, MapBlock*> &modified_blocks)
+void spread_light(LightBlocks &blocks, const NodeDefManager *nodemgr,
+	LightQueue &light_sources)
 {
 	// The light the current node can provide to its neighbors.
 	u8 spreading_light;
 	// The ChangingLight for the current node.
 	ChangingLight current;
-	// Position of the current neighbor.
-	mapblock_v3 neighbor_block_pos;
-	relative_v3 neighbor_rel_pos;
 	while (light_sources.next(spreading_light, current)) {
+		const LightBank bank = (LightBank)current.bank;
 		spreading_light--;
 		for (direction i = 0; i < 6; i++) {
 			// This node can't light up its light source
@@ -358,34 +447,26 @@ void spread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 				continue;
 			}
 			// Get the neighbor's position and block
-			neighbor_rel_pos = current.rel_position;
-			neighbor_block_pos = current.block_position;
-			MapBlock *neighbor_block;
-			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
-				neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
-				if (neighbor_block == NULL) {
-					current.block->setLightingComplete(bank, i, false);
+			u16 neighbor_node = current.node;
+			u32 neighbor_block = current.block;
+			if (step_node_index(i, neighbor_node)) {
+				neighbor_block = blocks.neighbor(current.block, i);
+				if (neighbor_block == LightBlocks::MISSING) {
+					blocks.block(current.block)->setLightingComplete(bank, i, false);
 					continue;
 				}
-			} else {
-				neighbor_block = current.block;
 			}
 			// Get the neighbor itself
-			MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos);
+			MapNode &neighbor = blocks.node(neighbor_block, neighbor_node);
 			ContentLightingFlags f = nodemgr->getLightingFlags(neighbor);
 			if (f.light_propagates) {
 				// Light up the neighbor, if it has less light than it should.
 				u8 neighbor_light = neighbor.getLightRaw(bank, f);
 				if (neighbor_light < spreading_light) {
 					neighbor.setLight(bank, spreading_light, f);
-					neighbor_block->setNodeNoCheck(neighbor_rel_pos, neighbor);
-					light_sources.push(spreading_light, neighbor_rel_pos,
-						neighbor_block_pos, neighbor_block, i);
-					// The current node was modified earlier, so its block
-					// is in modified_blocks.
-					if (current.block != neighbor_block) {
-						modified_blocks[neighbor_block_pos] = neighbor_block;
-					}
+					blocks.setModified(neighbor_block);
+					light_sources.push(spreading_light, neighbor_block,
+						neighbor_node, i, bank);
 				}
 			}
 		}
@@ -411,116 +492,112 @@ struct SunlightPropagationData{
  * Returns true if the node gets sunlight from the
  * node above it.
  *
- * \param pos position of the node.
+ * \param block the node's block
+ * \param node index of the node in its block
  */
-bool is_sunlight_above(Map *map, v3s16 pos, const NodeDefManager *ndef)
+bool is_sunlight_above(LightBlocks &blocks, u32 block, u16 node,
+	const NodeDefManager *ndef)
 {
-	bool sunlight = true;
-	mapblock_v3 source_block_pos;
-	relative_v3 source_rel_pos;
-	getNodeBlockPosWithOffset(pos + v3s16(0, 1, 0), source_block_pos,
-		source_rel_pos);
 	// If the node above has sunlight, this node also can get it.
-	MapBlock *source_block = map->getBlockNoCreateNoEx(source_block_pos);
-	if (source_block == NULL) {
+	u32 source_block = block;
+	if (step_node_index(1, node)) {
+		source_block = blocks.neighbor(block, 1);
 		// But if there is no node above, then use heuristics
-		MapBlock *node_block = map->getBlockNoCreateNoEx(getNodeBlockPos(pos));
-		if (node_block == NULL) {
-			sunlight = false;
-		} else {
-			sunlight = !node_block->getIsUnderground();
-		}
-	} else {
-		MapNode above = source_block->getNodeNoCheck(source_rel_pos);
-		if (above.getContent() == CONTENT_IGNORE) {
-			// Trust heuristics
-			if (source_block->getIsUnderground()) {
-				sunlight = false;
-			}
-		} else {
-			ContentLightingFlags above_f = ndef->getLightingFlags(above);
-			if (above.getLight(LIGHTBANK_DAY, above_f) != LIGHT_SUN) {
-				// If the node above doesn't have sunlight, this
-				// node is in shadow.
-				sunlight = false;
-			}
-		}
+		if (source_block == LightBlocks::MISSING)
+			return !blocks.block(block)->getIsUnderground();
+	}
+	const MapNode &above = blocks.node(source_block, node);
+	if (above.getContent() == CONTENT_IGNORE) {
+		// Trust heuristics
+		return !blocks.block(source_block)->getIsUnderground();
 	}
-	return sunlight;
+	// If the node above doesn't have sunlight, this
+	// node is in shadow.
+	ContentLightingFlags above_f = ndef->getLightingFlags(above);
+	return above.getLight(LIGHTBANK_DAY, above_f) == LIGHT_SUN;
 }
 
-static constexpr LightBank banks[] = { LIGHTBANK_DAY, LIGHTBANK_NIGHT };
-
 void update_lighting_nodes(Map *map,
 	const std::vector<std::pair<v3s16, MapNode>> &oldnodes,
 	std::map<v3s16, MapBlock*> &modified_blocks)
 {
 	const NodeDefManager *ndef = map->getNodeDefManager();
-	// For node getter functions
-	bool is_valid_position;
 
 	// cached allocations
-	thread_local UnlightQueue disappearing_lights(1);
-	thread_local ReLightQueue light_sources(4);
-
-	// Process each light bank separately
-	for (LightBank bank : banks) {
-		disappearing_lights.clear();
-		light_sources.clear();
-		// Nodes that are brighter than the brightest modified node was
-		// won't change, since they didn't get their light from a
-		// modified node.
-		u8 min_safe_light = 0;
-		for (auto it = oldnodes.cbegin(); it < oldnodes.cend(); ++it) {
-			u8 old_light = it->second.getLight(bank, ndef->getLightingFlags(it->second));
-			if (old_light > min_safe_light) {
-				min_safe_light = old_light;
-			}
+	thread_local LightBlocks blocks;
+	thread_local UnlightQueue disappearing_lights;
+	thread_local ReLightQueue light_sources;
+	blocks.reset(map);
+	disappearing_lights.clear();
+	light_sources.clear();
+
+	// Nodes that are brighter than the brightest modified node was
+	// won't change, since they didn't get their light from a
+	// modified node.
+	u8 min_safe_light[2] = {0, 0};
+	for (const auto &it : oldnodes) {
+		ContentLightingFlags old_f = ndef->getLightingFlags(it.second);
+		for (LightBank bank : banks) {
+			u8 old_light = it.second.getLight(bank, old_f);
+			if (old_light > min_safe_light[bank])
+				min_safe_light[bank] = old_light;
 		}
-		// If only one node changed, even nodes with the same brightness
-		// didn't get their light from the changed node.
-		if (oldnodes.size() > 1) {
-			min_safe_light++;
+	}
+	// If only one node changed, even nodes with the same brightness
+	// didn't get their light from the changed node.
+	if (oldnodes.size() > 1) {
+		for (LightBank bank : banks)
+			min_safe_light[bank]++;
+	}
+	// The sunlight above a node can still be removed by a node changed
+	// later, so with multiple nodes sunlight is only added at the end.
+	const bool add_sunlight = oldnodes.size() == 1;
+	// For each changed node process sunlight and initialize.
+	// Both light banks are processed together, they are independent.
+	for (const auto &it : oldnodes) {
+		// Get position and block of the changed node
+		relative_v3 rel_pos;
+		mapblock_v3 block_pos;
+		getNodeBlockPosWithOffset(it.first, block_pos, rel_pos);
+		const u32 block = blocks.get(block_pos);
+		if (block == LightBlocks::MISSING) {
+			continue;
 		}
-		// For each changed node process sunlight and initialize
-		for (auto it = oldnodes.cbegin(); it < oldnodes.cend(); ++it) {
-			// Get position and block of the changed node
-			v3s16 p = it->first;
-			relative_v3 rel_pos;
-			mapblock_v3 block_pos;
-			getNodeBlockPosWithOffset(p, block_pos, rel_pos);
-			MapBlock *block = map->getBlockNoCreateNoEx(block_pos);
-			if (block == NULL) {
-				continue;
-			}
-			// Get the new node
-			MapNode n = block->getNodeNoCheck(rel_pos);
+		const u16 node = node_index(rel_pos);
+		// Add the block of the added node to modified_blocks
+		modified_blocks[block_pos] = blocks.block(block);
 
-			// Light of the old node
-			u8 old_light = it->second.getLight(bank, ndef->getLightingFlags(it->second));
+		// Get the new node
+		MapNode &n = blocks.node(block, node);
+		ContentLightingFlags f = ndef->getLightingFlags(n);
+		ContentLightingFlags old_f = ndef->getLightingFlags(it.second);
 
-			// Add the block of the added node to modified_blocks
-			modified_blocks[block_pos] = block;
+		for (LightBank bank : banks) {
+			// Light of the old node
+			u8 old_light = it.second.getLight(bank, old_f);
 
 			// Get new light level of the node
 			u8 new_light = 0;
-			ContentLightingFlags f = ndef->getLightingFlags(n);
 			if (f.light_propagates) {
-				if (bank == LIGHTBANK_DAY && f.sunlight_propagates
-					&& is_sunlight_above(map, p, ndef)) {
+				if (bank == LIGHTBANK_DAY && f.sunlight_propagates && add_sunlight
+					&& is_sunlight_above(blocks, block, node, ndef)) {
 					new_light = LIGHT_SUN;
 				} else {
 					new_light = f.light_source;
-					for (const v3s16 &neighbor_dir : neighbor_dirs) {
-						v3s16 p2 = p + neighbor_dir;
-						MapNode n2 = map->getNode(p2, &is_valid_position);
-						if (is_valid_position) {
-							u8 spread = n2.getLight(bank, ndef->getLightingFlags(n2));
-							// If it is sure that the neighbor won't be
-							// unlighted, its light can spread to this node.
-							if (spread > new_light && spread >= min_safe_light) {
-								new_light = spread - 1;
-							}
+					for (direction d = 0; d < 6; d++) {
+						u16 node2 = node;
+						u32 block2 = block;
+						if (step_node_index(d, node2)) {
+							block2 = blocks.neighbor(block, d);
+							if (block2 == LightBlocks::MISSING)
+								continue;
+						}
+						const MapNode &n2 = blocks.node(block2, node2);
+						u8 spread = n2.getLight(bank, ndef->getLightingFlags(n2));
+						// If it is sure that the neighbor won't be
+						// unlighted, its light can spread to this node.
+						if (spread > new_light && spread >= min_safe_light[bank]) {
+							new_light = spread - 1;
 						}
 					}
 				}
@@ -530,7 +607,7 @@ void update_lighting_nodes(Map *map,
 			}
 
 			if (new_light > 0) {
-				light_sources.push(new_light, rel_pos, block_pos, block, 6);
+				light_sources.push(new_light, block, node, 6, bank);
 			}
 
 			if (new_light < old_light) {
@@ -539,20 +616,20 @@ void update_lighting_nodes(Map *map,
 
 				// Add to unlight queue
 				n.setLight(bank, 0, f);
-				block->setNodeNoCheck(rel_pos, n);
-				disappearing_lights.push(old_light, rel_pos, block_pos, block,
-					6);
+				blocks.setModified(block);
+				disappearing_lights.push(old_light, block, node, 6, bank);
 
 				// Remove sunlight, if there was any
 				if (bank == LIGHTBANK_DAY && old_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
-
-						MapNode n2;
-
-						n2 = map->getNode(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
+					u16 node2 = node;
+					u32 block2 = block;
+					for (;;) {
+						if (step_node_index(4, node2)) {
+							block2 = blocks.neighbor(block2, 4);
+							if (block2 == LightBlocks::MISSING)
+								break;
+						}
+						MapNode &n2 = blocks.node(block2, node2);
 
 						// If this node doesn't have sunlight, the nodes below
 						// it don't have too.
@@ -562,15 +639,10 @@ void update_lighting_nodes(Map *map,
 						}
 						// Remove sunlight and add to unlight queue.
 						n2.setLight(LIGHTBANK_DAY, 0, f2);
-						map->setNode(n2pos, n2);
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
-						disappearing_lights.push(LIGHT_SUN, rel_pos2,
-							block_pos2, block2,
-							4 /* The node above caused the change */);
+						blocks.setModified(block2);
+						disappearing_lights.push(LIGHT_SUN, block2, node2,
+							4 /* The node above caused the change */,
+							LIGHTBANK_DAY);
 					}
 				}
 			} else if (new_light > old_light) {
@@ -578,14 +650,15 @@ void update_lighting_nodes(Map *map,
 				// one, unlighting is not necessary.
 				// Propagate sunlight
 				if (bank == LIGHTBANK_DAY && new_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
-
-						MapNode n2;
-
-						n2 = map->getNode(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
+					u16 node2 = node;
+					u32 block2 = block;
+					for (;;) {
+						if (step_node_index(4, node2)) {
+							block2 = blocks.neighbor(block2, 4);
+							if (block2 == LightBlocks::MISSING)
+								break;
+						}
+						const MapNode &n2 = blocks.node(block2, node2);
 
 						// This should not happen, but if the node has sunlight
 						// then the iteration should stop.
@@ -597,34 +670,73 @@ void update_lighting_nodes(Map *map,
 						if (!f2.sunlight_propagates) {
 							break;
 						}
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
 						// Mark node for lighting.
-						light_sources.push(LIGHT_SUN, rel_pos2, block_pos2,
-							block2, 4);
+						light_sources.push(LIGHT_SUN, block2, node2, 4,
+							LIGHTBANK_DAY);
 					}
 				}
 			}
-
 		}
-		// Remove lights
-		unspread_light(map, ndef, bank, disappearing_lights, light_sources,
-			modified_blocks);
-		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= LIGHT_SUN; i++) {
-			const auto &lights = light_sources.lights[i];
-			for (auto it = lights.begin(); it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position);
-				n.setLight(bank, i, ndef->getLightingFlags(n));
-				it->block->setNodeNoCheck(it->rel_position, n);
+	}
+	// Remove lights
+	unspread_light(blocks, ndef, disappearing_lights, light_sources);
+	// With multiple nodes, a changed node ignored its neighbors which might
+	// have been unlit. Now all light that had to be removed is gone, the
+	// light that is left and the sunlight from above are safe to spread.
+	if (!add_sunlight) {
+		for (const auto &it : oldnodes) {
+			relative_v3 rel_pos;
+			mapblock_v3 block_pos;
+			getNodeBlockPosWithOffset(it.first, block_pos, rel_pos);
+			const u32 block = blocks.get(block_pos);
+			if (block == LightBlocks::MISSING)
+				continue;
+			const u16 node = node_index(rel_pos);
+			const MapNode &n = blocks.node(block, node);
+			ContentLightingFlags f = ndef->getLightingFlags(n);
+			if (!f.light_propagates)
+				continue;
+			if (f.sunlight_propagates && is_sunlight_above(blocks, block, node, ndef)) {
+				u16 node2 = node;
+				u32 block2 = block;
+				for (;;) {
+					const MapNode &n2 = blocks.node(block2, node2);
+					ContentLightingFlags f2 = ndef->getLightingFlags(n2);
+					if (!f2.sunlight_propagates ||
+							n2.getLight(LIGHTBANK_DAY, f2) == LIGHT_SUN)
+						break;
+					light_sources.push(LIGHT_SUN, block2, node2, 4, LIGHTBANK_DAY);
+					if (step_node_index(4, node2)) {
+						block2 = blocks.neighbor(block2, 4);
+						if (block2 == LightBlocks::MISSING)
+							break;
+					}
+				}
+			}
+			for (LightBank bank : banks) {
+				const u8 light = n.getLight(bank, f);
+				for (direction d = 0; d < 6; d++) {
+					u16 node2 = node;
+					u32 block2 = block;
+					if (step_node_index(d, node2)) {
+						block2 = blocks.neighbor(block, d);
+						if (block2 == LightBlocks::MISSING)
+							continue;
+					}
+					const MapNode &n2 = blocks.node(block2, node2);
+					u8 spread = n2.getLight(bank, ndef->getLightingFlags(n2));
+					if (spread > light + 1)
+						light_sources.push(spread - 1, block, node, 5 - d, bank);
+				}
 			}
 		}
-		// Spread lights.
-		spread_light(map, ndef, bank, light_sources, modified_blocks);
 	}
+	// Initialize light values for light spreading.
+	init_queued_lights(blocks, ndef, light_sources);
+	// Spread lights.
+	spread_light(blocks, ndef, light_sources);
+
+	blocks.finish(modified_blocks);
 }
 
 /*!
@@ -650,11 +762,10 @@ const static VoxelArea block_borders[] = {
  * its light source and its brightest neighbor minus one.
  * .
  */
-bool is_light_locally_correct(Map *map, const NodeDefManager *ndef,
-	LightBank bank, v3s16 pos)
+bool is_light_locally_correct(LightBlocks &blocks, const NodeDefManager *ndef,
+	LightBank bank, u32 block, u16 node)
 {
-	bool is_valid_position;
-	MapNode n = map->getNode(pos, &is_valid_position);
+	const MapNode &n = blocks.node(block, node);
 	ContentLightingFlags f = ndef->getLightingFlags(n);
 	if (!f.has_light) {
 		return true;
@@ -662,9 +773,16 @@ bool is_light_locally_correct(Map *map, const NodeDefManager *ndef,
 	u8 light = n.getLight(bank, f);
 	assert(f.light_source <= LIGHT_MAX);
 	u8 brightest_neighbor = f.light_source + 1;
-	for (const v3s16 &neighbor_dir : neighbor_dirs) {
-		MapNode n2 = map->getNode(pos + neighbor_dir,
-			&is_valid_position);
+	for (direction d = 0; d < 6; d++) {
+		u16 node2 = node;
+		u32 block2 = block;
+		if (step_node_index(d, node2)) {
+			block2 = blocks.neighbor(block, d);
+			// Unloaded nodes have no light
+			if (block2 == LightBlocks::MISSING)
+				continue;
+		}
+		const MapNode &n2 = blocks.node(block2, node2);
 		u8 light2 = n2.getLight(bank, ndef->getLightingFlags(n2));
 		if (brightest_neighbor < light2) {
 			brightest_neighbor = light2;
@@ -680,21 +798,22 @@ void update_block_border_lighting(Map *map, MapBlock *block,
 	const NodeDefManager *ndef = map->getNodeDefManager();
 	// Since invalid light is not common, do not allocate
 	// memory if not needed.
-	UnlightQueue disappearing_lights(0);
-	ReLightQueue light_sources(0);
+	LightBlocks blocks;
+	blocks.reset(map);
+	UnlightQueue disappearing_lights;
+	ReLightQueue light_sources;
 
+	const u32 block_index = blocks.get(block->getPos());
 	for (LightBank bank : banks) {
-		disappearing_lights.clear();
-		light_sources.clear();
 		// Get incorrect lights
 		for (direction d = 0; d < 6; d++) {
 			// For each direction
 			// Get neighbor block
-			v3s16 otherpos = block->getPos() + neighbor_dirs[d];
-			MapBlock *other = map->getBlockNoCreateNoEx(otherpos);
-			if (other == NULL) {
+			const u32 other_index = blocks.neighbor(block_index, d);
+			if (other_index == LightBlocks::MISSING) {
 				continue;
 			}
+			MapBlock *other = blocks.block(other_index);
 			// Only update if lighting was not completed.
 			if (block->isLightingComplete(bank, d) &&
 					other->isLightingComplete(bank, 5 - d))
@@ -703,51 +822,42 @@ void update_block_border_lighting(Map *map, MapBlock *block,
 			block->setLightingComplete(bank, d, true);
 			other->setLightingComplete(bank, 5 - d, true);
 			// The two blocks and their connecting surfaces
-			MapBlock *blocks[] = {block, other};
+			u32 indices[] = {block_index, other_index};
 			VoxelArea areas[] = {block_borders[d], block_borders[5 - d]};
 			// For both blocks
 			for (u8 blocknum = 0; blocknum < 2; blocknum++) {
-				MapBlock *b = blocks[blocknum];
+				const u32 b = indices[blocknum];
 				VoxelArea a = areas[blocknum];
 				// For all nodes
-				for (s32 x = a.MinEdge.X; x <= a.MaxEdge.X; x++)
-				for (s32 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
-				for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
-					MapNode n = b->getNodeNoCheck(x, y, z);
+				for (s16 x = a.MinEdge.X; x <= a.MaxEdge.X; x++)
+				for (s16 z = a.MinEdge.Z; z <= a.MaxEdge.Z; z++)
+				for (s16 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
+					const u16 node = node_index(relative_v3(x, y, z));
+					MapNode &n = blocks.node(b, node);
 					ContentLightingFlags f = ndef->getLightingFlags(n);
 					u8 light = n.getLight(bank, f);
 					// Sunlight is fixed
 					if (light < LIGHT_SUN) {
 						// Unlight if not correct
-						if (!is_light_locally_correct(map, ndef, bank,
-								v3s16(x, y, z) + b->getPosRelative())) {
+						if (!is_light_locally_correct(blocks, ndef, bank, b, node)) {
 							// Initialize for unlighting
-							n.setLight(bank, 0, ndef->getLightingFlags(n));
-							b->setNodeNoCheck(x, y, z, n);
-							modified_blocks[b->getPos()]=b;
-							disappearing_lights.push(light,
-								relative_v3(x, y, z), b->getPos(), b,
-								6);
+							n.setLight(bank, 0, f);
+							blocks.setModified(b);
+							disappearing_lights.push(light, b, node, 6, bank);
 						}
 					}
 				}
 			}
 		}
-		// Remove lights
-		unspread_light(map, ndef, bank, disappearing_lights, light_sources,
-			modified_blocks);
-		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= LIGHT_SUN; i++) {
-			const auto &lights = light_sources.lights[i];
-			for (auto it = lights.begin(); it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position);
-				n.setLight(bank, i, ndef->getLightingFlags(n));
-				it->block->setNodeNoCheck(it->rel_position, n);
-			}
-		}
-		// Spread lights.
-		spread_light(map, ndef, bank, light_sources, modified_blocks);
 	}
+	// Remove lights
+	unspread_light(blocks, ndef, disappearing_lights, light_sources);
+	// Initialize light values for light spreading.
+	init_queued_lights(blocks, ndef, light_sources);
+	// Spread lights.
+	spread_light(blocks, ndef, light_sources);
+
+	blocks.finish(modified_blocks);
 }
 
 /*!
@@ -846,7 +956,6 @@ void is_sunlight_above_block(Map *map, mapblock_v3 pos,
 		}
 	}
 }
-
 /*!
  * Propagates sunlight down in a given map block.
  *
@@ -857,13 +966,13 @@ void is_sunlight_above_block(Map *map, mapblock_v3 pos,
  *
  * \returns true if the block was modified, false otherwise.
  */
-bool propagate_block_sunlight(Map *map, const NodeDefManager *ndef,
+bool propagate_block_sunlight(LightBlocks &blocks, const NodeDefManager *ndef,
 	SunlightPropagationData *data, UnlightQueue *unlight, ReLightQueue *relight)
 {
 	bool modified = false;
 	// Get the block.
-	MapBlock *block = map->getBlockNoCreateNoEx(data->target_block);
-	if (block == NULL) {
+	const u32 block = blocks.get(data->target_block);
+	if (block == LightBlocks::MISSING) {
 		// The work is done if the block does not contain data.
 		data->data.clear();
 		return false;
@@ -879,16 +988,16 @@ bool propagate_block_sunlight(Map *map, const NodeDefManager *ndef,
 			// Propagate sunlight.
 			// For each node downwards:
 			for (; current_pos.Y >= 0; current_pos.Y--) {
-				MapNode n = block->getNodeNoCheck(current_pos);
+				const u16 node = node_index(current_pos);
+				MapNode &n = blocks.node(block, node);
 				ContentLightingFlags f = ndef->getLightingFlags(n);
 				if (n.getLightRaw(LIGHTBANK_DAY, f) < LIGHT_SUN
 						&& f.sunlight_propagates) {
 					// This node gets sunlight.
 					n.setLight(LIGHTBANK_DAY, LIGHT_SUN, f);
-					block->setNodeNoCheck(current_pos, n);
+					blocks.setModified(block);
 					modified = true;
-					relight->push(LIGHT_SUN, current_pos, data->target_block,
-						block, 4);
+					relight->push(LIGHT_SUN, block, node, 4, LIGHTBANK_DAY);
 				} else {
 					// Light already valid, propagation stopped.
 					break;
@@ -898,15 +1007,15 @@ bool propagate_block_sunlight(Map *map, const NodeDefManager *ndef,
 			// Propagate shadow.
 			// For each node downwards:
 			for (; current_pos.Y >= 0; current_pos.Y--) {
-				MapNode n = block->getNodeNoCheck(current_pos);
+				const u16 node = node_index(current_pos);
+				MapNode &n = blocks.node(block, node);
 				ContentLightingFlags f = ndef->getLightingFlags(n);
 				if (n.getLightRaw(LIGHTBANK_DAY, f) == LIGHT_SUN) {
 					// The sunlight is no longer valid.
 					n.setLight(LIGHTBANK_DAY, 0, f);
-					block->setNodeNoCheck(current_pos, n);
+					blocks.setModified(block);
 					modified = true;
-					unlight->push(LIGHT_SUN, current_pos, data->target_block,
-						block, 4);
+					unlight->push(LIGHT_SUN, block, node, 4, LIGHTBANK_DAY);
 				} else {
 					// Reached shadow, propagation stopped.
 					break;
@@ -941,6 +1050,56 @@ const static VoxelArea block_pad[] = {
 #undef B_1
 #undef B_2
 
+/*!
+ * The nodes of a map block which are not at its border.
+ */
+const static VoxelArea block_inner({1, 1, 1},
+	{MAP_BLOCKSIZE - 2, MAP_BLOCKSIZE - 2, MAP_BLOCKSIZE - 2});
+
+/*!
+ * Returns true if a light source could brighten one of its neighbors
+ * (or reaches an unloaded block). Light only grows while it is spread,
+ * so a source which can't do that now will never be able to.
+ *
+ * \param block the source's block
+ * \param node index of the source in its block
+ * \param light light of the source
+ * \param inner true if the source is not at the border of its block
+ */
+bool can_spread_light(LightBlocks &blocks, const NodeDefManager *ndef,
+	u32 block, u16 node, LightBank bank, u8 light, bool inner)
+{
+	if (inner) {
+		// All neighbors are in the same block
+		static constexpr s16 steps[6] = {1, MapBlock::ystride,
+			MapBlock::zstride, -(s16)MapBlock::zstride,
+			-(s16)MapBlock::ystride, -1};
+		const MapNode *data = &blocks.node(block, node);
+		for (s16 step : steps) {
+			const MapNode &n2 = data[step];
+			ContentLightingFlags f2 = ndef->getLightingFlags(n2);
+			if (f2.light_propagates && n2.getLightRaw(bank, f2) < light - 1)
+				return true;
+		}
+		return false;
+	}
+	for (direction d = 0; d < 6; d++) {
+		u16 node2 = node;
+		u32 block2 = block;
+		if (step_node_index(d, node2)) {
+			block2 = blocks.neighbor(block, d);
+			// Spreading would mark the lighting incomplete
+			if (block2 == LightBlocks::MISSING)
+				return true;
+		}
+		const MapNode &n2 = blocks.node(block2, node2);
+		ContentLightingFlags f2 = ndef->getLightingFlags(n2);
+		if (f2.light_propagates && n2.getLightRaw(bank, f2) < light - 1)
+			return true;
+	}
+	return false;
+}
+
 /*!
  * The common part of bulk light updates - it is always executed.
  * The procedure takes the nodes that should be unlit, and the
@@ -953,78 +1112,68 @@ const static VoxelArea block_pad[] = {
  * coordinates
  * \param maxblock greatest coordinates of the changed area in block
  * coordinates
- * \param unlight the first queue is for day light, the second is for
- * night light. Contains all nodes on the borders that need to be unlit.
- * \param relight the first queue is for day light, the second is for
- * night light. Contains nodes that were not modified, but got sunlight
+ * \param unlight contains all nodes on the borders that need to be unlit,
+ * of both light banks.
+ * \param relight contains nodes that were not modified, but got sunlight
  * because the changes.
  * \param modified_blocks the procedure adds all modified blocks to
  * this map
  */
-void finish_bulk_light_update(Map *map, mapblock_v3 minblock,
-	mapblock_v3 maxblock, UnlightQueue unlight[2], ReLightQueue relight[2],
-	std::map<v3s16, MapBlock*> *modified_blocks)
+void finish_bulk_light_update(LightBlocks &blocks, const NodeDefManager *ndef,
+	mapblock_v3 minblock, mapblock_v3 maxblock, UnlightQueue &unlight,
+	ReLightQueue &relight, std::map<v3s16, MapBlock*> *modified_blocks)
 {
-	const NodeDefManager *ndef = map->getNodeDefManager();
-
 	// --- STEP 1: Do unlighting
 
-	for (size_t bank = 0; bank < 2; bank++) {
-		LightBank b = banks[bank];
-		unspread_light(map, ndef, b, unlight[bank], relight[bank],
-			*modified_blocks);
-	}
+	unspread_light(blocks, ndef, unlight, relight);
 
 	// --- STEP 2: Get all newly inserted light sources
 
 	// For each block:
 	v3s16 blockpos;
-	v3s16 relpos;
 	for (blockpos.X = minblock.X; blockpos.X <= maxblock.X; blockpos.X++)
 	for (blockpos.Y = minblock.Y; blockpos.Y <= maxblock.Y; blockpos.Y++)
 	for (blockpos.Z = minblock.Z; blockpos.Z <= maxblock.Z; blockpos.Z++) {
-		MapBlock *block = map->getBlockNoCreateNoEx(blockpos);
-		if (!block)
+		const u32 block = blocks.get(blockpos);
+		if (block == LightBlocks::MISSING)
 			// Skip not existing blocks
 			continue;
 		// For each node in the block:
+		relative_v3 relpos;
+		u16 node = 0;
 		for (relpos.Z = 0; relpos.Z < MAP_BLOCKSIZE; relpos.Z++)
-		for (relpos.X = 0; relpos.X < MAP_BLOCKSIZE; relpos.X++)
-		for (relpos.Y = 0; relpos.Y < MAP_BLOCKSIZE; relpos.Y++) {
-			MapNode node = block->getNodeNoCheck(relpos.X, relpos.Y, relpos.Z);
-			ContentLightingFlags f = ndef->getLightingFlags(node);
+		for (relpos.Y = 0; relpos.Y < MAP_BLOCKSIZE; relpos.Y++)
+		for (relpos.X = 0; relpos.X < MAP_BLOCKSIZE; relpos.X++, node++) {
+			const MapNode &n = blocks.node(block, node);
+			ContentLightingFlags f = ndef->getLightingFlags(n);
+			const bool inner = block_inner.contains(relpos);
 
 			// For each light bank
-			for (size_t b = 0; b < 2; b++) {
-				LightBank bank = banks[b];
+			for (LightBank bank : banks) {
 				u8 light = f.has_light ?
-					node.getLight(bank, f):
+					n.getLight(bank, f):
 					f.light_source;
-				if (light > 1)
-					relight[b].push(light, relpos, blockpos, block, 6);
+				if (light <= 1)
+					continue;
+				// Light sources brighter than their own light must be
+				// initialized even if they can't brighten their neighbors
+				if ((f.has_light && n.getLightRaw(bank, f) < light) ||
+						can_spread_light(blocks, ndef, block, node, bank,
+							light, inner))
+					relight.push(light, block, node, 6, bank);
 			} // end of banks
 		} // end of nodes
 	} // end of blocks
 
 	// --- STEP 3: do light spreading
 
-	// For each light bank:
-	for (size_t b = 0; b < 2; b++) {
-		LightBank bank = banks[b];
-		// Sunlight is already initialized.
-		u8 maxlight = (b == 0) ? LIGHT_MAX : LIGHT_SUN;
-		// Initialize light values for light spreading.
-		for (u8 i = 0; i <= maxlight; i++) {
-			const auto &lights = relight[b].lights[i];
-			for (auto it = lights.begin(); it < lights.end(); ++it) {
-				MapNode n = it->block->getNodeNoCheck(it->rel_position);
-				n.setLight(bank, i, ndef->getLightingFlags(n));
-				it->block->setNodeNoCheck(it->rel_position, n);
-			}
-		}
-		// Spread lights.
-		spread_light(map, ndef, bank, relight[b], *modified_blocks);
-	}
+	// Initialize light values for light spreading.
+	// Sunlight is already initialized.
+	init_queued_lights(blocks, ndef, relight, LIGHT_MAX);
+	// Spread lights.
+	spread_light(blocks, ndef, relight);
+
+	blocks.finish(*modified_blocks);
 }
 
 void blit_back_with_light(Map *map, MMVManip *vm,
@@ -1036,9 +1185,11 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 		return;
 	mapblock_v3 minblock = getNodeBlockPos(vm->m_area.MinEdge);
 	mapblock_v3 maxblock = getNodeBlockPos(vm->m_area.MaxEdge);
-	// First queue is for day light, second is for night light.
-	UnlightQueue unlight[] = { UnlightQueue(256), UnlightQueue(256) };
-	ReLightQueue relight[] = { ReLightQueue(256), ReLightQueue(256) };
+	// Both light banks are in the same queues.
+	LightBlocks blocks;
+	blocks.reset(map);
+	UnlightQueue unlight;
+	ReLightQueue relight;
 	// Will hold sunlight data.
 	bool lights[MAP_BLOCKSIZE][MAP_BLOCKSIZE];
 	SunlightPropagationData data;
@@ -1061,10 +1212,7 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 			data.data.emplace_back(v2s16(x, z), lights[z][x]);
 		// Propagate sunlight and shadow below the voxel manipulator.
 		while (!data.data.empty()) {
-			if (propagate_block_sunlight(map, ndef, &data, &unlight[0],
-					&relight[0]))
-				(*modified_blocks)[data.target_block] =
-					map->getBlockNoCreateNoEx(data.target_block);
+			propagate_block_sunlight(blocks, ndef, &data, &unlight, &relight);
 			// Step downwards.
 			data.target_block.Y--;
 		}
@@ -1080,11 +1228,11 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 	for (blockpos.X = minblock.X; blockpos.X <= maxblock.X; blockpos.X++)
 	for (blockpos.Y = minblock.Y; blockpos.Y <= maxblock.Y; blockpos.Y++)
 	for (blockpos.Z = minblock.Z; blockpos.Z <= maxblock.Z; blockpos.Z++) {
-		MapBlock *block = map->getBlockNoCreateNoEx(blockpos);
-		if (!block)
+		const u32 block = blocks.get(blockpos);
+		if (block == LightBlocks::MISSING)
 			// Skip not existing blocks.
 			continue;
-		v3s16 offset = block->getPosRelative();
+		v3s16 offset = blockpos * MAP_BLOCKSIZE;
 		// For each border of the block:
 		for (const VoxelArea &a : block_pad) {
 			// For each node of the border:
@@ -1093,14 +1241,14 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 			for (relpos.Y = a.MinEdge.Y; relpos.Y <= a.MaxEdge.Y; relpos.Y++) {
 
 				// Get old and new node
-				MapNode oldnode = block->getNodeNoCheck(relpos);
+				const u16 node = node_index(relpos);
+				const MapNode &oldnode = blocks.node(block, node);
 				ContentLightingFlags oldf = ndef->getLightingFlags(oldnode);
 				MapNode newnode = vm->getNodeNoExNoEmerge(relpos + offset);
 				ContentLightingFlags newf = ndef->getLightingFlags(newnode);
 
 				// For each light bank
-				for (size_t b = 0; b < 2; b++) {
-					LightBank bank = banks[b];
+				for (LightBank bank : banks) {
 					u8 oldlight = oldf.has_light ?
 						oldnode.getLight(bank, oldf):
 						LIGHT_SUN; // no light information, force unlighting
@@ -1109,8 +1257,7 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 						newf.light_source;
 					// If the new node is dimmer, unlight.
 					if (oldlight > newlight) {
-						unlight[b].push(
-							oldlight, relpos, blockpos, block, 6);
+						unlight.push(oldlight, block, node, 6, bank);
 					}
 				} // end of banks
 			} // end of nodes
@@ -1123,7 +1270,7 @@ void blit_back_with_light(Map *map, MMVManip *vm,
 
 	// --- STEP 4: Finish light update
 
-	finish_bulk_light_update(map, minblock, maxblock, unlight, relight,
+	finish_bulk_light_update(blocks, ndef, minblock, maxblock, unlight, relight,
 		modified_blocks);
 }
 
@@ -1172,9 +1319,11 @@ void repair_block_light(Map *map, MapBlock *block,
 	if (!block)
 		return;
 	const NodeDefManager *ndef = map->getNodeDefManager();
-	// First queue is for day light, second is for night light.
-	UnlightQueue unlight[] = { UnlightQueue(256), UnlightQueue(256) };
-	ReLightQueue relight[] = { ReLightQueue(256), ReLightQueue(256) };
+	// Both light banks are in the same queues.
+	LightBlocks blocks;
+	blocks.reset(map);
+	UnlightQueue unlight;
+	ReLightQueue relight;
 	// Will hold sunlight data.
 	bool lights[MAP_BLOCKSIZE][MAP_BLOCKSIZE];
 	SunlightPropagationData data;
@@ -1196,16 +1345,14 @@ void repair_block_light(Map *map, MapBlock *block,
 	}
 	// Propagate sunlight and shadow below the voxel manipulator.
 	while (!data.data.empty()) {
-		if (propagate_block_sunlight(map, ndef, &data, &unlight[0],
-				&relight[0]))
-			(*modified_blocks)[data.target_block] =
-				map->getBlockNoCreateNoEx(data.target_block);
+		propagate_block_sunlight(blocks, ndef, &data, &unlight, &relight);
 		// Step downwards.
 		data.target_block.Y--;
 	}
 
 	// --- STEP 2: Get nodes from borders to unlight
 
+	const u32 block_index = blocks.get(blockpos);
 	// For each border of the block:
 	for (const VoxelArea &a : block_pad) {
 		v3s16 relpos;
@@ -1215,20 +1362,19 @@ void repair_block_light(Map *map, MapBlock *block,
 		for (relpos.Y = a.MinEdge.Y; relpos.Y <= a.MaxEdge.Y; relpos.Y++) {
 
 			// Get node
-			MapNode node = block->getNodeNoCheck(relpos);
-			ContentLightingFlags f = ndef->getLightingFlags(node);
+			const u16 node = node_index(relpos);
+			const MapNode &n = blocks.node(block_index, node);
+			ContentLightingFlags f = ndef->getLightingFlags(n);
 			// For each light bank
-			for (size_t b = 0; b < 2; b++) {
-				LightBank bank = banks[b];
+			for (LightBank bank : banks) {
 				u8 light = f.has_light ?
-					node.getLight(bank, f):
+					n.getLight(bank, f):
 					f.light_source;
 				// If the new node is dimmer than sunlight, unlight.
 				// (if it has maximal light, it is pointless to remove
 				// surrounding light, as it can only become brighter)
 				if (LIGHT_SUN > light) {
-					unlight[b].push(
-						LIGHT_SUN, relpos, blockpos, block, 6);
+					unlight.push(LIGHT_SUN, block_index, node, 6, bank);
 				}
 			} // end of banks
 		} // end of nodes
@@ -1236,7 +1382,7 @@ void repair_block_light(Map *map, MapBlock *block,
 
 	// STEP 3: Remove and spread light
 
-	finish_bulk_light_update(map, blockpos, blockpos, unlight, relight,
+	finish_bulk_light_update(blocks, ndef, blockpos, blockpos, unlight, relight,
 		modified_blocks);
 }
 